@@ -0,0 +1,136 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT (16)
+#define ARENA_ALIGN(n) \
+  (((n) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *Next;
+  size_t Size;  // usable bytes after the header
+  size_t Used;
+} ArenaBlock_t;
+
+// Block data starts right after the header, aligned like every allocation.
+#define ARENA_HEADER_SIZE ARENA_ALIGN(sizeof(ArenaBlock_t))
+
+struct Arena {
+  size_t BlockSize;
+  ArenaBlock_t *First;
+  ArenaBlock_t *Current;  // block allocations come from, NULL before use
+};
+
+static uint8_t *BlockData(ArenaBlock_t *b) {
+  return (uint8_t *)b + ARENA_HEADER_SIZE;
+}
+
+Arena_t *Arena_Create(size_t block_size) {
+  Arena_t *a = calloc(1, sizeof(*a));
+  if (a == NULL) {
+    return NULL;
+  }
+  a->BlockSize = ARENA_ALIGN(block_size ? block_size : 1);
+  return a;
+}
+
+void Arena_Destroy(Arena_t *a) {
+  if (a == NULL) {
+    return;
+  }
+  ArenaBlock_t *b = a->First;
+  while (b != NULL) {
+    ArenaBlock_t *next = b->Next;
+    free(b);
+    b = next;
+  }
+  free(a);
+}
+
+/*
+ * Makes the block after the current one (or the first block) current,
+ * reusing it when it is big enough for size and allocating a new one
+ * otherwise. Blocks that are too small stay in the list for later.
+ */
+static ArenaBlock_t *NextBlock(Arena_t *a, size_t size) {
+  ArenaBlock_t *prev = a->Current;
+  ArenaBlock_t *next = prev ? prev->Next : a->First;
+
+  if (next == NULL || next->Size < size) {
+    const size_t block_size = size > a->BlockSize ? size : a->BlockSize;
+    ArenaBlock_t *b = aligned_alloc(ARENA_ALIGNMENT,
+                                    ARENA_HEADER_SIZE + block_size);
+    if (b == NULL) {
+      return NULL;
+    }
+    b->Size = block_size;
+    b->Next = next;
+    if (prev) {
+      prev->Next = b;
+    } else {
+      a->First = b;
+    }
+    next = b;
+  }
+  next->Used = 0;
+  a->Current = next;
+  return next;
+}
+
+void *Arena_Alloc(Arena_t *a, size_t size) {
+  ArenaBlock_t *b = a->Current;
+
+  size = ARENA_ALIGN(size ? size : 1);
+  if (b == NULL || b->Size - b->Used < size) {
+    b = NextBlock(a, size);
+    if (b == NULL) {
+      return NULL;
+    }
+  }
+  void *p = BlockData(b) + b->Used;
+  b->Used += size;
+  return p;
+}
+
+void Arena_Reset(Arena_t *a) {
+  a->Current = NULL;
+}
+
+ArenaMark_t Arena_Mark(const Arena_t *a) {
+  ArenaMark_t mark = {a->Current, a->Current ? a->Current->Used : 0};
+  return mark;
+}
+
+void Arena_Rewind(Arena_t *a, ArenaMark_t mark) {
+  a->Current = mark.Block;
+  if (a->Current) {
+    a->Current->Used = mark.Used;
+  }
+}
+
+size_t Arena_BytesUsed(const Arena_t *a) {
+  size_t used = 0;
+  if (a->Current == NULL) {
+    return 0;
+  }
+  for (ArenaBlock_t *b = a->First; b != a->Current; b = b->Next) {
+    used += b->Used;
+  }
+  return used + a->Current->Used;
+}
+
+PolyLine2D_t *Arena_CreatePolyLine2D(Arena_t *a, unsigned int num_points) {
+  // Header and points in one allocation, so a line is one contiguous run of
+  // memory and consecutive lines sit next to each other.
+  const size_t header = ARENA_ALIGN(sizeof(PolyLine2D_t));
+  uint8_t *mem = Arena_Alloc(a, header + num_points * sizeof(Point2D_t));
+  if (mem == NULL) {
+    return NULL;
+  }
+  PolyLine2D_t *pl = (PolyLine2D_t *)mem;
+  memset(pl, 0, sizeof(*pl));
+  pl->Points = (Point2D_t *)(mem + header);
+  pl->NumPoints = num_points;
+  return pl;
+}
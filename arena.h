@@ -0,0 +1,72 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include "procgenlib.h"
+
+/*
+ * Bump allocator that hands out memory from large contiguous blocks.
+ * Allocations are never freed one by one; the whole arena is reset at once,
+ * or rewound to a mark taken earlier. Blocks are kept for reuse, so an arena
+ * that is reset every frame stops calling malloc after the first few frames.
+ *
+ * Typical uses are one arena per scene, reset when the scene is rebuilt, and
+ * a frame scratch arena that is reset at the start of every frame for
+ * geometry that is regenerated anyway.
+ *
+ * An arena is not thread safe. Give every thread its own.
+ */
+typedef struct Arena Arena_t;
+
+/*
+ * Position in an arena to rewind to. Only valid until the arena is reset or
+ * rewound to an earlier mark.
+ */
+typedef struct {
+  void *Block;
+  size_t Used;
+} ArenaMark_t;
+
+/*
+ * block_size is the size of each block in bytes. Allocations larger than
+ * that get a block of their own. No memory is allocated until first use.
+ *
+ * @note caller is responsible for disposing of the arena with
+ * Arena_Destroy(), which also releases everything allocated from it.
+ */
+Arena_t *Arena_Create(size_t block_size);
+void Arena_Destroy(Arena_t *a);
+
+/*
+ * Returns size bytes aligned to 16 bytes, or NULL when out of memory.
+ */
+void *Arena_Alloc(Arena_t *a, size_t size);
+
+/*
+ * Releases everything allocated from the arena, keeping its blocks.
+ */
+void Arena_Reset(Arena_t *a);
+
+ArenaMark_t Arena_Mark(const Arena_t *a);
+
+/*
+ * Releases everything allocated since mark was taken.
+ */
+void Arena_Rewind(Arena_t *a, ArenaMark_t mark);
+
+/*
+ * Bytes handed out since the last reset, including alignment padding.
+ */
+size_t Arena_BytesUsed(const Arena_t *a);
+
+/*
+ * Polyline with num_points points, allocated in one piece from the arena.
+ * Points are left uninitialised, color and thickness are zero. Returns NULL
+ * when out of memory.
+ *
+ * @note the polyline lives until the arena is reset or rewound and must not
+ * be passed to PolyLine2D_Destroy().
+ */
+PolyLine2D_t *Arena_CreatePolyLine2D(Arena_t *a, unsigned int num_points);
+
+#endif  // ARENA_H
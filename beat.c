@@ -0,0 +1,249 @@
+#include "beat.h"
+#include <allegro5/allegro_primitives.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "rng.h"
+
+#define PARTICLE_SIZE_PX (3)
+#define DENSITY_EXPOSURE (1.0f)  // filmic input at the mean covered density
+
+// Defaults of the velocity parameters, see params.h
+#define MAX_SPEED (100.0f)    // speed, px/s along each axis at most
+#define SPEED_STEP (10.0f)    // speed_step, px/s between speed levels
+#define NUM_SPEED_LEVELS (7)  // speed_levels, the rest stand still
+#define MAX_SPEED_LEVELS (8)
+
+// What each random number is for, one counter stream per use
+enum { RNG_STREAM_COLOR, RNG_STREAM_VEL_X, RNG_STREAM_VEL_Y };
+
+// What Beat_RenderSnapshot() draws
+typedef struct {
+  // After the last two steps; NULL with --closed-form, where positions
+  // follow from the step number
+  ParticleSoA_t *Positions;
+} BeatSnapshot_t;
+
+bool Beat_Init(Beat_t *b, Host_t *host, unsigned int default_count) {
+  const Options_t *options = &host->Options;
+  Params_t *params = &host->Options.Params;
+  size_t count =
+      Params_GetUInt(params, "particles", default_count, 1, UINT_MAX);
+  if (options->NumParticles) {
+    count = options->NumParticles;
+  }
+  b->Size = Params_Get(params, "size", PARTICLE_SIZE_PX, 0.5, 64.0);
+  b->Count = count;
+
+  b->Particles = ParticleSoA_Create(count);
+  if (options->Compact) {
+    b->Compact = ParticleCompact_Create(count);
+  }
+  b->Colors = malloc(count * sizeof(*b->Colors));
+  b->Batch = PrimBatch_Create(PRIM_BATCH_QUADS);
+  b->DrawX = ParticleSoA_AllocArray(count);
+  b->DrawY = ParticleSoA_AllocArray(count);
+  if (b->Particles == NULL || (options->Compact && b->Compact == NULL) ||
+      b->Colors == NULL || b->Batch == NULL || b->DrawX == NULL ||
+      b->DrawY == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate %zu particles!\n", count);
+    return false;
+  }
+  if (options->ParticleDraw != PARTICLE_DRAW_SQUARES) {
+    b->Density =
+        Density_Create(BEAT_WIDTH_PX, BEAT_HEIGHT_PX, host->RenderPool);
+    if (b->Density == NULL) {
+      fprintf(stderr, "ERROR: Failed to create density buffer!\n");
+      return false;
+    }
+  }
+
+  ParticleSoA_t *ps = b->Particles;
+  // Uniforms are generated straight into the velocity arrays and mapped to
+  // velocities in place by a velocity policy.
+  Rng_FillUniform(&host->Rng, RNG_STREAM_VEL_X, 0, 0, ps->vx, count);
+  Rng_FillUniform(&host->Rng, RNG_STREAM_VEL_Y, 0, 0, ps->vy, count);
+
+  for (int g = 0; g < 0x100; g++) {
+    b->Palette[g] = al_map_rgb(0xff, g, 0x38);
+  }
+  for (size_t i = 0; i < count; i++) {
+    b->Colors[i] = Rng_U32(&host->Rng, RNG_STREAM_COLOR, 0, i) % 0xff;
+    ps->origin_x[i] = BEAT_CENTER_X_PX;
+    ps->origin_y[i] = BEAT_CENTER_Y_PX;
+    ps->x[i] = ps->prev_x[i] = BEAT_CENTER_X_PX;
+    ps->y[i] = ps->prev_y[i] = BEAT_CENTER_Y_PX;
+  }
+  return true;
+}
+
+void Beat_Terminate(Beat_t *b) {
+  PrimBatch_Destroy(b->Batch);
+  Density_Destroy(b->Density);
+  ParticleSoA_Destroy(b->Particles);
+  ParticleCompact_Destroy(b->Compact);
+  free(b->Colors);
+  free(b->DrawX);
+  free(b->DrawY);
+}
+
+void Beat_VelocitiesUniform(Beat_t *b, Host_t *host) {
+  const float speed =
+      Params_Get(&host->Options.Params, "speed", MAX_SPEED, 0.0, 1e4);
+  ParticleSoA_t *ps = b->Particles;
+
+  for (size_t i = 0; i < ps->Count; i++) {
+    ps->vx[i] = speed - floorf(ps->vx[i] * 2 * speed);
+    ps->vy[i] = speed - floorf(ps->vy[i] * 2 * speed);
+  }
+}
+
+void Beat_VelocitiesTable(Beat_t *b, Host_t *host) {
+  Params_t *params = &host->Options.Params;
+  const float speed_step =
+      Params_Get(params, "speed_step", SPEED_STEP, 0.0, 1e4);
+  const unsigned int speed_levels = Params_GetUInt(
+      params, "speed_levels", NUM_SPEED_LEVELS, 1, MAX_SPEED_LEVELS);
+  ParticleSoA_t *ps = b->Particles;
+
+  float mag[MAX_SPEED_LEVELS] = {0};
+  for (unsigned int i = 0; i < speed_levels; i++) {
+    mag[i] = speed_step * (i + 1);
+  }
+  for (size_t i = 0; i < ps->Count; i++) {
+    const float magnitude = mag[(int)(ps->vx[i] * MAX_SPEED_LEVELS)];
+    const float angle = ps->vy[i] * 360.0f;  // direction of particle
+    ps->vx[i] = cos(angle) * magnitude;
+    ps->vy[i] = sin(angle) * magnitude;
+  }
+}
+
+bool Beat_Start(Beat_t *b, Host_t *host, const ParticleBoundary_t *boundary,
+                const void *bounds) {
+  const Options_t *options = &host->Options;
+  ParticleSoA_t *ps = b->Particles;
+
+  // Both integrators start from the same state: an updated run just carries
+  // on from the evaluated positions.
+  const float dt = 1.0 / options->SimRate;
+  if (b->Compact) {
+    // Periods have to be those of the velocities the compact store keeps.
+    ParticleCompact_QuantizeVelocities(b->Compact, ps);
+  }
+  boundary->SetPeriods(ps, dt, bounds);
+  b->StartStep = llround(options->StartTime * options->SimRate);
+
+  if (b->Compact) {
+    if (!ParticleCompact_SetPeriods(b->Compact, ps)) {
+      fprintf(stderr,
+              "ERROR: Particles take too many steps to reset for "
+              "--compact!\n");
+      return false;
+    }
+    ParticleSoA_Destroy(b->Particles);
+    b->Particles = NULL;
+    return true;
+  }
+  ParticleSoA_Seek(ps, dt, b->StartStep);
+  return true;
+}
+
+void Beat_Update(Beat_t *b, Host_t *host, const ParticleBoundary_t *boundary,
+                 const void *bounds, double dt) {
+  if (host->Options.ClosedForm) {
+    return;  // positions are evaluated from the step number when drawn
+  }
+  boundary->Update(b->Particles, host->Pool, dt, bounds);
+}
+
+/*
+ * Draws positions, or with --closed-form the particles' positions alpha of
+ * the way past step total_steps.
+ */
+static void Draw(Beat_t *b, Host_t *host, const ParticleSoA_t *positions,
+                 uint64_t total_steps, float alpha) {
+  ThreadPool_t *pool = host->RenderPool;
+
+  al_clear_to_color(al_map_rgb(0x30, 0x34, 0x3f));
+
+  if (host->Options.ClosedForm) {
+    // Interpolation draws between the last two updated states, so evaluate
+    // the step behind, which gives the same frames bit for bit.
+    const uint64_t step = b->StartStep + total_steps;
+    const float dt = 1.0 / host->Options.SimRate;
+    if (b->Compact) {
+      ParticleCompact_Evaluate(b->Compact, pool, dt, step ? step - 1 : 0,
+                               step ? alpha : 0, b->DrawX, b->DrawY);
+    } else {
+      ParticleSoA_Evaluate(b->Particles, pool, dt, step ? step - 1 : 0,
+                           step ? alpha : 0, b->DrawX, b->DrawY);
+    }
+  } else {
+    ParticleSoA_Interpolate(positions, pool, alpha, b->DrawX, b->DrawY);
+  }
+
+  if (b->Density) {
+    const DensityToneMap_t mode =
+        (host->Options.ParticleDraw == PARTICLE_DRAW_DENSITY_FILMIC)
+            ? DENSITY_TONEMAP_FILMIC
+            : DENSITY_TONEMAP_LOG;
+    Density_Splat(b->Density, pool, b->DrawX, b->DrawY, b->Count);
+    if (!Density_Resolve(b->Density, pool, mode, DENSITY_EXPOSURE,
+                         al_get_target_bitmap())) {
+      fprintf(stderr, "ERROR: Failed to draw the particle density!\n");
+    }
+    return;
+  }
+  PrimBatch_DrawSquares(b->Batch, b->DrawX, b->DrawY, b->Colors, b->Palette,
+                        b->Count, b->Size);
+}
+
+void Beat_Render(Beat_t *b, Host_t *host) {
+  const Scheduler_t *scheduler = &host->Scheduler;
+
+  Draw(b, host, b->Particles, scheduler->TotalSteps,
+       Scheduler_Alpha(scheduler));
+}
+
+void *Beat_CreateSnapshot(Host_t *host, void *state) {
+  const Beat_t *b = state;
+  BeatSnapshot_t *snap = calloc(1, sizeof(*snap));
+  if (snap == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate snapshot!\n");
+    return NULL;
+  }
+  if (!host->Options.ClosedForm) {
+    snap->Positions = ParticleSoA_CreatePositions(b->Count);
+    if (snap->Positions == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate snapshot of %zu particles!\n",
+              b->Count);
+      free(snap);
+      return NULL;
+    }
+  }
+  return snap;
+}
+
+void Beat_DestroySnapshot(Host_t *host, void *state, void *data) {
+  BeatSnapshot_t *snap = data;
+
+  ParticleSoA_Destroy(snap->Positions);
+  free(snap);
+}
+
+void Beat_Snapshot(Host_t *host, void *state, void *data) {
+  const Beat_t *b = state;
+  BeatSnapshot_t *snap = data;
+
+  if (snap->Positions) {
+    ParticleSoA_CopyPositions(snap->Positions, b->Particles, host->Pool);
+  }
+}
+
+void Beat_RenderSnapshot(Host_t *host, void *state,
+                         const Snapshot_t *snapshot) {
+  const BeatSnapshot_t *snap = snapshot->Data;
+
+  Draw(state, host, snap->Positions, snapshot->TotalSteps, snapshot->Alpha);
+}
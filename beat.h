@@ -0,0 +1,100 @@
+#ifndef BEAT_H
+#define BEAT_H
+
+#include <allegro5/allegro5.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "density.h"
+#include "host.h"
+#include "particle_compact.h"
+#include "particle_policy.h"
+#include "particle_soa.h"
+#include "prim_batch.h"
+
+/*
+ * What the beat sketches share: particles that fly out of the center of the
+ * window and start over from it when they leave a boundary. A sketch only
+ * picks the boundary, a ParticleBoundary_t (see particle_policy.h), and how
+ * velocities are drawn, so a new pattern is a boundary policy and a few
+ * lines of Init():
+ *
+ *   if (!Beat_Init(&s->Beat, host, NUM_PARTICLES)) ...
+ *   Beat_VelocitiesTable(&s->Beat, host);
+ *   if (!Beat_Start(&s->Beat, host, &ParticleCircle, &s->Bounds)) ...
+ *
+ * Update() and Render() hand over to Beat_Update() and Beat_Render(), and
+ * the Beat_*Snapshot() functions are the sketch's snapshot callbacks.
+ *
+ * Every beat sketch takes the parameters particles and size (see params.h),
+ * and the ones of its velocities.
+ */
+#define BEAT_WIDTH_PX (800)
+#define BEAT_HEIGHT_PX (800)
+#define BEAT_CENTER_X_PX (BEAT_WIDTH_PX / 2)
+#define BEAT_CENTER_Y_PX (BEAT_HEIGHT_PX / 2)
+#define BEAT_FPS (60.0f)
+
+typedef struct {
+  size_t Count;
+  // With --compact, Particles only lives until Beat_Start() has filled in
+  // Compact from it.
+  ParticleSoA_t *Particles;
+  ParticleCompact_t *Compact;
+  uint8_t *Colors;  // into Palette, cold data only read by Beat_Render()
+  ALLEGRO_COLOR Palette[256];
+  PrimBatch_t *Batch;
+  Density_t *Density;  // only used with --density
+  float *DrawX;        // interpolated positions handed to the batch
+  float *DrawY;
+  uint64_t StartStep;  // step the scheduler's step 0 stands for
+  float Size;          // px of each square
+} Beat_t;
+
+/*
+ * Creates the particles in the center of the window, default_count of them
+ * unless the particles parameter or --particles say otherwise, each with a
+ * velocity of two uniform random numbers for a velocity policy to map.
+ * Returns false after printing an error.
+ *
+ * @note caller is responsible for releasing b with Beat_Terminate(), also
+ * when this fails.
+ */
+bool Beat_Init(Beat_t *b, Host_t *host, unsigned int default_count);
+void Beat_Terminate(Beat_t *b);
+
+/*
+ * Velocity policies. Uniform gives every axis its own speed in
+ * [-speed, speed], the speed parameter. Table gives a direction and one of
+ * eight equally likely speeds, speed_step apart; the ones past
+ * speed_levels stand still.
+ */
+void Beat_VelocitiesUniform(Beat_t *b, Host_t *host);
+void Beat_VelocitiesTable(Beat_t *b, Host_t *host);
+
+/*
+ * Prepares both integrators for particles that reset at boundary with the
+ * given bounds, and moves them to --start-time. Call once the velocities are
+ * set. With --compact, rounds the velocities and moves the particles to the
+ * compact store, which fails when one takes too many steps to reset. Returns
+ * false after printing an error.
+ */
+bool Beat_Start(Beat_t *b, Host_t *host, const ParticleBoundary_t *boundary,
+                const void *bounds);
+
+void Beat_Update(Beat_t *b, Host_t *host, const ParticleBoundary_t *boundary,
+                 const void *bounds, double dt);
+void Beat_Render(Beat_t *b, Host_t *host);
+
+/*
+ * Sketch_t callbacks for --pipeline, for sketches whose state starts with
+ * their Beat_t. A snapshot only holds positions, and nothing with
+ * --closed-form, since the rest of a Beat_t does not change after
+ * Beat_Start().
+ */
+void *Beat_CreateSnapshot(Host_t *host, void *state);
+void Beat_DestroySnapshot(Host_t *host, void *state, void *data);
+void Beat_Snapshot(Host_t *host, void *state, void *data);
+void Beat_RenderSnapshot(Host_t *host, void *state,
+                         const Snapshot_t *snapshot);
+
+#endif  // BEAT_H
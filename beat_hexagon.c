@@ -0,0 +1,143 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "beat.h"
+#include "host.h"
+#include "particle_policy.h"
+
+// Defaults of the parameters, see params.h and beat.h
+#define NUM_PARTICLES (2000)           // particles
+#define RADIUS_PX (BEAT_WIDTH_PX / 3)  // radius, px to the edges
+
+// Normal of the hexagon's edge between 60 and 120 degrees, mirrored into
+// the first quadrant.
+#define HEX_KX (-0.866025404f)  // -cos(30)
+#define HEX_KY (0.5f)           // sin(30)
+#define HEX_KZ (0.577350269f)   // tan(30), half an edge per radius
+
+/*
+ * Particles reset when they leave a hexagon with flat top and bottom edges,
+ * radius from its center, around their origin. Folding a point by symmetry
+ * onto the top edge leaves only that edge to test, see
+ * https://iquilezles.org/articles/distfunctions2d/.
+ */
+typedef struct {
+  float radius;
+} Hexagon_t;
+
+static inline bool Hexagon_Outside(const Hexagon_t *b, float x, float y,
+                                   float ox, float oy) {
+  const float px = fabsf(x - ox);
+  const float py = fabsf(y - oy);
+  const float m = fminf(HEX_KX * px + HEX_KY * py, 0.0f);
+  return py - 2.0f * m * HEX_KY > b->radius;
+}
+
+static inline float Hexagon_Distance(const Hexagon_t *b, float x, float y,
+                                     float ox, float oy) {
+  float px = fabsf(x - ox);
+  float py = fabsf(y - oy);
+  const float m = fminf(HEX_KX * px + HEX_KY * py, 0.0f);
+  const float half_edge = HEX_KZ * b->radius;
+  px -= 2.0f * m * HEX_KX;
+  py -= 2.0f * m * HEX_KY;
+  px -= fminf(fmaxf(px, -half_edge), half_edge);
+  py -= b->radius;
+  return (py > 0) ? -hypotf(px, py) : hypotf(px, py);
+}
+
+#ifdef PARTICLE_POLICY_X86
+PARTICLE_POLICY_AVX2 static inline __m256 Hexagon_Outside8(
+    const Hexagon_t *b, __m256 x, __m256 y, __m256 ox, __m256 oy) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 ky = _mm256_set1_ps(HEX_KY);
+  const __m256 px = _mm256_andnot_ps(sign, _mm256_sub_ps(x, ox));
+  const __m256 py = _mm256_andnot_ps(sign, _mm256_sub_ps(y, oy));
+  const __m256 dot = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_set1_ps(HEX_KX), px), _mm256_mul_ps(ky, py));
+  const __m256 m = _mm256_min_ps(dot, _mm256_setzero_ps());
+  const __m256 fy = _mm256_sub_ps(
+      py, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), m), ky));
+  return _mm256_cmp_ps(fy, _mm256_set1_ps(b->radius), _CMP_GT_OQ);
+}
+
+PARTICLE_POLICY_SSE41 static inline __m128 Hexagon_Outside4(
+    const Hexagon_t *b, __m128 x, __m128 y, __m128 ox, __m128 oy) {
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 ky = _mm_set1_ps(HEX_KY);
+  const __m128 px = _mm_andnot_ps(sign, _mm_sub_ps(x, ox));
+  const __m128 py = _mm_andnot_ps(sign, _mm_sub_ps(y, oy));
+  const __m128 dot =
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(HEX_KX), px), _mm_mul_ps(ky, py));
+  const __m128 m = _mm_min_ps(dot, _mm_setzero_ps());
+  const __m128 fy =
+      _mm_sub_ps(py, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), m), ky));
+  return _mm_cmpgt_ps(fy, _mm_set1_ps(b->radius));
+}
+#endif
+
+PARTICLE_POLICY_DEFINE(Hexagon);
+
+typedef struct {
+  Beat_t Beat;  // first, see Beat_CreateSnapshot()
+  Hexagon_t Bounds;
+} State_t;
+
+static void Terminate(Host_t *host, void *state) {
+  State_t *s = state;
+
+  Beat_Terminate(&s->Beat);
+  free(s);
+}
+
+static void *Init(Host_t *host) {
+  State_t *s = calloc(1, sizeof(*s));
+  if (s == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate the sketch!\n");
+    return NULL;
+  }
+  s->Bounds.radius = Params_Get(&host->Options.Params, "radius", RADIUS_PX,
+                                1.0, BEAT_WIDTH_PX);
+  if (!Beat_Init(&s->Beat, host, NUM_PARTICLES)) {
+    Terminate(host, s);
+    return NULL;
+  }
+  Beat_VelocitiesTable(&s->Beat, host);
+  if (!Beat_Start(&s->Beat, host, &Hexagon, &s->Bounds)) {
+    Terminate(host, s);
+    return NULL;
+  }
+  return s;
+}
+
+static void Update(Host_t *host, void *state, double dt) {
+  State_t *s = state;
+
+  Beat_Update(&s->Beat, host, &Hexagon, &s->Bounds, dt);
+}
+
+static void Render(Host_t *host, void *state) {
+  State_t *s = state;
+
+  Beat_Render(&s->Beat, host);
+}
+
+static const Sketch_t sketch = {
+    .ApiVersion = SKETCH_API_VERSION,
+    .Title = "Beat Hexagon",
+    .Width = BEAT_WIDTH_PX,
+    .Height = BEAT_HEIGHT_PX,
+    .Fps = BEAT_FPS,
+    .StateSize = sizeof(State_t),
+    .Init = Init,
+    .Terminate = Terminate,
+    .Update = Update,
+    .Render = Render,
+    .CreateSnapshot = Beat_CreateSnapshot,
+    .DestroySnapshot = Beat_DestroySnapshot,
+    .Snapshot = Beat_Snapshot,
+    .RenderSnapshot = Beat_RenderSnapshot,
+};
+
+SKETCH_DEFINE(sketch)
@@ -1,190 +1,72 @@
-#include <allegro5/allegro5.h>
-#include <allegro5/allegro_primitives.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "beat.h"
+#include "host.h"
+#include "particle_policy.h"
 
-#define WIN_WIDTH_PX (800)
-#define WIN_HEIGHT_PX (800)
-#define CENTER_X_PX (WIN_HEIGHT_PX / 2)
-#define CENTER_Y_PX (WIN_WIDTH_PX / 2)
-#define RADIUS_PX (WIN_WIDTH_PX / 3)
+// Defaults of the parameters, see params.h and beat.h
+#define NUM_PARTICLES (1000)  // particles
 
-#define FPS (60.0f)
+PARTICLE_POLICY_DEFINE(ParticleRect);
 
-static ALLEGRO_DISPLAY *display = NULL;
-static ALLEGRO_EVENT_QUEUE *eq = NULL;
-static ALLEGRO_TIMER *timer = NULL;
-static bool redraw = true;
-static bool doexit = false;
+typedef struct {
+  Beat_t Beat;            // first, see Beat_CreateSnapshot()
+  ParticleRect_t Bounds;  // the window
+} State_t;
 
-static void Initialize();
-static void Terminate();
-static void Draw();
-static void ProcessInput(ALLEGRO_EVENT *ev);
-static void Update(double dt, ALLEGRO_EVENT *ev);
-static bool IsRunning();
+static void Terminate(Host_t *host, void *state) {
+  State_t *s = state;
 
-struct Particle {
-  ALLEGRO_COLOR color;
-  unsigned int size;
-  float origin_x;
-  float origin_y;
-  float x;
-  float y;
-  float velocity_x;
-  float velocity_y;
-};
-
-void Particle_Update(struct Particle *p, double dt);
-void Particle_Draw(struct Particle *p);
-void Init_Particles(void);
-
-#define NUM_PARTICLES (1000)
-struct Particle particles[NUM_PARTICLES];
-
-int main() {
-  double timeNow = 0.0, prevTime = 0.0, dt = 0.0;
-  ALLEGRO_EVENT ev;
-
-  Initialize();
-  Init_Particles();
-
-  while (IsRunning()) {
-    al_wait_for_event(eq, &ev);
-    timeNow = al_get_time();
-    dt = timeNow - prevTime;
-
-    ProcessInput(&ev);
-    Update(dt, &ev);
-    Draw();
-
-    prevTime = timeNow;
-  }
-
-  Terminate();
-  return 0;
+  Beat_Terminate(&s->Beat);
+  free(s);
 }
 
-static void Initialize() {
-  time_t t;
-  srand(time(&t));
-
-  if (!al_init()) {
-    fprintf(stderr, "ERROR: Failed to initialize allegro!\n");
-    goto init_fail;
+static void *Init(Host_t *host) {
+  State_t *s = calloc(1, sizeof(*s));
+  if (s == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate the sketch!\n");
+    return NULL;
   }
-
-  if (!al_init_primitives_addon()) {
-    fprintf(stderr, "ERROR: Failed to load primitives addon!\n");
-    goto prim_addon_fail;
+  s->Bounds = (ParticleRect_t){0.0, 0.0, BEAT_WIDTH_PX, BEAT_HEIGHT_PX};
+  if (!Beat_Init(&s->Beat, host, NUM_PARTICLES)) {
+    Terminate(host, s);
+    return NULL;
   }
-
-  timer = al_create_timer(1.0 / FPS);
-  if (!timer) {
-    fprintf(stderr, "ERROR: Failed to create timer!\n");
-    goto timer_fail;
-  }
-
-  display = al_create_display(WIN_WIDTH_PX, WIN_HEIGHT_PX);
-  if (!display) {
-    fprintf(stderr, "ERROR: Failed to create display!\n");
-    goto disp_fail;
-  }
-
-  eq = al_create_event_queue();
-  if (!eq) {
-    fprintf(stderr, "ERROR: Failed to create event queue!\n");
-    goto eq_fail;
-  }
-
-  al_register_event_source(eq, al_get_display_event_source(display));
-  al_register_event_source(eq, al_get_timer_event_source(timer));
-
-  al_set_window_title(display, "Contrails");
-  al_start_timer(timer);
-
-  return;
-
-eq_fail:
-disp_fail:
-  al_destroy_timer(timer);
-timer_fail:
-prim_addon_fail:
-init_fail:
-  exit(1);
-}
-
-static void Terminate() {
-  al_destroy_event_queue(eq);
-  al_destroy_display(display);
-  al_destroy_timer(timer);
-}
-
-static void Draw() {
-  if (redraw && al_is_event_queue_empty(eq)) {
-    redraw = false;
-    al_clear_to_color(al_map_rgb(0x30, 0x34, 0x3f));
-
-    for (int i = 0; i < NUM_PARTICLES; i++) {
-      Particle_Draw(&particles[i]);
-    }
-
-    al_flip_display();
+  Beat_VelocitiesUniform(&s->Beat, host);
+  if (!Beat_Start(&s->Beat, host, &ParticleRect, &s->Bounds)) {
+    Terminate(host, s);
+    return NULL;
   }
+  return s;
 }
 
-static void ProcessInput(ALLEGRO_EVENT *ev) {}
+static void Update(Host_t *host, void *state, double dt) {
+  State_t *s = state;
 
-static void Update(double dt, ALLEGRO_EVENT *ev) {
-  static double updateTimer = 0.0;
-  if (ev->type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
-    doexit = true;
-    return;
-  } else if (ev->type == ALLEGRO_EVENT_TIMER) {
-    redraw = true;
-  }
-
-  for (int i = 0; i < NUM_PARTICLES; i++) {
-    Particle_Update(&particles[i], dt);
-  }
+  Beat_Update(&s->Beat, host, &ParticleRect, &s->Bounds, dt);
 }
 
-static bool IsRunning() { return !doexit; }
-
-void Particle_Update(struct Particle *p, double dt) {
-  float x = p->x + p->velocity_x * dt;
-  float y = p->y + p->velocity_y * dt;
+static void Render(Host_t *host, void *state) {
+  State_t *s = state;
 
-  if (x < 0.0 || x > WIN_WIDTH_PX || y < 0.0 || y > WIN_HEIGHT_PX) {
-    p->x = p->origin_x;
-    p->y = p->origin_y;
-  } else {
-    p->x = x;
-    p->y = y;
-  }
+  Beat_Render(&s->Beat, host);
 }
 
-void Particle_Draw(struct Particle *p) {
-  al_draw_filled_rectangle(p->x, p->y, p->x + p->size, p->y + p->size,
-                           p->color);
-}
-
-void Init_Particles(void) {
-  const float mag[8] = {10.0, 20.0, 30.0, 40.0, 50.0, 60.0, 70.0};
-  for (int i = 0; i < NUM_PARTICLES; i++) {
-    float magnitude = mag[rand() % 8];
-    float angle = ((float)rand() / RAND_MAX) * 360.0f;  // direction of particle
-    float vel_x = cos(angle) * magnitude;
-    float vel_y = sin(angle) * magnitude;
+static const Sketch_t sketch = {
+    .ApiVersion = SKETCH_API_VERSION,
+    .Title = "Beat Square",
+    .Width = BEAT_WIDTH_PX,
+    .Height = BEAT_HEIGHT_PX,
+    .Fps = BEAT_FPS,
+    .StateSize = sizeof(State_t),
+    .Init = Init,
+    .Terminate = Terminate,
+    .Update = Update,
+    .Render = Render,
+    .CreateSnapshot = Beat_CreateSnapshot,
+    .DestroySnapshot = Beat_DestroySnapshot,
+    .Snapshot = Beat_Snapshot,
+    .RenderSnapshot = Beat_RenderSnapshot,
+};
 
-    particles[i].size = 3;
-    particles[i].color = al_map_rgb(0xff, rand() % 0xff, 0x38);
-    particles[i].origin_x = CENTER_X_PX;
-    particles[i].origin_y = CENTER_Y_PX;
-    particles[i].x = CENTER_X_PX;
-    particles[i].y = CENTER_Y_PX;
-    particles[i].velocity_x = 100 - rand() % 200;
-    particles[i].velocity_y = 100 - rand() % 200;
-  }
-}
+SKETCH_DEFINE(sketch)
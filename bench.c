@@ -0,0 +1,1452 @@
+#include <allegro5/allegro5.h>
+#include <allegro5/allegro_primitives.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "arena.h"
+#include "contrail_sim.h"
+#include "density.h"
+#include "flowfield.h"
+#include "gif.h"
+#include "handdrawn.h"
+#include "headless.h"
+#include "noise1234.h"
+#include "noise_batch.h"
+#include "particle_compact.h"
+#include "particle_policy.h"
+#include "particle_soa.h"
+#include "prim_batch.h"
+#include "procgenlib.h"
+#include "raster.h"
+#include "rng.h"
+#include "spatial_grid.h"
+#include "thread_pool.h"
+#include "trails.h"
+
+/*
+ * Headless benchmarks for the hot paths of the sketches. Every benchmark is
+ * swept over 1K, 10K, ... elements, run a few times to warm up and then timed
+ * repeatedly. Results go to stdout as JSON, progress to stderr:
+ *
+ *   ./bench > bench.json
+ */
+
+#define BENCH_MIN_SIZE (1000)
+#define BENCH_MAX_SIZE (10000000)
+#define BENCH_WARMUP_REPS (2)
+#define BENCH_MIN_REPS (5)
+#define BENCH_DEFAULT_REPS (31)
+#define BENCH_DEFAULT_BUDGET_S (1.0)  // timing budget per benchmark and size
+#define BENCH_DEFAULT_SEED (1)
+
+#define WORLD_PX (800)  // same canvas the sketches use
+#define SIM_DT (1.0f / 60.0f)
+#define UPDATE_GRAIN (1024)
+#define LINE_TABLE_SIZE (1024)  // lines are cycled, memory stays constant
+
+typedef struct {
+  unsigned int NumThreads;  // 0 uses every CPU
+  unsigned int Reps;        // timed repetitions, at most
+  size_t MaxSize;           // largest element count of the sweep
+  double Budget;            // seconds after which BENCH_MIN_REPS suffice
+  const char *Filter;       // only run benchmarks whose name contains this
+  bool Check;               // run the consistency checks instead
+} BenchOptions_t;
+
+typedef struct {
+  const char *Name;
+  const char *Unit;           // what one element is
+  bool Threaded;              // also run on the thread pool
+  bool (*Setup)(size_t n);    // allocates and initialises n elements
+  void (*Run)(size_t n);      // the timed part
+  void (*Teardown)(void);
+} Bench_t;
+
+static BenchOptions_t options;
+static Rng_t rng;
+static ThreadPool_t *pool = NULL;
+static ThreadPool_t *runPool = NULL;  // pool or NULL for the current run
+static ALLEGRO_BITMAP *canvas = NULL;
+static volatile float sink;  // keeps results of pure functions alive
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Beat sketch particles
+ */
+static ParticleSoA_t *soa = NULL;
+
+static bool Soa_Setup(size_t n) {
+  soa = ParticleSoA_Create(n);
+  if (soa == NULL) {
+    return false;
+  }
+  Rng_FillUniform(&rng, 0, 0, 0, soa->vx, n);
+  Rng_FillUniform(&rng, 1, 0, 0, soa->vy, n);
+  for (size_t i = 0; i < n; i++) {
+    soa->origin_x[i] = soa->x[i] = soa->prev_x[i] = WORLD_PX / 2;
+    soa->origin_y[i] = soa->y[i] = soa->prev_y[i] = WORLD_PX / 2;
+    soa->vx[i] = 100 - floorf(soa->vx[i] * 200);
+    soa->vy[i] = 100 - floorf(soa->vy[i] * 200);
+  }
+  return true;
+}
+
+static void Soa_Teardown(void) {
+  ParticleSoA_Destroy(soa);
+  soa = NULL;
+}
+
+static void SoaRect_Run(size_t n) {
+  ParticleSoA_UpdateRect(soa, runPool, SIM_DT, 0, 0, WORLD_PX, WORLD_PX);
+}
+
+static void SoaCircle_Run(size_t n) {
+  ParticleSoA_UpdateCircle(soa, runPool, SIM_DT, WORLD_PX / 3);
+}
+
+static uint64_t evalStep = 0;
+
+static bool SoaEval_Setup(size_t n) {
+  if (!Soa_Setup(n)) {
+    return false;
+  }
+  ParticleSoA_SetPeriodsRect(soa, SIM_DT, 0, 0, WORLD_PX, WORLD_PX);
+  evalStep = 0;
+  return true;
+}
+
+static void SoaEval_Run(size_t n) {
+  ParticleSoA_Evaluate(soa, runPool, SIM_DT, evalStep++, 0.5f, soa->x,
+                       soa->y);
+}
+
+/*
+ * The same particles in the quantized store of --compact, evaluated into
+ * the float store's position arrays as a sketch would into its draw arrays.
+ */
+static ParticleCompact_t *compact = NULL;
+
+static bool CompactEval_Setup(size_t n) {
+  compact = ParticleCompact_Create(n);
+  if (compact == NULL || !Soa_Setup(n)) {
+    return false;
+  }
+  ParticleCompact_QuantizeVelocities(compact, soa);
+  ParticleSoA_SetPeriodsRect(soa, SIM_DT, 0, 0, WORLD_PX, WORLD_PX);
+  evalStep = 0;
+  return ParticleCompact_SetPeriods(compact, soa);
+}
+
+static void CompactEval_Teardown(void) {
+  ParticleCompact_Destroy(compact);
+  compact = NULL;
+  Soa_Teardown();
+}
+
+static void CompactEval_Run(size_t n) {
+  ParticleCompact_Evaluate(compact, runPool, SIM_DT, evalStep++, 0.5f,
+                           soa->x, soa->y);
+}
+
+/*
+ * Not a benchmark: --check runs a seeded set of beat particles CHECK_STEPS
+ * updates on the pool, and a second set that ParticleSoA_Seek() started
+ * halfway. Every CHECK_EVERY steps, both have to be where seeking a third set
+ * to the same step puts it, and ParticleSoA_Interpolate() has to draw both
+ * where ParticleSoA_Evaluate() draws the step before, at a few alphas. They
+ * have to agree bit for bit, or a particle would reset on a different step,
+ * or be drawn somewhere else, with --closed-form or after --start-time than
+ * without.
+ */
+#define CHECK_PARTICLES (100003)  // odd, so the scalar tails run as well
+#define CHECK_STEPS (20000)       // longer than most particles' periods
+#define CHECK_EVERY (97)
+
+PARTICLE_POLICY_DEFINE(ParticleRect);
+PARTICLE_POLICY_DEFINE(ParticleCircle);
+
+static const float checkAlphas[] = {0, 1.0f / 3, 0.5f, 0.999f};
+
+static size_t CountMismatches(const float *ax, const float *ay,
+                              const float *bx, const float *by, size_t n) {
+  size_t bad = 0;
+  for (size_t i = 0; i < n; i++) {
+    bad += (ax[i] != bx[i] || ay[i] != by[i]);
+  }
+  return bad;
+}
+
+/*
+ * Particles of ps that are not where probe has them, after the last update
+ * and before it.
+ */
+static size_t CountStateMismatches(const ParticleSoA_t *ps,
+                                   const ParticleSoA_t *probe) {
+  return CountMismatches(ps->x, ps->y, probe->x, probe->y, ps->Count) +
+         CountMismatches(ps->prev_x, ps->prev_y, probe->prev_x,
+                         probe->prev_y, ps->Count);
+}
+
+/*
+ * Particles that ParticleSoA_Interpolate() draws somewhere else than x and y
+ * at alpha.
+ */
+static size_t CountDrawnMismatches(const ParticleSoA_t *ps, float alpha,
+                                   const float *x, const float *y,
+                                   float *draw_x, float *draw_y) {
+  ParticleSoA_Interpolate(ps, pool, alpha, draw_x, draw_y);
+  return CountMismatches(draw_x, draw_y, x, y, ps->Count);
+}
+
+static bool CheckBoundary(const char *name, const ParticleBoundary_t *boundary,
+                          const void *bounds) {
+  ParticleSoA_t *sets[3] = {ParticleSoA_Create(CHECK_PARTICLES),
+                            ParticleSoA_Create(CHECK_PARTICLES),
+                            ParticleSoA_Create(CHECK_PARTICLES)};
+  ParticleSoA_t *ps = sets[0];
+  ParticleSoA_t *seeked = sets[1];
+  ParticleSoA_t *probe = sets[2];
+  float *x = ParticleSoA_AllocArray(CHECK_PARTICLES);
+  float *y = ParticleSoA_AllocArray(CHECK_PARTICLES);
+  float *draw_x = ParticleSoA_AllocArray(CHECK_PARTICLES);
+  float *draw_y = ParticleSoA_AllocArray(CHECK_PARTICLES);
+  bool ok = false;
+
+  if (!ps || !seeked || !probe || !x || !y || !draw_x || !draw_y) {
+    fprintf(stderr, "ERROR: Failed to allocate %d particles!\n",
+            CHECK_PARTICLES);
+    goto done;
+  }
+  // Directions and speeds as Beat_VelocitiesTable() draws them, which are
+  // rarely whole pixels per step.
+  Rng_FillUniform(&rng, 0, 4, 0, ps->vx, CHECK_PARTICLES);
+  Rng_FillUniform(&rng, 1, 4, 0, ps->vy, CHECK_PARTICLES);
+  for (size_t i = 0; i < CHECK_PARTICLES; i++) {
+    const float magnitude = 10 * (1 + (int)(ps->vx[i] * 8));
+    const float angle = ps->vy[i] * 2 * M_PI;
+    ps->vx[i] = cosf(angle) * magnitude;
+    ps->vy[i] = sinf(angle) * magnitude;
+    ps->origin_x[i] = ps->x[i] = ps->prev_x[i] = WORLD_PX / 2;
+    ps->origin_y[i] = ps->y[i] = ps->prev_y[i] = WORLD_PX / 2;
+  }
+  boundary->SetPeriods(ps, SIM_DT, bounds);
+  for (int s = 1; s < 3; s++) {
+    const size_t bytes = CHECK_PARTICLES * sizeof(float);
+    memcpy(sets[s]->vx, ps->vx, bytes);
+    memcpy(sets[s]->vy, ps->vy, bytes);
+    memcpy(sets[s]->origin_x, ps->origin_x, bytes);
+    memcpy(sets[s]->origin_y, ps->origin_y, bytes);
+    memcpy(sets[s]->period, ps->period, bytes);
+  }
+  ParticleSoA_Seek(seeked, SIM_DT, CHECK_STEPS / 2);
+
+  for (uint64_t step = 1; step <= CHECK_STEPS; step++) {
+    const bool with_seeked = step >= CHECK_STEPS / 2;
+    boundary->Update(ps, pool, SIM_DT, bounds);
+    if (step > CHECK_STEPS / 2) {
+      boundary->Update(seeked, pool, SIM_DT, bounds);
+    }
+    if (step % CHECK_EVERY != 0 && step != CHECK_STEPS) {
+      continue;
+    }
+
+    ParticleSoA_Seek(probe, SIM_DT, step);
+    size_t bad = CountStateMismatches(ps, probe);
+    if (with_seeked) {
+      bad += CountStateMismatches(seeked, probe);
+    }
+    if (bad) {
+      fprintf(stderr,
+              "ERROR: %s: %zu particles off their closed form at step "
+              "%llu!\n",
+              name, bad, (unsigned long long)step);
+      goto done;
+    }
+
+    for (size_t a = 0; a < sizeof(checkAlphas) / sizeof(checkAlphas[0]);
+         a++) {
+      const float alpha = checkAlphas[a];
+      ParticleSoA_Evaluate(ps, pool, SIM_DT, step - 1, alpha, x, y);
+      bad = CountDrawnMismatches(ps, alpha, x, y, draw_x, draw_y);
+      if (with_seeked) {
+        bad += CountDrawnMismatches(seeked, alpha, x, y, draw_x, draw_y);
+      }
+      if (bad) {
+        fprintf(stderr,
+                "ERROR: %s: %zu particles drawn off their closed form at "
+                "step %llu, alpha %g!\n",
+                name, bad, (unsigned long long)step, alpha);
+        goto done;
+      }
+    }
+  }
+  fprintf(stderr, "%-20s ok, %d particles, %d steps, %s kernels\n", name,
+          CHECK_PARTICLES, CHECK_STEPS, ParticleSoA_KernelName());
+  ok = true;
+
+done:
+  for (int s = 0; s < 3; s++) {
+    ParticleSoA_Destroy(sets[s]);
+  }
+  free(x);
+  free(y);
+  free(draw_x);
+  free(draw_y);
+  return ok;
+}
+
+static bool Check_ClosedForm(void) {
+  const ParticleRect_t rect = {0, 0, WORLD_PX, WORLD_PX};
+  const ParticleCircle_t circle = {WORLD_PX / 3};
+  const bool rect_ok = CheckBoundary("closed_form_rect", &ParticleRect, &rect);
+  const bool circle_ok =
+      CheckBoundary("closed_form_circle", &ParticleCircle, &circle);
+  return rect_ok && circle_ok;
+}
+
+/*
+ * Also for --check: animated GIFs of CHECK_GIF_FRAMES frames, one row of
+ * every width up to CHECK_GIF_MAX_WIDTH and then checkGifSizes, go through
+ * gif.c and are read back by a strict decoder. Every
+ * frame has to decode to exactly its pixels and end with an end of
+ * information code, read at the width a decoder expects it at, followed by
+ * nothing but the padding of its last byte. Lenient viewers show a frame
+ * that misses its end code just the same, so only a check like this notices.
+ */
+#define CHECK_GIF_FRAMES (8)
+#define CHECK_GIF_MAX_WIDTH (3000)
+#define CHECK_GIF_COLORS (64)  // each alone in a 15-bit bucket, kept exactly
+#define LZW_MAX_CODES (4096)
+
+static const int checkGifSizes[][2] = {
+    {4095, 1}, {4096, 1}, {5000, 1}, {64, 64}, {97, 61}, {333, 77}, {800, 800},
+};
+
+typedef struct {
+  const uint8_t *Data;
+  size_t Size;
+  size_t Pos;
+} GifReader_t;
+
+static int GifRead(GifReader_t *r) {
+  return r->Pos < r->Size ? r->Data[r->Pos++] : -1;
+}
+
+static int GifRead16(GifReader_t *r) {
+  const int lo = GifRead(r);
+  const int hi = GifRead(r);
+  return (lo < 0 || hi < 0) ? -1 : lo | hi << 8;
+}
+
+/*
+ * Joins data sub-blocks into out, which holds r->Size bytes. Returns their
+ * length, or -1 if the file ends first.
+ */
+static long GifReadSubBlocks(GifReader_t *r, uint8_t *out) {
+  long len = 0;
+  for (;;) {
+    const int n = GifRead(r);
+    if (n <= 0 || r->Pos + n > r->Size) {
+      return n == 0 ? len : -1;
+    }
+    memcpy(out + len, r->Data + r->Pos, n);
+    r->Pos += n;
+    len += n;
+  }
+}
+
+/*
+ * Decodes count palette indices into out as a strict decoder would: codes
+ * widen when the next free code no longer fits, the stream has to end with
+ * an end of information code after exactly count pixels, and all that may
+ * follow is the rest of the byte that code ends in.
+ */
+static bool GifDecodeLzw(const uint8_t *data, long len, int min_size,
+                         uint8_t *out, size_t count) {
+  static uint16_t prefix[LZW_MAX_CODES];
+  static uint8_t suffix[LZW_MAX_CODES];
+  static uint8_t stack[LZW_MAX_CODES];
+  const int clear = 1 << min_size;
+  const int end = clear + 1;
+  int size = min_size + 1;
+  int next = end + 1;
+  int prev = -1;
+  size_t n = 0;
+  long bit = 0;
+
+  for (;;) {
+    if (bit + size > 8 * len) {
+      return false;  // ran out of data before the end code
+    }
+    int code = 0;
+    for (int b = 0; b < size; b++, bit++) {
+      code |= (data[bit / 8] >> (bit % 8) & 1) << b;
+    }
+
+    if (code == clear) {
+      size = min_size + 1;
+      next = end + 1;
+      prev = -1;
+      continue;
+    }
+    if (code == end) {
+      return n == count && (bit + 7) / 8 == len;
+    }
+    if (code > next || (prev < 0 && code >= clear) ||
+        (code == next && prev < 0)) {
+      return false;
+    }
+
+    // The string of code, or for the code about to be added, the string of
+    // prev followed by its own first pixel.
+    int sp = 0;
+    int c = code == next ? prev : code;
+    while (c >= clear) {
+      stack[sp++] = suffix[c];
+      c = prefix[c];
+    }
+    const uint8_t first = c;
+    stack[sp++] = first;
+    if (n + sp + (code == next) > count) {
+      return false;
+    }
+    while (sp > 0) {
+      out[n++] = stack[--sp];
+    }
+    if (code == next) {
+      out[n++] = first;
+    }
+
+    if (prev >= 0 && next < LZW_MAX_CODES) {
+      prefix[next] = prev;
+      suffix[next] = first;
+      next++;
+      if (next == 1 << size && size < 12) {
+        size++;
+      }
+    }
+    prev = code;
+  }
+}
+
+/*
+ * Reads the GIF at path back and compares it with count frames of width *
+ * height RGBA pixels. Returns how many frames are missing, malformed or
+ * differ, or -1 if the file cannot be read at all.
+ */
+static int CountGifMismatches(const char *path, const uint8_t *frames,
+                              int width, int height, int count) {
+  const size_t num_pixels = (size_t)width * height;
+  FILE *f = fopen(path, "rb");
+  uint8_t *data = NULL;
+  uint8_t *codes = NULL;
+  uint8_t *indices = NULL;
+  int bad = -1;
+
+  if (f == NULL || fseek(f, 0, SEEK_END) != 0) {
+    goto done;
+  }
+  const long size = ftell(f);
+  data = malloc(size > 0 ? size : 1);
+  codes = malloc(size > 0 ? size : 1);
+  indices = malloc(num_pixels);
+  rewind(f);
+  if (size < 13 || !data || !codes || !indices ||
+      fread(data, 1, size, f) != (size_t)size) {
+    goto done;
+  }
+
+  GifReader_t r = {data, size, 6};
+  if (memcmp(data, "GIF89a", 6) != 0 || GifRead16(&r) != width ||
+      GifRead16(&r) != height) {
+    goto done;
+  }
+  r.Pos += 3;  // no global color table, background, aspect
+
+  int frame = 0;
+  bad = 0;
+  for (;;) {
+    const int block = GifRead(&r);
+    if (block == 0x3b) {
+      break;
+    } else if (block == 0x21) {
+      GifRead(&r);  // label
+      if (GifReadSubBlocks(&r, codes) < 0) {
+        bad = -1;
+        goto done;
+      }
+    } else if (block == 0x2c) {
+      r.Pos += 4;  // left, top
+      const int w = GifRead16(&r);
+      const int h = GifRead16(&r);
+      const int flags = GifRead(&r);
+      const int num_colors = (flags & 0x80) ? 2 << (flags & 7) : 0;
+      const uint8_t *palette = data + r.Pos;
+      r.Pos += 3 * num_colors;
+      const int min_size = GifRead(&r);
+      const long len = GifReadSubBlocks(&r, codes);
+      if (len < 0 || min_size < 2 || min_size > 8) {
+        bad = -1;
+        goto done;
+      }
+
+      bool ok = w == width && h == height && frame < count &&
+                GifDecodeLzw(codes, len, min_size, indices, num_pixels);
+      const uint8_t *rgba = frames + 4 * num_pixels * frame;
+      for (size_t i = 0; ok && i < num_pixels; i++) {
+        const uint8_t *c = &palette[3 * indices[i]];
+        ok = indices[i] < num_colors && c[0] == rgba[4 * i] &&
+             c[1] == rgba[4 * i + 1] && c[2] == rgba[4 * i + 2];
+      }
+      bad += !ok;
+      frame++;
+    } else {
+      bad = -1;
+      goto done;
+    }
+  }
+  if (frame < count) {
+    bad += count - frame;
+  }
+
+done:
+  if (f) {
+    fclose(f);
+  }
+  free(data);
+  free(codes);
+  free(indices);
+  return bad;
+}
+
+/*
+ * Fills count frames with runs of up to CHECK_GIF_COLORS colors, a different
+ * number of them in every frame, so that codes of every width come up.
+ */
+static void FillGifFrames(uint8_t *frames, size_t num_pixels, int count) {
+  for (int f = 0; f < count; f++) {
+    const unsigned int num_colors = 2u << (f % 6);
+    uint8_t *rgba = frames + 4 * num_pixels * f;
+    unsigned int color = 0;
+    for (size_t i = 0; i < num_pixels; i++) {
+      const uint32_t u = Rng_U32(&rng, 6, f, i);
+      if (u % 4 == 0) {
+        color = (u >> 8) % num_colors;
+      }
+      rgba[4 * i] = (color & 3) << 6;
+      rgba[4 * i + 1] = (color >> 2 & 3) << 6;
+      rgba[4 * i + 2] = (color >> 4 & 3) << 6;
+      rgba[4 * i + 3] = 0xff;
+    }
+  }
+}
+
+static bool Check_Gif(void) {
+  const size_t num_sizes = CHECK_GIF_MAX_WIDTH +
+                           sizeof(checkGifSizes) / sizeof(checkGifSizes[0]);
+  char path[] = "/tmp/bench_check_XXXXXX";
+  const int fd = mkstemp(path);
+  bool ok = fd >= 0;
+
+  if (!ok) {
+    fprintf(stderr, "ERROR: Failed to create a temporary file!\n");
+    return false;
+  }
+  close(fd);
+
+  for (size_t s = 0; ok && s < num_sizes; s++) {
+    const bool row = s < CHECK_GIF_MAX_WIDTH;
+    const int width = row ? s + 1 : checkGifSizes[s - CHECK_GIF_MAX_WIDTH][0];
+    const int height = row ? 1 : checkGifSizes[s - CHECK_GIF_MAX_WIDTH][1];
+    const size_t num_pixels = (size_t)width * height;
+    uint8_t *frames = malloc(4 * num_pixels * CHECK_GIF_FRAMES);
+    GifWriter_t *g = frames ? Gif_Open(path, width, height) : NULL;
+    if (g == NULL) {
+      fprintf(stderr, "ERROR: Failed to start a %dx%d GIF!\n", width, height);
+      free(frames);
+      ok = false;
+      break;
+    }
+
+    FillGifFrames(frames, num_pixels, CHECK_GIF_FRAMES);
+    for (int f = 0; f < CHECK_GIF_FRAMES; f++) {
+      ok = Gif_AddFrame(g, frames + 4 * num_pixels * f, 2) && ok;
+    }
+    ok = Gif_Close(g) && ok;
+    const int bad =
+        CountGifMismatches(path, frames, width, height, CHECK_GIF_FRAMES);
+    if (!ok || bad != 0) {
+      fprintf(stderr, "ERROR: gif: %d of %d %dx%d frames do not read back!\n",
+              bad < 0 ? CHECK_GIF_FRAMES : bad, CHECK_GIF_FRAMES, width,
+              height);
+      ok = false;
+    }
+    free(frames);
+  }
+  remove(path);
+
+  if (ok) {
+    fprintf(stderr, "%-20s ok, %zu sizes, %d frames each\n", "gif_round_trip",
+            num_sizes, CHECK_GIF_FRAMES);
+  }
+  return ok;
+}
+
+/*
+ * Contrail particles
+ */
+static struct Particle *contrailParticles = NULL;
+
+static bool Contrail_Setup(size_t n) {
+  contrailParticles = calloc(n, sizeof(*contrailParticles));
+  if (contrailParticles == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    contrailParticles[i].id = i;
+    Particle_SetRandomVelocity(&contrailParticles[i], &rng);
+  }
+  return true;
+}
+
+static void Contrail_Teardown(void) {
+  free(contrailParticles);
+  contrailParticles = NULL;
+}
+
+static void ContrailUpdate(void *ctx, size_t begin, size_t end,
+                           unsigned int worker) {
+  for (size_t i = begin; i < end; i++) {
+    Particle_Update(&contrailParticles[i], SIM_DT, &rng, WORLD_PX / 2);
+  }
+}
+
+static void Contrail_Run(size_t n) {
+  ThreadPool_ParallelFor(runPool, n, UPDATE_GRAIN, ContrailUpdate, NULL);
+}
+
+/*
+ * Lines. Inputs come from a small table so that 10M lines don't need 10M
+ * lines worth of memory; the outputs are thrown away.
+ */
+static Line2D_t handLines[LINE_TABLE_SIZE];
+static struct Line contrailLines[LINE_TABLE_SIZE];
+
+static bool Lines_Setup(size_t n) {
+  for (size_t i = 0; i < LINE_TABLE_SIZE; i++) {
+    const float x0 = WORLD_PX * Rng_Uniform(&rng, 0, 1, 4 * i);
+    const float y0 = WORLD_PX * Rng_Uniform(&rng, 0, 1, 4 * i + 1);
+    const float x1 = WORLD_PX * Rng_Uniform(&rng, 0, 1, 4 * i + 2);
+    const float y1 = WORLD_PX * Rng_Uniform(&rng, 0, 1, 4 * i + 3);
+
+    handLines[i].Color = Color_FromHex(0xffff50, 0);
+    handLines[i].Thickness = 3.0;
+    handLines[i].StartPoint = (Point2D_t){.x = x0, .y = y0};
+    handLines[i].EndPoint = (Point2D_t){.x = x1, .y = y1};
+
+    contrailLines[i].color = al_map_rgb(0x80, 0x80, 0x80);
+    contrailLines[i].src_x = x0;
+    contrailLines[i].src_y = y0;
+    contrailLines[i].dst_x = x1;
+    contrailLines[i].dst_y = y1;
+  }
+  return true;
+}
+
+static void Lines_Teardown(void) {}
+
+static void HandDrawn_Run(size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    PolyLine2D_t *pl =
+        GetHandDawnLine(&handLines[i % LINE_TABLE_SIZE], HAND_DRAWN_POINTS,
+                        &rng, i, NULL);
+    if (pl != NULL) {
+      sink = pl->Points[1].x;
+      PolyLine2D_Destroy(pl);
+    }
+  }
+}
+
+/*
+ * Same lines from a frame scratch arena: every run is a frame that
+ * regenerates all n lines and releases them with one reset.
+ */
+static Arena_t *lineArena = NULL;
+
+static bool HandDrawnArena_Setup(size_t n) {
+  lineArena = Arena_Create(1024 * 1024);
+  return lineArena != NULL && Lines_Setup(n);
+}
+
+static void HandDrawnArena_Teardown(void) {
+  Arena_Destroy(lineArena);
+  lineArena = NULL;
+  Lines_Teardown();
+}
+
+static void HandDrawnArena_Run(size_t n) {
+  Arena_Reset(lineArena);
+  for (size_t i = 0; i < n; i++) {
+    PolyLine2D_t *pl =
+        GetHandDawnLine(&handLines[i % LINE_TABLE_SIZE], HAND_DRAWN_POINTS,
+                        &rng, i, lineArena);
+    if (pl != NULL) {
+      sink = pl->Points[1].x;
+    }
+  }
+}
+
+/*
+ * A page of hatching: short diagonal strokes all over the canvas, generated
+ * as one batch.
+ */
+static Line2D_t *hatchLines = NULL;
+static HandDrawnBatch_t *hatchBatch = NULL;
+
+static bool HandDrawnBatch_Setup(size_t n) {
+  hatchLines = malloc(n * sizeof(*hatchLines));
+  hatchBatch = HandDrawnBatch_Create();
+  if (hatchLines == NULL || hatchBatch == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    const float x = WORLD_PX * Rng_Uniform(&rng, 0, 4, 3 * i);
+    const float y = WORLD_PX * Rng_Uniform(&rng, 0, 4, 3 * i + 1);
+    const float len = 5 + 55 * Rng_Uniform(&rng, 0, 4, 3 * i + 2);
+
+    hatchLines[i].Color = Color_FromHex(0xffff50, 0);
+    hatchLines[i].Thickness = 1.0;
+    hatchLines[i].StartPoint = (Point2D_t){.x = x, .y = y};
+    hatchLines[i].EndPoint = (Point2D_t){.x = x + len, .y = y - len};
+  }
+  return true;
+}
+
+static void HandDrawnBatch_Teardown(void) {
+  HandDrawnBatch_Destroy(hatchBatch);
+  free(hatchLines);
+  hatchBatch = NULL;
+  hatchLines = NULL;
+}
+
+static void HandDrawnBatch_Run(size_t n) {
+  if (HandDrawnBatch_Generate(hatchBatch, hatchLines, n, NULL, &rng, 0)) {
+    sink = hatchBatch->X[hatchBatch->NumPoints / 2];
+  }
+}
+
+static void LineSegs_Run(size_t n) {
+  struct Line segs[NUM_LINE_SEGS];
+
+  for (size_t i = 0; i < n; i++) {
+    Line_BreakIntoSegs(&contrailLines[i % LINE_TABLE_SIZE], segs,
+                       NUM_LINE_SEGS);
+    AddNoiseToLineSegs(segs, NUM_LINE_SEGS, &rng, i);
+  }
+  sink = segs[1].src_x;
+}
+
+/*
+ * Perlin noise. Sample positions step through the lattice at a non-integer
+ * rate so every sample lands in a different cell position.
+ */
+static bool Noise_Setup(size_t n) { return true; }
+static void Noise_Teardown(void) {}
+
+static void Noise1_Run(size_t n) {
+  float acc = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    acc += noise1(i * 0.0137f);
+  }
+  sink = acc;
+}
+
+static void Noise2_Run(size_t n) {
+  float acc = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    acc += noise2((i & 1023) * 0.0137f, (i >> 10) * 0.0137f);
+  }
+  sink = acc;
+}
+
+static void Noise3_Run(size_t n) {
+  float acc = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    acc += noise3((i & 127) * 0.0137f, ((i >> 7) & 127) * 0.0137f,
+                  (i >> 14) * 0.0137f);
+  }
+  sink = acc;
+}
+
+/*
+ * Batched noise. Positions are precomputed into arrays, walking the lattice
+ * like the noise3 case above.
+ */
+static float *noiseX = NULL;
+static float *noiseY = NULL;
+static float *noiseZ = NULL;
+static float *noiseOut = NULL;
+
+static bool NoiseBatch_Setup(size_t n) {
+  noiseX = malloc(n * sizeof(*noiseX));
+  noiseY = malloc(n * sizeof(*noiseY));
+  noiseZ = malloc(n * sizeof(*noiseZ));
+  noiseOut = malloc(n * sizeof(*noiseOut));
+  if (noiseX == NULL || noiseY == NULL || noiseZ == NULL || noiseOut == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    noiseX[i] = (i & 127) * 0.0137f;
+    noiseY[i] = ((i >> 7) & 127) * 0.0137f;
+    noiseZ[i] = (i >> 14) * 0.0137f;
+  }
+  return true;
+}
+
+static void NoiseBatch_Teardown(void) {
+  free(noiseX);
+  free(noiseY);
+  free(noiseZ);
+  free(noiseOut);
+  noiseX = noiseY = noiseZ = noiseOut = NULL;
+}
+
+static void Noise1Batch_Run(size_t n) { noise1_batch(noiseX, noiseOut, n); }
+
+static void Noise2Batch_Run(size_t n) {
+  noise2_batch(noiseX, noiseY, noiseOut, n);
+}
+
+static void Noise3Batch_Run(size_t n) {
+  noise3_batch(noiseX, noiseY, noiseZ, noiseOut, n);
+}
+
+/*
+ * Flow field advection. The field is baked once in setup; the timed part is
+ * the bilinear lookup plus integration the contrail sketch runs every step.
+ */
+static FlowField_t *flow = NULL;
+
+static bool Flow_Setup(size_t n) {
+  const FlowFieldParams_t params = {
+      .Width = 80,
+      .Height = 80,
+      .CellSize = WORLD_PX / 80.0f,
+      .NoiseScale = 1.0f / 200,
+      .TimeScale = 0,
+      .SliceTime = 1,
+      .Speed = 60,
+  };
+
+  flow = FlowField_Create(&params);
+  if (flow == NULL || !Soa_Setup(n)) {
+    return false;
+  }
+  Rng_FillUniform(&rng, 0, 3, 0, soa->x, n);
+  Rng_FillUniform(&rng, 1, 3, 0, soa->y, n);
+  for (size_t i = 0; i < n; i++) {
+    soa->x[i] *= WORLD_PX;
+    soa->y[i] *= WORLD_PX;
+  }
+  return true;
+}
+
+static void Flow_Teardown(void) {
+  FlowField_Destroy(flow);
+  flow = NULL;
+  Soa_Teardown();
+}
+
+static void FlowAdvect(void *ctx, size_t begin, size_t end,
+                       unsigned int worker) {
+  FlowField_Advect(flow, soa, begin, end, SIM_DT);
+}
+
+static void Flow_Run(size_t n) {
+  ThreadPool_ParallelFor(runPool, n, UPDATE_GRAIN, FlowAdvect, NULL);
+}
+
+/*
+ * Draw submission into the offscreen canvas through the same batches the
+ * sketches use. In this headless build that includes Allegro's software
+ * rasteriser.
+ */
+static PrimBatch_t *drawBatch = NULL;
+static float *drawX = NULL;
+static float *drawY = NULL;
+static uint8_t *drawColors = NULL;
+static ALLEGRO_COLOR drawPalette[256];
+
+static bool Draw_Setup(size_t n, PrimBatchType_t type) {
+  drawBatch = PrimBatch_Create(type);
+  drawX = ParticleSoA_AllocArray(n);
+  drawY = ParticleSoA_AllocArray(n);
+  drawColors = malloc(n * sizeof(*drawColors));
+  if (drawBatch == NULL || drawX == NULL || drawY == NULL ||
+      drawColors == NULL) {
+    return false;
+  }
+  Rng_FillUniform(&rng, 0, 2, 0, drawX, n);
+  Rng_FillUniform(&rng, 1, 2, 0, drawY, n);
+  for (size_t i = 0; i < n; i++) {
+    drawX[i] *= WORLD_PX;
+    drawY[i] *= WORLD_PX;
+    drawColors[i] = i % 0xff;
+  }
+  for (int g = 0; g < 0x100; g++) {
+    drawPalette[g] = al_map_rgb(0xff, g, 0x38);
+  }
+  return true;
+}
+
+static bool DrawSquares_Setup(size_t n) {
+  return Draw_Setup(n, PRIM_BATCH_QUADS);
+}
+
+static bool DrawLines_Setup(size_t n) {
+  return Draw_Setup(n, PRIM_BATCH_LINES);
+}
+
+static void Draw_Teardown(void) {
+  PrimBatch_Destroy(drawBatch);
+  free(drawX);
+  free(drawY);
+  free(drawColors);
+  drawBatch = NULL;
+  drawX = drawY = NULL;
+  drawColors = NULL;
+}
+
+static void DrawSquares_Run(size_t n) {
+  PrimBatch_DrawSquares(drawBatch, drawX, drawY, drawColors, drawPalette, n,
+                        3);
+}
+
+static void DrawLines_Run(size_t n) {
+  PrimBatch_Begin(drawBatch);
+  for (size_t i = 0; i < n; i++) {
+    PrimBatch_AddLine(drawBatch, WORLD_PX / 2, WORLD_PX / 2, drawX[i],
+                      drawY[i], drawPalette[drawColors[i]]);
+  }
+  PrimBatch_End(drawBatch);
+}
+
+/*
+ * Trail history of n / TRAIL_BENCH_LENGTH particles, so the size counts
+ * samples, like 100K particles x 64 samples at 6.4M.
+ */
+#define TRAIL_BENCH_LENGTH (64)
+static Trails_t *trails = NULL;
+
+static bool Trails_Setup(size_t n) {
+  const size_t count = n / TRAIL_BENCH_LENGTH;
+  trails = Trails_Create(count, TRAIL_BENCH_LENGTH);
+  if (trails == NULL || !Draw_Setup(count, PRIM_BATCH_LINES)) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    Trails_Reset(trails, i, drawX[i], drawY[i]);
+  }
+  return true;
+}
+
+static void Trails_Teardown(void) {
+  Trails_Destroy(trails);
+  trails = NULL;
+  Draw_Teardown();
+}
+
+static void TrailsPush_Run(size_t n) {
+  Trails_Push(trails, runPool, drawX, drawY);
+}
+
+static void TrailsDraw_Run(size_t n) {
+  Trails_Draw(trails, runPool, drawX, drawY, drawColors, drawPalette);
+}
+
+/*
+ * Density rendering of n particles into the canvas, splat and resolve.
+ */
+static Density_t *density = NULL;
+
+static bool Density_Setup(size_t n) {
+  density = Density_Create(WORLD_PX, WORLD_PX, runPool);
+  return density != NULL && Draw_Setup(n, PRIM_BATCH_QUADS);
+}
+
+static void Density_Teardown(void) {
+  Density_Destroy(density);
+  density = NULL;
+  Draw_Teardown();
+}
+
+static void Density_Run(size_t n) {
+  Density_Splat(density, runPool, drawX, drawY, n);
+  Density_Resolve(density, runPool, DENSITY_TONEMAP_LOG, 1, canvas);
+}
+
+/*
+ * Culling n lines against a window-sized view. The world grows with n so
+ * that the view always holds about as many lines, so the time should stay
+ * flat however large the world gets.
+ */
+#define CULL_LINES_PER_WINDOW (1000)
+#define CULL_CELL_PX (256.0f)
+#define CULL_QUERIES (64)  // views per run, spread over the world
+static SpatialGrid_t *cullGrid = NULL;
+static float cullWorld = 0;
+
+static bool Cull_Setup(size_t n) {
+  cullWorld = WORLD_PX * sqrtf((float)n / CULL_LINES_PER_WINDOW);
+  if (cullWorld < WORLD_PX) {
+    cullWorld = WORLD_PX;
+  }
+  const GridRect_t world = {0, 0, cullWorld, cullWorld};
+  const float cell = fmaxf(CULL_CELL_PX, cullWorld / 1024);
+  GridRect_t *bounds = malloc(n * sizeof(*bounds));
+  cullGrid = SpatialGrid_Create(world, cell);
+  if (bounds == NULL || cullGrid == NULL) {
+    free(bounds);
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    const float x = cullWorld * Rng_Uniform(&rng, 0, 3, 2 * i);
+    const float y = cullWorld * Rng_Uniform(&rng, 0, 3, 2 * i + 1);
+    bounds[i] = (GridRect_t){x, y, x + 100, y + 50};
+  }
+  const bool ok = SpatialGrid_Build(cullGrid, bounds, n);
+  free(bounds);
+  return ok;
+}
+
+static void Cull_Teardown(void) {
+  SpatialGrid_Destroy(cullGrid);
+  cullGrid = NULL;
+}
+
+static void Cull_Run(size_t n) {
+  const float step = (cullWorld - WORLD_PX) / CULL_QUERIES;
+  size_t found = 0;
+  for (int q = 0; q < CULL_QUERIES; q++) {
+    const GridRect_t view = {q * step, q * step, q * step + WORLD_PX,
+                             q * step + WORLD_PX};
+    const uint32_t *items;
+    found += SpatialGrid_Query(cullGrid, view, &items);
+  }
+  sink = found;
+}
+
+/*
+ * Frames of the large test world, `./test --set lines=50000`: 50000 lines
+ * scattered over 16000 px and indexed by a grid. Each frame is a window at
+ * a zoom of 1 further along the diagonal, whose lines are found through the
+ * grid and hand drawn into an arena with a point per SCENE_SEGMENT_PX.
+ * Frames are drawn until n lines have been, so the size counts lines drawn
+ * rather than lines in the world.
+ */
+#define SCENE_LINES (50000)
+#define SCENE_WORLD_PX (16000.0f)
+#define SCENE_CELL_PX (256.0f)
+#define SCENE_SEGMENT_PX (24.0f)
+#define SCENE_VIEWS (64)  // frames along the diagonal before starting over
+
+static Line2D_t *sceneLines = NULL;
+static SpatialGrid_t *sceneGrid = NULL;
+static Arena_t *sceneArena = NULL;
+static unsigned int sceneView = 0;
+
+static bool Scene_Setup(size_t n) {
+  const GridRect_t world = {0, 0, SCENE_WORLD_PX, SCENE_WORLD_PX};
+  GridRect_t *bounds = malloc(SCENE_LINES * sizeof(*bounds));
+  sceneLines = malloc(SCENE_LINES * sizeof(*sceneLines));
+  sceneGrid = SpatialGrid_Create(world, SCENE_CELL_PX);
+  sceneArena = Arena_Create(1024 * 1024);
+  if (!bounds || !sceneLines || !sceneGrid || !sceneArena) {
+    free(bounds);
+    return false;
+  }
+  for (size_t i = 0; i < SCENE_LINES; i++) {
+    const float x = SCENE_WORLD_PX * Rng_Uniform(&rng, 0, 5, 4 * i);
+    const float y = SCENE_WORLD_PX * Rng_Uniform(&rng, 0, 5, 4 * i + 1);
+    const float angle = 2 * M_PI * Rng_Uniform(&rng, 0, 5, 4 * i + 2);
+    const float len = 20 + 180 * Rng_Uniform(&rng, 0, 5, 4 * i + 3);
+    Line2D_t *l = &sceneLines[i];
+
+    l->Color = Color_FromHex(0xffff50, 0);
+    l->Thickness = 2.0;
+    l->StartPoint = (Point2D_t){.x = x, .y = y};
+    l->EndPoint =
+        (Point2D_t){.x = x + len * cosf(angle), .y = y + len * sinf(angle)};
+    bounds[i] = (GridRect_t){fminf(x, l->EndPoint.x) - 1,
+                             fminf(y, l->EndPoint.y) - 1,
+                             fmaxf(x, l->EndPoint.x) + 1,
+                             fmaxf(y, l->EndPoint.y) + 1};
+  }
+  const bool ok = SpatialGrid_Build(sceneGrid, bounds, SCENE_LINES);
+  free(bounds);
+  sceneView = 0;
+  return ok;
+}
+
+static void Scene_Teardown(void) {
+  SpatialGrid_Destroy(sceneGrid);
+  Arena_Destroy(sceneArena);
+  free(sceneLines);
+  sceneGrid = NULL;
+  sceneArena = NULL;
+  sceneLines = NULL;
+}
+
+static void Scene_Run(size_t n) {
+  size_t drawn = 0;
+  while (drawn < n) {
+    const float t = (float)(sceneView++ % SCENE_VIEWS) / SCENE_VIEWS *
+                    (SCENE_WORLD_PX - WORLD_PX);
+    const GridRect_t view = {t, t, t + WORLD_PX, t + WORLD_PX};
+    const uint32_t *visible;
+    const size_t count = SpatialGrid_Query(sceneGrid, view, &visible);
+
+    Arena_Reset(sceneArena);
+    for (size_t i = 0; i < count && drawn < n; i++, drawn++) {
+      Line2D_t line = sceneLines[visible[i]];
+      line.StartPoint.x -= t;
+      line.StartPoint.y -= t;
+      line.EndPoint.x -= t;
+      line.EndPoint.y -= t;
+      const float len = hypotf(line.EndPoint.x - line.StartPoint.x,
+                               line.EndPoint.y - line.StartPoint.y);
+      const unsigned int points =
+          fminf(2 + len / SCENE_SEGMENT_PX, HAND_DRAWN_POINTS);
+      PolyLine2D_t *pl =
+          GetHandDawnLine(&line, points, &rng, visible[i], sceneArena);
+      if (pl != NULL) {
+        sink = pl->Points[1].x;
+      }
+    }
+  }
+}
+
+/*
+ * The draw benchmarks above through the tiled CPU rasterizer instead of
+ * Allegro, recording and flushing into the canvas on the run's pool.
+ */
+static Raster_t *raster = NULL;
+
+static bool RasterBench_Start(bool ok) {
+  if (!ok) {
+    return false;
+  }
+  raster = Raster_Create(canvas, runPool);
+  Raster_MakeCurrent(raster);
+  return raster != NULL;
+}
+
+static void RasterBench_Stop(void) {
+  Raster_Destroy(raster);
+  raster = NULL;
+}
+
+static bool RasterSquares_Setup(size_t n) {
+  return RasterBench_Start(DrawSquares_Setup(n));
+}
+
+static bool RasterLines_Setup(size_t n) {
+  return RasterBench_Start(DrawLines_Setup(n));
+}
+
+static bool RasterTrails_Setup(size_t n) {
+  return RasterBench_Start(Trails_Setup(n));
+}
+
+static void RasterDraw_Teardown(void) {
+  RasterBench_Stop();
+  Draw_Teardown();
+}
+
+static void RasterTrails_Teardown(void) {
+  RasterBench_Stop();
+  Trails_Teardown();
+}
+
+static void RasterSquares_Run(size_t n) {
+  DrawSquares_Run(n);
+  Raster_Flush(raster);
+}
+
+static void RasterLines_Run(size_t n) {
+  DrawLines_Run(n);
+  Raster_Flush(raster);
+}
+
+static void RasterTrails_Run(size_t n) {
+  TrailsDraw_Run(n);
+  Raster_Flush(raster);
+}
+
+static const Bench_t benches[] = {
+    {"beat_square_update", "particles", true, Soa_Setup, SoaRect_Run,
+     Soa_Teardown},
+    {"beat_circle_update", "particles", true, Soa_Setup, SoaCircle_Run,
+     Soa_Teardown},
+    {"beat_square_evaluate", "particles", true, SoaEval_Setup, SoaEval_Run,
+     Soa_Teardown},
+    {"beat_square_evaluate_compact", "particles", true, CompactEval_Setup,
+     CompactEval_Run, CompactEval_Teardown},
+    {"contrail_update", "particles", true, Contrail_Setup, Contrail_Run,
+     Contrail_Teardown},
+    {"flow_advect", "particles", true, Flow_Setup, Flow_Run, Flow_Teardown},
+    {"hand_drawn_line", "lines", false, Lines_Setup, HandDrawn_Run,
+     Lines_Teardown},
+    {"hand_drawn_line_arena", "lines", false, HandDrawnArena_Setup,
+     HandDrawnArena_Run, HandDrawnArena_Teardown},
+    {"hand_drawn_batch", "lines", false, HandDrawnBatch_Setup,
+     HandDrawnBatch_Run, HandDrawnBatch_Teardown},
+    {"line_segs_noise", "lines", false, Lines_Setup, LineSegs_Run,
+     Lines_Teardown},
+    {"noise1", "samples", false, Noise_Setup, Noise1_Run, Noise_Teardown},
+    {"noise2", "samples", false, Noise_Setup, Noise2_Run, Noise_Teardown},
+    {"noise3", "samples", false, Noise_Setup, Noise3_Run, Noise_Teardown},
+    {"noise1_batch", "samples", false, NoiseBatch_Setup, Noise1Batch_Run,
+     NoiseBatch_Teardown},
+    {"noise2_batch", "samples", false, NoiseBatch_Setup, Noise2Batch_Run,
+     NoiseBatch_Teardown},
+    {"noise3_batch", "samples", false, NoiseBatch_Setup, Noise3Batch_Run,
+     NoiseBatch_Teardown},
+    {"draw_squares", "quads", false, DrawSquares_Setup, DrawSquares_Run,
+     Draw_Teardown},
+    {"draw_lines", "lines", false, DrawLines_Setup, DrawLines_Run,
+     Draw_Teardown},
+    {"trails_push", "samples", true, Trails_Setup, TrailsPush_Run,
+     Trails_Teardown},
+    {"trails_draw", "samples", true, Trails_Setup, TrailsDraw_Run,
+     Trails_Teardown},
+    {"density_render", "particles", true, Density_Setup, Density_Run,
+     Density_Teardown},
+    {"grid_cull", "lines", false, Cull_Setup, Cull_Run, Cull_Teardown},
+    {"scene_frames", "lines", false, Scene_Setup, Scene_Run, Scene_Teardown},
+    {"raster_squares", "quads", true, RasterSquares_Setup, RasterSquares_Run,
+     RasterDraw_Teardown},
+    {"raster_lines", "lines", true, RasterLines_Setup, RasterLines_Run,
+     RasterDraw_Teardown},
+    {"raster_trails", "samples", true, RasterTrails_Setup, RasterTrails_Run,
+     RasterTrails_Teardown},
+};
+
+static int CompareU64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * Times one benchmark at one size and prints its JSON record.
+ */
+static bool Measure(const Bench_t *b, size_t n, unsigned int threads,
+                    bool first) {
+  uint64_t *samples = malloc(options.Reps * sizeof(*samples));
+  if (samples == NULL) {
+    return false;
+  }
+
+  if (!b->Setup(n)) {
+    fprintf(stderr, "ERROR: Failed to set up %s with %zu elements!\n",
+            b->Name, n);
+    b->Teardown();
+    free(samples);
+    return false;
+  }
+
+  // Warm caches, branch predictors and the pool's workers. Huge sizes that
+  // already blow the budget get a single warmup run.
+  uint64_t start = NowNs();
+  for (int i = 0; i < BENCH_WARMUP_REPS; i++) {
+    b->Run(n);
+    if ((NowNs() - start) * 1e-9 > options.Budget) {
+      break;
+    }
+  }
+
+  unsigned int reps = 0;
+  start = NowNs();
+  while (reps < options.Reps) {
+    const uint64_t t0 = NowNs();
+    b->Run(n);
+    samples[reps++] = NowNs() - t0;
+    if (reps >= BENCH_MIN_REPS && (NowNs() - start) * 1e-9 > options.Budget) {
+      break;
+    }
+  }
+  b->Teardown();
+
+  qsort(samples, reps, sizeof(*samples), CompareU64);
+  const uint64_t median = samples[reps / 2];
+  const uint64_t p99 = samples[(size_t)ceil(0.99 * reps) - 1];
+
+  printf("%s    {\"name\": \"%s\", \"unit\": \"%s\", \"size\": %zu, "
+         "\"threads\": %u, \"reps\": %u, \"min_ns\": %llu, "
+         "\"median_ns\": %llu, \"p99_ns\": %llu, \"per_sec\": %.1f}",
+         first ? "" : ",\n", b->Name, b->Unit, n, threads, reps,
+         (unsigned long long)samples[0], (unsigned long long)median,
+         (unsigned long long)p99, median ? n * 1e9 / median : 0.0);
+  fflush(stdout);
+  fprintf(stderr, "%-20s %9zu %-9s %2u threads  %12.1f/s\n", b->Name, n,
+          b->Unit, threads, median ? n * 1e9 / median : 0.0);
+
+  free(samples);
+  return true;
+}
+
+static bool ParseSize(const char *str, size_t *value) {
+  char *end;
+  errno = 0;
+  unsigned long long v = strtoull(str, &end, 10);
+  if (errno != 0 || end == str || *end != '\0' || str[0] == '-') {
+    fprintf(stderr, "ERROR: '%s' is not a valid unsigned integer!\n", str);
+    return false;
+  }
+  *value = (size_t)v;
+  return true;
+}
+
+static bool ParseOptions(int argc, char **argv) {
+  size_t value;
+
+  options.NumThreads = 0;
+  options.Reps = BENCH_DEFAULT_REPS;
+  options.MaxSize = BENCH_MAX_SIZE;
+  options.Budget = BENCH_DEFAULT_BUDGET_S;
+  options.Filter = NULL;
+  options.Check = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const bool has_value = (i + 1 < argc);
+
+    if (strcmp(arg, "--threads") == 0 && has_value) {
+      if (!ParseSize(argv[++i], &value)) {
+        return false;
+      }
+      options.NumThreads = value;
+    } else if (strcmp(arg, "--reps") == 0 && has_value) {
+      if (!ParseSize(argv[++i], &value) || value < BENCH_MIN_REPS) {
+        fprintf(stderr, "ERROR: --reps needs at least %d!\n", BENCH_MIN_REPS);
+        return false;
+      }
+      options.Reps = value;
+    } else if (strcmp(arg, "--max-size") == 0 && has_value) {
+      if (!ParseSize(argv[++i], &options.MaxSize)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--budget") == 0 && has_value) {
+      options.Budget = strtod(argv[++i], NULL);
+    } else if (strcmp(arg, "--filter") == 0 && has_value) {
+      options.Filter = argv[++i];
+    } else if (strcmp(arg, "--check") == 0) {
+      options.Check = true;
+    } else {
+      fprintf(stderr, "ERROR: Unknown or incomplete option '%s'!\n", arg);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void PrintUsage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options] > results.json\n"
+          "  --threads N   pool size for threaded benchmarks (default 0, one "
+          "per CPU)\n"
+          "  --reps N      max timed repetitions per size (default %d)\n"
+          "  --max-size N  largest element count swept (default %d)\n"
+          "  --budget S    seconds per size before stopping early (default "
+          "%.1f)\n"
+          "  --filter STR  only run benchmarks whose name contains STR\n"
+          "  --check       check that stepping and closed-form evaluation of\n"
+          "                the beat particles agree and that GIFs read back,\n"
+          "                instead of timing\n",
+          prog, BENCH_DEFAULT_REPS, BENCH_MAX_SIZE, BENCH_DEFAULT_BUDGET_S);
+}
+
+int main(int argc, char **argv) {
+  int ret = 0;
+
+  if (!ParseOptions(argc, argv)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  if (!al_init()) {
+    fprintf(stderr, "ERROR: Failed to initialize allegro!\n");
+    return 1;
+  }
+  if (!al_init_primitives_addon()) {
+    fprintf(stderr, "ERROR: Failed to load primitives addon!\n");
+    return 1;
+  }
+  canvas = Headless_CreateTarget(WORLD_PX, WORLD_PX);
+  if (!canvas) {
+    return 1;
+  }
+  pool = ThreadPool_Create(options.NumThreads);
+  if (!pool) {
+    fprintf(stderr, "ERROR: Failed to create thread pool!\n");
+    al_destroy_bitmap(canvas);
+    return 1;
+  }
+  Rng_Init(&rng, BENCH_DEFAULT_SEED);
+
+  if (options.Check) {
+    const bool closed_form_ok = Check_ClosedForm();
+    const bool gif_ok = Check_Gif();
+    ret = closed_form_ok && gif_ok ? 0 : 1;
+    ThreadPool_Destroy(pool);
+    al_destroy_bitmap(canvas);
+    return ret;
+  }
+
+  const unsigned int num_threads = ThreadPool_NumThreads(pool);
+  printf("{\n  \"threads\": %u,\n  \"soa_kernel\": \"%s\",\n"
+         "  \"noise_kernel\": \"%s\",\n  \"flow_kernel\": \"%s\",\n"
+         "  \"raster_kernel\": \"%s\",\n  \"results\": [\n",
+         num_threads, ParticleSoA_KernelName(), noise_batch_kernel(),
+         FlowField_KernelName(), Raster_KernelName());
+
+  bool first = true;
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    const Bench_t *b = &benches[i];
+    if (options.Filter && strstr(b->Name, options.Filter) == NULL) {
+      continue;
+    }
+    for (size_t n = BENCH_MIN_SIZE; n <= options.MaxSize; n *= 10) {
+      runPool = NULL;
+      if (!Measure(b, n, 1, first)) {
+        ret = 1;
+        goto done;
+      }
+      first = false;
+      if (b->Threaded && num_threads > 1) {
+        runPool = pool;
+        if (!Measure(b, n, num_threads, first)) {
+          ret = 1;
+          goto done;
+        }
+      }
+    }
+  }
+
+done:
+  printf("\n  ]\n}\n");
+  ThreadPool_Destroy(pool);
+  al_destroy_bitmap(canvas);
+  return ret;
+}
@@ -0,0 +1,390 @@
+#include "capture.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gif.h"
+
+// Frames the encoder may lag behind before the render loop has to wait.
+// 800 x 800 RGBA is 2.5 MB per slot.
+#define CAPTURE_QUEUE_FRAMES (8)
+#define GIF_MIN_DELAY_CS (2)
+
+typedef enum { FORMAT_RAW, FORMAT_Y4M, FORMAT_GIF } CaptureFormat_t;
+
+struct Capture {
+  CaptureFormat_t Format;
+  FILE *File;        // raw and Y4M
+  GifWriter_t *Gif;  // GIF
+  int Width;
+  int Height;
+  double Fps;
+
+  // Double-buffered readback of video bitmaps
+  ALLEGRO_BITMAP *Staging[2];
+  int Pending;  // staging bitmap holding a frame not read back yet, or -1
+  int Current;  // staging bitmap the next frame is copied into
+
+  // Ring of frame slots, guarded by Mutex. The render loop fills
+  // Slots[Head], the encoder empties Slots[Tail].
+  uint8_t *Slots[CAPTURE_QUEUE_FRAMES];
+  unsigned int Head;
+  unsigned int Tail;
+  unsigned int Count;
+  bool Stop;
+  ALLEGRO_MUTEX *Mutex;
+  ALLEGRO_COND *Cond;
+  ALLEGRO_THREAD *Thread;
+
+  // Only touched by the encoder until it has been joined
+  uint8_t *Yuv;
+  double GifTime;       // capture time of the next frame, centiseconds
+  double GifWritten;    // delays written so far, centiseconds
+  bool Failed;
+  unsigned long Frames;  // frames queued
+  unsigned long Stalls;  // times the render loop waited for a free slot
+};
+
+static bool HasExtension(const char *path, const char *ext) {
+  const size_t len = strlen(path);
+  const size_t ext_len = strlen(ext);
+  if (len < ext_len) {
+    return false;
+  }
+  for (size_t i = 0; i < ext_len; i++) {
+    char ch = path[len - ext_len + i];
+    if (ch >= 'A' && ch <= 'Z') {
+      ch += 'a' - 'A';
+    }
+    if (ch != ext[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint8_t ClampByte(int v) {
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/*
+ * BT.601 limited range, in 8.8 fixed point. Chroma is the average of each
+ * 2x2 block, sited in its center as C420jpeg says.
+ */
+static void RgbaToI420(const uint8_t *rgba, int width, int height,
+                       uint8_t *out) {
+  const int cw = (width + 1) / 2;
+  const int ch = (height + 1) / 2;
+  uint8_t *y_plane = out;
+  uint8_t *u_plane = out + (size_t)width * height;
+  uint8_t *v_plane = u_plane + (size_t)cw * ch;
+
+  for (size_t i = 0; i < (size_t)width * height; i++) {
+    const uint8_t *p = &rgba[4 * i];
+    y_plane[i] = (66 * p[0] + 129 * p[1] + 25 * p[2] + 128 + (16 << 8)) >> 8;
+  }
+  for (int cy = 0; cy < ch; cy++) {
+    const int y0 = 2 * cy;
+    const int y1 = (y0 + 1 < height) ? y0 + 1 : y0;
+    for (int cx = 0; cx < cw; cx++) {
+      const int x0 = 2 * cx;
+      const int x1 = (x0 + 1 < width) ? x0 + 1 : x0;
+      const uint8_t *p[4] = {&rgba[4 * ((size_t)y0 * width + x0)],
+                             &rgba[4 * ((size_t)y0 * width + x1)],
+                             &rgba[4 * ((size_t)y1 * width + x0)],
+                             &rgba[4 * ((size_t)y1 * width + x1)]};
+      const int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+      const int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+      const int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+      u_plane[cy * cw + cx] =
+          ClampByte(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+      v_plane[cy * cw + cx] =
+          ClampByte(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+  }
+}
+
+static size_t I420Size(int width, int height) {
+  return (size_t)width * height +
+         2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+}
+
+/*
+ * Runs on the encoder thread.
+ */
+static bool Encode(Capture_t *c, const uint8_t *rgba) {
+  switch (c->Format) {
+    case FORMAT_RAW:
+      return fwrite(rgba, 4, (size_t)c->Width * c->Height, c->File) ==
+             (size_t)c->Width * c->Height;
+    case FORMAT_Y4M: {
+      const size_t size = I420Size(c->Width, c->Height);
+      RgbaToI420(rgba, c->Width, c->Height, c->Yuv);
+      return fputs("FRAME\n", c->File) >= 0 &&
+             fwrite(c->Yuv, 1, size, c->File) == size;
+    }
+    case FORMAT_GIF: {
+      // Round the frame's end time, not its length, so the delays add up
+      // to the real duration instead of drifting.
+      c->GifTime += 100.0 / c->Fps;
+      double delay = floor(c->GifTime + 0.5) - c->GifWritten;
+      if (delay < GIF_MIN_DELAY_CS) {
+        delay = GIF_MIN_DELAY_CS;
+      }
+      c->GifWritten += delay;
+      return Gif_AddFrame(c->Gif, rgba, (unsigned int)delay);
+    }
+  }
+  return false;
+}
+
+static void *EncoderMain(ALLEGRO_THREAD *thread, void *arg) {
+  Capture_t *c = arg;
+
+  (void)thread;
+  al_lock_mutex(c->Mutex);
+  for (;;) {
+    while (!c->Stop && c->Count == 0) {
+      al_wait_cond(c->Cond, c->Mutex);
+    }
+    if (c->Count == 0) {
+      break;  // stopped and drained
+    }
+    const uint8_t *rgba = c->Slots[c->Tail];
+    al_unlock_mutex(c->Mutex);
+
+    // After a failed write keep draining, so the render loop never blocks
+    // on a dead encoder.
+    if (!c->Failed && !Encode(c, rgba)) {
+      fprintf(stderr, "ERROR: Failed to write captured frame!\n");
+      c->Failed = true;
+    }
+
+    al_lock_mutex(c->Mutex);
+    c->Tail = (c->Tail + 1) % CAPTURE_QUEUE_FRAMES;
+    c->Count--;
+    al_broadcast_cond(c->Cond);
+  }
+  al_unlock_mutex(c->Mutex);
+  return NULL;
+}
+
+static uint8_t *AcquireSlot(Capture_t *c) {
+  al_lock_mutex(c->Mutex);
+  if (c->Count == CAPTURE_QUEUE_FRAMES) {
+    c->Stalls++;
+    while (c->Count == CAPTURE_QUEUE_FRAMES) {
+      al_wait_cond(c->Cond, c->Mutex);
+    }
+  }
+  uint8_t *slot = c->Slots[c->Head];
+  al_unlock_mutex(c->Mutex);
+  return slot;
+}
+
+static void SubmitSlot(Capture_t *c) {
+  al_lock_mutex(c->Mutex);
+  c->Head = (c->Head + 1) % CAPTURE_QUEUE_FRAMES;
+  c->Count++;
+  c->Frames++;
+  al_broadcast_cond(c->Cond);
+  al_unlock_mutex(c->Mutex);
+}
+
+/*
+ * Copies bmp into the next free slot and hands it to the encoder.
+ */
+static bool ReadBack(Capture_t *c, ALLEGRO_BITMAP *bmp) {
+  ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(
+      bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+  if (region == NULL) {
+    fprintf(stderr, "ERROR: Failed to lock captured bitmap!\n");
+    return false;
+  }
+
+  uint8_t *slot = AcquireSlot(c);
+  const size_t row_size = (size_t)c->Width * 4;
+  for (int y = 0; y < c->Height; y++) {
+    memcpy(&slot[y * row_size], (const uint8_t *)region->data +
+                                    (ptrdiff_t)y * region->pitch,
+           row_size);
+  }
+  al_unlock_bitmap(bmp);
+  SubmitSlot(c);
+  return true;
+}
+
+/*
+ * Queues the staged frame that has not been read back yet, if any.
+ */
+static bool FlushStaging(Capture_t *c) {
+  if (c->Pending < 0) {
+    return true;
+  }
+  const int pending = c->Pending;
+  c->Pending = -1;
+  return ReadBack(c, c->Staging[pending]);
+}
+
+Capture_t *Capture_Create(const char *path, int width, int height,
+                          double fps) {
+  Capture_t *c = calloc(1, sizeof(*c));
+  if (c == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate capture!\n");
+    return NULL;
+  }
+  c->Width = width;
+  c->Height = height;
+  c->Fps = fps;
+  c->Pending = -1;
+
+  for (int i = 0; i < CAPTURE_QUEUE_FRAMES; i++) {
+    c->Slots[i] = malloc((size_t)width * height * 4);
+    if (c->Slots[i] == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate capture frames!\n");
+      goto fail;
+    }
+  }
+
+  if (HasExtension(path, ".gif")) {
+    c->Format = FORMAT_GIF;
+    c->Gif = Gif_Open(path, width, height);
+    if (c->Gif == NULL) {
+      goto fail;
+    }
+  } else {
+    c->Format = HasExtension(path, ".y4m") ? FORMAT_Y4M : FORMAT_RAW;
+    c->File = fopen(path, "wb");
+    if (c->File == NULL) {
+      fprintf(stderr, "ERROR: Failed to create '%s'!\n", path);
+      goto fail;
+    }
+  }
+  if (c->Format == FORMAT_Y4M) {
+    // Frame rate as a fraction, exact for whole and NTSC-style rates
+    unsigned long num = lround(fps * 1001.0);
+    unsigned long den = 1001;
+    if (num % den == 0) {
+      num /= den;
+      den = 1;
+    }
+    fprintf(c->File, "YUV4MPEG2 W%d H%d F%lu:%lu Ip A1:1 C420jpeg\n", width,
+            height, num, den);
+    c->Yuv = malloc(I420Size(width, height));
+    if (c->Yuv == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate capture frames!\n");
+      goto fail;
+    }
+  }
+
+  c->Mutex = al_create_mutex();
+  c->Cond = al_create_cond();
+  if (!c->Mutex || !c->Cond) {
+    fprintf(stderr, "ERROR: Failed to create capture lock!\n");
+    goto fail;
+  }
+  c->Thread = al_create_thread(EncoderMain, c);
+  if (c->Thread == NULL) {
+    fprintf(stderr, "ERROR: Failed to create encoder thread!\n");
+    goto fail;
+  }
+  al_start_thread(c->Thread);
+  return c;
+
+fail:
+  Capture_Destroy(c);
+  return NULL;
+}
+
+bool Capture_AddFrame(Capture_t *c, ALLEGRO_BITMAP *bmp) {
+  if (al_get_bitmap_width(bmp) != c->Width ||
+      al_get_bitmap_height(bmp) != c->Height) {
+    fprintf(stderr, "ERROR: Captured bitmap is %dx%d, expected %dx%d!\n",
+            al_get_bitmap_width(bmp), al_get_bitmap_height(bmp), c->Width,
+            c->Height);
+    return false;
+  }
+
+  // A memory bitmap can be read right away.
+  if (al_get_bitmap_flags(bmp) & ALLEGRO_MEMORY_BITMAP) {
+    return ReadBack(c, bmp);
+  }
+
+  // Otherwise queue a GPU copy of this frame, then read back the previous
+  // one, whose copy has had a whole frame to finish.
+  ALLEGRO_BITMAP *staging = c->Staging[c->Current];
+  if (staging == NULL) {
+    const int prev_flags = al_get_new_bitmap_flags();
+    al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP);
+    staging = al_create_bitmap(c->Width, c->Height);
+    al_set_new_bitmap_flags(prev_flags);
+    if (staging == NULL) {
+      fprintf(stderr, "ERROR: Failed to create capture staging bitmap!\n");
+      return false;
+    }
+    c->Staging[c->Current] = staging;
+  }
+
+  ALLEGRO_STATE state;
+  al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+  al_set_target_bitmap(staging);
+  al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+  al_draw_bitmap(bmp, 0, 0, 0);
+  al_restore_state(&state);
+
+  const bool ok = FlushStaging(c);
+  c->Pending = c->Current;
+  c->Current ^= 1;
+  return ok;
+}
+
+bool Capture_Destroy(Capture_t *c) {
+  bool ok = true;
+  if (c == NULL) {
+    return false;
+  }
+
+  if (c->Thread) {
+    ok = FlushStaging(c);
+    al_lock_mutex(c->Mutex);
+    c->Stop = true;
+    al_broadcast_cond(c->Cond);
+    al_unlock_mutex(c->Mutex);
+    al_join_thread(c->Thread, NULL);
+    al_destroy_thread(c->Thread);
+
+    printf("Captured %lu frames, render loop waited for the encoder %lu "
+           "times\n",
+           c->Frames, c->Stalls);
+    ok = ok && !c->Failed;
+  }
+  if (c->Cond) {
+    al_destroy_cond(c->Cond);
+  }
+  if (c->Mutex) {
+    al_destroy_mutex(c->Mutex);
+  }
+
+  for (int i = 0; i < 2; i++) {
+    if (c->Staging[i]) {
+      al_destroy_bitmap(c->Staging[i]);
+    }
+  }
+  if (c->Gif && !Gif_Close(c->Gif)) {
+    ok = false;
+  }
+  if (c->File && fclose(c->File) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    fprintf(stderr, "ERROR: Failed to write capture file!\n");
+  }
+  for (int i = 0; i < CAPTURE_QUEUE_FRAMES; i++) {
+    free(c->Slots[i]);
+  }
+  free(c->Yuv);
+  free(c);
+  return ok;
+}
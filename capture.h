@@ -0,0 +1,51 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <allegro5/allegro5.h>
+#include <stdbool.h>
+
+/*
+ * Records rendered frames to a video file in the background. The format is
+ * picked from the file extension:
+ *
+ *   .y4m  YUV4MPEG2, 4:2:0, readable by ffmpeg, mpv and most encoders
+ *   .gif  animated GIF, one 256 color palette per frame
+ *   else  raw RGBA, width * height * 4 bytes per frame, no header
+ *
+ * Capture_AddFrame() only copies the pixels into one of a fixed number of
+ * preallocated frame slots; a background thread converts and writes them.
+ * Frames from video bitmaps (the backbuffer) are first copied into one of
+ * two staging bitmaps on the GPU and read back one frame later, by which
+ * time the copy has finished, so the render loop does not wait for the GPU
+ * either. No frame is ever dropped: if the encoder falls behind by more
+ * than the queue holds, Capture_AddFrame() blocks until a slot frees up.
+ *
+ * GIF frame delays are in hundredths of a second and players treat delays
+ * below 2 as 10, so GIFs captured above 50 FPS play back at 50 FPS.
+ */
+typedef struct Capture Capture_t;
+
+/*
+ * Creates path and starts the encoder thread. Frames must be width x height
+ * and are timed at fps frames per second. Returns NULL and prints an error
+ * on failure.
+ *
+ * @note caller is responsible for finishing the file with Capture_Destroy().
+ */
+Capture_t *Capture_Create(const char *path, int width, int height,
+                          double fps);
+
+/*
+ * Queues the contents of bmp as the next frame. Call from the thread that
+ * draws, after the frame is rendered and before the display is flipped.
+ * Returns false if the bitmap could not be read.
+ */
+bool Capture_AddFrame(Capture_t *c, ALLEGRO_BITMAP *bmp);
+
+/*
+ * Writes out every queued frame, stops the encoder and closes the file.
+ * Returns false if anything could not be written.
+ */
+bool Capture_Destroy(Capture_t *c);
+
+#endif  // CAPTURE_H
@@ -1,9 +1,19 @@
 #include <allegro5/allegro5.h>
 #include <allegro5/allegro_primitives.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "contrail_sim.h"
+#include "flowfield.h"
+#include "host.h"
+#include "line_mesh.h"
 #include "noise1234.h"
+#include "particle_soa.h"
+#include "prim_batch.h"
+#include "raster.h"
+#include "trails.h"
 
 #define WIN_WIDTH_PX (800)
 #define WIN_HEIGHT_PX (800)
@@ -13,317 +23,472 @@
 
 #define FPS (60.0f)
 
-static ALLEGRO_DISPLAY *display = NULL;
-static ALLEGRO_EVENT_QUEUE *eq = NULL;
-static ALLEGRO_TIMER *timer = NULL;
-static bool redraw = true;
-static bool doexit = false;
-
-static void Initialize();
-static void Terminate();
-static void Draw();
-static void ProcessInput(ALLEGRO_EVENT *ev);
-static void Update(double dt, ALLEGRO_EVENT *ev);
-static bool IsRunning();
-
-struct Particle {
-  float x;
-  float y;
-  ALLEGRO_COLOR color;
-  unsigned int size;
-  float src_x;
-  float src_y;
-  float vel_x;
-  float vel_y;
-  float vel_mag;    // in units of pixels/sec
-  float vel_angle;  // in units of degrees
-  float dst_x;
-  float dst_y;
-  float lerp_duration;  // how many seconds the particle takes to travel from
-                        // src to dst. Calculated from velocity
-  float lerp_time;      // how many seconds the particle has been traveling from
-                        // src.
-};
-
-struct Line {
-  ALLEGRO_COLOR color;
-  float src_x;
-  float src_y;
-  float dst_x;
-  float dst_y;
-};
-
-#define NUM_LINE_SEGS (16)
 #define NUM_CONTRAILS (2)
+#define MAX_LINE_SEGS (64)  // line_segs at most
 
 struct Contrail {
   struct Line main_line;
-  struct Line line_segs[NUM_LINE_SEGS];
+  struct Line line_segs[MAX_LINE_SEGS];
+  unsigned int num_segs;
 };
 
-void Line_BreakIntoSegs(struct Line *sl, struct Line *segs,
-                        unsigned int num_segs);
-void AddNoiseToLineSegs(struct Line *segs, unsigned int num_segs);
-void Init_Contrails(void);
-void Contrail_Draw(struct Contrail *c);
-
-struct Contrail contrails[NUM_CONTRAILS];
-
-void Particle_Update(struct Particle *p, double dt);
-void Particle_Draw(struct Particle *p);
-void Particle_SetRandomVelocity(struct Particle *p);
-void Init_Particles(void);
-float Lerp(float start, float end, float percent);
-float EaseOut(float t);
-
+// Defaults of the parameters, see params.h: particles, flow_particles,
+// radius, line_segs (NUM_LINE_SEGS) and flow_speed
 #define NUM_PARTICLES (50)
-struct Particle particles[NUM_PARTICLES];
-
-int main() {
-  double timeNow = 0.0, prevTime = 0.0, dt = 0.0;
-  ALLEGRO_EVENT ev;
-
-  Initialize();
-  Init_Particles();
-  Init_Contrails();
-
-  while (IsRunning()) {
-    al_wait_for_event(eq, &ev);
-    timeNow = al_get_time();
-    dt = timeNow - prevTime;
-
-    ProcessInput(&ev);
-    Update(dt, &ev);
-    Draw();
+#define PARTICLE_SIZE_PX (5)
+#define UPDATE_GRAIN (1024)  // particles per thread pool chunk
+
+// Particles that drift through the baked curl-noise field. Unlike the
+// contrail particles they never evaluate noise themselves, so there can be
+// orders of magnitude more of them.
+#define NUM_FLOW_PARTICLES (10000)
+#define FLOW_GRID_CELLS (80)
+#define FLOW_TRAIL_SAMPLES (24)  // simulation steps of history per particle
+#define FLOW_SPEED (60.0f)       // px/s per unit of noise gradient
+#define FLOW_PALETTE_SIZE (0x40)
+
+typedef struct {
+  struct Contrail Contrails[NUM_CONTRAILS];
+
+  // Every line and particle head of a frame goes through these two batches.
+  PrimBatch_t *LineBatch;
+  PrimBatch_t *QuadBatch;
+  // The contrails never change, so they are tessellated once and kept.
+  LineMesh_t *ContrailMesh;
+
+  struct Particle *Particles;
+  size_t NumParticles;
+  float Radius;  // px a contrail particle travels before respawning
+  ALLEGRO_COLOR Palette[256];
+
+  FlowField_t *Flow;
+  ParticleSoA_t *FlowParticles;
+  float *FlowDrawX;  // interpolated positions for Render()
+  float *FlowDrawY;
+  uint8_t *FlowColors;  // into FlowPalette
+  ALLEGRO_COLOR FlowPalette[FLOW_PALETTE_SIZE];
+  Trails_t *FlowTrails;
+  uint32_t FlowStep;  // RNG generation for respawns
+} State_t;
+
+// What RenderSnapshot() draws with --pipeline
+typedef struct {
+  struct Particle *Particles;
+  ParticleSoA_t *FlowPositions;
+  Trails_t *FlowTrails;
+} ContrailSnapshot_t;
+
+// Thread pool context of the update bodies
+typedef struct {
+  State_t *State;
+  const Rng_t *Rng;
+  double Dt;
+} UpdateCtx_t;
+
+static bool Init_Batches(State_t *s);
+static void Terminate_Batches(State_t *s);
+static bool Init_Particles(Host_t *host, State_t *s);
+static void Terminate_Particles(State_t *s);
+static bool Init_FlowParticles(Host_t *host, State_t *s);
+static void Terminate_FlowParticles(State_t *s);
+static bool Init_Contrails(Host_t *host, State_t *s);
+static void Contrail_AddToMesh(LineMesh_t *mesh, struct Contrail *c);
+static void DrawParticles(State_t *s, const struct Particle *particles,
+                          float alpha);
+static void DrawFlow(Host_t *host, State_t *s, const ParticleSoA_t *positions,
+                     Trails_t *trails, float alpha);
+
+static void Terminate(Host_t *host, void *state) {
+  State_t *s = state;
+
+  Terminate_Batches(s);
+  Terminate_FlowParticles(s);
+  Terminate_Particles(s);
+  free(s);
+}
 
-    prevTime = timeNow;
+static void *Init(Host_t *host) {
+  State_t *s = calloc(1, sizeof(*s));
+  if (s == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate the sketch!\n");
+    return NULL;
   }
-
-  Terminate();
-  return 0;
+  if (!Init_Batches(s) || !Init_Particles(host, s) ||
+      !Init_FlowParticles(host, s) || !Init_Contrails(host, s)) {
+    Terminate(host, s);
+    return NULL;
+  }
+  return s;
 }
 
-static void Initialize() {
-  time_t t;
-  srand(time(&t));
-
-  if (!al_init()) {
-    fprintf(stderr, "ERROR: Failed to initialize allegro!\n");
-    goto init_fail;
-  }
+/*
+ * Draws one frame into the current target bitmap (the backbuffer, or the
+ * offscreen canvas in headless mode).
+ */
+static void Render(Host_t *host, void *state) {
+  State_t *s = state;
 
-  if (!al_init_primitives_addon()) {
-    fprintf(stderr, "ERROR: Failed to load primitives addon!\n");
-    goto prim_addon_fail;
-  }
+  al_clear_to_color(al_map_rgb(0x30, 0x34, 0x3f));
 
-  timer = al_create_timer(1.0 / FPS);
-  if (!timer) {
-    fprintf(stderr, "ERROR: Failed to create timer!\n");
-    goto timer_fail;
-  }
+  DrawParticles(s, s->Particles, Scheduler_Alpha(&host->Scheduler));
+#if 0
+  Raster_DrawLine(200, 400, 600, 400, al_map_rgb(0xff, 0x70, 0x3b),
+                  8 * (noise1(al_get_time()) + 1));
+#endif
+  LineMesh_Draw(s->ContrailMesh);
+  DrawFlow(host, s, s->FlowParticles, s->FlowTrails,
+           Scheduler_Alpha(&host->Scheduler));
+}
 
-  display = al_create_display(WIN_WIDTH_PX, WIN_HEIGHT_PX);
-  if (!display) {
-    fprintf(stderr, "ERROR: Failed to create display!\n");
-    goto disp_fail;
+static void *CreateSnapshot(Host_t *host, void *state) {
+  const State_t *s = state;
+  ContrailSnapshot_t *snap = calloc(1, sizeof(*snap));
+  if (snap == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate snapshot!\n");
+    return NULL;
   }
-
-  eq = al_create_event_queue();
-  if (!eq) {
-    fprintf(stderr, "ERROR: Failed to create event queue!\n");
-    goto eq_fail;
+  snap->Particles = malloc(s->NumParticles * sizeof(*snap->Particles));
+  snap->FlowPositions =
+      ParticleSoA_CreatePositions(s->FlowParticles->Count);
+  snap->FlowTrails = Trails_Create(s->FlowTrails->NumTrails,
+                                   s->FlowTrails->Length);
+  if (snap->Particles == NULL || snap->FlowPositions == NULL ||
+      snap->FlowTrails == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate snapshot!\n");
+    free(snap->Particles);
+    ParticleSoA_Destroy(snap->FlowPositions);
+    Trails_Destroy(snap->FlowTrails);
+    free(snap);
+    return NULL;
   }
+  return snap;
+}
 
-  al_register_event_source(eq, al_get_display_event_source(display));
-  al_register_event_source(eq, al_get_timer_event_source(timer));
-
-  al_set_window_title(display, "Contrails");
-  al_start_timer(timer);
-
-  return;
+static void DestroySnapshot(Host_t *host, void *state, void *data) {
+  ContrailSnapshot_t *snap = data;
 
-eq_fail:
-disp_fail:
-  al_destroy_timer(timer);
-timer_fail:
-prim_addon_fail:
-init_fail:
-  exit(1);
+  free(snap->Particles);
+  ParticleSoA_Destroy(snap->FlowPositions);
+  Trails_Destroy(snap->FlowTrails);
+  free(snap);
 }
 
-static void Terminate() {
-  al_destroy_event_queue(eq);
-  al_destroy_display(display);
-  al_destroy_timer(timer);
+/*
+ * Only the particles move; the contrails are drawn from their mesh.
+ */
+static void Snapshot(Host_t *host, void *state, void *data) {
+  const State_t *s = state;
+  ContrailSnapshot_t *snap = data;
+
+  memcpy(snap->Particles, s->Particles,
+         s->NumParticles * sizeof(*snap->Particles));
+  ParticleSoA_CopyPositions(snap->FlowPositions, s->FlowParticles,
+                            host->Pool);
+  Trails_CopySamples(snap->FlowTrails, s->FlowTrails, host->Pool);
 }
 
-static void Draw() {
-  if (redraw && al_is_event_queue_empty(eq)) {
-    redraw = false;
-    al_clear_to_color(al_map_rgb(0x30, 0x34, 0x3f));
-
-#if 0
-    for (int i = 0; i < NUM_PARTICLES; i++) {
-      Particle_Draw(&particles[i]);
-    }
-#endif
-#if 0
-    al_draw_line(200, 400, 600, 400, al_map_rgb(0xff, 0x70, 0x3b),
-                 8 * (noise1(al_get_time()) + 1));
-#endif
-#if 0
-    for (int i = 0; i < NUM_CONTRAILS; i++) {
-      Contrail_Draw(&contrails[i]);
-    }
-#endif
-
-    {
-      float xs = 400;
-      float xy = 400;
-      float len = 100;
-      float angle = M_PI / 128;
-      float base_len = 2 * len * tan(angle);
+static void RenderSnapshot(Host_t *host, void *state,
+                           const Snapshot_t *snapshot) {
+  State_t *s = state;
+  const ContrailSnapshot_t *snap = snapshot->Data;
 
-      al_draw_triangle(xs - base_len / 2, xy, xs + base_len / 2, xy, xs,
-                       xy - len, al_map_rgb(0x70, 0x70, 0x70), 1);
-    }
-    al_flip_display();
-  }
+  al_clear_to_color(al_map_rgb(0x30, 0x34, 0x3f));
+  DrawParticles(s, snap->Particles, snapshot->Alpha);
+  LineMesh_Draw(s->ContrailMesh);
+  DrawFlow(host, s, snap->FlowPositions, snap->FlowTrails, snapshot->Alpha);
 }
 
-static void ProcessInput(ALLEGRO_EVENT *ev) {}
-
-static void Update(double dt, ALLEGRO_EVENT *ev) {
-  static double updateTimer = 0.0;
-  if (ev->type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
-    doexit = true;
-    return;
-  } else if (ev->type == ALLEGRO_EVENT_TIMER) {
-    redraw = true;
-  }
-
-  for (int i = 0; i < NUM_PARTICLES; i++) {
-    Particle_Update(&particles[i], dt);
+/*
+ * Thread pool body. Particles that respawn cost more than the ones that just
+ * move, which the pool evens out by work stealing.
+ */
+static void UpdateParticles(void *ctx, size_t begin, size_t end,
+                            unsigned int worker) {
+  const UpdateCtx_t *c = ctx;
+  for (size_t i = begin; i < end; i++) {
+    Particle_Update(&c->State->Particles[i], c->Dt, c->Rng,
+                    c->State->Radius);
   }
 }
 
-static bool IsRunning() { return !doexit; }
-
-void Particle_Update(struct Particle *p, double dt) {
-  p->lerp_time += dt;
-  if (p->lerp_time > p->lerp_duration) {
-    p->x = p->src_x;
-    p->y = p->src_y;
-    Particle_SetRandomVelocity(p);
-  } else {
-    p->x = Lerp(p->src_x, p->dst_x, EaseOut(p->lerp_time / p->lerp_duration));
-    p->y = Lerp(p->src_y, p->dst_y, EaseOut(p->lerp_time / p->lerp_duration));
+/*
+ * Thread pool body for the flow particles. Advection is a grid lookup, so
+ * chunks cost about the same; the ones that drifted off the canvas come back
+ * at a random spot, without a trail.
+ */
+static void UpdateFlowParticles(void *ctx, size_t begin, size_t end,
+                                unsigned int worker) {
+  const UpdateCtx_t *c = ctx;
+  State_t *s = c->State;
+  ParticleSoA_t *ps = s->FlowParticles;
+
+  FlowField_Advect(s->Flow, ps, begin, end, c->Dt);
+  for (size_t i = begin; i < end; i++) {
+    if (ps->x[i] < 0 || ps->x[i] >= WIN_WIDTH_PX || ps->y[i] < 0 ||
+        ps->y[i] >= WIN_HEIGHT_PX) {
+      ps->x[i] = ps->prev_x[i] =
+          WIN_WIDTH_PX * Rng_Uniform(c->Rng, RNG_STREAM_FLOW_X, s->FlowStep, i);
+      ps->y[i] = ps->prev_y[i] =
+          WIN_HEIGHT_PX *
+          Rng_Uniform(c->Rng, RNG_STREAM_FLOW_Y, s->FlowStep, i);
+      Trails_Reset(s->FlowTrails, i, ps->x[i], ps->y[i]);
+    }
   }
 }
 
-void Particle_Draw(struct Particle *p) {
-  al_draw_line(p->src_x, p->src_y, p->x, p->y, p->color, 1);
+/*
+ * The field only changes once per frame; the steps in between all sample the
+ * same blend of slices.
+ */
+static void BeginFrame(Host_t *host, void *state) {
+  State_t *s = state;
+  FlowField_SetTime(s->Flow,
+                    host->Scheduler.TotalSteps * host->Scheduler.Step);
+}
 
-  // Draw the head of the line (the actual particle) centered at (p->x, p->y)
-  al_draw_filled_rectangle(p->x - p->size / 2, p->y - p->size / 2,
-                           p->x + p->size / 2, p->y + p->size / 2, p->color);
+static void Update(Host_t *host, void *state, double dt) {
+  State_t *s = state;
+  UpdateCtx_t ctx = {s, &host->Rng, dt};
+
+  ThreadPool_ParallelFor(host->Pool, s->NumParticles, UPDATE_GRAIN,
+                         UpdateParticles, &ctx);
+  ThreadPool_ParallelFor(host->Pool, s->FlowParticles->Count, UPDATE_GRAIN,
+                         UpdateFlowParticles, &ctx);
+  Trails_Push(s->FlowTrails, host->Pool, s->FlowParticles->x,
+              s->FlowParticles->y);
+  s->FlowStep++;
 }
 
-void Init_Particles(void) {
-  for (int i = 0; i < NUM_PARTICLES; i++) {
-    particles[i].size = 5;
-    particles[i].color = al_map_rgb(0xff, rand() % 0xff, 0x38);
-    particles[i].src_x = CENTER_X_PX;
-    particles[i].src_y = CENTER_Y_PX;
-    particles[i].x = CENTER_X_PX;
-    particles[i].y = CENTER_Y_PX;
-    Particle_SetRandomVelocity(&particles[i]);
+/*
+ * Draws the flow particles at positions, alpha of the way through the last
+ * step, with their trails, and what goes on top of them.
+ */
+static void DrawFlow(Host_t *host, State_t *s, const ParticleSoA_t *positions,
+                     Trails_t *trails, float alpha) {
+  ParticleSoA_Interpolate(positions, host->RenderPool, alpha, s->FlowDrawX,
+                          s->FlowDrawY);
+  Trails_Draw(trails, host->RenderPool, s->FlowDrawX, s->FlowDrawY,
+              s->FlowColors, s->FlowPalette);
+  PrimBatch_DrawSquares(s->QuadBatch, s->FlowDrawX, s->FlowDrawY,
+                        s->FlowColors, s->FlowPalette, positions->Count, 2);
+
+  {
+    float xs = 400;
+    float xy = 400;
+    float len = 100;
+    float angle = M_PI / 128;
+    float base_len = 2 * len * tan(angle);
+
+    Raster_DrawTriangle(xs - base_len / 2, xy, xs + base_len / 2, xy, xs,
+                        xy - len, al_map_rgb(0x70, 0x70, 0x70), 1);
   }
 }
 
-void Particle_SetRandomVelocity(struct Particle *p) {
-  p->vel_mag = 50.0 + ((float)rand() / RAND_MAX) * 100.0;
-  p->vel_angle = ((float)rand() / RAND_MAX) * 2.0 * M_PI;
-  p->vel_x = cos(p->vel_angle) * p->vel_mag;
-  p->vel_y = sin(p->vel_angle) * p->vel_mag;
-  p->dst_x = p->src_x + cos(p->vel_angle) * RADIUS_PX;
-  p->dst_y = p->src_y + sin(p->vel_angle) * RADIUS_PX;
-  p->lerp_duration = sqrtf((p->dst_x - p->src_x) * (p->dst_x - p->src_x) +
-                           (p->dst_y - p->src_y) * (p->dst_y - p->src_y)) /
-                     p->vel_mag;
-  p->lerp_time = 0.0;
+/*
+ * @note must be called between PrimBatch_Begin() and PrimBatch_End() on both
+ * s->LineBatch and s->QuadBatch.
+ */
+static void Particle_Draw(State_t *s, const struct Particle *p, float alpha) {
+  const ALLEGRO_COLOR color = s->Palette[p->color];
+  float x, y;
+
+  Particle_Position(p, CENTER_X_PX, CENTER_Y_PX, s->Radius, alpha, &x, &y);
+  PrimBatch_AddLine(s->LineBatch, CENTER_X_PX, CENTER_Y_PX, x, y, color);
+
+  // Draw the head of the line (the actual particle) centered at (x, y)
+  PrimBatch_AddQuad(s->QuadBatch, x - PARTICLE_SIZE_PX / 2,
+                    y - PARTICLE_SIZE_PX / 2, x + PARTICLE_SIZE_PX / 2,
+                    y + PARTICLE_SIZE_PX / 2, color);
 }
 
-float Lerp(float start, float end, float percent) {
-  return (start + (end - start) * percent);
+/*
+ * Draws the s->NumParticles contrail particles, alpha of the way through the
+ * last step, as one line batch and one quad batch.
+ */
+static void DrawParticles(State_t *s, const struct Particle *particles,
+                          float alpha) {
+  PrimBatch_Begin(s->LineBatch);
+  PrimBatch_Begin(s->QuadBatch);
+  for (size_t i = 0; i < s->NumParticles; i++) {
+    Particle_Draw(s, &particles[i], alpha);
+  }
+  PrimBatch_End(s->LineBatch);
+  PrimBatch_End(s->QuadBatch);
 }
 
-float EaseOut(float t) { return (1 - (1 - t) * (1 - t)); }
+static bool Init_Particles(Host_t *host, State_t *s) {
+  Params_t *params = &host->Options.Params;
+
+  s->NumParticles =
+      Params_GetUInt(params, "particles", NUM_PARTICLES, 1, UINT_MAX);
+  s->Radius = Params_Get(params, "radius", RADIUS_PX, 1.0, WIN_WIDTH_PX);
+  s->Particles = calloc(s->NumParticles, sizeof(*s->Particles));
+  if (s->Particles == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate %zu particles!\n",
+            s->NumParticles);
+    return false;
+  }
 
-void Line_BreakIntoSegs(struct Line *sl, struct Line *segs,
-                        unsigned int num_segs) {
-  float len_x = (sl->dst_x - sl->src_x) / num_segs;
-  float len_y = (sl->dst_y - sl->src_y) / num_segs;
+  for (int g = 0; g < 0x100; g++) {
+    s->Palette[g] = al_map_rgb(0xff, g, 0x38);
+  }
+  for (size_t i = 0; i < s->NumParticles; i++) {
+    struct Particle *p = &s->Particles[i];
 
-  for (int i = 0; i < num_segs; i++) {
-    segs[i].src_x = sl->src_x + i * len_x;
-    segs[i].src_y = sl->src_y + i * len_y;
-    segs[i].dst_x = sl->src_x + (i + 1) * len_x;
-    segs[i].dst_y = sl->src_y + (i + 1) * len_y;
+    p->id = i;
+    p->color = Rng_U32(&host->Rng, RNG_STREAM_COLOR, 0, i) % 0xff;
+    Particle_SetRandomVelocity(p, &host->Rng);
   }
+  return true;
 }
-void AddNoiseToLineSegs(struct Line *segs, unsigned int num_segs) {
-  if (num_segs == 0) {
-    return;
+
+static void Terminate_Particles(State_t *s) { free(s->Particles); }
+
+static bool Init_FlowParticles(Host_t *host, State_t *s) {
+  Params_t *p = &host->Options.Params;
+  const FlowFieldParams_t params = {
+      .Width = FLOW_GRID_CELLS,
+      .Height = FLOW_GRID_CELLS,
+      .CellSize = (float)WIN_WIDTH_PX / FLOW_GRID_CELLS,
+      .NoiseScale = 1.0f / 200,
+      .TimeScale = 0.1f,
+      .SliceTime = 0.5f,
+      .Speed = Params_Get(p, "flow_speed", FLOW_SPEED, 0.0, 1e4),
+  };
+  size_t count = Params_GetUInt(p, "flow_particles",
+                                NUM_FLOW_PARTICLES, 1, UINT_MAX);
+  // --particles only resizes these; the contrail particles keep theirs.
+  if (host->Options.NumParticles) {
+    count = host->Options.NumParticles;
   }
 
-  // maximum amount of noise is proportional to the length of a line segment
-  float seg_len =
-      sqrt((segs[0].dst_x - segs[0].src_x) * (segs[0].dst_x - segs[0].src_x) +
-           (segs[0].dst_y - segs[0].src_y) * (segs[0].dst_y - segs[0].src_y));
-  float max_noise_mult = 1.0;
-  float max_noise;
-  float dx;
-  float dy;
-  for (int i = 1; i < num_segs; i++) {
-    max_noise =
-        seg_len * Lerp(1.0, 0.0, EaseOut(((float)i - 1.0) / (float)num_segs));
-    dx = max_noise / 2 - max_noise * (float)rand() / (float)RAND_MAX;
-    dy = max_noise / 2 - max_noise * (float)rand() / (float)RAND_MAX;
-    segs[i].src_x += dx;
-    segs[i].src_y += dy;
-    segs[i - 1].dst_x = segs[i].src_x;
-    segs[i - 1].dst_y = segs[i].src_y;
+  s->Flow = FlowField_Create(&params);
+  s->FlowParticles = ParticleSoA_Create(count);
+  s->FlowDrawX = ParticleSoA_AllocArray(count);
+  s->FlowDrawY = ParticleSoA_AllocArray(count);
+  s->FlowColors = malloc(count * sizeof(*s->FlowColors));
+  s->FlowTrails = Trails_Create(count, FLOW_TRAIL_SAMPLES);
+  if (!s->Flow || !s->FlowParticles || !s->FlowDrawX || !s->FlowDrawY ||
+      !s->FlowColors || !s->FlowTrails) {
+    fprintf(stderr, "ERROR: Failed to create the flow field!\n");
+    return false;
   }
+
+  for (int i = 0; i < FLOW_PALETTE_SIZE; i++) {
+    s->FlowPalette[i] = al_map_rgb(0x5e, 0xb0 - i, 0xc5);
+  }
+  ParticleSoA_t *ps = s->FlowParticles;
+  for (size_t i = 0; i < count; i++) {
+    ps->x[i] = ps->prev_x[i] =
+        WIN_WIDTH_PX * Rng_Uniform(&host->Rng, RNG_STREAM_FLOW_X, 0, i);
+    ps->y[i] = ps->prev_y[i] =
+        WIN_HEIGHT_PX * Rng_Uniform(&host->Rng, RNG_STREAM_FLOW_Y, 0, i);
+    ps->origin_x[i] = ps->x[i];
+    ps->origin_y[i] = ps->y[i];
+    s->FlowColors[i] =
+        Rng_U32(&host->Rng, RNG_STREAM_COLOR, 1, i) % FLOW_PALETTE_SIZE;
+    Trails_Reset(s->FlowTrails, i, ps->x[i], ps->y[i]);
+  }
+  s->FlowStep = 1;
+  return true;
 }
 
-void Init_Contrails(void) {
+static void Terminate_FlowParticles(State_t *s) {
+  FlowField_Destroy(s->Flow);
+  Trails_Destroy(s->FlowTrails);
+  ParticleSoA_Destroy(s->FlowParticles);
+  free(s->FlowDrawX);
+  free(s->FlowDrawY);
+  free(s->FlowColors);
+}
+
+static bool Init_Contrails(Host_t *host, State_t *s) {
+  const ALLEGRO_COLOR segColor = al_map_rgb(0xff, 0xff, 0x38);
+  const unsigned int num_segs = Params_GetUInt(
+      &host->Options.Params, "line_segs", NUM_LINE_SEGS, 1, MAX_LINE_SEGS);
+
   for (int i = 0; i < NUM_CONTRAILS; i++) {
-    contrails[i].main_line.color = al_map_rgb(0x80, 0x80, 0x80);
+    struct Contrail *c = &s->Contrails[i];
+
+    c->main_line.color = al_map_rgb(0x80, 0x80, 0x80);
     if (i == 0) {
-      contrails[i].main_line.src_x = 200;
-      contrails[i].main_line.src_y = 400;
-      contrails[i].main_line.dst_x = 600;
-      contrails[i].main_line.dst_y = 400;
+      c->main_line.src_x = 200;
+      c->main_line.src_y = 400;
+      c->main_line.dst_x = 600;
+      c->main_line.dst_y = 400;
     } else {
-      contrails[i].main_line.src_x = 600;
-      contrails[i].main_line.src_y = 500;
-      contrails[i].main_line.dst_x = 200;
-      contrails[i].main_line.dst_y = 700;
+      c->main_line.src_x = 600;
+      c->main_line.src_y = 500;
+      c->main_line.dst_x = 200;
+      c->main_line.dst_y = 700;
+    }
+    c->num_segs = num_segs;
+    Line_BreakIntoSegs(&c->main_line, c->line_segs, num_segs);
+    AddNoiseToLineSegs(c->line_segs, num_segs, &host->Rng, i);
+    for (unsigned int j = 0; j < num_segs; j++) {
+      c->line_segs[j].color = segColor;
     }
-    Line_BreakIntoSegs(&contrails[i].main_line, contrails[i].line_segs,
-                       NUM_LINE_SEGS);
-    AddNoiseToLineSegs(contrails[i].line_segs, NUM_LINE_SEGS);
   }
+
+  s->ContrailMesh = LineMesh_Create();
+  if (s->ContrailMesh == NULL) {
+    fprintf(stderr, "ERROR: Failed to create contrail mesh!\n");
+    return false;
+  }
+  LineMesh_Begin(s->ContrailMesh);
+  for (int i = 0; i < NUM_CONTRAILS; i++) {
+    Contrail_AddToMesh(s->ContrailMesh, &s->Contrails[i]);
+  }
+  LineMesh_End(s->ContrailMesh);
+  return true;
 }
 
-void Contrail_Draw(struct Contrail *c) {
-  al_draw_line(c->main_line.src_x, c->main_line.src_y, c->main_line.dst_x,
-               c->main_line.dst_y, c->main_line.color, 1.0);
-  for (int i = 0; i < NUM_LINE_SEGS; i++) {
-    al_draw_line(c->line_segs[i].src_x, c->line_segs[i].src_y,
-                 c->line_segs[i].dst_x, c->line_segs[i].dst_y,
-                 al_map_rgb(0xff, 0xff, 0x38), 1.0);
+/*
+ * @note must be called between LineMesh_Begin() and LineMesh_End() on mesh.
+ */
+static void Contrail_AddToMesh(LineMesh_t *mesh, struct Contrail *c) {
+  LineMesh_AddLine(mesh, c->main_line.src_x, c->main_line.src_y,
+                   c->main_line.dst_x, c->main_line.dst_y, c->main_line.color,
+                   0);
+  for (unsigned int i = 0; i < c->num_segs; i++) {
+    LineMesh_AddLine(mesh, c->line_segs[i].src_x, c->line_segs[i].src_y,
+                     c->line_segs[i].dst_x, c->line_segs[i].dst_y,
+                     c->line_segs[i].color, 0);
   }
 }
+
+static bool Init_Batches(State_t *s) {
+  s->LineBatch = PrimBatch_Create(PRIM_BATCH_LINES);
+  s->QuadBatch = PrimBatch_Create(PRIM_BATCH_QUADS);
+  if (s->LineBatch == NULL || s->QuadBatch == NULL) {
+    fprintf(stderr, "ERROR: Failed to create draw batches!\n");
+    return false;
+  }
+  return true;
+}
+
+static void Terminate_Batches(State_t *s) {
+  LineMesh_Destroy(s->ContrailMesh);
+  PrimBatch_Destroy(s->LineBatch);
+  PrimBatch_Destroy(s->QuadBatch);
+}
+
+static const Sketch_t sketch = {
+    .ApiVersion = SKETCH_API_VERSION,
+    .Title = "Contrails",
+    .Width = WIN_WIDTH_PX,
+    .Height = WIN_HEIGHT_PX,
+    .Fps = FPS,
+    .StateSize = sizeof(State_t),
+    .Init = Init,
+    .Terminate = Terminate,
+    .BeginFrame = BeginFrame,
+    .Update = Update,
+    .Render = Render,
+    .CreateSnapshot = CreateSnapshot,
+    .DestroySnapshot = DestroySnapshot,
+    .Snapshot = Snapshot,
+    .RenderSnapshot = RenderSnapshot,
+};
+
+SKETCH_DEFINE(sketch)
@@ -0,0 +1,95 @@
+#include "contrail_sim.h"
+#include <math.h>
+
+#define VEL_MAG_ONE (256.0f)                // vel_mag of 1 px/s
+#define VEL_ANGLE_ONE (65536 / (2 * M_PI))  // vel_angle of 1 rad
+
+// Seconds p takes to travel radius pixels from its source
+static float LerpDuration(const struct Particle *p, float radius) {
+  return radius / (p->vel_mag / VEL_MAG_ONE);
+}
+
+void Particle_Update(struct Particle *p, double dt, const Rng_t *rng,
+                     float radius) {
+  p->prev_lerp_time = p->lerp_time;
+  p->lerp_time += dt;
+  if (p->lerp_time > LerpDuration(p, radius)) {
+    p->generation++;
+    Particle_SetRandomVelocity(p, rng);
+  }
+}
+
+/*
+ * Draws from the particle's own (id, generation) counters, so it is safe to
+ * call from any worker and gives the same result regardless of update order.
+ * Speeds are 50 to 150 px/s, well inside vel_mag's range.
+ */
+void Particle_SetRandomVelocity(struct Particle *p, const Rng_t *rng) {
+  const float u_mag =
+      Rng_Uniform(rng, RNG_STREAM_VEL_MAG, p->generation, p->id);
+  const float u_angle =
+      Rng_Uniform(rng, RNG_STREAM_VEL_ANGLE, p->generation, p->id);
+
+  p->vel_mag = lrintf((50.0f + u_mag * 100.0f) * VEL_MAG_ONE);
+  p->vel_angle = (uint32_t)(u_angle * 65536.0f);
+  p->lerp_time = p->prev_lerp_time = 0.0f;
+}
+
+void Particle_Position(const struct Particle *p, float src_x, float src_y,
+                       float radius, float alpha, float *x, float *y) {
+  const float angle = p->vel_angle / VEL_ANGLE_ONE;
+  const float t = Lerp(p->prev_lerp_time, p->lerp_time, alpha);
+  const float d = radius * EaseOut(t / LerpDuration(p, radius));
+
+  *x = src_x + cosf(angle) * d;
+  *y = src_y + sinf(angle) * d;
+}
+
+float Lerp(float start, float end, float percent) {
+  return (start + (end - start) * percent);
+}
+
+float EaseOut(float t) { return (1 - (1 - t) * (1 - t)); }
+
+void Line_BreakIntoSegs(struct Line *sl, struct Line *segs,
+                        unsigned int num_segs) {
+  float len_x = (sl->dst_x - sl->src_x) / num_segs;
+  float len_y = (sl->dst_y - sl->src_y) / num_segs;
+
+  for (int i = 0; i < num_segs; i++) {
+    segs[i].src_x = sl->src_x + i * len_x;
+    segs[i].src_y = sl->src_y + i * len_y;
+    segs[i].dst_x = sl->src_x + (i + 1) * len_x;
+    segs[i].dst_y = sl->src_y + (i + 1) * len_y;
+  }
+}
+
+void AddNoiseToLineSegs(struct Line *segs, unsigned int num_segs,
+                        const Rng_t *rng, unsigned int line_id) {
+  if (num_segs == 0) {
+    return;
+  }
+
+  // maximum amount of noise is proportional to the length of a line segment
+  float seg_len =
+      sqrt((segs[0].dst_x - segs[0].src_x) * (segs[0].dst_x - segs[0].src_x) +
+           (segs[0].dst_y - segs[0].src_y) * (segs[0].dst_y - segs[0].src_y));
+  float max_noise_mult = 1.0;
+  float max_noise;
+  float dx;
+  float dy;
+  float u_x;
+  float u_y;
+  for (int i = 1; i < num_segs; i++) {
+    max_noise =
+        seg_len * Lerp(1.0, 0.0, EaseOut(((float)i - 1.0) / (float)num_segs));
+    u_x = Rng_Uniform(rng, RNG_STREAM_SEG_NOISE, line_id, 2 * i);
+    u_y = Rng_Uniform(rng, RNG_STREAM_SEG_NOISE, line_id, 2 * i + 1);
+    dx = max_noise / 2 - max_noise * u_x;
+    dy = max_noise / 2 - max_noise * u_y;
+    segs[i].src_x += dx;
+    segs[i].src_y += dy;
+    segs[i - 1].dst_x = segs[i].src_x;
+    segs[i - 1].dst_y = segs[i].src_y;
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef CONTRAIL_SIM_H
+#define CONTRAIL_SIM_H
+
+#include <allegro5/allegro5.h>
+#include <stdint.h>
+#include "rng.h"
+
+/*
+ * Simulation side of the contrail sketch: particles that ease out from a
+ * source point and respawn, and noisy line segments. Nothing here draws, so
+ * it can be driven by the sketch and by the benchmarks alike.
+ */
+/*
+ * A particle only keeps what cannot be derived: how far along it is and the
+ * velocity it drew. Where it is follows from those and the source and
+ * radius every particle of a sketch shares, see Particle_Position(), and
+ * its color is an index into the sketch's palette. 24 bytes rather than
+ * the 84 of a particle with its positions, destination, duration and color
+ * stored.
+ */
+struct Particle {
+  float lerp_time;       // seconds the particle has been traveling from src
+  float prev_lerp_time;  // before the last update, for interpolation
+  uint32_t id;           // random stream index, fixed for the particle
+  uint32_t generation;   // bumped on every respawn
+  uint16_t vel_mag;      // px/s, 8.8 fixed point
+  uint16_t vel_angle;    // 2 pi / 65536 rad
+  uint8_t color;         // palette index
+};
+
+// What each random number is for, one counter stream per use
+enum {
+  RNG_STREAM_COLOR,
+  RNG_STREAM_VEL_MAG,
+  RNG_STREAM_VEL_ANGLE,
+  RNG_STREAM_SEG_NOISE,
+  RNG_STREAM_FLOW_X,
+  RNG_STREAM_FLOW_Y,
+};
+
+struct Line {
+  ALLEGRO_COLOR color;
+  float src_x;
+  float src_y;
+  float dst_x;
+  float dst_y;
+};
+
+#define NUM_LINE_SEGS (16)
+
+/*
+ * Advances p by dt, respawning it at its source with a new random velocity
+ * once it has travelled radius pixels.
+ */
+void Particle_Update(struct Particle *p, double dt, const Rng_t *rng,
+                     float radius);
+void Particle_SetRandomVelocity(struct Particle *p, const Rng_t *rng);
+
+/*
+ * Where p is alpha of the way through its last update, easing out from
+ * (src_x, src_y) towards the point radius pixels away in its direction.
+ */
+void Particle_Position(const struct Particle *p, float src_x, float src_y,
+                       float radius, float alpha, float *x, float *y);
+
+void Line_BreakIntoSegs(struct Line *sl, struct Line *segs,
+                        unsigned int num_segs);
+void AddNoiseToLineSegs(struct Line *segs, unsigned int num_segs,
+                        const Rng_t *rng, unsigned int line_id);
+
+float Lerp(float start, float end, float percent);
+float EaseOut(float t);
+
+#endif  // CONTRAIL_SIM_H
@@ -0,0 +1,115 @@
+#include "damage.h"
+#include <allegro5/allegro5.h>
+#include <math.h>
+
+// Past this share of the frame, one full redraw is cheaper than many clipped
+// ones.
+#define DAMAGE_FULL_FRACTION (0.5f)
+
+void Damage_Init(Damage_t *d, int width, int height) {
+  d->Width = width;
+  d->Height = height;
+  d->NumRects = 0;
+  d->Full = true;
+}
+
+void Damage_AddAll(Damage_t *d) {
+  d->Full = true;
+  d->NumRects = 0;
+}
+
+bool Damage_IsEmpty(const Damage_t *d) {
+  return !d->Full && d->NumRects == 0;
+}
+
+static int Min(int a, int b) { return a < b ? a : b; }
+static int Max(int a, int b) { return a > b ? a : b; }
+
+static long Area(const DamageRect_t *r) {
+  return (long)(r->X1 - r->X0) * (r->Y1 - r->Y0);
+}
+
+static DamageRect_t Union(const DamageRect_t *a, const DamageRect_t *b) {
+  DamageRect_t u = {Min(a->X0, b->X0), Min(a->Y0, b->Y0), Max(a->X1, b->X1),
+                    Max(a->Y1, b->Y1)};
+  return u;
+}
+
+static bool Touch(const DamageRect_t *a, const DamageRect_t *b) {
+  return a->X0 <= b->X1 && b->X0 <= a->X1 && a->Y0 <= b->Y1 &&
+         b->Y0 <= a->Y1;
+}
+
+void Damage_AddRect(Damage_t *d, float x0, float y0, float x1, float y1) {
+  if (d->Full) {
+    return;
+  }
+  DamageRect_t r = {Max((int)floorf(fminf(x0, x1)) - 1, 0),
+                    Max((int)floorf(fminf(y0, y1)) - 1, 0),
+                    Min((int)ceilf(fmaxf(x0, x1)) + 1, d->Width),
+                    Min((int)ceilf(fmaxf(y0, y1)) + 1, d->Height)};
+  if (r.X0 >= r.X1 || r.Y0 >= r.Y1) {
+    return;  // off screen
+  }
+
+  // Swallow every rectangle the new one touches. Each merge can make it
+  // touch ones it missed before, so repeat until nothing changes.
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    for (unsigned int i = 0; i < d->NumRects; i++) {
+      if (Touch(&r, &d->Rects[i])) {
+        r = Union(&r, &d->Rects[i]);
+        d->Rects[i] = d->Rects[--d->NumRects];
+        merged = true;
+        break;
+      }
+    }
+  }
+
+  if (d->NumRects == DAMAGE_MAX_RECTS) {
+    // Out of slots: grow whichever rectangle grows least by taking it in.
+    unsigned int best = 0;
+    long best_growth = -1;
+    for (unsigned int i = 0; i < d->NumRects; i++) {
+      const DamageRect_t u = Union(&r, &d->Rects[i]);
+      const long growth = Area(&u) - Area(&d->Rects[i]);
+      if (best_growth < 0 || growth < best_growth) {
+        best = i;
+        best_growth = growth;
+      }
+    }
+    r = Union(&r, &d->Rects[best]);
+    d->Rects[best] = d->Rects[--d->NumRects];
+  }
+  d->Rects[d->NumRects++] = r;
+
+  long area = 0;
+  for (unsigned int i = 0; i < d->NumRects; i++) {
+    area += Area(&d->Rects[i]);
+  }
+  if (area > DAMAGE_FULL_FRACTION * d->Width * d->Height) {
+    Damage_AddAll(d);
+  }
+}
+
+bool Damage_Redraw(Damage_t *d, void (*draw)(void *ctx), void *ctx) {
+  if (Damage_IsEmpty(d)) {
+    return false;
+  }
+  if (d->Full) {
+    draw(ctx);
+  } else {
+    int cx, cy, cw, ch;
+    al_get_clipping_rectangle(&cx, &cy, &cw, &ch);
+    for (unsigned int i = 0; i < d->NumRects; i++) {
+      const DamageRect_t *r = &d->Rects[i];
+      al_set_clipping_rectangle(r->X0, r->Y0, r->X1 - r->X0, r->Y1 - r->Y0);
+      draw(ctx);
+    }
+    al_set_clipping_rectangle(cx, cy, cw, ch);
+  }
+  d->Full = false;
+  d->NumRects = 0;
+  return true;
+}
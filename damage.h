@@ -0,0 +1,55 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <stdbool.h>
+
+/*
+ * Tracks which parts of a frame changed since it was last drawn. Changes are
+ * recorded as rectangles in target pixels; overlapping ones are merged, and
+ * when there are too many, or they cover most of the frame, the whole frame
+ * is marked instead.
+ *
+ * Redrawing only the damaged parts needs a target that keeps its contents
+ * between frames, such as an offscreen canvas that is blitted to the
+ * backbuffer. A backbuffer's contents are undefined after a flip.
+ */
+#define DAMAGE_MAX_RECTS (16)
+
+typedef struct {
+  int X0;  // inclusive
+  int Y0;
+  int X1;  // exclusive
+  int Y1;
+} DamageRect_t;
+
+typedef struct {
+  int Width;
+  int Height;
+  bool Full;  // everything is damaged, Rects is unused
+  unsigned int NumRects;
+  DamageRect_t Rects[DAMAGE_MAX_RECTS];
+} Damage_t;
+
+/*
+ * Starts out with the whole frame damaged, so the first frame is drawn.
+ */
+void Damage_Init(Damage_t *d, int width, int height);
+
+/*
+ * Marks [x0, x1) x [y0, y1) as changed. Coordinates are rounded outwards
+ * and padded by a pixel to cover antialiased edges.
+ */
+void Damage_AddRect(Damage_t *d, float x0, float y0, float x1, float y1);
+void Damage_AddAll(Damage_t *d);
+
+bool Damage_IsEmpty(const Damage_t *d);
+
+/*
+ * Calls draw(ctx) once for each damaged rectangle with the current target's
+ * clipping rectangle set to it, so draw can redraw the whole scene and only
+ * pixels in the rectangle are touched. Clears the damage afterwards. Returns
+ * false, without calling draw, when nothing was damaged.
+ */
+bool Damage_Redraw(Damage_t *d, void (*draw)(void *ctx), void *ctx);
+
+#endif  // DAMAGE_H
@@ -0,0 +1,231 @@
+#include "density.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LUT_SIZE (1024)
+#define SPLAT_GRAIN (65536)  // particles per thread pool chunk
+#define ROW_GRAIN (16)       // rows per thread pool chunk when resolving
+
+// Background of the sketches, then https://coolors.co/5eb0c5-fff275-ff8c42-
+// ff3c38-a23e48 ordered from cool to hot.
+static const uint32_t defaultPalette[] = {0x30343f, 0x5eb0c5, 0xa23e48,
+                                          0xff3c38, 0xff8c42, 0xfff275};
+
+struct Density {
+  int Width;
+  int Height;
+  unsigned int NumWorkers;
+  float **Buffers;  // one frame per worker
+  float *Merged;
+  // Per row statistics of the merged frame, so bands never share them
+  float *RowMax;
+  double *RowSum;
+  unsigned int *RowCovered;
+  uint8_t Lut[LUT_SIZE][4];  // RGBA, in memory order
+};
+
+Density_t *Density_Create(int width, int height, ThreadPool_t *pool) {
+  Density_t *d = calloc(1, sizeof(*d));
+  if (d == NULL) {
+    return NULL;
+  }
+  const size_t num_pixels = (size_t)width * height;
+  d->Width = width;
+  d->Height = height;
+  d->NumWorkers = ThreadPool_NumThreads(pool);
+  d->Buffers = calloc(d->NumWorkers, sizeof(*d->Buffers));
+  d->Merged = malloc(num_pixels * sizeof(float));
+  d->RowMax = malloc(height * sizeof(*d->RowMax));
+  d->RowSum = malloc(height * sizeof(*d->RowSum));
+  d->RowCovered = malloc(height * sizeof(*d->RowCovered));
+  if (!d->Buffers || !d->Merged || !d->RowMax || !d->RowSum ||
+      !d->RowCovered) {
+    Density_Destroy(d);
+    return NULL;
+  }
+  for (unsigned int w = 0; w < d->NumWorkers; w++) {
+    d->Buffers[w] = calloc(num_pixels, sizeof(float));
+    if (d->Buffers[w] == NULL) {
+      Density_Destroy(d);
+      return NULL;
+    }
+  }
+
+  Density_SetPalette(d, defaultPalette,
+                     sizeof(defaultPalette) / sizeof(defaultPalette[0]));
+  return d;
+}
+
+void Density_Destroy(Density_t *d) {
+  if (d == NULL) {
+    return;
+  }
+  for (unsigned int w = 0; d->Buffers && w < d->NumWorkers; w++) {
+    free(d->Buffers[w]);
+  }
+  free(d->Buffers);
+  free(d->Merged);
+  free(d->RowMax);
+  free(d->RowSum);
+  free(d->RowCovered);
+  free(d);
+}
+
+void Density_SetPalette(Density_t *d, const uint32_t *rgb,
+                        unsigned int count) {
+  for (int i = 0; i < LUT_SIZE; i++) {
+    // Position between the two stops around entry i
+    const float pos = (float)i / (LUT_SIZE - 1) * (count - 1);
+    const unsigned int s = (pos >= count - 1) ? count - 2 : (unsigned int)pos;
+    const float f = pos - s;
+    for (int c = 0; c < 3; c++) {
+      const int shift = 16 - 8 * c;
+      const float a = (rgb[s] >> shift) & 0xff;
+      const float b = (rgb[s + 1] >> shift) & 0xff;
+      d->Lut[i][c] = (uint8_t)(a + (b - a) * f + 0.5f);
+    }
+    d->Lut[i][3] = 0xff;
+  }
+}
+
+typedef struct {
+  Density_t *Density;
+  const float *X;
+  const float *Y;
+} SplatCtx_t;
+
+static void SplatRange(void *ctx, size_t begin, size_t end,
+                       unsigned int worker) {
+  const SplatCtx_t *c = ctx;
+  const Density_t *d = c->Density;
+  float *buf = d->Buffers[worker];
+
+  for (size_t i = begin; i < end; i++) {
+    // Truncation rounds -0.5 to 0, so test the float before converting.
+    const float x = c->X[i];
+    const float y = c->Y[i];
+    if (x >= 0 && y >= 0 && x < d->Width && y < d->Height) {
+      buf[(size_t)y * d->Width + (size_t)x] += 1.0f;
+    }
+  }
+}
+
+void Density_Splat(Density_t *d, ThreadPool_t *pool, const float *x,
+                   const float *y, size_t count) {
+  SplatCtx_t ctx = {d, x, y};
+  ThreadPool_ParallelFor(pool, count, SPLAT_GRAIN, SplatRange, &ctx);
+}
+
+static void MergeRows(void *ctx, size_t begin, size_t end,
+                      unsigned int worker) {
+  Density_t *d = ctx;
+  const size_t w = d->Width;
+
+  for (size_t row = begin; row < end; row++) {
+    float *out = &d->Merged[row * w];
+    memcpy(out, &d->Buffers[0][row * w], w * sizeof(float));
+    memset(&d->Buffers[0][row * w], 0, w * sizeof(float));
+    for (unsigned int k = 1; k < d->NumWorkers; k++) {
+      float *in = &d->Buffers[k][row * w];
+      for (size_t i = 0; i < w; i++) {
+        out[i] += in[i];
+      }
+      memset(in, 0, w * sizeof(float));
+    }
+
+    float max = 0;
+    double sum = 0;
+    unsigned int covered = 0;
+    for (size_t i = 0; i < w; i++) {
+      max = fmaxf(max, out[i]);
+      sum += out[i];
+      covered += (out[i] > 0);
+    }
+    d->RowMax[row] = max;
+    d->RowSum[row] = sum;
+    d->RowCovered[row] = covered;
+  }
+}
+
+/*
+ * log2(x) for x >= 1 to within 0.01, which is finer than the palette
+ * resolution and, unlike log2f(), lets the mapping loop vectorize.
+ */
+static inline float FastLog2(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  const float e = (float)((int)(bits >> 23) - 127);
+  bits = (bits & 0x7fffff) | 0x3f800000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+  // Quadratic through log2(1) = 0 and log2(2) = 1, so empty pixels stay 0
+  return e + (-0.34484843f * m + 2.03454529f) * m - 1.68969686f;
+}
+
+typedef struct {
+  const Density_t *Density;
+  DensityToneMap_t Mode;
+  float Scale;  // density to tone curve input
+  uint8_t *Pixels;
+  int Pitch;
+} MapCtx_t;
+
+static void MapRows(void *ctx, size_t begin, size_t end,
+                    unsigned int worker) {
+  const MapCtx_t *c = ctx;
+  const Density_t *d = c->Density;
+
+  for (size_t row = begin; row < end; row++) {
+    const float *in = &d->Merged[row * d->Width];
+    uint8_t *out = c->Pixels + (ptrdiff_t)row * c->Pitch;
+    for (int i = 0; i < d->Width; i++) {
+      float t;
+      if (c->Mode == DENSITY_TONEMAP_LOG) {
+        t = FastLog2(1.0f + in[i]) * c->Scale;
+      } else {
+        // Narkowicz's fit of the ACES filmic curve
+        const float x = in[i] * c->Scale;
+        t = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+      }
+      t = fminf(fmaxf(t, 0.0f), 1.0f);
+      memcpy(&out[4 * i], d->Lut[(int)(t * (LUT_SIZE - 1) + 0.5f)], 4);
+    }
+  }
+}
+
+bool Density_Resolve(Density_t *d, ThreadPool_t *pool, DensityToneMap_t mode,
+                     float exposure, ALLEGRO_BITMAP *target) {
+  if (al_get_bitmap_width(target) != d->Width ||
+      al_get_bitmap_height(target) != d->Height) {
+    return false;
+  }
+  ThreadPool_ParallelFor(pool, d->Height, ROW_GRAIN, MergeRows, d);
+
+  float max = 0;
+  double sum = 0;
+  size_t covered = 0;
+  for (int row = 0; row < d->Height; row++) {
+    max = fmaxf(max, d->RowMax[row]);
+    sum += d->RowSum[row];
+    covered += d->RowCovered[row];
+  }
+
+  MapCtx_t ctx = {d, mode, 0};
+  if (mode == DENSITY_TONEMAP_LOG) {
+    ctx.Scale = (max > 0) ? 1.0f / FastLog2(1.0f + max) : 0;
+  } else {
+    ctx.Scale = covered ? exposure * covered / sum : 0;
+  }
+
+  ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(
+      target, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+  if (region == NULL) {
+    return false;
+  }
+  ctx.Pixels = region->data;
+  ctx.Pitch = region->pitch;
+  ThreadPool_ParallelFor(pool, d->Height, ROW_GRAIN, MapRows, &ctx);
+  al_unlock_bitmap(target);
+  return true;
+}
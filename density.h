@@ -0,0 +1,66 @@
+#ifndef DENSITY_H
+#define DENSITY_H
+
+#include <allegro5/allegro5.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_pool.h"
+
+/*
+ * Accumulation renderer for particle counts far beyond what can be drawn as
+ * individual primitives. Every particle adds one to the pixel it lands on in
+ * a float density buffer; the buffer is then tone mapped and colored through
+ * a palette, so overlapping particles build up brightness instead of
+ * painting over each other.
+ *
+ * Each worker of the thread pool splats into a frame-sized buffer of its
+ * own, so splatting needs no atomics. Resolving merges the worker buffers a
+ * band of rows at a time, clearing them for the next frame as it goes.
+ *
+ * Everything runs on the CPU and the result is written straight into the
+ * target bitmap's pixels.
+ */
+typedef struct Density Density_t;
+
+typedef enum {
+  DENSITY_TONEMAP_LOG,     // log(1 + d) scaled so the densest pixel is 1
+  DENSITY_TONEMAP_FILMIC,  // filmic curve around the mean covered density
+} DensityToneMap_t;
+
+/*
+ * Creates a width x height buffer for splatting from pool, or from the
+ * calling thread only when pool is NULL. Returns NULL on failure.
+ *
+ * @note caller is responsible for disposing of the buffer with
+ * Density_Destroy().
+ */
+Density_t *Density_Create(int width, int height, ThreadPool_t *pool);
+void Density_Destroy(Density_t *d);
+
+/*
+ * Replaces the palette with count colors given as 0xRRGGBB, from empty
+ * pixels to the densest ones. count must be at least 2. The default starts
+ * at the sketches' background and runs through the coolors palette from the
+ * README.
+ */
+void Density_SetPalette(Density_t *d, const uint32_t *rgb, unsigned int count);
+
+/*
+ * Adds count particles at (x[i], y[i]). Particles outside the buffer are
+ * ignored. May be called several times per frame, with the pool the buffer
+ * was created for.
+ */
+void Density_Splat(Density_t *d, ThreadPool_t *pool, const float *x,
+                   const float *y, size_t count);
+
+/*
+ * Tone maps everything splatted since the last resolve into target, which
+ * must be the size of the buffer, and starts a new frame. exposure scales
+ * the filmic curve's input. Returns false if target has the wrong size or
+ * could not be locked.
+ */
+bool Density_Resolve(Density_t *d, ThreadPool_t *pool, DensityToneMap_t mode,
+                     float exposure, ALLEGRO_BITMAP *target);
+
+#endif  // DENSITY_H
@@ -0,0 +1,420 @@
+#include "flowfield.h"
+#include <allegro5/allegro5.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "noise_batch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLOWFIELD_X86 (1)
+#include <immintrin.h>
+#endif
+
+#define NUM_SLICES (3)
+#define NO_SLICE (-1)
+
+typedef struct {
+  float *Vx;
+  float *Vy;
+  int64_t Index;  // time slice held, NO_SLICE if none
+} FlowSlice_t;
+
+struct FlowField {
+  FlowFieldParams_t Params;
+  unsigned int Cols;  // grid nodes across, Width + 1
+  unsigned int Rows;  // grid nodes down, Height + 1
+  size_t NumNodes;
+  float InvCellSize;
+
+  // Field that is sampled: a blend of Slices[0] and Slices[1]
+  float *Vx;
+  float *Vy;
+  // Slices[0] and [1] bracket the current time, [2] is the next one. The
+  // background thread only ever writes Slices[2].
+  FlowSlice_t Slices[NUM_SLICES];
+
+  // Baking scratch: stream function with a one node border for the central
+  // differences, and one row of noise coordinates.
+  float *Psi;
+  float *NoiseX;
+  float *NoiseY;
+  float *NoiseZ;
+
+  // Background baker
+  ALLEGRO_THREAD *Thread;
+  ALLEGRO_MUTEX *Mutex;
+  ALLEGRO_COND *Cond;
+  int64_t Request;  // slice to bake into Slices[2], NO_SLICE if none
+  bool Baking;
+  bool Stop;
+};
+
+/*
+ * Bakes time slice `index` into out_vx and out_vy. Velocity is the curl of the
+ * stream function psi: (d psi / dy, -d psi / dx).
+ */
+static void Bake(FlowField_t *ff, int64_t index, float *out_vx,
+                 float *out_vy) {
+  const FlowFieldParams_t *p = &ff->Params;
+  const unsigned int psi_cols = ff->Cols + 2;
+  const unsigned int psi_rows = ff->Rows + 2;
+  const float step = p->CellSize * p->NoiseScale;  // noise units per node
+  const float z = index * p->SliceTime * p->TimeScale;
+
+  for (unsigned int i = 0; i < psi_cols; i++) {
+    ff->NoiseX[i] = ((float)i - 1.0f) * step;
+    ff->NoiseZ[i] = z;
+  }
+  for (unsigned int j = 0; j < psi_rows; j++) {
+    const float y = ((float)j - 1.0f) * step;
+    for (unsigned int i = 0; i < psi_cols; i++) {
+      ff->NoiseY[i] = y;
+    }
+    noise3_batch(ff->NoiseX, ff->NoiseY, ff->NoiseZ, &ff->Psi[j * psi_cols],
+                 psi_cols);
+  }
+
+  // Central differences are in noise units, Speed turns them into pixels.
+  const float scale = p->Speed / (2.0f * step);
+  for (unsigned int j = 0; j < ff->Rows; j++) {
+    const float *up = &ff->Psi[j * psi_cols + 1];
+    const float *left = &ff->Psi[(j + 1) * psi_cols];
+    const float *right = &ff->Psi[(j + 1) * psi_cols + 2];
+    const float *down = &ff->Psi[(j + 2) * psi_cols + 1];
+    float *vx = &out_vx[j * ff->Cols];
+    float *vy = &out_vy[j * ff->Cols];
+    for (unsigned int i = 0; i < ff->Cols; i++) {
+      vx[i] = (down[i] - up[i]) * scale;
+      vy[i] = -(right[i] - left[i]) * scale;
+    }
+  }
+}
+
+static void BakeSlice(FlowField_t *ff, int64_t index, FlowSlice_t *out) {
+  Bake(ff, index, out->Vx, out->Vy);
+  out->Index = index;
+}
+
+static void *BakerMain(ALLEGRO_THREAD *thread, void *arg) {
+  FlowField_t *ff = arg;
+
+  (void)thread;
+  al_lock_mutex(ff->Mutex);
+  for (;;) {
+    while (!ff->Stop && ff->Request == NO_SLICE) {
+      al_wait_cond(ff->Cond, ff->Mutex);
+    }
+    if (ff->Stop) {
+      break;
+    }
+    const int64_t index = ff->Request;
+    ff->Request = NO_SLICE;
+    ff->Baking = true;
+    al_unlock_mutex(ff->Mutex);
+
+    BakeSlice(ff, index, &ff->Slices[2]);
+
+    al_lock_mutex(ff->Mutex);
+    ff->Baking = false;
+    al_broadcast_cond(ff->Cond);
+  }
+  al_unlock_mutex(ff->Mutex);
+  return NULL;
+}
+
+/*
+ * Blocks until the baker is idle, after which the caller owns every slice
+ * and the scratch buffers.
+ */
+static void WaitBaker(FlowField_t *ff) {
+  al_lock_mutex(ff->Mutex);
+  while (ff->Baking || ff->Request != NO_SLICE) {
+    al_wait_cond(ff->Cond, ff->Mutex);
+  }
+  al_unlock_mutex(ff->Mutex);
+}
+
+static void RequestBake(FlowField_t *ff, int64_t index) {
+  al_lock_mutex(ff->Mutex);
+  ff->Request = index;
+  al_broadcast_cond(ff->Cond);
+  al_unlock_mutex(ff->Mutex);
+}
+
+FlowField_t *FlowField_Create(const FlowFieldParams_t *params) {
+  FlowField_t *ff = calloc(1, sizeof(*ff));
+  if (ff == NULL) {
+    return NULL;
+  }
+  ff->Params = *params;
+  ff->Cols = params->Width + 1;
+  ff->Rows = params->Height + 1;
+  ff->NumNodes = (size_t)ff->Cols * ff->Rows;
+  ff->InvCellSize = 1.0f / params->CellSize;
+  ff->Request = NO_SLICE;
+
+  const bool animated =
+      (params->TimeScale != 0.0f && params->SliceTime > 0.0f);
+  bool ok = (params->Width > 0 && params->Height > 0);
+  ff->Vx = malloc(ff->NumNodes * sizeof(*ff->Vx));
+  ff->Vy = malloc(ff->NumNodes * sizeof(*ff->Vy));
+  for (int i = 0; i < NUM_SLICES && animated; i++) {
+    ff->Slices[i].Vx = malloc(ff->NumNodes * sizeof(float));
+    ff->Slices[i].Vy = malloc(ff->NumNodes * sizeof(float));
+    ff->Slices[i].Index = NO_SLICE;
+    ok = ok && ff->Slices[i].Vx && ff->Slices[i].Vy;
+  }
+  ff->Psi = malloc((size_t)(ff->Cols + 2) * (ff->Rows + 2) * sizeof(float));
+  ff->NoiseX = malloc((ff->Cols + 2) * sizeof(float));
+  ff->NoiseY = malloc((ff->Cols + 2) * sizeof(float));
+  ff->NoiseZ = malloc((ff->Cols + 2) * sizeof(float));
+  if (!ok || !ff->Vx || !ff->Vy || !ff->Psi || !ff->NoiseX || !ff->NoiseY ||
+      !ff->NoiseZ) {
+    FlowField_Destroy(ff);
+    return NULL;
+  }
+
+  if (!animated) {
+    Bake(ff, 0, ff->Vx, ff->Vy);
+    return ff;
+  }
+
+  ff->Mutex = al_create_mutex();
+  ff->Cond = al_create_cond();
+  if (!ff->Mutex || !ff->Cond) {
+    FlowField_Destroy(ff);
+    return NULL;
+  }
+  ff->Thread = al_create_thread(BakerMain, ff);
+  if (ff->Thread == NULL) {
+    FlowField_Destroy(ff);
+    return NULL;
+  }
+  al_start_thread(ff->Thread);
+
+  FlowField_SetTime(ff, 0.0);
+  return ff;
+}
+
+void FlowField_Destroy(FlowField_t *ff) {
+  if (ff == NULL) {
+    return;
+  }
+
+  if (ff->Thread) {
+    al_lock_mutex(ff->Mutex);
+    ff->Stop = true;
+    al_broadcast_cond(ff->Cond);
+    al_unlock_mutex(ff->Mutex);
+    al_join_thread(ff->Thread, NULL);
+    al_destroy_thread(ff->Thread);
+  }
+  if (ff->Cond) {
+    al_destroy_cond(ff->Cond);
+  }
+  if (ff->Mutex) {
+    al_destroy_mutex(ff->Mutex);
+  }
+
+  for (int i = 0; i < NUM_SLICES; i++) {
+    free(ff->Slices[i].Vx);
+    free(ff->Slices[i].Vy);
+  }
+  free(ff->Vx);
+  free(ff->Vy);
+  free(ff->Psi);
+  free(ff->NoiseX);
+  free(ff->NoiseY);
+  free(ff->NoiseZ);
+  free(ff);
+}
+
+void FlowField_SetTime(FlowField_t *ff, double t) {
+  FlowSlice_t *s = ff->Slices;
+
+  if (ff->Thread == NULL) {
+    return;  // static field, baked once by FlowField_Create()
+  }
+
+  const double pos = t / ff->Params.SliceTime;
+  const int64_t k = (int64_t)floor(pos);
+
+  if (s[0].Index != k || s[1].Index != k + 1) {
+    WaitBaker(ff);
+
+    // Normal case: time moved into the next slice, which was baked in the
+    // background. Rotate it into place.
+    for (int i = 0; i < NUM_SLICES - 1 && s[0].Index != k &&
+                    s[1].Index != NO_SLICE && s[1].Index <= k;
+         i++) {
+      const FlowSlice_t old = s[0];
+      s[0] = s[1];
+      s[1] = s[2];
+      s[2] = old;
+    }
+    // Time jumped (first frame, seeking, a long stall): bake synchronously.
+    if (s[0].Index != k) {
+      BakeSlice(ff, k, &s[0]);
+    }
+    if (s[1].Index != k + 1) {
+      if (s[2].Index == k + 1) {
+        const FlowSlice_t old = s[1];
+        s[1] = s[2];
+        s[2] = old;
+      } else {
+        BakeSlice(ff, k + 1, &s[1]);
+      }
+    }
+    if (s[2].Index != k + 2) {
+      RequestBake(ff, k + 2);
+    }
+  }
+
+  const float a = (float)(pos - k);
+  for (size_t i = 0; i < ff->NumNodes; i++) {
+    ff->Vx[i] = s[0].Vx[i] + (s[1].Vx[i] - s[0].Vx[i]) * a;
+    ff->Vy[i] = s[0].Vy[i] + (s[1].Vy[i] - s[0].Vy[i]) * a;
+  }
+}
+
+static void Sample_Scalar(const FlowField_t *ff, const float *x,
+                          const float *y, float *vx, float *vy, size_t count) {
+  const float max_gx = (float)ff->Params.Width;
+  const float max_gy = (float)ff->Params.Height;
+  const int max_ix = (int)ff->Params.Width - 1;
+  const int max_iy = (int)ff->Params.Height - 1;
+
+  for (size_t i = 0; i < count; i++) {
+    // fmaxf() first so NaN positions land on the edge like the SIMD path
+    const float gx = fminf(fmaxf(x[i] * ff->InvCellSize, 0.0f), max_gx);
+    const float gy = fminf(fmaxf(y[i] * ff->InvCellSize, 0.0f), max_gy);
+    int ix = (int)gx;
+    int iy = (int)gy;
+    ix = (ix < max_ix) ? ix : max_ix;
+    iy = (iy < max_iy) ? iy : max_iy;
+    const float fx = gx - (float)ix;
+    const float fy = gy - (float)iy;
+    const size_t n = (size_t)iy * ff->Cols + ix;
+    const size_t s = n + ff->Cols;
+
+    const float tx = ff->Vx[n] + (ff->Vx[n + 1] - ff->Vx[n]) * fx;
+    const float bx = ff->Vx[s] + (ff->Vx[s + 1] - ff->Vx[s]) * fx;
+    const float ty = ff->Vy[n] + (ff->Vy[n + 1] - ff->Vy[n]) * fx;
+    const float by = ff->Vy[s] + (ff->Vy[s + 1] - ff->Vy[s]) * fx;
+    vx[i] = tx + (bx - tx) * fy;
+    vy[i] = ty + (by - ty) * fy;
+  }
+}
+
+#ifdef FLOWFIELD_X86
+/*
+ * Same arithmetic as Sample_Scalar, 8 particles at a time with the four
+ * corners fetched by gathers.
+ */
+__attribute__((target("avx2"))) static void Sample_AVX2(
+    const FlowField_t *ff, const float *x, const float *y, float *vx,
+    float *vy, size_t count) {
+  const __m256 inv = _mm256_set1_ps(ff->InvCellSize);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 max_gx = _mm256_set1_ps((float)ff->Params.Width);
+  const __m256 max_gy = _mm256_set1_ps((float)ff->Params.Height);
+  const __m256i max_ix = _mm256_set1_epi32((int)ff->Params.Width - 1);
+  const __m256i max_iy = _mm256_set1_epi32((int)ff->Params.Height - 1);
+  const __m256i cols = _mm256_set1_epi32((int)ff->Cols);
+  const __m256i one = _mm256_set1_epi32(1);
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m256 gx = _mm256_mul_ps(_mm256_loadu_ps(&x[i]), inv);
+    __m256 gy = _mm256_mul_ps(_mm256_loadu_ps(&y[i]), inv);
+    gx = _mm256_min_ps(_mm256_max_ps(gx, zero), max_gx);
+    gy = _mm256_min_ps(_mm256_max_ps(gy, zero), max_gy);
+    const __m256i ix = _mm256_min_epi32(_mm256_cvttps_epi32(gx), max_ix);
+    const __m256i iy = _mm256_min_epi32(_mm256_cvttps_epi32(gy), max_iy);
+    const __m256 fx = _mm256_sub_ps(gx, _mm256_cvtepi32_ps(ix));
+    const __m256 fy = _mm256_sub_ps(gy, _mm256_cvtepi32_ps(iy));
+    const __m256i n = _mm256_add_epi32(_mm256_mullo_epi32(iy, cols), ix);
+    const __m256i s = _mm256_add_epi32(n, cols);
+    const __m256i ne = _mm256_add_epi32(n, one);
+    const __m256i se = _mm256_add_epi32(s, one);
+
+    const __m256 x00 = _mm256_i32gather_ps(ff->Vx, n, 4);
+    const __m256 x10 = _mm256_i32gather_ps(ff->Vx, ne, 4);
+    const __m256 x01 = _mm256_i32gather_ps(ff->Vx, s, 4);
+    const __m256 x11 = _mm256_i32gather_ps(ff->Vx, se, 4);
+    const __m256 y00 = _mm256_i32gather_ps(ff->Vy, n, 4);
+    const __m256 y10 = _mm256_i32gather_ps(ff->Vy, ne, 4);
+    const __m256 y01 = _mm256_i32gather_ps(ff->Vy, s, 4);
+    const __m256 y11 = _mm256_i32gather_ps(ff->Vy, se, 4);
+
+    const __m256 tx =
+        _mm256_add_ps(x00, _mm256_mul_ps(_mm256_sub_ps(x10, x00), fx));
+    const __m256 bx =
+        _mm256_add_ps(x01, _mm256_mul_ps(_mm256_sub_ps(x11, x01), fx));
+    const __m256 ty =
+        _mm256_add_ps(y00, _mm256_mul_ps(_mm256_sub_ps(y10, y00), fx));
+    const __m256 by =
+        _mm256_add_ps(y01, _mm256_mul_ps(_mm256_sub_ps(y11, y01), fx));
+    _mm256_storeu_ps(
+        &vx[i], _mm256_add_ps(tx, _mm256_mul_ps(_mm256_sub_ps(bx, tx), fy)));
+    _mm256_storeu_ps(
+        &vy[i], _mm256_add_ps(ty, _mm256_mul_ps(_mm256_sub_ps(by, ty), fy)));
+  }
+  Sample_Scalar(ff, &x[i], &y[i], &vx[i], &vy[i], count - i);
+}
+#endif  // FLOWFIELD_X86
+
+/*
+ * Cached CPU check; the first call may come from several pool workers at
+ * once, which all store the same value.
+ */
+static bool UseAVX2(void) {
+#ifdef FLOWFIELD_X86
+  static _Atomic int hasAVX2 = -1;
+  int has = hasAVX2;
+  if (has < 0) {
+    __builtin_cpu_init();
+    has = __builtin_cpu_supports("avx2") ? 1 : 0;
+    hasAVX2 = has;
+  }
+  return has;
+#else
+  return false;
+#endif
+}
+
+void FlowField_Sample(const FlowField_t *ff, const float *x, const float *y,
+                      float *vx, float *vy, size_t count) {
+#ifdef FLOWFIELD_X86
+  if (UseAVX2()) {
+    Sample_AVX2(ff, x, y, vx, vy, count);
+    return;
+  }
+#endif
+  Sample_Scalar(ff, x, y, vx, vy, count);
+}
+
+void FlowField_Advect(const FlowField_t *ff, ParticleSoA_t *ps, size_t begin,
+                      size_t end, float dt) {
+  float *restrict x = ps->x;
+  float *restrict y = ps->y;
+  float *restrict prev_x = ps->prev_x;
+  float *restrict prev_y = ps->prev_y;
+  // Not restrict: FlowField_Sample() writes these through its own pointers.
+  const float *vx = ps->vx;
+  const float *vy = ps->vy;
+
+  FlowField_Sample(ff, &x[begin], &y[begin], &ps->vx[begin], &ps->vy[begin],
+                   end - begin);
+  for (size_t i = begin; i < end; i++) {
+    prev_x[i] = x[i];
+    prev_y[i] = y[i];
+    x[i] += vx[i] * dt;
+    y[i] += vy[i] * dt;
+  }
+}
+
+const char *FlowField_KernelName(void) {
+  return UseAVX2() ? "avx2" : "scalar";
+}
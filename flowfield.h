@@ -0,0 +1,70 @@
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include <stddef.h>
+#include "particle_soa.h"
+
+/*
+ * Curl-noise flow field baked into a grid. The stream function is 3D Perlin
+ * noise over (x, y, time); its curl gives a divergence-free velocity field,
+ * so particles swirl around without bunching up or thinning out.
+ *
+ * Noise is only evaluated when baking the grid. Particles look the field up
+ * by bilinear interpolation, so the per-particle cost does not depend on how
+ * expensive the noise is.
+ *
+ * A time-varying field keeps baked slices at times k * SliceTime and blends
+ * between the two around the current time. While those are in use, a
+ * background thread bakes the next one, so at most one slice is baked per
+ * slice interval and the frame never waits for noise unless time jumps.
+ */
+typedef struct FlowField FlowField_t;
+
+typedef struct {
+  unsigned int Width;   // grid cells across
+  unsigned int Height;  // grid cells down
+  float CellSize;       // pixels per grid cell
+  float NoiseScale;     // noise cycles per pixel
+  float TimeScale;      // noise cycles per second, 0 for a static field
+  float SliceTime;      // seconds between baked time slices
+  float Speed;          // pixels per second per unit of noise gradient
+} FlowFieldParams_t;
+
+/*
+ * Bakes the field at time 0 before returning. Returns NULL on failure.
+ *
+ * @note caller is responsible for disposing of the field with
+ * FlowField_Destroy().
+ */
+FlowField_t *FlowField_Create(const FlowFieldParams_t *params);
+void FlowField_Destroy(FlowField_t *ff);
+
+/*
+ * Moves the field to time t (seconds), typically once per frame. Any thread
+ * may call it, but only one at a time, and never while FlowField_Sample() or
+ * FlowField_Advect() is running on the field.
+ */
+void FlowField_SetTime(FlowField_t *ff, double t);
+
+/*
+ * Writes the field velocity at (x[i], y[i]) to (vx[i], vy[i]). Positions
+ * outside the grid are clamped to its edge. Safe to call from several
+ * threads at once.
+ */
+void FlowField_Sample(const FlowField_t *ff, const float *x, const float *y,
+                      float *vx, float *vy, size_t count);
+
+/*
+ * Advects particles [begin, end) of ps through the field for dt seconds.
+ * The sampled velocity is left in ps->vx and ps->vy and the old position in
+ * prev_x and prev_y. Meant to be called from a ThreadPool_ParallelFor body.
+ */
+void FlowField_Advect(const FlowField_t *ff, ParticleSoA_t *ps, size_t begin,
+                      size_t end, float dt);
+
+/*
+ * Name of the sampling code path, e.g. "avx2".
+ */
+const char *FlowField_KernelName(void);
+
+#endif  // FLOWFIELD_H
@@ -0,0 +1,284 @@
+#include "gif.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_BUCKETS (32768)  // 5 bits per channel
+#define MAX_COLORS (256)
+#define LZW_MIN_CODE_SIZE (8)
+#define LZW_CLEAR (1 << LZW_MIN_CODE_SIZE)
+#define LZW_MAX_CODE (4095)
+#define LZW_MAX_CODE_SIZE (12)
+#define LZW_HASH_SIZE (8192)  // power of two, comfortably above 4096 codes
+
+struct GifWriter {
+  FILE *File;
+  int Width;
+  int Height;
+  uint8_t *Indices;  // palette index per pixel of the current frame
+  uint32_t *Count;   // histogram over 15-bit colors
+  uint32_t *Sum;     // per bucket r, g, b sums, for the bucket's average
+  uint64_t *Order;   // used buckets, sorted by popularity
+  uint8_t *Lut;      // bucket to palette index
+  uint8_t Palette[MAX_COLORS * 3];
+  int32_t HashKey[LZW_HASH_SIZE];
+  int16_t HashCode[LZW_HASH_SIZE];
+  // Bit packing into 255 byte data sub-blocks
+  uint8_t Block[255];
+  int BlockLen;
+  uint32_t Bits;
+  int NumBits;
+};
+
+static void Put16(FILE *f, unsigned int v) {
+  fputc(v & 0xff, f);
+  fputc((v >> 8) & 0xff, f);
+}
+
+GifWriter_t *Gif_Open(const char *path, int width, int height) {
+  GifWriter_t *g = calloc(1, sizeof(*g));
+  if (g == NULL) {
+    return NULL;
+  }
+  g->Width = width;
+  g->Height = height;
+  g->Indices = malloc((size_t)width * height);
+  g->Count = malloc(NUM_BUCKETS * sizeof(*g->Count));
+  g->Sum = malloc(NUM_BUCKETS * 3 * sizeof(*g->Sum));
+  g->Order = malloc(NUM_BUCKETS * sizeof(*g->Order));
+  g->Lut = malloc(NUM_BUCKETS);
+  if (!g->Indices || !g->Count || !g->Sum || !g->Order || !g->Lut) {
+    Gif_Close(g);
+    return NULL;
+  }
+  g->File = fopen(path, "wb");
+  if (g->File == NULL) {
+    fprintf(stderr, "ERROR: Failed to create '%s'!\n", path);
+    Gif_Close(g);
+    return NULL;
+  }
+
+  // Header and logical screen without a global color table
+  fwrite("GIF89a", 1, 6, g->File);
+  Put16(g->File, width);
+  Put16(g->File, height);
+  fputc(0x00, g->File);
+  fputc(0x00, g->File);
+  fputc(0x00, g->File);
+
+  // NETSCAPE2.0 extension: loop forever
+  fwrite("\x21\xff\x0bNETSCAPE2.0\x03\x01", 1, 16, g->File);
+  Put16(g->File, 0);
+  fputc(0x00, g->File);
+  return g;
+}
+
+static int CompareDescending(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a;
+  const uint64_t y = *(const uint64_t *)b;
+  return (x < y) - (x > y);
+}
+
+/*
+ * Builds the palette for one frame and fills in Indices. Returns the number
+ * of palette entries used.
+ */
+static int Quantize(GifWriter_t *g, const uint8_t *rgba) {
+  const size_t num_pixels = (size_t)g->Width * g->Height;
+  size_t num_used = 0;
+
+  memset(g->Count, 0, NUM_BUCKETS * sizeof(*g->Count));
+  memset(g->Sum, 0, NUM_BUCKETS * 3 * sizeof(*g->Sum));
+  for (size_t i = 0; i < num_pixels; i++) {
+    const uint8_t *p = &rgba[4 * i];
+    const unsigned int b = (p[0] >> 3) << 10 | (p[1] >> 3) << 5 | p[2] >> 3;
+    g->Count[b]++;
+    g->Sum[3 * b] += p[0];
+    g->Sum[3 * b + 1] += p[1];
+    g->Sum[3 * b + 2] += p[2];
+  }
+
+  // Most popular buckets first. Counts fit in 49 bits, the bucket in 15.
+  for (unsigned int b = 0; b < NUM_BUCKETS; b++) {
+    if (g->Count[b]) {
+      g->Order[num_used++] = (uint64_t)g->Count[b] << 15 | b;
+    }
+  }
+  if (num_used > MAX_COLORS) {
+    qsort(g->Order, num_used, sizeof(*g->Order), CompareDescending);
+  }
+  const int num_colors = num_used < MAX_COLORS ? (int)num_used : MAX_COLORS;
+
+  for (int c = 0; c < num_colors; c++) {
+    const unsigned int b = g->Order[c] & (NUM_BUCKETS - 1);
+    for (int k = 0; k < 3; k++) {
+      g->Palette[3 * c + k] = g->Sum[3 * b + k] / g->Count[b];
+    }
+    g->Lut[b] = c;
+  }
+
+  // Buckets that did not make it into the palette map to the nearest entry.
+  for (size_t i = num_colors; i < num_used; i++) {
+    const unsigned int b = g->Order[i] & (NUM_BUCKETS - 1);
+    int r = g->Sum[3 * b] / g->Count[b];
+    int gr = g->Sum[3 * b + 1] / g->Count[b];
+    int bl = g->Sum[3 * b + 2] / g->Count[b];
+    int best = 0;
+    int best_dist = 1 << 30;
+    for (int c = 0; c < num_colors; c++) {
+      const int dr = r - g->Palette[3 * c];
+      const int dg = gr - g->Palette[3 * c + 1];
+      const int db = bl - g->Palette[3 * c + 2];
+      const int dist = dr * dr + dg * dg + db * db;
+      if (dist < best_dist) {
+        best = c;
+        best_dist = dist;
+      }
+    }
+    g->Lut[b] = best;
+  }
+
+  for (size_t i = 0; i < num_pixels; i++) {
+    const uint8_t *p = &rgba[4 * i];
+    g->Indices[i] =
+        g->Lut[(p[0] >> 3) << 10 | (p[1] >> 3) << 5 | p[2] >> 3];
+  }
+  return num_colors;
+}
+
+static void PutByte(GifWriter_t *g, uint8_t byte) {
+  g->Block[g->BlockLen++] = byte;
+  if (g->BlockLen == (int)sizeof(g->Block)) {
+    fputc(g->BlockLen, g->File);
+    fwrite(g->Block, 1, g->BlockLen, g->File);
+    g->BlockLen = 0;
+  }
+}
+
+static void PutCode(GifWriter_t *g, unsigned int code, int size) {
+  g->Bits |= code << g->NumBits;
+  g->NumBits += size;
+  while (g->NumBits >= 8) {
+    PutByte(g, g->Bits & 0xff);
+    g->Bits >>= 8;
+    g->NumBits -= 8;
+  }
+}
+
+static void ResetDictionary(GifWriter_t *g) {
+  memset(g->HashKey, 0xff, sizeof(g->HashKey));
+}
+
+/*
+ * Looks up the code for prefix followed by pixel. Returns the slot, which
+ * holds key -1 when the string is not in the dictionary yet.
+ */
+static int FindSlot(const GifWriter_t *g, int32_t key) {
+  unsigned int h = (unsigned int)(key * 2654435761u) >> 19;
+  while (g->HashKey[h] != -1 && g->HashKey[h] != key) {
+    h = (h + 1) & (LZW_HASH_SIZE - 1);
+  }
+  return h;
+}
+
+static void Compress(GifWriter_t *g) {
+  const size_t num_pixels = (size_t)g->Width * g->Height;
+  int code_size = LZW_MIN_CODE_SIZE + 1;
+  int max_code = LZW_CLEAR + 1;
+  int prefix = g->Indices[0];
+
+  g->Bits = 0;
+  g->NumBits = 0;
+  g->BlockLen = 0;
+  ResetDictionary(g);
+  PutCode(g, LZW_CLEAR, code_size);
+
+  for (size_t i = 1; i < num_pixels; i++) {
+    const int32_t key = prefix << 8 | g->Indices[i];
+    const int slot = FindSlot(g, key);
+    if (g->HashKey[slot] == key) {
+      prefix = g->HashCode[slot];
+      continue;
+    }
+
+    PutCode(g, prefix, code_size);
+    g->HashKey[slot] = key;
+    g->HashCode[slot] = ++max_code;
+    if (max_code >= (1 << code_size)) {
+      code_size++;
+    }
+    if (max_code == LZW_MAX_CODE) {
+      PutCode(g, LZW_CLEAR, code_size);
+      ResetDictionary(g);
+      code_size = LZW_MIN_CODE_SIZE + 1;
+      max_code = LZW_CLEAR + 1;
+    }
+    prefix = g->Indices[i];
+  }
+
+  PutCode(g, prefix, code_size);
+  // A decoder runs an entry behind: only on reading prefix does it add the
+  // entry made above, and it widens its codes when that fills the current
+  // width, so the end code has to be written at the width it has then.
+  if (max_code + 1 >= (1 << code_size) && code_size < LZW_MAX_CODE_SIZE) {
+    code_size++;
+  }
+  PutCode(g, LZW_CLEAR + 1, code_size);
+  if (g->NumBits > 0) {
+    PutByte(g, g->Bits & 0xff);
+  }
+  if (g->BlockLen > 0) {
+    fputc(g->BlockLen, g->File);
+    fwrite(g->Block, 1, g->BlockLen, g->File);
+  }
+  fputc(0x00, g->File);  // end of image data
+}
+
+bool Gif_AddFrame(GifWriter_t *g, const uint8_t *rgba, unsigned int delay_cs) {
+  const int num_colors = Quantize(g, rgba);
+  int depth = 1;  // color table holds 2^depth entries
+  while ((1 << depth) < num_colors) {
+    depth++;
+  }
+
+  // Graphic control extension: no transparency, frame delay
+  fwrite("\x21\xf9\x04\x04", 1, 4, g->File);
+  Put16(g->File, delay_cs);
+  fputc(0x00, g->File);
+  fputc(0x00, g->File);
+
+  // Image descriptor with a local color table
+  fputc(0x2c, g->File);
+  Put16(g->File, 0);
+  Put16(g->File, 0);
+  Put16(g->File, g->Width);
+  Put16(g->File, g->Height);
+  fputc(0x80 | (depth - 1), g->File);
+  fwrite(g->Palette, 1, 3 * num_colors, g->File);
+  for (int c = num_colors; c < (1 << depth); c++) {
+    fwrite("\0\0\0", 1, 3, g->File);
+  }
+
+  fputc(LZW_MIN_CODE_SIZE, g->File);
+  Compress(g);
+  return !ferror(g->File);
+}
+
+bool Gif_Close(GifWriter_t *g) {
+  bool ok = true;
+  if (g == NULL) {
+    return false;
+  }
+  if (g->File) {
+    fputc(0x3b, g->File);  // trailer
+    ok = !ferror(g->File);
+    ok = (fclose(g->File) == 0) && ok;
+  }
+  free(g->Indices);
+  free(g->Count);
+  free(g->Sum);
+  free(g->Order);
+  free(g->Lut);
+  free(g);
+  return ok;
+}
@@ -0,0 +1,34 @@
+#ifndef GIF_H
+#define GIF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Minimal animated GIF writer. Every frame is a full image with its own
+ * palette of up to 256 colors, picked by popularity from a 15-bit color
+ * histogram of that frame, which suits the flat palettes of the sketches.
+ * The animation loops forever.
+ */
+typedef struct GifWriter GifWriter_t;
+
+/*
+ * Returns NULL and prints an error when path cannot be created.
+ *
+ * @note caller is responsible for finishing the file with Gif_Close().
+ */
+GifWriter_t *Gif_Open(const char *path, int width, int height);
+
+/*
+ * Appends a frame of width * height RGBA pixels (alpha is ignored) that is
+ * shown for delay_cs hundredths of a second.
+ */
+bool Gif_AddFrame(GifWriter_t *g, const uint8_t *rgba, unsigned int delay_cs);
+
+/*
+ * Writes the trailer and closes the file. Returns false if any write failed
+ * along the way.
+ */
+bool Gif_Close(GifWriter_t *g);
+
+#endif  // GIF_H
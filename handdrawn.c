@@ -0,0 +1,312 @@
+#include "handdrawn.h"
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAND_DRAWN_X86 (1)
+#include <immintrin.h>
+#endif
+
+#define RNG_STREAM_JITTER (0)
+#define RNG_STREAM_BATCH_JITTER (1)
+
+#define HAND_DRAWN_ALIGNMENT (64)
+
+PolyLine2D_t *GetHandDawnLine(Line2D_t *line, unsigned int num_points,
+                              const Rng_t *rng, unsigned int line_id,
+                              Arena_t *arena) {
+  PolyLine2D_t *pl = arena ? Arena_CreatePolyLine2D(arena, num_points)
+                           : PolyLine2D_Create(num_points);
+  if (pl == NULL) {
+    return NULL;
+  }
+  const float seg_len_x =
+      (line->EndPoint.x - line->StartPoint.x) / (pl->NumPoints - 1);
+  const float seg_len_y =
+      (line->EndPoint.y - line->StartPoint.y) / (pl->NumPoints - 1);
+  const Vector2D_t orthoVector = Vector2D_Orthogonal(Vector2D_FromLine(line));
+
+  pl->Color = line->Color;
+  pl->Thickness = line->Thickness;
+
+  // Start and end points of the polyline are the same as the input line
+  pl->Points[0] = line->StartPoint;
+  pl->Points[pl->NumPoints - 1] = line->EndPoint;
+
+  // Divide the line into line segments
+  for (int i = 1; i < pl->NumPoints - 1; i++) {
+    pl->Points[i].x = pl->Points[i - 1].x + seg_len_x;
+    pl->Points[i].y = pl->Points[i - 1].y + seg_len_y;
+  }
+
+  // This is so we don't have to sprinkle constant checks later on. It just
+  // protects against a programmer that decides to use less than 3 points for
+  // some reason.
+  if (pl->NumPoints < 3) {
+    return pl;
+  }
+
+  // Jitter all line segment points except for the first and the last one.
+  // This can be combined with the previousloop, but for readability it is not.
+  Line2D_t lineSeg;
+  Vector2D_t segVec;         // line segment vector
+  Vector2D_t segStartVec;    // vector to the start of the line segment
+  float orthoVecNoiseScale;  // Multiplier for the orthogonal vector noise
+  Vector2D_t noisyOrthoVec;  // orthogonal vector multiplied by the noise factor
+  Vector2D_t
+      noisySegVec;  // line segment vector with the noise added at the end
+
+  for (int i = 1; i < pl->NumPoints - 1; i++) {
+    lineSeg.StartPoint = pl->Points[i - 1];
+    lineSeg.EndPoint = pl->Points[i];
+    segVec = Vector2D_FromLine(&lineSeg);
+    segStartVec = Vector2D_FromPoint(lineSeg.StartPoint);
+    orthoVecNoiseScale =
+        2.0 - 4.0 * Rng_Uniform(rng, RNG_STREAM_JITTER, line_id, i);
+    noisyOrthoVec = Vector2D_Scale(orthoVector, orthoVecNoiseScale);
+    noisySegVec = Vector2D_Add(noisyOrthoVec, segVec);
+
+    pl->Points[i] = Point2D_FromVector(Vector2D_Add(segStartVec, noisySegVec));
+  }
+  return pl;
+}
+
+static const HandDrawnParams_t defaultParams = {
+    .Scale = 1.0f,
+    .SegmentLength = 20.0f,
+    .MinPoints = 3,
+    .MaxPoints = 32,
+    .Jitter = 0.1f,
+    .MaxJitter = 2.0f,
+};
+
+HandDrawnBatch_t *HandDrawnBatch_Create(void) {
+  return calloc(1, sizeof(HandDrawnBatch_t));
+}
+
+void HandDrawnBatch_Destroy(HandDrawnBatch_t *b) {
+  if (b == NULL) {
+    return;
+  }
+  free(b->Offsets);
+  free(b->Amps);
+  free(b->X);
+  free(b->Y);
+  free(b);
+}
+
+static float *AllocPoints(size_t count) {
+  const size_t per_line = HAND_DRAWN_ALIGNMENT / sizeof(float);
+  const size_t padded = (count + per_line) / per_line * per_line;
+  return aligned_alloc(HAND_DRAWN_ALIGNMENT, padded * sizeof(float));
+}
+
+static bool Reserve(HandDrawnBatch_t *b, size_t lines, size_t points) {
+  if (lines + 1 > b->LineCapacity) {
+    size_t *offsets = realloc(b->Offsets, (lines + 1) * sizeof(*offsets));
+    if (offsets == NULL) {
+      return false;
+    }
+    b->Offsets = offsets;
+    float *amps = realloc(b->Amps, (lines + 1) * sizeof(*amps));
+    if (amps == NULL) {
+      return false;
+    }
+    b->Amps = amps;
+    b->LineCapacity = lines + 1;
+  }
+  if (points > b->PointCapacity) {
+    // Contents are regenerated anyway, so there is nothing to copy over.
+    free(b->X);
+    free(b->Y);
+    b->X = AllocPoints(points);
+    b->Y = AllocPoints(points);
+    if (b->X == NULL || b->Y == NULL) {
+      b->PointCapacity = 0;
+      return false;
+    }
+    b->PointCapacity = points;
+  }
+  return true;
+}
+
+// Where a line's points go: along (Dx, Dy) from (Sx, Sy), Step of the way
+// apart, and up to (Nx, Ny) to either side.
+typedef struct {
+  float Sx;
+  float Sy;
+  float Dx;
+  float Dy;
+  float Nx;
+  float Ny;
+  float Step;
+} LineFrame_t;
+
+static LineFrame_t GetLineFrame(const Line2D_t *line, int n, float amp) {
+  const float dx = line->EndPoint.x - line->StartPoint.x;
+  const float dy = line->EndPoint.y - line->StartPoint.y;
+  const float len = sqrtf(dx * dx + dy * dy);
+  const float inv_len = len > 0 ? 1.0f / len : 0.0f;
+  return (LineFrame_t){
+      .Sx = line->StartPoint.x,
+      .Sy = line->StartPoint.y,
+      .Dx = dx,
+      .Dy = dy,
+      .Nx = -dy * inv_len * amp,  // unit normal times amplitude
+      .Ny = dx * inv_len * amp,
+      .Step = 1.0f / (n - 1),
+  };
+}
+
+// The ends stay exactly where the input line has them.
+static void PinEnds(float *x, float *y, int n, const Line2D_t *line) {
+  x[0] = line->StartPoint.x;
+  y[0] = line->StartPoint.y;
+  x[n - 1] = line->EndPoint.x;
+  y[n - 1] = line->EndPoint.y;
+}
+
+/*
+ * Lays out n points evenly along a line and pushes the inner ones sideways
+ * by amp * (1 - 2u), where u is the uniform already stored in x.
+ */
+static void JitterLine(float *x, float *y, int n, const Line2D_t *line,
+                       float amp) {
+  const LineFrame_t f = GetLineFrame(line, n, amp);
+
+  for (int j = 0; j < n; j++) {
+    const float t = (float)j * f.Step;
+    const float s = 1.0f - 2.0f * x[j];
+    x[j] = f.Sx + f.Dx * t + f.Nx * s;
+    y[j] = f.Sy + f.Dy * t + f.Ny * s;
+  }
+  PinEnds(x, y, n, line);
+}
+
+static void JitterLines_Scalar(HandDrawnBatch_t *b, const Line2D_t *lines) {
+  for (size_t i = 0; i < b->NumLines; i++) {
+    const size_t o = b->Offsets[i];
+    JitterLine(&b->X[o], &b->Y[o], b->Offsets[i + 1] - o, &lines[i],
+               b->Amps[i]);
+  }
+}
+
+#ifdef HAND_DRAWN_X86
+/*
+ * JitterLine() eight points at a time, with the points past the end of the
+ * line masked off, so the few points of a short line take a single pass.
+ * The same operations in the same order, so the points are the scalar
+ * loop's to the bit.
+ */
+__attribute__((target("avx2"))) static void JitterLine_AVX2(
+    float *x, float *y, int n, const Line2D_t *line, float amp) {
+  const LineFrame_t f = GetLineFrame(line, n, amp);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 sx = _mm256_set1_ps(f.Sx);
+  const __m256 sy = _mm256_set1_ps(f.Sy);
+  const __m256 dx = _mm256_set1_ps(f.Dx);
+  const __m256 dy = _mm256_set1_ps(f.Dy);
+  const __m256 nx = _mm256_set1_ps(f.Nx);
+  const __m256 ny = _mm256_set1_ps(f.Ny);
+  const __m256 step = _mm256_set1_ps(f.Step);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 two = _mm256_set1_ps(2.0f);
+
+  for (int j = 0; j < n; j += 8) {
+    const __m256i index = _mm256_add_epi32(_mm256_set1_epi32(j), lanes);
+    const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), index);
+    const __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(index), step);
+    const __m256 u = _mm256_maskload_ps(&x[j], mask);
+    const __m256 s = _mm256_sub_ps(one, _mm256_mul_ps(two, u));
+    const __m256 px = _mm256_add_ps(_mm256_add_ps(sx, _mm256_mul_ps(dx, t)),
+                                    _mm256_mul_ps(nx, s));
+    const __m256 py = _mm256_add_ps(_mm256_add_ps(sy, _mm256_mul_ps(dy, t)),
+                                    _mm256_mul_ps(ny, s));
+    _mm256_maskstore_ps(&x[j], mask, px);
+    _mm256_maskstore_ps(&y[j], mask, py);
+  }
+  PinEnds(x, y, n, line);
+}
+
+__attribute__((target("avx2"))) static void JitterLines_AVX2(
+    HandDrawnBatch_t *b, const Line2D_t *lines) {
+  for (size_t i = 0; i < b->NumLines; i++) {
+    const size_t o = b->Offsets[i];
+    JitterLine_AVX2(&b->X[o], &b->Y[o], b->Offsets[i + 1] - o, &lines[i],
+                    b->Amps[i]);
+  }
+}
+#endif  // HAND_DRAWN_X86
+
+/*
+ * Cached CPU check. Batches may be generated from several threads, so the
+ * first call can race; every racer stores the same value.
+ */
+static bool UseAVX2(void) {
+#ifdef HAND_DRAWN_X86
+  static _Atomic int hasAVX2 = -1;
+  int has = hasAVX2;
+  if (has < 0) {
+    __builtin_cpu_init();
+    has = __builtin_cpu_supports("avx2") ? 1 : 0;
+    hasAVX2 = has;
+  }
+  return has;
+#else
+  return false;
+#endif
+}
+
+static void JitterLines(HandDrawnBatch_t *b, const Line2D_t *lines) {
+#ifdef HAND_DRAWN_X86
+  if (UseAVX2()) {
+    JitterLines_AVX2(b, lines);
+    return;
+  }
+#endif
+  JitterLines_Scalar(b, lines);
+}
+
+bool HandDrawnBatch_Generate(HandDrawnBatch_t *b, const Line2D_t *lines,
+                             size_t count, const HandDrawnParams_t *params,
+                             const Rng_t *rng, unsigned int batch_id) {
+  const HandDrawnParams_t *p = params ? params : &defaultParams;
+  const unsigned int min_points = p->MinPoints < 2 ? 2 : p->MinPoints;
+  const unsigned int max_points =
+      p->MaxPoints < min_points ? min_points : p->MaxPoints;
+  size_t total = 0;
+
+  if (!Reserve(b, count, 0)) {
+    return false;
+  }
+
+  // First pass: point count and jitter amplitude per line, and the offsets
+  // table they give.
+  for (size_t i = 0; i < count; i++) {
+    const float dx = lines[i].EndPoint.x - lines[i].StartPoint.x;
+    const float dy = lines[i].EndPoint.y - lines[i].StartPoint.y;
+    const float len = sqrtf(dx * dx + dy * dy);
+    const float segs = ceilf(len * p->Scale / p->SegmentLength);
+    unsigned int n = segs + 1 > max_points ? max_points : segs + 1;
+
+    if (n < min_points) {
+      n = min_points;
+    }
+    b->Amps[i] = fminf(p->MaxJitter, p->Jitter * len / (n - 1));
+    b->Offsets[i] = total;
+    total += n;
+  }
+  b->Offsets[count] = total;
+  b->NumLines = count;
+  b->NumPoints = total;
+
+  if (!Reserve(b, count, total)) {
+    return false;
+  }
+
+  // One bulk draw of every uniform the batch needs, then a pass that turns
+  // them into points in place.
+  Rng_FillUniform(rng, RNG_STREAM_BATCH_JITTER, batch_id, 0, b->X, total);
+  JitterLines(b, lines);
+  return true;
+}
@@ -0,0 +1,79 @@
+#ifndef HANDDRAWN_H
+#define HANDDRAWN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+#include "procgenlib.h"
+#include "rng.h"
+
+// Points of a line from GetHandDawnLine(), unless there is a reason for
+// more or fewer
+#define HAND_DRAWN_POINTS (32)
+
+/*
+ * Turns a straight line into a wobbly polyline that looks hand drawn.
+ *
+ * TODO: Add variability in length
+ *
+ * The polyline has num_points points and the same wobble however long the
+ * line is; HandDrawnBatch_Generate() scales both with the length. line_id
+ * selects the random stream, so the same id and seed always give the same
+ * wobble.
+ *
+ * The polyline is allocated from arena, or from the heap if arena is NULL.
+ *
+ * @note when arena is NULL, caller is responsible for disposing of the
+ * polyline structure with PolyLine2D_Destroy().
+ */
+PolyLine2D_t *GetHandDawnLine(Line2D_t *line, unsigned int num_points,
+                              const Rng_t *rng, unsigned int line_id,
+                              Arena_t *arena);
+
+/*
+ * Hand-drawn lines generated many at a time into one structure-of-arrays
+ * point buffer. The points of line i are X[j], Y[j] for j in
+ * [Offsets[i], Offsets[i + 1]).
+ */
+typedef struct {
+  size_t NumLines;
+  size_t NumPoints;
+  size_t *Offsets;  // NumLines + 1 entries
+  float *X;
+  float *Y;
+  float *Amps;  // sideways jitter per line, NumLines entries
+  size_t LineCapacity;
+  size_t PointCapacity;
+} HandDrawnBatch_t;
+
+typedef struct {
+  float Scale;             // on-screen pixels per line unit
+  float SegmentLength;     // on-screen pixels per segment
+  unsigned int MinPoints;  // at least 2
+  unsigned int MaxPoints;
+  float Jitter;     // largest sideways offset as a fraction of a segment
+  float MaxJitter;  // cap on the sideways offset, in line units
+} HandDrawnParams_t;
+
+/*
+ * @note caller is responsible for disposing of the batch with
+ * HandDrawnBatch_Destroy().
+ */
+HandDrawnBatch_t *HandDrawnBatch_Create(void);
+void HandDrawnBatch_Destroy(HandDrawnBatch_t *b);
+
+/*
+ * Replaces the contents of b with hand-drawn versions of lines[0, count).
+ * Each line gets as many points as its on-screen length calls for, within
+ * [MinPoints, MaxPoints], and a sideways jitter that scales with its segment
+ * length. params may be NULL for defaults that look like GetHandDawnLine().
+ *
+ * batch_id selects the random stream, and each point is jittered by its
+ * index in the batch, so the same lines, id and seed always give the same
+ * points. Returns false when out of memory.
+ */
+bool HandDrawnBatch_Generate(HandDrawnBatch_t *b, const Line2D_t *lines,
+                             size_t count, const HandDrawnParams_t *params,
+                             const Rng_t *rng, unsigned int batch_id);
+
+#endif  // HANDDRAWN_H
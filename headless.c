@@ -0,0 +1,86 @@
+#include "headless.h"
+#include <allegro5/allegro_image.h>
+#include <stdio.h>
+#include "capture.h"
+#include "trace.h"
+
+#define MAX_PATH_LEN (1024)
+
+bool Headless_Init(void) {
+  if (!al_init_image_addon()) {
+    fprintf(stderr, "ERROR: Failed to load image addon!\n");
+    return false;
+  }
+  return true;
+}
+
+ALLEGRO_BITMAP *Headless_CreateTarget(int width, int height) {
+  const int prev_flags = al_get_new_bitmap_flags();
+
+  al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+  ALLEGRO_BITMAP *bmp = al_create_bitmap(width, height);
+  al_set_new_bitmap_flags(prev_flags);
+
+  if (bmp == NULL) {
+    fprintf(stderr, "ERROR: Failed to create offscreen bitmap!\n");
+    return NULL;
+  }
+  al_set_target_bitmap(bmp);
+  return bmp;
+}
+
+bool Headless_SaveFrame(ALLEGRO_BITMAP *bmp, const char *out_dir,
+                        unsigned int frame) {
+  char path[MAX_PATH_LEN];
+  int len = snprintf(path, sizeof(path), "%s/frame_%05u.png", out_dir, frame);
+  if (len < 0 || len >= (int)sizeof(path)) {
+    fprintf(stderr, "ERROR: Output path is too long!\n");
+    return false;
+  }
+
+  if (!al_save_bitmap(path, bmp)) {
+    fprintf(stderr, "ERROR: Failed to save frame '%s'!\n", path);
+    return false;
+  }
+  return true;
+}
+
+bool Headless_Run(const Options_t *opts, ALLEGRO_BITMAP *target,
+                  double frame_time, void (*advance)(void *ctx, double now),
+                  void (*draw)(void *ctx), void *ctx) {
+  Capture_t *capture = NULL;
+  bool ok = true;
+
+  if (opts->CapturePath) {
+    capture =
+        Capture_Create(opts->CapturePath, al_get_bitmap_width(target),
+                       al_get_bitmap_height(target), 1.0 / frame_time);
+    if (capture == NULL) {
+      return false;
+    }
+  }
+
+  const double start = al_get_time();
+
+  for (unsigned int frame = 0; frame < opts->NumFrames && ok; frame++) {
+    advance(ctx, (frame + 1) * frame_time);
+    draw(ctx);
+    if (capture) {
+      ok = Capture_AddFrame(capture, target);
+    } else if (!opts->LastFrameOnly || frame + 1 == opts->NumFrames) {
+      ok = Headless_SaveFrame(target, opts->OutDir, frame);
+    }
+    TRACE_FRAME_END();
+  }
+  if (capture && !Capture_Destroy(capture)) {
+    ok = false;
+  }
+  if (!ok) {
+    return false;
+  }
+
+  const double elapsed = al_get_time() - start;
+  printf("Rendered %u frames in %.2f s (%.1f FPS)\n", opts->NumFrames, elapsed,
+         elapsed > 0.0 ? opts->NumFrames / elapsed : 0.0);
+  return true;
+}
@@ -0,0 +1,40 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <allegro5/allegro5.h>
+#include "options.h"
+
+/*
+ * Offscreen rendering for machines without a display. Frames are drawn into
+ * an Allegro memory bitmap and exported as a numbered PNG sequence
+ * (OutDir/frame_00000.png, OutDir/frame_00001.png, ...), or recorded to
+ * CapturePath when that is set.
+ */
+
+/*
+ * Loads the image addon needed for PNG export. Call after al_init().
+ */
+bool Headless_Init(void);
+
+/*
+ * Creates a memory bitmap of the given size and makes it the drawing target.
+ * Returns NULL on failure.
+ */
+ALLEGRO_BITMAP *Headless_CreateTarget(int width, int height);
+
+bool Headless_SaveFrame(ALLEGRO_BITMAP *bmp, const char *out_dir,
+                        unsigned int frame);
+
+/*
+ * Renders opts->NumFrames frames as fast as the CPU allows, saving or
+ * capturing target after every frame. Each frame calls advance(ctx, now)
+ * with the simulated time at the end of that frame (frame_time,
+ * 2 * frame_time, ...) and then draw(ctx), so the output matches a real-time
+ * run at 1 / frame_time FPS. With opts->LastFrameOnly only the last frame
+ * is saved, under its own number.
+ */
+bool Headless_Run(const Options_t *opts, ALLEGRO_BITMAP *target,
+                  double frame_time, void (*advance)(void *ctx, double now),
+                  void (*draw)(void *ctx), void *ctx);
+
+#endif  // HEADLESS_H
@@ -0,0 +1,701 @@
+#include "host.h"
+#include <allegro5/allegro_primitives.h>
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "headless.h"
+#include "pipeline.h"
+#include "trace.h"
+
+#define MAX_PATH_LEN (1024)
+#define PLUGIN_CHECK_INTERVAL_S (0.5)
+
+// A snapshot on its way from the simulation thread to the main thread
+typedef struct {
+  Snapshot_t Snapshot;
+  double Time;  // when its newest step was due, see Scheduler_Alpha()
+} Slot_t;
+
+typedef struct {
+  Host_t Host;
+  const Sketch_t *Sketch;
+  void *State;
+
+  // Only used with --pipeline
+  Pipeline_t *Pipeline;
+  Slot_t Slots[3];
+
+  // Only used by Host_MainPlugin()
+  const char *PluginPath;
+  struct timespec PluginMtime;   // of the loaded build
+  struct timespec PendingMtime;  // of a build that may still be written
+  unsigned int PluginLoads;
+  double NextPluginCheck;
+} Runtime_t;
+
+static bool Initialize(Runtime_t *rt);
+static void Terminate(Runtime_t *rt);
+static bool CreateRaster(Host_t *host);
+static void Draw(Runtime_t *rt);
+static void Render(void *ctx);
+static void ProcessInput(Runtime_t *rt, ALLEGRO_EVENT *ev);
+static void Advance(void *ctx, double now);
+static void CheckPlugin(Runtime_t *rt);
+static bool CanPipeline(const Sketch_t *sketch);
+static bool StartPipeline(Runtime_t *rt);
+static void StopPipeline(Runtime_t *rt);
+
+static int Run(Runtime_t *rt, int argc, char **argv) {
+  Host_t *host = &rt->Host;
+  const Sketch_t *sketch = rt->Sketch;
+  ALLEGRO_EVENT ev;
+  int ret = 0;
+
+  if (!Options_Parse(&host->Options, argc, argv)) {
+    Options_PrintUsage(argv[0]);
+    return 1;
+  }
+  if (sketch->ApiVersion != SKETCH_API_VERSION) {
+    fprintf(stderr, "ERROR: Sketch was built for host API %u, not %u!\n",
+            sketch->ApiVersion, SKETCH_API_VERSION);
+    return 1;
+  }
+#ifndef ENABLE_TRACE
+  if (host->Options.TracePath || host->Options.TraceOverlay) {
+    fprintf(stderr, "ERROR: Tracing is not built in, use make TRACE=1!\n");
+    return 1;
+  }
+#endif
+  if (host->Options.Pipeline && host->Options.Headless) {
+    fprintf(stderr, "ERROR: --pipeline needs a window!\n");
+    return 1;
+  }
+  if (host->Options.Pipeline && !CanPipeline(sketch)) {
+    fprintf(stderr, "ERROR: This sketch does not support --pipeline!\n");
+    return 1;
+  }
+
+  if (!Initialize(rt)) {
+    return 1;
+  }
+#ifdef ENABLE_TRACE
+  if (host->Options.TracePath || host->Options.TraceOverlay) {
+    Trace_Init();
+  }
+#endif
+  Damage_Init(&host->Damage, sketch->Width, sketch->Height);
+  View_Init(&host->View, sketch->Width, sketch->Height);
+  rt->State = sketch->Init(host);
+  if (rt->State == NULL) {
+    Terminate(rt);
+    return 1;
+  }
+  if (!Params_Check(&host->Options.Params)) {
+    sketch->Terminate(host, rt->State);
+    Terminate(rt);
+    return 1;
+  }
+  Scheduler_Init(&host->Scheduler, host->Options.SimRate,
+                 host->Options.MaxStepsPerFrame,
+                 host->Options.Headless ? 0.0 : al_get_time());
+  if (host->Options.Pipeline && !StartPipeline(rt)) {
+    sketch->Terminate(host, rt->State);
+    Terminate(rt);
+    return 1;
+  }
+
+  if (host->Options.Headless) {
+    if (!Headless_Run(&host->Options, host->Canvas, 1.0 / sketch->Fps,
+                      Advance, Render, rt)) {
+      ret = 1;
+    }
+  } else {
+    while (!host->Exit) {
+      TRACE_BEGIN(TRACE_PHASE_WAIT);
+      al_wait_for_event(host->Queue, &ev);
+      TRACE_END(TRACE_PHASE_WAIT);
+      TRACE_BEGIN(TRACE_PHASE_INPUT);
+      ProcessInput(rt, &ev);
+      TRACE_END(TRACE_PHASE_INPUT);
+
+      // Only timer ticks advance the simulation, unless it runs on a thread
+      // of its own; other events just get handled.
+      if (ev.type == ALLEGRO_EVENT_TIMER) {
+        if (rt->Pipeline) {
+          host->Frames++;
+        } else {
+          Advance(rt, al_get_time());
+        }
+        CheckPlugin(rt);
+      }
+      Draw(rt);
+    }
+  }
+
+  // The sketch may hold vertex buffers, which have to go before the display
+  // does. A failed restart after a reload leaves no state behind.
+  StopPipeline(rt);
+  if (rt->State) {
+    rt->Sketch->Terminate(host, rt->State);
+  }
+  if (host->Frames) {
+    printf("Frame time: %.2f ms update, %.2f ms render (%lu frames)\n",
+           1000.0 * host->UpdateTime / host->Frames,
+           1000.0 * host->RenderTime / host->Frames, host->Frames);
+  }
+  Terminate(rt);
+#ifdef ENABLE_TRACE
+  // Written once the pool's threads are gone
+  if (host->Options.TracePath && !Trace_Write(host->Options.TracePath)) {
+    ret = 1;
+  }
+  Trace_Shutdown();
+#endif
+  return ret;
+}
+
+int Host_Main(const Sketch_t *sketch, int argc, char **argv) {
+  Runtime_t rt = {.Sketch = sketch};
+  return Run(&rt, argc, argv);
+}
+
+static bool CopyFile(const char *from, const char *to) {
+  char buf[64 * 1024];
+  size_t n;
+  bool ok = true;
+
+  FILE *in = fopen(from, "rb");
+  if (in == NULL) {
+    return false;
+  }
+  FILE *out = fopen(to, "wb");
+  if (out == NULL) {
+    fclose(in);
+    return false;
+  }
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0 && ok) {
+    ok = fwrite(buf, 1, n, out) == n;
+  }
+  ok = ok && !ferror(in);
+  fclose(in);
+  return fclose(out) == 0 && ok;
+}
+
+/*
+ * Loads the sketch in rt->PluginPath. dlopen() hands back the library that
+ * is already loaded for a path it has seen, so every build is loaded from a
+ * copy of its own. Earlier builds are never unloaded: the running state may
+ * still point at their constants, and threads may still be returning
+ * through their code. Returns NULL after printing an error on failure.
+ */
+static const Sketch_t *LoadPlugin(Runtime_t *rt) {
+  char copy[MAX_PATH_LEN];
+  struct stat st;
+
+  if (stat(rt->PluginPath, &st) != 0) {
+    fprintf(stderr, "ERROR: Failed to find sketch '%s'!\n", rt->PluginPath);
+    return NULL;
+  }
+  const char *tmp = getenv("TMPDIR");
+  int len = snprintf(copy, sizeof(copy), "%s/sketch-%ld-%u.so",
+                     tmp ? tmp : "/tmp", (long)getpid(), rt->PluginLoads++);
+  if (len < 0 || len >= (int)sizeof(copy)) {
+    fprintf(stderr, "ERROR: Temporary path is too long!\n");
+    return NULL;
+  }
+  if (!CopyFile(rt->PluginPath, copy)) {
+    fprintf(stderr, "ERROR: Failed to copy sketch to '%s'!\n", copy);
+    unlink(copy);
+    return NULL;
+  }
+
+  void *lib = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+  unlink(copy);  // stays mapped
+  if (lib == NULL) {
+    fprintf(stderr, "ERROR: Failed to load sketch: %s!\n", dlerror());
+    return NULL;
+  }
+  const Sketch_t *(*get)(void) =
+      (const Sketch_t *(*)(void))dlsym(lib, SKETCH_ENTRY_POINT);
+  if (get == NULL) {
+    fprintf(stderr, "ERROR: '%s' does not export %s()!\n", rt->PluginPath,
+            SKETCH_ENTRY_POINT);
+    dlclose(lib);
+    return NULL;
+  }
+
+  rt->PluginMtime = rt->PendingMtime = st.st_mtim;
+  return get();
+}
+
+int Host_MainPlugin(const char *path, int argc, char **argv) {
+  Runtime_t rt = {.PluginPath = path};
+
+  rt.Sketch = LoadPlugin(&rt);
+  if (rt.Sketch == NULL) {
+    return 1;
+  }
+  return Run(&rt, argc, argv);
+}
+
+static bool SameTime(struct timespec a, struct timespec b) {
+  return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+/*
+ * Swaps in a rebuilt sketch. A new build is only loaded once its file has
+ * stayed unchanged for a whole check interval, so the linker is done writing
+ * it. A build that fails to load is reported once and the old code keeps
+ * running.
+ */
+static void CheckPlugin(Runtime_t *rt) {
+  Host_t *host = &rt->Host;
+  const double now = al_get_time();
+  struct stat st;
+
+  if (rt->PluginPath == NULL || now < rt->NextPluginCheck) {
+    return;
+  }
+  rt->NextPluginCheck = now + PLUGIN_CHECK_INTERVAL_S;
+  if (stat(rt->PluginPath, &st) != 0 ||
+      SameTime(st.st_mtim, rt->PluginMtime)) {
+    return;
+  }
+  if (!SameTime(st.st_mtim, rt->PendingMtime)) {
+    rt->PendingMtime = st.st_mtim;
+    return;
+  }
+
+  const Sketch_t *old = rt->Sketch;
+  const Sketch_t *sketch = LoadPlugin(rt);
+  rt->PluginMtime = st.st_mtim;
+  if (sketch == NULL) {
+    return;
+  }
+  if (sketch->ApiVersion != SKETCH_API_VERSION ||
+      sketch->Width != old->Width || sketch->Height != old->Height ||
+      (sketch->Flags & SKETCH_DAMAGE) != (old->Flags & SKETCH_DAMAGE) ||
+      (rt->Pipeline && !CanPipeline(sketch))) {
+    fprintf(stderr, "ERROR: Rebuilt sketch needs a restart, not reloaded!\n");
+    return;
+  }
+
+  // The simulation thread runs the old code, and snapshots have its layout
+  const bool pipeline = rt->Pipeline != NULL;
+  StopPipeline(rt);
+  if (sketch->StateSize == old->StateSize) {
+    rt->Sketch = sketch;
+    printf("Reloaded %s\n", rt->PluginPath);
+  } else {
+    old->Terminate(host, rt->State);
+    rt->Sketch = sketch;
+    rt->State = sketch->Init(host);
+    if (rt->State == NULL) {
+      host->Exit = true;
+      return;
+    }
+    printf("Restarted %s, its state changed size\n", rt->PluginPath);
+  }
+  if (pipeline && !StartPipeline(rt)) {
+    host->Exit = true;
+    return;
+  }
+  al_set_window_title(host->Display, sketch->Title);
+  Damage_AddAll(&host->Damage);
+}
+
+static bool Initialize(Runtime_t *rt) {
+  Host_t *host = &rt->Host;
+  const Sketch_t *sketch = rt->Sketch;
+  const bool damage = sketch->Flags & SKETCH_DAMAGE;
+
+  Rng_Init(&host->Rng, host->Options.Seed);
+  printf("Seed: %llu\n", (unsigned long long)host->Options.Seed);
+
+  if (!al_init()) {
+    fprintf(stderr, "ERROR: Failed to initialize allegro!\n");
+    goto init_fail;
+  }
+
+  if (!al_init_primitives_addon()) {
+    fprintf(stderr, "ERROR: Failed to load primitives addon!\n");
+    goto prim_addon_fail;
+  }
+
+  host->Pool = ThreadPool_Create(host->Options.NumThreads);
+  if (!host->Pool) {
+    fprintf(stderr, "ERROR: Failed to create thread pool!\n");
+    goto pool_fail;
+  }
+  host->RenderPool = host->Pool;
+  if (host->Options.Pipeline) {
+    host->RenderPool = ThreadPool_Create(host->Options.NumThreads);
+    if (!host->RenderPool) {
+      fprintf(stderr, "ERROR: Failed to create render thread pool!\n");
+      goto render_pool_fail;
+    }
+  }
+
+  if (host->Options.Headless) {
+    if (!Headless_Init()) {
+      goto headless_fail;
+    }
+    host->Canvas = Headless_CreateTarget(sketch->Width, sketch->Height);
+    if (!host->Canvas) {
+      goto headless_fail;
+    }
+    if (host->Options.Raster && !CreateRaster(host)) {
+      goto raster_fail;
+    }
+    return true;
+  }
+
+  host->Timer = al_create_timer(1.0 / sketch->Fps);
+  if (!host->Timer) {
+    fprintf(stderr, "ERROR: Failed to create timer!\n");
+    goto timer_fail;
+  }
+
+  if (damage) {
+    al_set_new_display_flags(ALLEGRO_GENERATE_EXPOSE_EVENTS);
+  }
+  host->Display = al_create_display(sketch->Width, sketch->Height);
+  if (!host->Display) {
+    fprintf(stderr, "ERROR: Failed to create display!\n");
+    goto disp_fail;
+  }
+
+  // The backbuffer is undefined after a flip, so frames of sketches that
+  // only redraw what changed are kept here. The rasterizer draws into memory,
+  // and the canvas is copied to the window when done.
+  if (host->Options.Raster) {
+    host->Canvas = Headless_CreateTarget(sketch->Width, sketch->Height);
+    if (!host->Canvas || !CreateRaster(host)) {
+      goto canvas_fail;
+    }
+  } else if (damage) {
+    host->Canvas = al_create_bitmap(sketch->Width, sketch->Height);
+    if (!host->Canvas) {
+      fprintf(stderr, "ERROR: Failed to create canvas!\n");
+      goto canvas_fail;
+    }
+    al_set_target_bitmap(host->Canvas);
+  }
+
+  if (!al_install_mouse() || !al_install_keyboard()) {
+    fprintf(stderr, "ERROR: Failed to install mouse and keyboard!\n");
+    goto input_fail;
+  }
+
+  host->Queue = al_create_event_queue();
+  if (!host->Queue) {
+    fprintf(stderr, "ERROR: Failed to create event queue!\n");
+    goto eq_fail;
+  }
+
+  al_register_event_source(host->Queue,
+                           al_get_display_event_source(host->Display));
+  al_register_event_source(host->Queue,
+                           al_get_timer_event_source(host->Timer));
+  al_register_event_source(host->Queue, al_get_mouse_event_source());
+  al_register_event_source(host->Queue, al_get_keyboard_event_source());
+
+  if (host->Options.CapturePath) {
+    host->Capture = Capture_Create(host->Options.CapturePath, sketch->Width,
+                                   sketch->Height, sketch->Fps);
+    if (!host->Capture) {
+      goto capture_fail;
+    }
+  }
+
+  al_set_window_title(host->Display, sketch->Title);
+  al_start_timer(host->Timer);
+
+  return true;
+
+capture_fail:
+eq_fail:
+input_fail:
+canvas_fail:
+disp_fail:
+timer_fail:
+raster_fail:
+headless_fail:
+render_pool_fail:
+  Terminate(rt);  // releases whatever was created
+pool_fail:
+prim_addon_fail:
+init_fail:
+  return false;
+}
+
+static void Terminate(Runtime_t *rt) {
+  Host_t *host = &rt->Host;
+
+  if (host->Capture && !Capture_Destroy(host->Capture)) {
+    fprintf(stderr, "ERROR: Capture is incomplete!\n");
+  }
+  if (host->RenderPool != host->Pool) {
+    ThreadPool_Destroy(host->RenderPool);
+  }
+  Raster_Destroy(host->Raster);
+  ThreadPool_Destroy(host->Pool);
+  if (host->Canvas) {
+    al_destroy_bitmap(host->Canvas);
+  }
+  if (host->Queue) {
+    al_destroy_event_queue(host->Queue);
+  }
+  if (host->Display) {
+    al_destroy_display(host->Display);
+  }
+  if (host->Timer) {
+    al_destroy_timer(host->Timer);
+  }
+}
+
+/*
+ * Creates the rasterizer for --raster, drawing into the canvas with the
+ * render pool, and makes it this thread's. Prints an error on failure.
+ */
+static bool CreateRaster(Host_t *host) {
+  host->Raster = Raster_Create(host->Canvas, host->RenderPool);
+  if (!host->Raster) {
+    fprintf(stderr, "ERROR: Failed to create rasterizer!\n");
+    return false;
+  }
+  Raster_MakeCurrent(host->Raster);
+  return true;
+}
+
+/*
+ * Shows a new frame. Sketches that track damage, and every sketch with
+ * --raster, draw into the canvas. When a sketch that tracks damage changed
+ * nothing on it and the window needs no repainting, the window keeps showing
+ * the last frame and no time is spent clearing, drawing or flipping. The
+ * trace overlay changes every frame, so it always repaints.
+ */
+static void Draw(Runtime_t *rt) {
+  Host_t *host = &rt->Host;
+  const bool damage = rt->Sketch->Flags & SKETCH_DAMAGE;
+
+  if (!host->Redraw || !al_is_event_queue_empty(host->Queue)) {
+    return;
+  }
+  host->Redraw = false;
+
+  if (damage && Damage_IsEmpty(&host->Damage) && !host->Present &&
+      !host->Options.TraceOverlay) {
+    TRACE_COUNT(TRACE_COUNT_UNCHANGED);
+    if (host->Capture) {
+      // The video still needs a frame
+      Capture_AddFrame(host->Capture, host->Canvas);
+    }
+    TRACE_FRAME_END();
+    return;
+  }
+  host->Present = false;
+
+  ALLEGRO_BITMAP *frame = al_get_backbuffer(host->Display);
+  if (host->Canvas) {
+    frame = host->Canvas;
+    al_set_target_bitmap(frame);
+  }
+  Render(rt);
+  if (host->Capture) {
+    TRACE_BEGIN(TRACE_PHASE_CAPTURE);
+    Capture_AddFrame(host->Capture, frame);
+    TRACE_END(TRACE_PHASE_CAPTURE);
+  }
+  if (host->Canvas) {
+    al_set_target_backbuffer(host->Display);
+    al_draw_bitmap(host->Canvas, 0, 0, 0);
+  }
+#ifdef ENABLE_TRACE
+  if (host->Options.TraceOverlay) {
+    TRACE_BEGIN(TRACE_PHASE_OVERLAY);
+    Trace_DrawOverlay();
+    TRACE_END(TRACE_PHASE_OVERLAY);
+  }
+#endif
+  TRACE_BEGIN(TRACE_PHASE_FLIP);
+  al_flip_display();
+  TRACE_END(TRACE_PHASE_FLIP);
+  TRACE_FRAME_END();
+}
+
+/*
+ * With --pipeline the newest snapshot is drawn, and how far between its last
+ * two steps to draw it is worked out here from the time its last step was
+ * due, much like Scheduler_Alpha() does for updates on this thread.
+ */
+static void RenderScene(void *ctx) {
+  Runtime_t *rt = ctx;
+
+  if (rt->Pipeline) {
+    Slot_t *slot = Pipeline_Latest(rt->Pipeline);
+    const double alpha =
+        (al_get_time() - slot->Time) * rt->Host.Options.SimRate;
+    slot->Snapshot.Alpha = fmin(fmax(alpha, 0.0), 1.0);
+    rt->Sketch->RenderSnapshot(&rt->Host, rt->State, &slot->Snapshot);
+    return;
+  }
+  rt->Sketch->Render(&rt->Host, rt->State);
+}
+
+/*
+ * Draws one frame into the current target bitmap: the backbuffer, or the
+ * canvas. A SKETCH_DAMAGE sketch only redraws the damaged parts; the canvas
+ * keeps its contents between frames, so the rest is still up to date. With
+ * --raster the primitives are only recorded while the sketch draws, and
+ * rasterized into the canvas at the end.
+ */
+static void Render(void *ctx) {
+  Runtime_t *rt = ctx;
+  const double start = al_get_time();
+
+  TRACE_BEGIN(TRACE_PHASE_RENDER);
+  if (rt->Sketch->Flags & SKETCH_DAMAGE) {
+    Damage_Redraw(&rt->Host.Damage, RenderScene, rt);
+  } else {
+    RenderScene(rt);
+  }
+  if (rt->Host.Raster && !Raster_Flush(rt->Host.Raster)) {
+    fprintf(stderr, "ERROR: Failed to rasterize the frame!\n");
+  }
+  TRACE_END(TRACE_PHASE_RENDER);
+  rt->Host.RenderTime += al_get_time() - start;
+}
+
+static void ProcessInput(Runtime_t *rt, ALLEGRO_EVENT *ev) {
+  Host_t *host = &rt->Host;
+
+  if (ev->type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
+    host->Exit = true;
+  } else if (ev->type == ALLEGRO_EVENT_DISPLAY_EXPOSE ||
+             ev->type == ALLEGRO_EVENT_DISPLAY_SWITCH_IN) {
+    host->Present = true;
+    host->Redraw = true;
+  } else if (ev->type == ALLEGRO_EVENT_TIMER) {
+    if (host->Redraw) {
+      TRACE_COUNT(TRACE_COUNT_COALESCED);
+    }
+    host->Redraw = true;
+  } else if (View_HandleEvent(&host->View, ev)) {
+    // Everything on screen moved
+    Damage_AddAll(&host->Damage);
+  }
+}
+
+/*
+ * Runs as many fixed simulation steps as fit into the time since the last
+ * call and returns how many.
+ */
+static unsigned int RunSteps(Runtime_t *rt, double now) {
+  Host_t *host = &rt->Host;
+  const double start = al_get_time();
+  const uint64_t dropped = host->Scheduler.DroppedSteps;
+
+  TRACE_BEGIN(TRACE_PHASE_UPDATE);
+  const unsigned int steps = Scheduler_Advance(&host->Scheduler, now);
+  if (rt->Sketch->BeginFrame) {
+    rt->Sketch->BeginFrame(host, rt->State);
+  }
+  for (unsigned int i = 0; i < steps; i++) {
+    rt->Sketch->Update(host, rt->State, host->Scheduler.Step);
+  }
+  TRACE_END(TRACE_PHASE_UPDATE);
+  if (host->Scheduler.DroppedSteps != dropped) {
+    TRACE_COUNT(TRACE_COUNT_DROPPED);
+  }
+  host->UpdateTime += al_get_time() - start;
+  return steps;
+}
+
+/*
+ * Simulates up to the time of the frame about to be drawn.
+ */
+static void Advance(void *ctx, double now) {
+  Runtime_t *rt = ctx;
+
+  RunSteps(rt, now);
+  rt->Host.Frames++;
+}
+
+static bool CanPipeline(const Sketch_t *sketch) {
+  return sketch->CreateSnapshot && sketch->DestroySnapshot &&
+         sketch->Snapshot && sketch->RenderSnapshot &&
+         !(sketch->Flags & SKETCH_DAMAGE);
+}
+
+/*
+ * Body of the simulation thread with --pipeline. Wakes up when the next step
+ * is due, so the newest snapshot is never much more than a step old, runs
+ * the steps and copies the result into snapshot.
+ */
+static bool Produce(void *ctx, void *snapshot, double *next) {
+  Runtime_t *rt = ctx;
+  Host_t *host = &rt->Host;
+  Slot_t *slot = snapshot;
+  const double now = al_get_time();
+
+  const unsigned int steps = RunSteps(rt, now);
+  *next = now + host->Scheduler.Step - host->Scheduler.Accumulator;
+  // A snapshot that never held a state takes one anyway: the first one is
+  // drawn before any step ran.
+  if (steps == 0 && slot->Time != 0) {
+    return false;
+  }
+
+  TRACE_BEGIN(TRACE_PHASE_SNAPSHOT);
+  rt->Sketch->Snapshot(host, rt->State, slot->Snapshot.Data);
+  slot->Snapshot.TotalSteps = host->Scheduler.TotalSteps;
+  slot->Time = now - host->Scheduler.Accumulator;
+  TRACE_END(TRACE_PHASE_SNAPSHOT);
+  return true;
+}
+
+/*
+ * Moves updates to a simulation thread, after which the main thread only
+ * ever touches the state through RenderSnapshot(). Returns false after
+ * printing an error.
+ */
+static bool StartPipeline(Runtime_t *rt) {
+  Host_t *host = &rt->Host;
+  void *slots[3];
+
+  for (int i = 0; i < 3; i++) {
+    Slot_t *slot = &rt->Slots[i];
+    slot->Snapshot.Data = rt->Sketch->CreateSnapshot(host, rt->State);
+    slot->Time = 0;
+    if (slot->Snapshot.Data == NULL) {
+      StopPipeline(rt);
+      return false;
+    }
+    slots[i] = slot;
+  }
+  rt->Pipeline = Pipeline_Create(slots, Produce, rt);
+  if (rt->Pipeline == NULL) {
+    StopPipeline(rt);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Joins the simulation thread and releases the snapshots, if there are any.
+ */
+static void StopPipeline(Runtime_t *rt) {
+  Pipeline_Destroy(rt->Pipeline);
+  rt->Pipeline = NULL;
+  for (int i = 0; i < 3; i++) {
+    Slot_t *slot = &rt->Slots[i];
+    if (slot->Snapshot.Data) {
+      rt->Sketch->DestroySnapshot(&rt->Host, rt->State, slot->Snapshot.Data);
+      slot->Snapshot.Data = NULL;
+    }
+  }
+}
@@ -0,0 +1,141 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <allegro5/allegro5.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "capture.h"
+#include "damage.h"
+#include "options.h"
+#include "raster.h"
+#include "rng.h"
+#include "scheduler.h"
+#include "thread_pool.h"
+#include "view.h"
+
+/*
+ * Runtime shared by all sketches. The host parses the options and owns
+ * Allegro, the window or headless canvas, the timer and event loop, the
+ * fixed timestep scheduler, the thread pool, the random numbers, capture and
+ * frame timing. A sketch only provides a Sketch_t of callbacks and keeps
+ * everything else in a state of its own.
+ *
+ * A sketch is either linked into an executable of its own, where
+ * SKETCH_DEFINE() provides main(), or built as a shared object with
+ * -DSKETCH_PLUGIN and run by sketch_host:
+ *
+ *   ./sketch_host ./beat_square.so --particles 100000
+ *
+ * sketch_host reloads the shared object when it is rebuilt. Everything a
+ * sketch keeps between callbacks has to live in the state its Init()
+ * returned, since the new code starts with fresh globals but gets the old
+ * state, so a long simulation carries on with the new update and drawing
+ * code. When StateSize changed the layout can no longer be trusted; the old
+ * code terminates its state and the new code starts over.
+ */
+#define SKETCH_API_VERSION (2)
+
+// Sketch_t.Flags
+#define SKETCH_DAMAGE (1u << 0)  // only redraw Host_t.Damage, see damage.h
+
+typedef struct {
+  Options_t Options;
+  Rng_t Rng;
+  Scheduler_t Scheduler;
+  ThreadPool_t *Pool;
+  // Pool to draw with. The same as Pool, except with --pipeline, where
+  // updates and drawing run at the same time and each has a pool of its own.
+  ThreadPool_t *RenderPool;
+  ALLEGRO_DISPLAY *Display;  // NULL in headless mode
+  // Offscreen target in headless mode, and the window's contents between
+  // frames for SKETCH_DAMAGE sketches or with --raster.
+  ALLEGRO_BITMAP *Canvas;
+  Raster_t *Raster;    // draws into the canvas with --raster, see raster.h
+  Damage_t Damage;     // what SKETCH_DAMAGE sketches changed since drawn
+  View_t View;         // pan and zoom of the window, for sketches that use it
+  Capture_t *Capture;  // records the window, if asked to
+
+  ALLEGRO_EVENT_QUEUE *Queue;
+  ALLEGRO_TIMER *Timer;
+  bool Redraw;
+  bool Present;  // canvas needs to be shown again as it is
+  bool Exit;
+
+  // Time spent in the sketch, reported on exit
+  unsigned long Frames;
+  double UpdateTime;
+  double RenderTime;
+} Host_t;
+
+// What Sketch_t.RenderSnapshot() draws with --pipeline
+typedef struct {
+  uint64_t TotalSteps;  // Scheduler_t.TotalSteps when it was taken
+  float Alpha;          // fraction of a step past them, see Scheduler_Alpha()
+  void *Data;           // from Sketch_t.CreateSnapshot()
+} Snapshot_t;
+
+typedef struct {
+  unsigned int ApiVersion;  // SKETCH_API_VERSION
+  const char *Title;
+  int Width;
+  int Height;
+  double Fps;
+  unsigned int Flags;
+  size_t StateSize;  // size of what Init() returns, checked on reload
+
+  /*
+   * Creates the sketch's state once the host and the drawing target are up.
+   * Returns NULL after printing an error on failure.
+   */
+  void *(*Init)(Host_t *host);
+  // Releases the state. Called while the display still exists.
+  void (*Terminate)(Host_t *host, void *state);
+  // Optional. Called once per frame, before that frame's updates, or with
+  // --pipeline before every batch of updates.
+  void (*BeginFrame)(Host_t *host, void *state);
+  // Runs one fixed simulation step of dt seconds.
+  void (*Update)(Host_t *host, void *state, double dt);
+  // Draws a frame into the current target bitmap.
+  void (*Render)(Host_t *host, void *state);
+
+  /*
+   * Optional, all four or none, and needed for --pipeline. Update() then
+   * runs on a simulation thread of its own, which copies what drawing needs
+   * out of the state with Snapshot() after every step into one of three
+   * snapshots made by CreateSnapshot(). The main thread meanwhile draws the
+   * newest complete one with RenderSnapshot(), which must leave alone
+   * whatever Update() writes, must not look at host->Scheduler, and draws
+   * with host->RenderPool. Not for SKETCH_DAMAGE sketches.
+   */
+  void *(*CreateSnapshot)(Host_t *host, void *state);
+  void (*DestroySnapshot)(Host_t *host, void *state, void *data);
+  void (*Snapshot)(Host_t *host, void *state, void *data);
+  void (*RenderSnapshot)(Host_t *host, void *state,
+                         const Snapshot_t *snapshot);
+} Sketch_t;
+
+/*
+ * Runs sketch until the window is closed or the headless frames are done.
+ * Returns the process exit status.
+ */
+int Host_Main(const Sketch_t *sketch, int argc, char **argv);
+
+/*
+ * Like Host_Main() for the sketch in the shared object at path, which is
+ * watched for changes and reloaded while the window is open.
+ */
+int Host_MainPlugin(const char *path, int argc, char **argv);
+
+// Symbol a sketch's shared object exports, const Sketch_t *Sketch_Get(void)
+#define SKETCH_ENTRY_POINT "Sketch_Get"
+
+#ifdef SKETCH_PLUGIN
+#define SKETCH_DEFINE(sketch) \
+  const Sketch_t *Sketch_Get(void) { return &(sketch); }
+#else
+#define SKETCH_DEFINE(sketch) \
+  int main(int argc, char **argv) { return Host_Main(&(sketch), argc, argv); }
+#endif
+
+#endif  // HOST_H
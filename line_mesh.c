@@ -0,0 +1,277 @@
+#include "line_mesh.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raster.h"
+
+#define MITER_LIMIT (4.0f)  // longest miter, in half thicknesses
+#define HAIRLINE_PX (1.0f)
+
+LineMesh_t *LineMesh_Create(void) {
+  LineMesh_t *m = calloc(1, sizeof(*m));
+  if (m == NULL) {
+    return NULL;
+  }
+  ALLEGRO_BITMAP *target = al_get_target_bitmap();
+  m->Gpu = target && !(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP);
+  return m;
+}
+
+void LineMesh_Destroy(LineMesh_t *m) {
+  if (m == NULL) {
+    return;
+  }
+  if (m->Vertices) {
+    al_destroy_vertex_buffer(m->Vertices);
+  }
+  free(m->CpuVertices);
+  free(m->Points);
+  free(m->Items);
+  free(m);
+}
+
+void LineMesh_Begin(LineMesh_t *m) {
+  m->NumItems = 0;
+  m->NumVerts = 0;
+  m->NumPoints = 0;
+}
+
+/*
+ * 64-bit FNV-1a over 32-bit words; the inputs are all floats.
+ */
+static uint64_t HashWords(uint64_t h, const void *data, size_t bytes) {
+  const uint8_t *p = data;
+  for (size_t i = 0; i + 4 <= bytes; i += 4) {
+    uint32_t w;
+    memcpy(&w, p + i, sizeof(w));
+    h = (h ^ w) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+static bool Reserve(LineMesh_t *m, size_t items, int verts, int points) {
+  if (items > m->ItemCapacity) {
+    const size_t cap = items * 2;
+    LineMeshItem_t *it = realloc(m->Items, cap * sizeof(*it));
+    if (it == NULL) {
+      return false;
+    }
+    m->Items = it;
+    m->ItemCapacity = cap;
+  }
+  if (verts > m->VertCapacity) {
+    const int cap = verts * 2;
+    ALLEGRO_VERTEX *v = realloc(m->CpuVertices, cap * sizeof(*v));
+    if (v == NULL) {
+      return false;
+    }
+    m->CpuVertices = v;
+    m->VertCapacity = cap;
+  }
+  if (points > m->PointCapacity) {
+    const int cap = points * 2;
+    float *p = realloc(m->Points, 2 * cap * sizeof(*p));
+    if (p == NULL) {
+      return false;
+    }
+    m->Points = p;
+    m->PointCapacity = cap;
+  }
+  return true;
+}
+
+static void SetVertex(ALLEGRO_VERTEX *v, float x, float y,
+                      ALLEGRO_COLOR color) {
+  v->x = x;
+  v->y = y;
+  v->z = 0;
+  v->u = 0;
+  v->v = 0;
+  v->color = color;
+}
+
+/*
+ * Writes the strip for one polyline: a left and a right vertex per point,
+ * offset along the mitred normal, plus a copy of the first and last vertex
+ * so consecutive lines are joined by degenerate triangles.
+ */
+static void Tessellate(ALLEGRO_VERTEX *out, const Point2D_t *pts, size_t n,
+                       ALLEGRO_COLOR color, float thickness) {
+  const float hw = 0.5f * (thickness > 0 ? thickness : HAIRLINE_PX);
+  float prev_nx = 0;
+  float prev_ny = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    // Normal of the segment leaving this point; the last point reuses the
+    // one arriving at it. Zero length segments keep the previous normal.
+    float nx = prev_nx;
+    float ny = prev_ny;
+    if (i + 1 < n) {
+      const float dx = pts[i + 1].x - pts[i].x;
+      const float dy = pts[i + 1].y - pts[i].y;
+      const float len = sqrtf(dx * dx + dy * dy);
+      if (len > 0) {
+        nx = -dy / len;
+        ny = dx / len;
+      }
+    }
+    if (i == 0) {
+      prev_nx = nx;
+      prev_ny = ny;
+    }
+
+    // Miter: the average of both normals, stretched so the edges stay hw
+    // away from the centre line, but not without bound at sharp turns.
+    float mx = prev_nx + nx;
+    float my = prev_ny + ny;
+    const float mlen = sqrtf(mx * mx + my * my);
+    float scale = hw;
+    if (mlen > 1e-6f) {
+      mx /= mlen;
+      my /= mlen;
+      const float cos_half = mx * nx + my * ny;
+      scale = hw / fmaxf(cos_half, 1.0f / MITER_LIMIT);
+    } else {
+      mx = nx;
+      my = ny;
+    }
+
+    SetVertex(&out[1 + 2 * i], pts[i].x + mx * scale, pts[i].y + my * scale,
+              color);
+    SetVertex(&out[2 + 2 * i], pts[i].x - mx * scale, pts[i].y - my * scale,
+              color);
+    prev_nx = nx;
+    prev_ny = ny;
+  }
+  out[0] = out[1];
+  out[2 * n + 1] = out[2 * n];
+}
+
+static bool AddPoints(LineMesh_t *m, const Point2D_t *pts, size_t n,
+                      ALLEGRO_COLOR color, float thickness) {
+  const int num_verts = n >= 2 ? 2 * (int)n + 2 : 0;
+  const size_t item = m->NumItems;
+  const int first = m->NumVerts;
+  const int first_point = m->NumPoints;
+  uint64_t h = 0xcbf29ce484222325ull;
+
+  h = HashWords(h, &n, sizeof(n));
+  h = HashWords(h, pts, n * sizeof(*pts));
+  h = HashWords(h, &color, sizeof(color));
+  h = HashWords(h, &thickness, sizeof(thickness));
+
+  if (!Reserve(m, item + 1, first + num_verts, first_point + (int)n)) {
+    return false;
+  }
+
+  LineMeshItem_t *it = &m->Items[item];
+  const bool same = item < m->PrevNumItems && it->Hash == h &&
+                    it->FirstVert == first && it->NumVerts == num_verts &&
+                    it->FirstPoint == first_point;
+  if (!same) {
+    if (num_verts > 0) {
+      Tessellate(&m->CpuVertices[first], pts, n, color, thickness);
+      m->Tessellations++;
+    }
+    float *xy = &m->Points[2 * first_point];
+    for (size_t i = 0; i < n; i++) {
+      xy[2 * i] = pts[i].x;
+      xy[2 * i + 1] = pts[i].y;
+    }
+    it->Hash = h;
+    it->FirstVert = first;
+    it->NumVerts = num_verts;
+    it->FirstPoint = first_point;
+    it->NumPoints = (int)n;
+    it->Color = color;
+    it->Thickness = thickness;
+    // Lines are added front to back, so the range only grows at the end.
+    if (m->DirtyBegin == m->DirtyEnd) {
+      m->DirtyBegin = first;
+    }
+    m->DirtyEnd = first + num_verts;
+  }
+  m->NumItems = item + 1;
+  m->NumVerts = first + num_verts;
+  m->NumPoints = first_point + (int)n;
+  return true;
+}
+
+bool LineMesh_AddPolyLine(LineMesh_t *m, const PolyLine2D_t *pl) {
+  const ALLEGRO_COLOR color =
+      al_map_rgb(pl->Color.r, pl->Color.g, pl->Color.b);
+  return AddPoints(m, pl->Points, pl->NumPoints, color, pl->Thickness);
+}
+
+bool LineMesh_AddLine(LineMesh_t *m, float x0, float y0, float x1, float y1,
+                      ALLEGRO_COLOR color, float thickness) {
+  const Point2D_t pts[2] = {{.x = x0, .y = y0}, {.x = x1, .y = y1}};
+  return AddPoints(m, pts, 2, color, thickness);
+}
+
+/*
+ * Copies the changed range into the vertex buffer, recreating the buffer
+ * when the mesh outgrew it. Any failure leaves the mesh on the CPU path.
+ */
+static void Upload(LineMesh_t *m) {
+  if (!m->Gpu || m->NumVerts == 0) {
+    return;
+  }
+  if (m->Vertices == NULL || m->NumVerts > m->BufferCapacity) {
+    if (m->Vertices) {
+      al_destroy_vertex_buffer(m->Vertices);
+    }
+    m->BufferCapacity = m->VertCapacity;
+    m->Vertices = al_create_vertex_buffer(NULL, m->CpuVertices,
+                                          m->BufferCapacity,
+                                          ALLEGRO_PRIM_BUFFER_DYNAMIC);
+    return;
+  }
+  const int begin = m->DirtyBegin;
+  const int end = m->DirtyEnd < m->NumVerts ? m->DirtyEnd : m->NumVerts;
+  if (begin >= end) {
+    return;
+  }
+  ALLEGRO_VERTEX *dst =
+      al_lock_vertex_buffer(m->Vertices, begin, end - begin,
+                            ALLEGRO_LOCK_WRITEONLY);
+  if (dst == NULL) {
+    al_destroy_vertex_buffer(m->Vertices);
+    m->Vertices = NULL;
+    return;
+  }
+  memcpy(dst, &m->CpuVertices[begin], (end - begin) * sizeof(*dst));
+  al_unlock_vertex_buffer(m->Vertices);
+}
+
+void LineMesh_End(LineMesh_t *m) {
+  if (m->DirtyBegin < m->DirtyEnd) {
+    Upload(m);
+  }
+  m->DirtyBegin = m->DirtyEnd = 0;
+  m->PrevNumItems = m->NumItems;
+}
+
+void LineMesh_Draw(const LineMesh_t *m) {
+  if (m->NumVerts == 0) {
+    return;
+  }
+  Raster_t *raster = Raster_GetCurrent();
+  if (raster) {
+    for (size_t i = 0; i < m->NumItems; i++) {
+      const LineMeshItem_t *it = &m->Items[i];
+      if (it->NumPoints >= 2) {
+        Raster_AddPolyLine(raster, &m->Points[2 * it->FirstPoint],
+                           it->NumPoints, it->Color, it->Thickness);
+      }
+    }
+    return;
+  }
+  if (m->Vertices) {
+    al_draw_vertex_buffer(m->Vertices, NULL, 0, m->NumVerts,
+                          ALLEGRO_PRIM_TRIANGLE_STRIP);
+  } else {
+    al_draw_prim(m->CpuVertices, NULL, NULL, 0, m->NumVerts,
+                 ALLEGRO_PRIM_TRIANGLE_STRIP);
+  }
+}
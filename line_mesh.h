@@ -0,0 +1,84 @@
+#ifndef LINE_MESH_H
+#define LINE_MESH_H
+
+#include <allegro5/allegro5.h>
+#include <allegro5/allegro_primitives.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "procgenlib.h"
+
+/*
+ * Retained thick-line geometry. Polylines are tessellated once into a single
+ * triangle strip that lives in a vertex buffer, and every frame the whole
+ * mesh is drawn with one call. Like PrimBatch_t it falls back to a CPU-side
+ * array when no vertex buffer can be created.
+ *
+ * The mesh is filled between LineMesh_Begin() and LineMesh_End(). Every line
+ * added is hashed, and a line that is the same as the one added in the same
+ * position last time is neither tessellated nor uploaded again, so
+ * re-adding an unchanged scene every frame only costs the hashing, and a
+ * scene that is never re-added costs nothing but the draw call.
+ *
+ * The points are kept as well, so with a rasterizer current (see raster.h)
+ * every line is drawn from them as one antialiased polyline rather than from
+ * the strip.
+ */
+typedef struct {
+  uint64_t Hash;  // of the points, color and thickness
+  int FirstVert;
+  int NumVerts;
+  int FirstPoint;  // x, y pair in Points
+  int NumPoints;
+  ALLEGRO_COLOR Color;
+  float Thickness;
+} LineMeshItem_t;
+
+typedef struct {
+  ALLEGRO_VERTEX_BUFFER *Vertices;  // NULL when using the CPU path
+  int BufferCapacity;               // vertices the vertex buffer holds
+  bool Gpu;                         // target supported vertex buffers
+  ALLEGRO_VERTEX *CpuVertices;      // always kept, the upload source
+  int VertCapacity;
+  int NumVerts;
+  float *Points;  // x, y pairs of every line, for the rasterizer
+  int PointCapacity;
+  int NumPoints;
+  LineMeshItem_t *Items;
+  size_t ItemCapacity;
+  size_t NumItems;
+  size_t PrevNumItems;  // items of the last build that can be reused
+  int DirtyBegin;  // vertices changed since the last upload
+  int DirtyEnd;
+  size_t Tessellations;  // lines tessellated so far, for profiling
+} LineMesh_t;
+
+/*
+ * Creates an empty mesh for the current target bitmap. Must be called after
+ * the display (or headless canvas) exists.
+ *
+ * @note caller is responsible for disposing of the mesh with
+ * LineMesh_Destroy().
+ */
+LineMesh_t *LineMesh_Create(void);
+void LineMesh_Destroy(LineMesh_t *m);
+
+void LineMesh_Begin(LineMesh_t *m);
+
+/*
+ * Adds a polyline of the given thickness, or a 1 pixel wide one when the
+ * thickness is not positive. Returns false when out of memory.
+ */
+bool LineMesh_AddPolyLine(LineMesh_t *m, const PolyLine2D_t *pl);
+bool LineMesh_AddLine(LineMesh_t *m, float x0, float y0, float x1, float y1,
+                      ALLEGRO_COLOR color, float thickness);
+
+/*
+ * Drops whatever was not added again since LineMesh_Begin() and uploads the
+ * vertices that changed.
+ */
+void LineMesh_End(LineMesh_t *m);
+
+void LineMesh_Draw(const LineMesh_t *m);
+
+#endif  // LINE_MESH_H
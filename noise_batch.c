@@ -0,0 +1,369 @@
+#include "noise_batch.h"
+#include <stdbool.h>
+#include "noise1234.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_BATCH_X86 (1)
+#include <immintrin.h>
+#endif
+
+#define LANES (8)
+
+/*
+ * Periods are applied before the 0..255 wrap, exactly like pnoise*(). The
+ * plain functions wrap only, which a period of 0 stands for below.
+ */
+typedef struct {
+  int px, py, pz;
+} Periods_t;
+
+static void Noise1_Scalar(const float *x, float *out, size_t count,
+                          const Periods_t *p) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = p->px ? pnoise1(x[i], p->px) : noise1(x[i]);
+  }
+}
+
+static void Noise2_Scalar(const float *x, const float *y, float *out,
+                          size_t count, const Periods_t *p) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = p->px ? pnoise2(x[i], y[i], p->px, p->py) : noise2(x[i], y[i]);
+  }
+}
+
+static void Noise3_Scalar(const float *x, const float *y, const float *z,
+                          float *out, size_t count, const Periods_t *p) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = p->px ? pnoise3(x[i], y[i], z[i], p->px, p->py, p->pz)
+                   : noise3(x[i], y[i], z[i]);
+  }
+}
+
+#ifdef NOISE_BATCH_X86
+/*
+ * Ken Perlin's permutation, repeated so that perm[i + perm[j]] never needs a
+ * wrap. The same table noise1234.c uses, widened to 32 bits for gathers.
+ */
+static const int perm[512] = {
+    151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233, 7,
+    225, 140, 36,  103, 30,  69,  142, 8,   99,  37,  240, 21,  10,  23,  190,
+    6,   148, 247, 120, 234, 75,  0,   26,  197, 62,  94,  252, 219, 203, 117,
+    35,  11,  32,  57,  177, 33,  88,  237, 149, 56,  87,  174, 20,  125, 136,
+    171, 168, 68,  175, 74,  165, 71,  134, 139, 48,  27,  166, 77,  146, 158,
+    231, 83,  111, 229, 122, 60,  211, 133, 230, 220, 105, 92,  41,  55,  46,
+    245, 40,  244, 102, 143, 54,  65,  25,  63,  161, 1,   216, 80,  73,  209,
+    76,  132, 187, 208, 89,  18,  169, 200, 196, 135, 130, 116, 188, 159, 86,
+    164, 100, 109, 198, 173, 186, 3,   64,  52,  217, 226, 250, 124, 123, 5,
+    202, 38,  147, 118, 126, 255, 82,  85,  212, 207, 206, 59,  227, 47,  16,
+    58,  17,  182, 189, 28,  42,  223, 183, 170, 213, 119, 248, 152, 2,   44,
+    154, 163, 70,  221, 153, 101, 155, 167, 43,  172, 9,   129, 22,  39,  253,
+    19,  98,  108, 110, 79,  113, 224, 232, 178, 185, 112, 104, 218, 246, 97,
+    228, 251, 34,  242, 193, 238, 210, 144, 12,  191, 179, 162, 241, 81,  51,
+    145, 235, 249, 14,  239, 107, 49,  192, 214, 31,  181, 199, 106, 157, 184,
+    84,  204, 176, 115, 121, 50,  45,  127, 4,   150, 254, 138, 236, 205, 93,
+    222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156,
+    180, 151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233,
+    7,   225, 140, 36,  103, 30,  69,  142, 8,   99,  37,  240, 21,  10,  23,
+    190, 6,   148, 247, 120, 234, 75,  0,   26,  197, 62,  94,  252, 219, 203,
+    117, 35,  11,  32,  57,  177, 33,  88,  237, 149, 56,  87,  174, 20,  125,
+    136, 171, 168, 68,  175, 74,  165, 71,  134, 139, 48,  27,  166, 77,  146,
+    158, 231, 83,  111, 229, 122, 60,  211, 133, 230, 220, 105, 92,  41,  55,
+    46,  245, 40,  244, 102, 143, 54,  65,  25,  63,  161, 1,   216, 80,  73,
+    209, 76,  132, 187, 208, 89,  18,  169, 200, 196, 135, 130, 116, 188, 159,
+    86,  164, 100, 109, 198, 173, 186, 3,   64,  52,  217, 226, 250, 124, 123,
+    5,   202, 38,  147, 118, 126, 255, 82,  85,  212, 207, 206, 59,  227, 47,
+    16,  58,  17,  182, 189, 28,  42,  223, 183, 170, 213, 119, 248, 152, 2,
+    44,  154, 163, 70,  221, 153, 101, 155, 167, 43,  172, 9,   129, 22,  39,
+    253, 19,  98,  108, 110, 79,  113, 224, 232, 178, 185, 112, 104, 218, 246,
+    97,  228, 251, 34,  242, 193, 238, 210, 144, 12,  191, 179, 162, 241, 81,
+    51,  145, 235, 249, 14,  239, 107, 49,  192, 214, 31,  181, 199, 106, 157,
+    184, 84,  204, 176, 115, 121, 50,  45,  127, 4,   150, 254, 138, 236, 205,
+    93,  222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,
+    156, 180};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i Perm(__m256i i) {
+  return _mm256_i32gather_epi32(perm, i, 4);
+}
+
+// FASTFLOOR(x): (int)x < x ? (int)x : (int)x - 1
+AVX2 static inline __m256i FastFloor(__m256 x) {
+  const __m256i t = _mm256_cvttps_epi32(x);
+  const __m256 lt = _mm256_cmp_ps(_mm256_cvtepi32_ps(t), x, _CMP_LT_OQ);
+  return _mm256_add_epi32(t, _mm256_xor_si256(_mm256_castps_si256(lt),
+                                              _mm256_set1_epi32(-1)));
+}
+
+// FADE(t): t * t * t * (t * (t * 6 - 15) + 10)
+AVX2 static inline __m256 Fade(__m256 t) {
+  const __m256 t3 = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+  __m256 f = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)),
+                           _mm256_set1_ps(15.0f));
+  f = _mm256_add_ps(_mm256_mul_ps(t, f), _mm256_set1_ps(10.0f));
+  return _mm256_mul_ps(t3, f);
+}
+
+// LERP(t, a, b): a + t * (b - a)
+AVX2 static inline __m256 Lerp(__m256 t, __m256 a, __m256 b) {
+  return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+// Moves bit `bit` of h into the float sign bit.
+AVX2 static inline __m256 SignFromBit(__m256i h, int bit) {
+  return _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1 << bit)),
+                        31 - bit));
+}
+
+AVX2 static inline __m256 Grad1(__m256i hash, __m256 x) {
+  const __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+  __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(h, _mm256_set1_epi32(7)));
+  g = _mm256_add_ps(_mm256_set1_ps(1.0f), g);
+  g = _mm256_xor_ps(g, SignFromBit(h, 3));
+  return _mm256_mul_ps(g, x);
+}
+
+AVX2 static inline __m256 Grad2(__m256i hash, __m256 x, __m256 y) {
+  const __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(7));
+  const __m256 lt4 =
+      _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+  const __m256 u = _mm256_blendv_ps(y, x, lt4);
+  const __m256 v = _mm256_blendv_ps(x, y, lt4);
+  const __m256 v2 = _mm256_mul_ps(_mm256_set1_ps(2.0f), v);
+  return _mm256_add_ps(_mm256_xor_ps(u, SignFromBit(h, 0)),
+                       _mm256_xor_ps(v2, SignFromBit(h, 1)));
+}
+
+AVX2 static inline __m256 Grad3(__m256i hash, __m256 x, __m256 y, __m256 z) {
+  const __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+  const __m256 lt8 =
+      _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+  const __m256 lt4 =
+      _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+  const __m256 is12or14 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+      _mm256_or_si256(h, _mm256_set1_epi32(2)), _mm256_set1_epi32(14)));
+  const __m256 u = _mm256_blendv_ps(y, x, lt8);
+  const __m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, is12or14), y, lt4);
+  return _mm256_add_ps(_mm256_xor_ps(u, SignFromBit(h, 0)),
+                       _mm256_xor_ps(v, SignFromBit(h, 1)));
+}
+
+/*
+ * i % p with C semantics (truncating, sign of i), which AVX2 has no
+ * instruction for. The double quotient is exact enough for any 32-bit i and
+ * p that truncating it gives the integer quotient.
+ */
+AVX2 static inline __m256i Mod(__m256i i, __m256i p) {
+  const __m256d plo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(p));
+  const __m256d phi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(p, 1));
+  const __m256d ilo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(i));
+  const __m256d ihi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(i, 1));
+  const __m128i qlo = _mm256_cvttpd_epi32(_mm256_div_pd(ilo, plo));
+  const __m128i qhi = _mm256_cvttpd_epi32(_mm256_div_pd(ihi, phi));
+  const __m256i q = _mm256_set_m128i(qhi, qlo);
+  return _mm256_sub_epi32(i, _mm256_mullo_epi32(q, p));
+}
+
+/*
+ * Splits x into the wrapped lattice cells on either side and the distances
+ * to them. A zero period means wrap at 256 only.
+ */
+AVX2 static inline void Lattice(__m256 x, int period, __m256i *i0, __m256i *i1,
+                                __m256 *f0, __m256 *f1) {
+  const __m256i mask = _mm256_set1_epi32(0xff);
+  const __m256i i = FastFloor(x);
+  const __m256i next = _mm256_add_epi32(i, _mm256_set1_epi32(1));
+
+  *f0 = _mm256_sub_ps(x, _mm256_cvtepi32_ps(i));
+  *f1 = _mm256_sub_ps(*f0, _mm256_set1_ps(1.0f));
+  if (period) {
+    const __m256i p = _mm256_set1_epi32(period);
+    *i1 = _mm256_and_si256(Mod(next, p), mask);
+    *i0 = _mm256_and_si256(Mod(i, p), mask);
+  } else {
+    *i1 = _mm256_and_si256(next, mask);
+    *i0 = _mm256_and_si256(i, mask);
+  }
+}
+
+AVX2 static void Noise1_AVX2(const float *x, float *out, size_t count,
+                             const Periods_t *p) {
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    __m256i ix0, ix1;
+    __m256 fx0, fx1;
+    Lattice(_mm256_loadu_ps(&x[i]), p->px, &ix0, &ix1, &fx0, &fx1);
+
+    const __m256 s = Fade(fx0);
+    const __m256 n0 = Grad1(Perm(ix0), fx0);
+    const __m256 n1 = Grad1(Perm(ix1), fx1);
+    _mm256_storeu_ps(&out[i],
+                     _mm256_mul_ps(_mm256_set1_ps(0.188f), Lerp(s, n0, n1)));
+  }
+  Noise1_Scalar(&x[i], &out[i], count - i, p);
+}
+
+AVX2 static void Noise2_AVX2(const float *x, const float *y, float *out,
+                             size_t count, const Periods_t *p) {
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    __m256i ix0, ix1, iy0, iy1;
+    __m256 fx0, fx1, fy0, fy1;
+    Lattice(_mm256_loadu_ps(&x[i]), p->px, &ix0, &ix1, &fx0, &fx1);
+    Lattice(_mm256_loadu_ps(&y[i]), p->py, &iy0, &iy1, &fy0, &fy1);
+
+    const __m256 t = Fade(fy0);
+    const __m256 s = Fade(fx0);
+    const __m256i py0 = Perm(iy0);
+    const __m256i py1 = Perm(iy1);
+    __m256 nx0, nx1;
+
+    nx0 = Grad2(Perm(_mm256_add_epi32(ix0, py0)), fx0, fy0);
+    nx1 = Grad2(Perm(_mm256_add_epi32(ix0, py1)), fx0, fy1);
+    const __m256 n0 = Lerp(t, nx0, nx1);
+
+    nx0 = Grad2(Perm(_mm256_add_epi32(ix1, py0)), fx1, fy0);
+    nx1 = Grad2(Perm(_mm256_add_epi32(ix1, py1)), fx1, fy1);
+    const __m256 n1 = Lerp(t, nx0, nx1);
+
+    _mm256_storeu_ps(&out[i],
+                     _mm256_mul_ps(_mm256_set1_ps(0.507f), Lerp(s, n0, n1)));
+  }
+  Noise2_Scalar(&x[i], &y[i], &out[i], count - i, p);
+}
+
+AVX2 static void Noise3_AVX2(const float *x, const float *y, const float *z,
+                             float *out, size_t count, const Periods_t *p) {
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    __m256i ix0, ix1, iy0, iy1, iz0, iz1;
+    __m256 fx0, fx1, fy0, fy1, fz0, fz1;
+    Lattice(_mm256_loadu_ps(&x[i]), p->px, &ix0, &ix1, &fx0, &fx1);
+    Lattice(_mm256_loadu_ps(&y[i]), p->py, &iy0, &iy1, &fy0, &fy1);
+    Lattice(_mm256_loadu_ps(&z[i]), p->pz, &iz0, &iz1, &fz0, &fz1);
+
+    const __m256 r = Fade(fz0);
+    const __m256 t = Fade(fy0);
+    const __m256 s = Fade(fx0);
+    const __m256i pz0 = Perm(iz0);
+    const __m256i pz1 = Perm(iz1);
+    // perm[iy + perm[iz]] for the four (y, z) corners
+    const __m256i p00 = Perm(_mm256_add_epi32(iy0, pz0));
+    const __m256i p01 = Perm(_mm256_add_epi32(iy0, pz1));
+    const __m256i p10 = Perm(_mm256_add_epi32(iy1, pz0));
+    const __m256i p11 = Perm(_mm256_add_epi32(iy1, pz1));
+    __m256 nxy0, nxy1, nx0, nx1;
+
+    nxy0 = Grad3(Perm(_mm256_add_epi32(ix0, p00)), fx0, fy0, fz0);
+    nxy1 = Grad3(Perm(_mm256_add_epi32(ix0, p01)), fx0, fy0, fz1);
+    nx0 = Lerp(r, nxy0, nxy1);
+    nxy0 = Grad3(Perm(_mm256_add_epi32(ix0, p10)), fx0, fy1, fz0);
+    nxy1 = Grad3(Perm(_mm256_add_epi32(ix0, p11)), fx0, fy1, fz1);
+    nx1 = Lerp(r, nxy0, nxy1);
+    const __m256 n0 = Lerp(t, nx0, nx1);
+
+    nxy0 = Grad3(Perm(_mm256_add_epi32(ix1, p00)), fx1, fy0, fz0);
+    nxy1 = Grad3(Perm(_mm256_add_epi32(ix1, p01)), fx1, fy0, fz1);
+    nx0 = Lerp(r, nxy0, nxy1);
+    nxy0 = Grad3(Perm(_mm256_add_epi32(ix1, p10)), fx1, fy1, fz0);
+    nxy1 = Grad3(Perm(_mm256_add_epi32(ix1, p11)), fx1, fy1, fz1);
+    nx1 = Lerp(r, nxy0, nxy1);
+    const __m256 n1 = Lerp(t, nx0, nx1);
+
+    _mm256_storeu_ps(&out[i],
+                     _mm256_mul_ps(_mm256_set1_ps(0.936f), Lerp(s, n0, n1)));
+  }
+  Noise3_Scalar(&x[i], &y[i], &z[i], &out[i], count - i, p);
+}
+#endif  // NOISE_BATCH_X86
+
+/*
+ * Cached CPU check. Batches may be sampled from pool workers, so the first
+ * call can race; every racer stores the same value.
+ */
+static bool UseAVX2(void) {
+#ifdef NOISE_BATCH_X86
+  static _Atomic int hasAVX2 = -1;
+  int has = hasAVX2;
+  if (has < 0) {
+    __builtin_cpu_init();
+    has = __builtin_cpu_supports("avx2") ? 1 : 0;
+    hasAVX2 = has;
+  }
+  return has;
+#else
+  return false;
+#endif
+}
+
+void noise1_batch(const float *x, float *out, size_t count) {
+  const Periods_t p = {0, 0, 0};
+#ifdef NOISE_BATCH_X86
+  if (UseAVX2()) {
+    Noise1_AVX2(x, out, count, &p);
+    return;
+  }
+#endif
+  Noise1_Scalar(x, out, count, &p);
+}
+
+void noise2_batch(const float *x, const float *y, float *out, size_t count) {
+  const Periods_t p = {0, 0, 0};
+#ifdef NOISE_BATCH_X86
+  if (UseAVX2()) {
+    Noise2_AVX2(x, y, out, count, &p);
+    return;
+  }
+#endif
+  Noise2_Scalar(x, y, out, count, &p);
+}
+
+void noise3_batch(const float *x, const float *y, const float *z, float *out,
+                  size_t count) {
+  const Periods_t p = {0, 0, 0};
+#ifdef NOISE_BATCH_X86
+  if (UseAVX2()) {
+    Noise3_AVX2(x, y, z, out, count, &p);
+    return;
+  }
+#endif
+  Noise3_Scalar(x, y, z, out, count, &p);
+}
+
+void pnoise1_batch(const float *x, float *out, size_t count, int px) {
+  const Periods_t p = {px, 0, 0};
+#ifdef NOISE_BATCH_X86
+  if (UseAVX2()) {
+    Noise1_AVX2(x, out, count, &p);
+    return;
+  }
+#endif
+  Noise1_Scalar(x, out, count, &p);
+}
+
+void pnoise2_batch(const float *x, const float *y, float *out, size_t count,
+                   int px, int py) {
+  const Periods_t p = {px, py, 0};
+#ifdef NOISE_BATCH_X86
+  if (UseAVX2()) {
+    Noise2_AVX2(x, y, out, count, &p);
+    return;
+  }
+#endif
+  Noise2_Scalar(x, y, out, count, &p);
+}
+
+void pnoise3_batch(const float *x, const float *y, const float *z, float *out,
+                   size_t count, int px, int py, int pz) {
+  const Periods_t p = {px, py, pz};
+#ifdef NOISE_BATCH_X86
+  if (UseAVX2()) {
+    Noise3_AVX2(x, y, z, out, count, &p);
+    return;
+  }
+#endif
+  Noise3_Scalar(x, y, z, out, count, &p);
+}
+
+const char *noise_batch_kernel(void) { return UseAVX2() ? "avx2" : "scalar"; }
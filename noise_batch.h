@@ -0,0 +1,35 @@
+#ifndef NOISE_BATCH_H
+#define NOISE_BATCH_H
+
+#include <stddef.h>
+
+/*
+ * Array versions of the Perlin noise functions in noise1234.h. out[i] is the
+ * same value noise1(x[i]), noise2(x[i], y[i]), ... would return, computed 8
+ * samples at a time with AVX2 where the CPU supports it and by calling the
+ * original functions otherwise.
+ *
+ * The vector path mirrors noise1234.c operation for operation; results are
+ * bit-identical as long as the build does not contract float multiplies and
+ * adds into FMAs (the default for -O2 without -march).
+ */
+void noise1_batch(const float *x, float *out, size_t count);
+void noise2_batch(const float *x, const float *y, float *out, size_t count);
+void noise3_batch(const float *x, const float *y, const float *z, float *out,
+                  size_t count);
+
+/*
+ * Periodic variants, see pnoise1() etc. Periods must be positive.
+ */
+void pnoise1_batch(const float *x, float *out, size_t count, int px);
+void pnoise2_batch(const float *x, const float *y, float *out, size_t count,
+                   int px, int py);
+void pnoise3_batch(const float *x, const float *y, const float *z, float *out,
+                   size_t count, int px, int py, int pz);
+
+/*
+ * Name of the code path the batch functions use, e.g. "avx2".
+ */
+const char *noise_batch_kernel(void);
+
+#endif  // NOISE_BATCH_H
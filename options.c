@@ -0,0 +1,200 @@
+#include "options.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_NUM_FRAMES (600)
+#define DEFAULT_SIM_RATE (60.0)
+#define DEFAULT_MAX_STEPS_PER_FRAME (8)
+
+static bool ParseUInt(const char *str, unsigned int *value) {
+  char *end;
+  errno = 0;
+  unsigned long v = strtoul(str, &end, 10);
+  if (errno != 0 || end == str || *end != '\0' || str[0] == '-' ||
+      v > 0xffffffffUL) {
+    fprintf(stderr, "ERROR: '%s' is not a valid unsigned integer!\n", str);
+    return false;
+  }
+  *value = (unsigned int)v;
+  return true;
+}
+
+static bool ParsePositiveDouble(const char *str, double *value) {
+  char *end;
+  errno = 0;
+  double v = strtod(str, &end);
+  if (errno != 0 || end == str || *end != '\0' || !(v > 0.0)) {
+    fprintf(stderr, "ERROR: '%s' is not a valid positive number!\n", str);
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+static bool ParseNonNegativeDouble(const char *str, double *value) {
+  char *end;
+  errno = 0;
+  double v = strtod(str, &end);
+  if (errno != 0 || end == str || *end != '\0' || !(v >= 0.0) || isinf(v)) {
+    fprintf(stderr, "ERROR: '%s' is not a valid non-negative number!\n", str);
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+static bool ParseU64(const char *str, uint64_t *value) {
+  char *end;
+  errno = 0;
+  unsigned long long v = strtoull(str, &end, 10);
+  if (errno != 0 || end == str || *end != '\0' || str[0] == '-') {
+    fprintf(stderr, "ERROR: '%s' is not a valid unsigned integer!\n", str);
+    return false;
+  }
+  *value = (uint64_t)v;
+  return true;
+}
+
+bool Options_Parse(Options_t *opts, int argc, char **argv) {
+  opts->Headless = false;
+  opts->NumFrames = DEFAULT_NUM_FRAMES;
+  opts->OutDir = ".";
+  opts->LastFrameOnly = false;
+  opts->NumParticles = 0;
+  opts->NumThreads = 0;
+  opts->SimRate = DEFAULT_SIM_RATE;
+  opts->MaxStepsPerFrame = DEFAULT_MAX_STEPS_PER_FRAME;
+  opts->Seed = (uint64_t)time(NULL);
+  opts->ClosedForm = false;
+  opts->Compact = false;
+  opts->StartTime = 0.0;
+  opts->CapturePath = NULL;
+  opts->ParticleDraw = PARTICLE_DRAW_SQUARES;
+  opts->TracePath = NULL;
+  opts->TraceOverlay = false;
+  opts->Pipeline = false;
+  opts->Raster = false;
+  Params_Init(&opts->Params);
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const bool has_value = (i + 1 < argc);
+
+    if (strcmp(arg, "--headless") == 0) {
+      opts->Headless = true;
+    } else if (strcmp(arg, "--frames") == 0 && has_value) {
+      if (!ParseUInt(argv[++i], &opts->NumFrames)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--out") == 0 && has_value) {
+      opts->OutDir = argv[++i];
+    } else if (strcmp(arg, "--last-frame") == 0) {
+      opts->LastFrameOnly = true;
+    } else if (strcmp(arg, "--particles") == 0 && has_value) {
+      if (!ParseUInt(argv[++i], &opts->NumParticles)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--threads") == 0 && has_value) {
+      if (!ParseUInt(argv[++i], &opts->NumThreads)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--sim-rate") == 0 && has_value) {
+      if (!ParsePositiveDouble(argv[++i], &opts->SimRate)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--max-steps") == 0 && has_value) {
+      if (!ParseUInt(argv[++i], &opts->MaxStepsPerFrame)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--seed") == 0 && has_value) {
+      if (!ParseU64(argv[++i], &opts->Seed)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--closed-form") == 0) {
+      opts->ClosedForm = true;
+    } else if (strcmp(arg, "--compact") == 0) {
+      opts->Compact = true;
+      opts->ClosedForm = true;  // the compact store has no positions to update
+    } else if (strcmp(arg, "--start-time") == 0 && has_value) {
+      if (!ParseNonNegativeDouble(argv[++i], &opts->StartTime)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--capture") == 0 && has_value) {
+      opts->CapturePath = argv[++i];
+    } else if (strcmp(arg, "--density") == 0 && has_value) {
+      const char *mode = argv[++i];
+      if (strcmp(mode, "log") == 0) {
+        opts->ParticleDraw = PARTICLE_DRAW_DENSITY_LOG;
+      } else if (strcmp(mode, "filmic") == 0) {
+        opts->ParticleDraw = PARTICLE_DRAW_DENSITY_FILMIC;
+      } else {
+        fprintf(stderr, "ERROR: Unknown density tone map '%s'!\n", mode);
+        return false;
+      }
+    } else if (strcmp(arg, "--trace") == 0 && has_value) {
+      opts->TracePath = argv[++i];
+    } else if (strcmp(arg, "--trace-overlay") == 0) {
+      opts->TraceOverlay = true;
+    } else if (strcmp(arg, "--pipeline") == 0) {
+      opts->Pipeline = true;
+    } else if (strcmp(arg, "--raster") == 0) {
+      opts->Raster = true;
+    } else if (strcmp(arg, "--config") == 0 && has_value) {
+      if (!Params_Load(&opts->Params, argv[++i])) {
+        return false;
+      }
+    } else if (strcmp(arg, "--set") == 0 && has_value) {
+      if (!Params_SetAssignment(&opts->Params, argv[++i])) {
+        return false;
+      }
+    } else {
+      fprintf(stderr, "ERROR: Unknown or incomplete option '%s'!\n", arg);
+      return false;
+    }
+  }
+  return true;
+}
+
+void Options_PrintUsage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --headless    render offscreen and export PNG frames\n"
+          "  --frames N    number of frames to render headless (default %d)\n"
+          "  --out DIR     directory for exported frames (default .)\n"
+          "  --last-frame  only export the last headless frame\n"
+          "  --particles N number of particles (default depends on sketch)\n"
+          "  --threads N   update worker threads (default 0, one per CPU)\n"
+          "  --sim-rate HZ fixed simulation steps per second (default %.0f)\n"
+          "  --max-steps N max simulation steps per frame (default %d)\n"
+          "  --seed N      random seed, same seed same output (default time)\n"
+          "  --closed-form compute beat particle positions from time instead\n"
+          "                of updating them every step\n"
+          "  --compact     --closed-form with beat particles quantized to 7\n"
+          "                bytes each, for runs of 10M and more\n"
+          "  --start-time S start the beat sketches S simulated seconds in\n"
+          "  --capture FILE record the frames to FILE (.y4m, .gif, or raw\n"
+          "                RGBA otherwise); headless runs write it instead\n"
+          "                of PNG frames\n"
+          "  --density log|filmic draw the beat particles as accumulated\n"
+          "                density with the given tone map, for very large\n"
+          "                particle counts\n"
+          "  --trace FILE  write where each frame's time went to FILE, as CSV\n"
+          "                if it ends in .csv and Chrome trace JSON otherwise\n"
+          "                (needs make TRACE=1)\n"
+          "  --trace-overlay show a frame time histogram in the window\n"
+          "                (needs make TRACE=1)\n"
+          "  --pipeline    update on a thread of its own while the last\n"
+          "                state is drawn (beat sketches and contrail)\n"
+          "  --raster      draw primitives with the tiled CPU rasterizer\n"
+          "                instead of Allegro, for machines without a GPU\n"
+          "  --config FILE read sketch parameters from FILE, one\n"
+          "                name = value per line\n"
+          "  --set NAME=VALUE set a sketch parameter, overriding --config\n"
+          "                when it comes after it\n",
+          prog, DEFAULT_NUM_FRAMES, DEFAULT_SIM_RATE,
+          DEFAULT_MAX_STEPS_PER_FRAME);
+}
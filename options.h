@@ -0,0 +1,46 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "params.h"
+
+// How the beat sketches draw their particles
+typedef enum {
+  PARTICLE_DRAW_SQUARES,         // one small square each
+  PARTICLE_DRAW_DENSITY_LOG,     // accumulated density, log tone mapped
+  PARTICLE_DRAW_DENSITY_FILMIC,  // accumulated density, filmic tone mapped
+} ParticleDraw_t;
+
+/*
+ * Command line options shared by all sketches.
+ */
+typedef struct {
+  bool Headless;                  // render offscreen, no display
+  unsigned int NumFrames;         // number of frames to render headless
+  const char *OutDir;             // directory that receives exported frames
+  bool LastFrameOnly;             // export only the last headless frame
+  unsigned int NumParticles;      // particle count, 0 keeps sketch default
+  unsigned int NumThreads;        // update worker threads, 0 uses every CPU
+  double SimRate;                 // fixed simulation steps per second
+  unsigned int MaxStepsPerFrame;  // cap on simulation steps per frame
+  uint64_t Seed;                  // random seed, defaults to the time
+  bool ClosedForm;                // evaluate positions instead of updating
+  bool Compact;                   // quantized beat particles, and ClosedForm
+  double StartTime;               // simulated seconds to start from
+  const char *CapturePath;        // video file to record, NULL for none
+  ParticleDraw_t ParticleDraw;    // how the beat sketches draw particles
+  const char *TracePath;          // frame phase trace to write, or NULL
+  bool TraceOverlay;              // show frame times in the window
+  bool Pipeline;                  // update on a thread of its own
+  bool Raster;                    // draw with the CPU rasterizer, raster.h
+  Params_t Params;                // --config and --set, see params.h
+} Options_t;
+
+/*
+ * Fills opts from argv. Returns false and prints an error on a bad option.
+ */
+bool Options_Parse(Options_t *opts, int argc, char **argv);
+void Options_PrintUsage(const char *prog);
+
+#endif  // OPTIONS_H
@@ -0,0 +1,191 @@
+#include "params.h"
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE_LEN (1024)
+
+void Params_Init(Params_t *p) {
+  p->Count = 0;
+  p->NumInvalid = 0;
+}
+
+bool Params_ValidName(const char *name) {
+  const size_t len = strlen(name);
+  if (len == 0 || len >= PARAMS_NAME_LEN) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (!isalnum((unsigned char)name[i]) && name[i] != '_') {
+      return false;
+    }
+  }
+  return true;
+}
+
+static Param_t *Find(Params_t *p, const char *name) {
+  for (unsigned int i = 0; i < p->Count; i++) {
+    if (strcmp(p->Params[i].Name, name) == 0) {
+      return &p->Params[i];
+    }
+  }
+  return NULL;
+}
+
+bool Params_Set(Params_t *p, const char *name, double value) {
+  if (!Params_ValidName(name)) {
+    fprintf(stderr, "ERROR: '%s' is not a valid parameter name!\n", name);
+    return false;
+  }
+  Param_t *param = Find(p, name);
+  if (param == NULL) {
+    if (p->Count == PARAMS_MAX) {
+      fprintf(stderr, "ERROR: More than %d parameters!\n", PARAMS_MAX);
+      return false;
+    }
+    param = &p->Params[p->Count++];
+    strcpy(param->Name, name);
+  }
+  param->Value = value;
+  param->Used = false;
+  return true;
+}
+
+static bool ParseValue(const char *name, const char *str, double *value) {
+  char *end;
+  errno = 0;
+  const double v = strtod(str, &end);
+  if (errno != 0 || end == str || *end != '\0' || !isfinite(v)) {
+    fprintf(stderr, "ERROR: '%s' is not a valid value for %s!\n", str, name);
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+bool Params_SetAssignment(Params_t *p, const char *str) {
+  char line[MAX_LINE_LEN];
+  char *name;
+  char *value;
+  double v;
+
+  if (strlen(str) >= sizeof(line)) {
+    fprintf(stderr, "ERROR: Parameter '%.32s...' is too long!\n", str);
+    return false;
+  }
+  strcpy(line, str);
+  if (Params_SplitLine(line, &name, &value) != 1) {
+    fprintf(stderr, "ERROR: '%s' is not a name=value parameter!\n", str);
+    return false;
+  }
+  return ParseValue(name, value, &v) && Params_Set(p, name, v);
+}
+
+bool Params_Load(Params_t *p, const char *path) {
+  char line[MAX_LINE_LEN];
+  char *name;
+  char *value;
+  unsigned int line_num = 0;
+  bool ok = true;
+
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: Failed to open config '%s'!\n", path);
+    return false;
+  }
+  while (ok && fgets(line, sizeof(line), f)) {
+    double v;
+    line_num++;
+    const int kind = Params_SplitLine(line, &name, &value);
+    if (kind < 0) {
+      fprintf(stderr, "ERROR: %s:%u is not a name = value line!\n", path,
+              line_num);
+      ok = false;
+    } else if (kind > 0) {
+      ok = ParseValue(name, value, &v) && Params_Set(p, name, v);
+    }
+  }
+  if (ok && ferror(f)) {
+    fprintf(stderr, "ERROR: Failed to read config '%s'!\n", path);
+    ok = false;
+  }
+  fclose(f);
+  return ok;
+}
+
+double Params_Get(Params_t *p, const char *name, double def, double min,
+                  double max) {
+  Param_t *param = Find(p, name);
+  if (param == NULL) {
+    return def;
+  }
+  param->Used = true;
+  if (!(param->Value >= min && param->Value <= max)) {
+    fprintf(stderr, "ERROR: Parameter %s is %g, it has to be in [%g, %g]!\n",
+            name, param->Value, min, max);
+    p->NumInvalid++;
+    return def;
+  }
+  return param->Value;
+}
+
+unsigned int Params_GetUInt(Params_t *p, const char *name, unsigned int def,
+                            unsigned int min, unsigned int max) {
+  const double v = Params_Get(p, name, def, min, max);
+  if (v != floor(v)) {
+    fprintf(stderr, "ERROR: Parameter %s is %g, not a whole number!\n", name,
+            v);
+    p->NumInvalid++;
+    return def;
+  }
+  return (unsigned int)v;
+}
+
+bool Params_Check(const Params_t *p) {
+  bool ok = (p->NumInvalid == 0);
+  for (unsigned int i = 0; i < p->Count; i++) {
+    if (!p->Params[i].Used) {
+      fprintf(stderr, "ERROR: This sketch has no parameter %s!\n",
+              p->Params[i].Name);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+static char *Trim(char *s) {
+  while (isspace((unsigned char)*s)) {
+    s++;
+  }
+  char *end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1])) {
+    end--;
+  }
+  *end = '\0';
+  return s;
+}
+
+int Params_SplitLine(char *line, char **name, char **value) {
+  char *comment = strchr(line, '#');
+  if (comment) {
+    *comment = '\0';
+  }
+  char *text = Trim(line);
+  if (*text == '\0') {
+    return 0;
+  }
+  char *eq = strchr(text, '=');
+  if (eq == NULL) {
+    return -1;
+  }
+  *eq = '\0';
+  *name = Trim(text);
+  *value = Trim(eq + 1);
+  if (!Params_ValidName(*name) || **value == '\0') {
+    return -1;
+  }
+  return 1;
+}
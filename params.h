@@ -0,0 +1,76 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdbool.h>
+
+/*
+ * Named numeric parameters that let a sketch's tunables change without a
+ * rebuild. They come from a config file, one per line,
+ *
+ *   # beat_circle with more, slower particles
+ *   particles = 20000
+ *   speed_step = 5
+ *
+ * and from --set name=value on the command line, the later one winning. A
+ * sketch looks up each parameter it has with Params_Get() and keeps its own
+ * default for the ones not given. Since a misspelt name would otherwise go
+ * unnoticed, Params_Check() fails for any parameter no sketch looked up.
+ */
+#define PARAMS_MAX (32)
+#define PARAMS_NAME_LEN (32)  // including the terminating NUL
+
+typedef struct {
+  char Name[PARAMS_NAME_LEN];
+  double Value;
+  bool Used;  // looked up by the sketch
+} Param_t;
+
+typedef struct {
+  unsigned int Count;
+  unsigned int NumInvalid;  // lookups that rejected the given value
+  Param_t Params[PARAMS_MAX];
+} Params_t;
+
+void Params_Init(Params_t *p);
+
+/*
+ * Sets name to value, replacing an earlier value. Returns false and prints
+ * an error for a bad name or when there are PARAMS_MAX parameters already.
+ */
+bool Params_Set(Params_t *p, const char *name, double value);
+
+// Sets a parameter from "name=value". Returns false and prints an error.
+bool Params_SetAssignment(Params_t *p, const char *str);
+
+// Sets every parameter in the file at path. Returns false and prints an error.
+bool Params_Load(Params_t *p, const char *path);
+
+/*
+ * Value of name, or def when it was not given. Values outside [min, max]
+ * print an error, count as invalid for Params_Check(), and give def.
+ */
+double Params_Get(Params_t *p, const char *name, double def, double min,
+                  double max);
+
+// Like Params_Get() for parameters that have to be whole numbers.
+unsigned int Params_GetUInt(Params_t *p, const char *name, unsigned int def,
+                            unsigned int min, unsigned int max);
+
+/*
+ * Returns false and prints an error for every parameter that was given but
+ * never looked up, or if a lookup rejected its value.
+ */
+bool Params_Check(const Params_t *p);
+
+/*
+ * Splits a line of a parameter file in place into a name and the text after
+ * the '=', both without surrounding blanks. Anything after a '#' is a
+ * comment. Returns 1 for an assignment, 0 for a line without one, and -1
+ * for a malformed line or a bad name.
+ */
+int Params_SplitLine(char *line, char **name, char **value);
+
+// Whether name is usable: letters, digits and '_', shorter than the limit.
+bool Params_ValidName(const char *name);
+
+#endif  // PARAMS_H
@@ -0,0 +1,176 @@
+#include "particle_compact.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARTICLE_COMPACT_X86 (1)
+#endif
+
+#define COMPACT_ALIGNMENT (64)
+#define COMPACT_GRAIN (16384)  // particles per thread pool chunk
+#define COMPACT_MAX_VEL (INT16_MAX)
+
+/*
+ * Zeroed, 64-byte aligned and padded to whole cache lines, like
+ * ParticleSoA_AllocArray().
+ */
+static void *AllocArray(size_t count, size_t size) {
+  size_t bytes = (count * size + COMPACT_ALIGNMENT - 1) / COMPACT_ALIGNMENT *
+                 COMPACT_ALIGNMENT;
+  if (bytes == 0) {
+    bytes = COMPACT_ALIGNMENT;
+  }
+  void *a = aligned_alloc(COMPACT_ALIGNMENT, bytes);
+  if (a != NULL) {
+    memset(a, 0, bytes);
+  }
+  return a;
+}
+
+ParticleCompact_t *ParticleCompact_Create(size_t count) {
+  ParticleCompact_t *pc = calloc(1, sizeof(*pc));
+  if (pc == NULL) {
+    return NULL;
+  }
+
+  pc->Count = count;
+  pc->VelScale = 1;
+  pc->vx = AllocArray(count, sizeof(*pc->vx));
+  pc->vy = AllocArray(count, sizeof(*pc->vy));
+  pc->period = AllocArray(count, sizeof(*pc->period));
+
+  if (!pc->vx || !pc->vy || !pc->period) {
+    ParticleCompact_Destroy(pc);
+    return NULL;
+  }
+  return pc;
+}
+
+void ParticleCompact_Destroy(ParticleCompact_t *pc) {
+  if (pc == NULL) {
+    return;
+  }
+  free(pc->vx);
+  free(pc->vy);
+  free(pc->period);
+  free(pc);
+}
+
+static int16_t Quantize(float v, float scale) {
+  const float q = fminf(fmaxf(rintf(v / scale), -COMPACT_MAX_VEL),
+                        COMPACT_MAX_VEL);
+  return (int16_t)q;
+}
+
+void ParticleCompact_QuantizeVelocities(ParticleCompact_t *pc,
+                                        ParticleSoA_t *ps) {
+  float max_v = 0;
+  for (size_t i = 0; i < ps->Count; i++) {
+    max_v = fmaxf(max_v, fmaxf(fabsf(ps->vx[i]), fabsf(ps->vy[i])));
+  }
+
+  pc->OriginX = ps->Count ? ps->origin_x[0] : 0;
+  pc->OriginY = ps->Count ? ps->origin_y[0] : 0;
+  pc->VelScale = max_v > 0 ? max_v / COMPACT_MAX_VEL : 1;
+  for (size_t i = 0; i < ps->Count; i++) {
+    pc->vx[i] = Quantize(ps->vx[i], pc->VelScale);
+    pc->vy[i] = Quantize(ps->vy[i], pc->VelScale);
+    // The same product ParticleCompact_Evaluate() makes, so both stores
+    // agree on where a particle is and on its period.
+    ps->vx[i] = (float)pc->vx[i] * pc->VelScale;
+    ps->vy[i] = (float)pc->vy[i] * pc->VelScale;
+  }
+}
+
+bool ParticleCompact_SetPeriods(ParticleCompact_t *pc,
+                                const ParticleSoA_t *ps) {
+  for (size_t i = 0; i < ps->Count; i++) {
+    if (ps->period[i] > UINT16_MAX || ps->origin_x[i] != pc->OriginX ||
+        ps->origin_y[i] != pc->OriginY) {
+      return false;
+    }
+    pc->period[i] = (uint16_t)ps->period[i];
+  }
+  return true;
+}
+
+typedef struct {
+  const ParticleCompact_t *pc;
+  float dt;
+  double step;
+  float alpha;
+  float *out_x;
+  float *out_y;
+} EvaluateJob_t;
+
+/*
+ * ParticleSoA_Evaluate()'s loop and arithmetic, with the velocities and
+ * periods widened as they are loaded: 6 bytes read a particle instead of 20,
+ * for the same positions.
+ */
+#define EVALUATE_LOOP(job, begin, end)                     \
+  do {                                                     \
+    const int16_t *restrict vx = (job)->pc->vx;            \
+    const int16_t *restrict vy = (job)->pc->vy;            \
+    const uint16_t *restrict period = (job)->pc->period;   \
+    const float ox = (job)->pc->OriginX;                   \
+    const float oy = (job)->pc->OriginY;                   \
+    const float scale = (job)->pc->VelScale;               \
+    const float dt = (job)->dt;                            \
+    const float alpha = (job)->alpha;                      \
+    float *out_x = (job)->out_x;                           \
+    float *out_y = (job)->out_y;                           \
+    for (size_t i = (begin); i < (end); i++) {             \
+      const double p = period[i];                          \
+      double k = (job)->step;                              \
+      k = p > 0 ? k - floor(k / p) * p : k;                \
+      const float k0 = (float)k;                           \
+      const float v_x = (float)vx[i] * scale;              \
+      const float v_y = (float)vy[i] * scale;              \
+      const float x0 = ox + v_x * (k0 * dt);               \
+      const float y0 = oy + v_y * (k0 * dt);               \
+      const float x1 = ox + v_x * ((k0 + 1) * dt);         \
+      const float y1 = oy + v_y * ((k0 + 1) * dt);         \
+      const bool reset = k + 1 == p;                       \
+      out_x[i] = reset ? ox : x0 + (x1 - x0) * alpha;      \
+      out_y[i] = reset ? oy : y0 + (y1 - y0) * alpha;      \
+    }                                                      \
+  } while (0)
+
+static void Evaluate_Scalar(const EvaluateJob_t *job, size_t begin,
+                            size_t end) {
+  EVALUATE_LOOP(job, begin, end);
+}
+
+#ifdef PARTICLE_COMPACT_X86
+__attribute__((target("avx2"))) static void Evaluate_AVX2(
+    const EvaluateJob_t *job, size_t begin, size_t end) {
+  EVALUATE_LOOP(job, begin, end);
+}
+#endif
+
+static void EvaluateJob(void *ctx, size_t begin, size_t end,
+                        unsigned int worker) {
+  const EvaluateJob_t *job = ctx;
+#ifdef PARTICLE_COMPACT_X86
+  if (ParticleSoA_Isa() == PARTICLE_ISA_AVX2) {
+    Evaluate_AVX2(job, begin, end);
+    return;
+  }
+#endif
+  Evaluate_Scalar(job, begin, end);
+}
+
+void ParticleCompact_Evaluate(const ParticleCompact_t *pc, ThreadPool_t *pool,
+                              float dt, uint64_t step, float alpha,
+                              float *out_x, float *out_y) {
+  EvaluateJob_t job = {.pc = pc,
+                       .dt = dt,
+                       .step = (double)step,
+                       .alpha = alpha,
+                       .out_x = out_x,
+                       .out_y = out_y};
+  ParticleSoA_Isa();  // picks the kernels before any worker asks
+  ThreadPool_ParallelFor(pool, pc->Count, COMPACT_GRAIN, EvaluateJob, &job);
+}
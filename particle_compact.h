@@ -0,0 +1,71 @@
+#ifndef PARTICLE_COMPACT_H
+#define PARTICLE_COMPACT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "particle_soa.h"
+#include "thread_pool.h"
+
+/*
+ * Quantized particle store for the closed-form integrator, for runs with so
+ * many particles that ParticleSoA_t's 40 bytes each, plus a byte of color,
+ * no longer fit in cache or memory bandwidth.
+ *
+ * Positions are not stored at all: ParticleSoA_Evaluate() derives them from
+ * the step number, an origin, a velocity and a period, so that is all this
+ * keeps. Every particle shares one origin, velocities are 16-bit fixed point
+ * with a scale shared by the store, and periods are 16-bit step counts,
+ * 6 bytes a particle. Colors stay with the sketch, as 8-bit palette indices.
+ *
+ * A store is filled from a ParticleSoA_t set up as for ParticleSoA_Evaluate()
+ * and evaluates to the same positions, since the periods are found for the
+ * quantized velocities rather than the original ones:
+ *
+ *   ParticleCompact_QuantizeVelocities(pc, ps);
+ *   boundary->SetPeriods(ps, dt, bounds);
+ *   if (!ParticleCompact_SetPeriods(pc, ps)) ...
+ */
+typedef struct {
+  size_t Count;
+  float OriginX;   // of every particle
+  float OriginY;
+  float VelScale;  // px/s per unit of vx and vy
+  int16_t *vx;
+  int16_t *vy;
+  uint16_t *period;  // steps from one reset to the next, 0 if never reset
+} ParticleCompact_t;
+
+/*
+ * @note caller is responsible for disposing of the store with
+ * ParticleCompact_Destroy().
+ */
+ParticleCompact_t *ParticleCompact_Create(size_t count);
+void ParticleCompact_Destroy(ParticleCompact_t *pc);
+
+/*
+ * Rounds the velocities of ps, which holds as many particles, to the store's
+ * fixed point, picking a scale that fits the fastest one, and writes the
+ * rounded velocities back to ps, where the periods are found. Takes the
+ * origin of the first particle as everyone's.
+ */
+void ParticleCompact_QuantizeVelocities(ParticleCompact_t *pc,
+                                        ParticleSoA_t *ps);
+
+/*
+ * Copies the periods of ps. Returns false if one is too long to store, or a
+ * particle of ps starts somewhere else than the first one.
+ */
+bool ParticleCompact_SetPeriods(ParticleCompact_t *pc,
+                                const ParticleSoA_t *ps);
+
+/*
+ * Writes where every particle is drawn alpha of the way through update
+ * number step + 1 into out_x and out_y, as ParticleSoA_Evaluate() does for
+ * the store the particles came from.
+ */
+void ParticleCompact_Evaluate(const ParticleCompact_t *pc, ThreadPool_t *pool,
+                              float dt, uint64_t step, float alpha,
+                              float *out_x, float *out_y);
+
+#endif  // PARTICLE_COMPACT_H
@@ -0,0 +1,320 @@
+#ifndef PARTICLE_POLICY_H
+#define PARTICLE_POLICY_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "particle_soa.h"
+#include "thread_pool.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARTICLE_POLICY_X86 (1)
+#include <immintrin.h>
+#define PARTICLE_POLICY_AVX2 __attribute__((target("avx2")))
+#define PARTICLE_POLICY_SSE41 __attribute__((target("sse4.1")))
+#endif
+
+/*
+ * Update kernels specialised on where particles reset. A boundary policy
+ * Name is a struct of parameters, Name_t, and four inline functions:
+ *
+ *   bool Name_Outside(const Name_t *b, float x, float y, float ox, float oy)
+ *     whether a particle at (x, y) that started at (ox, oy) has to reset
+ *   __m256 Name_Outside8(const Name_t *b, __m256 x, __m256 y, __m256 ox,
+ *                        __m256 oy)
+ *   __m128 Name_Outside4(...)
+ *     the same test as a lane mask, eight and four particles at a time,
+ *     declared PARTICLE_POLICY_AVX2 and PARTICLE_POLICY_SSE41 (x86 only),
+ *     with the same float operations in the same order, so every loop
+ *     resets a particle on the same step
+ *   float Name_Distance(const Name_t *b, float x, float y, float ox,
+ *                       float oy)
+ *     how far a particle inside is from the boundary at least, in pixels
+ *
+ * PARTICLE_POLICY_DEFINE(Name) then defines a ParticleBoundary_t Name,
+ * whose Update moves the particles and resets the ones the policy puts
+ * outside, and whose SetPeriods prepares ParticleSoA_Evaluate(), the
+ * closed-form integrator, for the same boundary. Any shape with a signed
+ * distance function works. Each policy gets its own scalar, SSE4.1 and AVX2
+ * loop with the test inlined, so the inner loops do not branch or call
+ * anything; the widest one the CPU supports is picked once per chunk of
+ * particles.
+ *
+ * Rectangles (ParticleRect_t) and circles around each particle's origin
+ * (ParticleCircle_t) are defined here. Definitions are static, so every
+ * file that needs one defines its own.
+ */
+typedef struct {
+  // Moves every particle of ps by dt, resetting the ones that left bounds
+  void (*Update)(ParticleSoA_t *ps, ThreadPool_t *pool, float dt,
+                 const void *bounds);
+  // Fills in ps->period for updates of dt seconds, see ParticleSoA_Evaluate()
+  void (*SetPeriods)(ParticleSoA_t *ps, float dt, const void *bounds);
+} ParticleBoundary_t;
+
+#define PARTICLE_POLICY_GRAIN (16384)  // particles per thread pool chunk
+#define PARTICLE_POLICY_MAX_PERIOD (16777216.0f)  // 2^24, whole float steps
+
+typedef struct {
+  ParticleSoA_t *ps;
+  float dt;
+  const void *bounds;
+  ParticleIsa_t isa;
+} ParticlePolicyJob_t;
+
+/*
+ * The lanes a policy puts outside go back to their origin and an age of 0,
+ * the others move to (x, y), k steps old, and keep where they were as the
+ * previous position.
+ */
+#define PARTICLE_POLICY_STORE_(ps, i, px, py, x, y, ox, oy, k, zero, out, \
+                               store, blend)                             \
+  do {                                                                   \
+    store(&(ps)->prev_x[i], blend(px, ox, out));                         \
+    store(&(ps)->prev_y[i], blend(py, oy, out));                         \
+    store(&(ps)->x[i], blend(x, ox, out));                               \
+    store(&(ps)->y[i], blend(y, oy, out));                               \
+    store(&(ps)->age[i], blend(k, zero, out));                           \
+  } while (0)
+
+#ifdef PARTICLE_POLICY_X86
+#define PARTICLE_POLICY_DEFINE_SIMD_(Name)                                  \
+  PARTICLE_POLICY_AVX2 static void Name##_UpdateAVX2(                       \
+      ParticleSoA_t *ps, size_t begin, size_t end, float dt,                \
+      const Name##_t *bounds) {                                             \
+    const Name##_t b = *bounds;                                             \
+    const __m256 vdt = _mm256_set1_ps(dt);                                  \
+    const __m256 one = _mm256_set1_ps(1.0f);                                \
+    const __m256 zero = _mm256_setzero_ps();                                \
+    size_t i = begin;                                                       \
+                                                                            \
+    for (; i + 8 <= end; i += 8) {                                          \
+      const __m256 ox = _mm256_loadu_ps(&ps->origin_x[i]);                  \
+      const __m256 oy = _mm256_loadu_ps(&ps->origin_y[i]);                  \
+      const __m256 px = _mm256_loadu_ps(&ps->x[i]);                         \
+      const __m256 py = _mm256_loadu_ps(&ps->y[i]);                         \
+      const __m256 k = _mm256_add_ps(_mm256_loadu_ps(&ps->age[i]), one);    \
+      const __m256 t = _mm256_mul_ps(k, vdt);                               \
+      const __m256 x = _mm256_add_ps(                                       \
+          ox, _mm256_mul_ps(_mm256_loadu_ps(&ps->vx[i]), t));               \
+      const __m256 y = _mm256_add_ps(                                       \
+          oy, _mm256_mul_ps(_mm256_loadu_ps(&ps->vy[i]), t));               \
+      const __m256 out = Name##_Outside8(&b, x, y, ox, oy);                 \
+      PARTICLE_POLICY_STORE_(ps, i, px, py, x, y, ox, oy, k, zero, out,     \
+                             _mm256_storeu_ps, _mm256_blendv_ps);           \
+    }                                                                       \
+    Name##_UpdateScalar(ps, i, end, dt, &b);                                \
+  }                                                                         \
+                                                                            \
+  PARTICLE_POLICY_SSE41 static void Name##_UpdateSSE41(                     \
+      ParticleSoA_t *ps, size_t begin, size_t end, float dt,                \
+      const Name##_t *bounds) {                                             \
+    const Name##_t b = *bounds;                                             \
+    const __m128 vdt = _mm_set1_ps(dt);                                     \
+    const __m128 one = _mm_set1_ps(1.0f);                                   \
+    const __m128 zero = _mm_setzero_ps();                                   \
+    size_t i = begin;                                                       \
+                                                                            \
+    for (; i + 4 <= end; i += 4) {                                          \
+      const __m128 ox = _mm_loadu_ps(&ps->origin_x[i]);                     \
+      const __m128 oy = _mm_loadu_ps(&ps->origin_y[i]);                     \
+      const __m128 px = _mm_loadu_ps(&ps->x[i]);                            \
+      const __m128 py = _mm_loadu_ps(&ps->y[i]);                            \
+      const __m128 k = _mm_add_ps(_mm_loadu_ps(&ps->age[i]), one);          \
+      const __m128 t = _mm_mul_ps(k, vdt);                                  \
+      const __m128 x =                                                      \
+          _mm_add_ps(ox, _mm_mul_ps(_mm_loadu_ps(&ps->vx[i]), t));          \
+      const __m128 y =                                                      \
+          _mm_add_ps(oy, _mm_mul_ps(_mm_loadu_ps(&ps->vy[i]), t));          \
+      const __m128 out = Name##_Outside4(&b, x, y, ox, oy);                 \
+      PARTICLE_POLICY_STORE_(ps, i, px, py, x, y, ox, oy, k, zero, out,     \
+                             _mm_storeu_ps, _mm_blendv_ps);                 \
+    }                                                                       \
+    Name##_UpdateScalar(ps, i, end, dt, &b);                                \
+  }
+#define PARTICLE_POLICY_DISPATCH_(Name, job, begin, end)                    \
+  switch ((job)->isa) {                                                     \
+    case PARTICLE_ISA_AVX2:                                                 \
+      Name##_UpdateAVX2((job)->ps, begin, end, (job)->dt, (job)->bounds);   \
+      break;                                                                \
+    case PARTICLE_ISA_SSE41:                                                \
+      Name##_UpdateSSE41((job)->ps, begin, end, (job)->dt, (job)->bounds);  \
+      break;                                                                \
+    default:                                                                \
+      Name##_UpdateScalar((job)->ps, begin, end, (job)->dt, (job)->bounds); \
+  }
+#else
+#define PARTICLE_POLICY_DEFINE_SIMD_(Name)
+#define PARTICLE_POLICY_DISPATCH_(Name, job, begin, end) \
+  Name##_UpdateScalar((job)->ps, begin, end, (job)->dt, (job)->bounds)
+#endif  // PARTICLE_POLICY_X86
+
+/*
+ * Every loop, SIMD or not, puts a particle k steps past its last reset at
+ * origin + v * (k * dt) rather than adding v * dt to where it was, so no
+ * error builds up and updates land on exactly the positions, and reset on
+ * exactly the steps, that the periods and ParticleSoA_Evaluate() give. The
+ * scalar loop also finishes what the SIMD loops leave over. Periods are
+ * found with that same arithmetic, skipping as many steps as the distance
+ * to the boundary allows, up to the first step that is outside.
+ */
+#define PARTICLE_POLICY_DEFINE(Name)                                          \
+  static void Name##_UpdateScalar(ParticleSoA_t *ps, size_t begin,            \
+                                  size_t end, float dt,                       \
+                                  const Name##_t *bounds) {                   \
+    const Name##_t b = *bounds;                                               \
+    for (size_t i = begin; i < end; i++) {                                    \
+      const float k = ps->age[i] + 1;                                         \
+      const float x = ps->origin_x[i] + ps->vx[i] * (k * dt);                 \
+      const float y = ps->origin_y[i] + ps->vy[i] * (k * dt);                 \
+                                                                              \
+      if (Name##_Outside(&b, x, y, ps->origin_x[i], ps->origin_y[i])) {       \
+        ps->x[i] = ps->prev_x[i] = ps->origin_x[i];                           \
+        ps->y[i] = ps->prev_y[i] = ps->origin_y[i];                           \
+        ps->age[i] = 0;                                                       \
+      } else {                                                                \
+        ps->prev_x[i] = ps->x[i];                                             \
+        ps->prev_y[i] = ps->y[i];                                             \
+        ps->x[i] = x;                                                         \
+        ps->y[i] = y;                                                         \
+        ps->age[i] = k;                                                       \
+      }                                                                       \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  PARTICLE_POLICY_DEFINE_SIMD_(Name)                                          \
+                                                                              \
+  static void Name##_Job(void *ctx, size_t begin, size_t end,                 \
+                         unsigned int worker) {                               \
+    const ParticlePolicyJob_t *job = ctx;                                     \
+    PARTICLE_POLICY_DISPATCH_(Name, job, begin, end);                         \
+  }                                                                           \
+                                                                              \
+  static void Name##_Update(ParticleSoA_t *ps, ThreadPool_t *pool, float dt,  \
+                            const void *bounds) {                             \
+    ParticlePolicyJob_t job = {                                               \
+        .ps = ps, .dt = dt, .bounds = bounds, .isa = ParticleSoA_Isa()};      \
+    ThreadPool_ParallelFor(pool, ps->Count, PARTICLE_POLICY_GRAIN,            \
+                           Name##_Job, &job);                                 \
+  }                                                                           \
+                                                                              \
+  static float Name##_Period(const Name##_t *b, float ox, float oy, float vx, \
+                             float vy, float dt) {                            \
+    const float step_len = sqrtf(vx * vx + vy * vy) * dt;                     \
+    float k = 1;                                                              \
+                                                                              \
+    if (!(step_len > 0)) {                                                    \
+      return 0;                                                               \
+    }                                                                         \
+    while (!Name##_Outside(b, ox + vx * (k * dt), oy + vy * (k * dt), ox,     \
+                           oy)) {                                             \
+      const float d = Name##_Distance(b, ox + vx * (k * dt),                  \
+                                      oy + vy * (k * dt), ox, oy);            \
+      k += fmaxf(floorf(d / step_len), 1);                                    \
+      if (k >= PARTICLE_POLICY_MAX_PERIOD) {                                  \
+        return 0;                                                             \
+      }                                                                       \
+    }                                                                         \
+    /* Distances are only nearly exact, so step back to the first step */     \
+    /* that is out */                                                         \
+    while (k > 1 && Name##_Outside(b, ox + vx * ((k - 1) * dt),               \
+                                   oy + vy * ((k - 1) * dt), ox, oy)) {       \
+      k--;                                                                    \
+    }                                                                         \
+    return k;                                                                 \
+  }                                                                           \
+                                                                              \
+  static void Name##_SetPeriods(ParticleSoA_t *ps, float dt,                  \
+                                const void *bounds) {                         \
+    for (size_t i = 0; i < ps->Count; i++) {                                  \
+      ps->period[i] = Name##_Period(bounds, ps->origin_x[i], ps->origin_y[i], \
+                                    ps->vx[i], ps->vy[i], dt);                \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static const ParticleBoundary_t Name = {Name##_Update, Name##_SetPeriods}
+
+/*
+ * Particles reset when they leave [min_x, max_x] x [min_y, max_y].
+ */
+typedef struct {
+  float min_x;
+  float min_y;
+  float max_x;
+  float max_y;
+} ParticleRect_t;
+
+static inline bool ParticleRect_Outside(const ParticleRect_t *b, float x,
+                                        float y, float ox, float oy) {
+  return x < b->min_x || x > b->max_x || y < b->min_y || y > b->max_y;
+}
+
+static inline float ParticleRect_Distance(const ParticleRect_t *b, float x,
+                                          float y, float ox, float oy) {
+  return fminf(fminf(x - b->min_x, b->max_x - x),
+               fminf(y - b->min_y, b->max_y - y));
+}
+
+#ifdef PARTICLE_POLICY_X86
+PARTICLE_POLICY_AVX2 static inline __m256 ParticleRect_Outside8(
+    const ParticleRect_t *b, __m256 x, __m256 y, __m256 ox, __m256 oy) {
+  const __m256 min_x = _mm256_set1_ps(b->min_x);
+  const __m256 min_y = _mm256_set1_ps(b->min_y);
+  const __m256 max_x = _mm256_set1_ps(b->max_x);
+  const __m256 max_y = _mm256_set1_ps(b->max_y);
+  __m256 out = _mm256_or_ps(_mm256_cmp_ps(x, min_x, _CMP_LT_OQ),
+                            _mm256_cmp_ps(x, max_x, _CMP_GT_OQ));
+  out = _mm256_or_ps(out, _mm256_cmp_ps(y, min_y, _CMP_LT_OQ));
+  return _mm256_or_ps(out, _mm256_cmp_ps(y, max_y, _CMP_GT_OQ));
+}
+
+PARTICLE_POLICY_SSE41 static inline __m128 ParticleRect_Outside4(
+    const ParticleRect_t *b, __m128 x, __m128 y, __m128 ox, __m128 oy) {
+  __m128 out = _mm_or_ps(_mm_cmplt_ps(x, _mm_set1_ps(b->min_x)),
+                         _mm_cmpgt_ps(x, _mm_set1_ps(b->max_x)));
+  out = _mm_or_ps(out, _mm_cmplt_ps(y, _mm_set1_ps(b->min_y)));
+  return _mm_or_ps(out, _mm_cmpgt_ps(y, _mm_set1_ps(b->max_y)));
+}
+#endif
+
+/*
+ * Particles reset when they are further than radius from their origin.
+ */
+typedef struct {
+  float radius;
+} ParticleCircle_t;
+
+static inline bool ParticleCircle_Outside(const ParticleCircle_t *b, float x,
+                                          float y, float ox, float oy) {
+  const float dx = x - ox;
+  const float dy = y - oy;
+  return dx * dx + dy * dy > b->radius * b->radius;
+}
+
+static inline float ParticleCircle_Distance(const ParticleCircle_t *b,
+                                            float x, float y, float ox,
+                                            float oy) {
+  return b->radius - hypotf(x - ox, y - oy);
+}
+
+#ifdef PARTICLE_POLICY_X86
+PARTICLE_POLICY_AVX2 static inline __m256 ParticleCircle_Outside8(
+    const ParticleCircle_t *b, __m256 x, __m256 y, __m256 ox, __m256 oy) {
+  const __m256 dx = _mm256_sub_ps(x, ox);
+  const __m256 dy = _mm256_sub_ps(y, oy);
+  const __m256 d =
+      _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+  return _mm256_cmp_ps(d, _mm256_set1_ps(b->radius * b->radius),
+                       _CMP_GT_OQ);
+}
+
+PARTICLE_POLICY_SSE41 static inline __m128 ParticleCircle_Outside4(
+    const ParticleCircle_t *b, __m128 x, __m128 y, __m128 ox, __m128 oy) {
+  const __m128 dx = _mm_sub_ps(x, ox);
+  const __m128 dy = _mm_sub_ps(y, oy);
+  const __m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+  return _mm_cmpgt_ps(d, _mm_set1_ps(b->radius * b->radius));
+}
+#endif
+
+#endif  // PARTICLE_POLICY_H
@@ -0,0 +1,317 @@
+#include "particle_soa.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "particle_policy.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARTICLE_SOA_X86 (1)
+#endif
+
+#define SOA_ALIGNMENT (64)
+#define SOA_FLOATS_PER_LINE (SOA_ALIGNMENT / sizeof(float))
+#define SOA_UPDATE_GRAIN (16384)  // particles per thread pool chunk
+
+float *ParticleSoA_AllocArray(size_t count) {
+  size_t padded = (count + SOA_FLOATS_PER_LINE - 1) / SOA_FLOATS_PER_LINE *
+                  SOA_FLOATS_PER_LINE;
+  if (padded == 0) {
+    padded = SOA_FLOATS_PER_LINE;
+  }
+  float *a = aligned_alloc(SOA_ALIGNMENT, padded * sizeof(float));
+  if (a != NULL) {
+    memset(a, 0, padded * sizeof(float));
+  }
+  return a;
+}
+
+ParticleSoA_t *ParticleSoA_Create(size_t count) {
+  ParticleSoA_t *ps = calloc(1, sizeof(*ps));
+  if (ps == NULL) {
+    return NULL;
+  }
+
+  ps->Count = count;
+  ps->x = ParticleSoA_AllocArray(count);
+  ps->y = ParticleSoA_AllocArray(count);
+  ps->prev_x = ParticleSoA_AllocArray(count);
+  ps->prev_y = ParticleSoA_AllocArray(count);
+  ps->vx = ParticleSoA_AllocArray(count);
+  ps->vy = ParticleSoA_AllocArray(count);
+  ps->origin_x = ParticleSoA_AllocArray(count);
+  ps->origin_y = ParticleSoA_AllocArray(count);
+  ps->period = ParticleSoA_AllocArray(count);
+  ps->age = ParticleSoA_AllocArray(count);
+
+  if (!ps->x || !ps->y || !ps->prev_x || !ps->prev_y || !ps->vx || !ps->vy ||
+      !ps->origin_x || !ps->origin_y || !ps->period || !ps->age) {
+    ParticleSoA_Destroy(ps);
+    return NULL;
+  }
+  return ps;
+}
+
+ParticleSoA_t *ParticleSoA_CreatePositions(size_t count) {
+  ParticleSoA_t *ps = calloc(1, sizeof(*ps));
+  if (ps == NULL) {
+    return NULL;
+  }
+
+  ps->Count = count;
+  ps->x = ParticleSoA_AllocArray(count);
+  ps->y = ParticleSoA_AllocArray(count);
+  ps->prev_x = ParticleSoA_AllocArray(count);
+  ps->prev_y = ParticleSoA_AllocArray(count);
+
+  if (!ps->x || !ps->y || !ps->prev_x || !ps->prev_y) {
+    ParticleSoA_Destroy(ps);
+    return NULL;
+  }
+  return ps;
+}
+
+void ParticleSoA_Destroy(ParticleSoA_t *ps) {
+  if (ps == NULL) {
+    return;
+  }
+  free(ps->x);
+  free(ps->y);
+  free(ps->prev_x);
+  free(ps->prev_y);
+  free(ps->vx);
+  free(ps->vy);
+  free(ps->origin_x);
+  free(ps->origin_y);
+  free(ps->period);
+  free(ps->age);
+  free(ps);
+}
+
+static ParticleIsa_t isa = PARTICLE_ISA_SCALAR;
+static const char *kernelName = NULL;
+
+/*
+ * Picks the widest kernels the CPU supports. Runs once, on first use.
+ */
+static void SelectKernels(void) {
+  // Only ever called from the main thread, before any job is handed to the
+  // pool, so no locking is needed.
+  if (kernelName != NULL) {
+    return;
+  }
+  isa = PARTICLE_ISA_SCALAR;
+  kernelName = "scalar";
+
+#ifdef PARTICLE_SOA_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    isa = PARTICLE_ISA_AVX2;
+    kernelName = "avx2";
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    isa = PARTICLE_ISA_SSE41;
+    kernelName = "sse4.1";
+  }
+#endif
+}
+
+ParticleIsa_t ParticleSoA_Isa(void) {
+  SelectKernels();
+  return isa;
+}
+
+PARTICLE_POLICY_DEFINE(ParticleRect);
+PARTICLE_POLICY_DEFINE(ParticleCircle);
+
+void ParticleSoA_UpdateRect(ParticleSoA_t *ps, ThreadPool_t *pool, float dt,
+                            float min_x, float min_y, float max_x,
+                            float max_y) {
+  const ParticleRect_t bounds = {min_x, min_y, max_x, max_y};
+  ParticleRect.Update(ps, pool, dt, &bounds);
+}
+
+void ParticleSoA_UpdateCircle(ParticleSoA_t *ps, ThreadPool_t *pool, float dt,
+                              float radius) {
+  const ParticleCircle_t bounds = {radius};
+  ParticleCircle.Update(ps, pool, dt, &bounds);
+}
+
+typedef struct {
+  ParticleSoA_t *dst;
+  const ParticleSoA_t *src;
+} CopyJob_t;
+
+static void CopyJob(void *ctx, size_t begin, size_t end, unsigned int worker) {
+  const CopyJob_t *job = ctx;
+  const size_t bytes = (end - begin) * sizeof(float);
+
+  memcpy(job->dst->x + begin, job->src->x + begin, bytes);
+  memcpy(job->dst->y + begin, job->src->y + begin, bytes);
+  memcpy(job->dst->prev_x + begin, job->src->prev_x + begin, bytes);
+  memcpy(job->dst->prev_y + begin, job->src->prev_y + begin, bytes);
+}
+
+void ParticleSoA_CopyPositions(ParticleSoA_t *dst, const ParticleSoA_t *src,
+                               ThreadPool_t *pool) {
+  CopyJob_t job = {.dst = dst, .src = src};
+  ThreadPool_ParallelFor(pool, src->Count, SOA_UPDATE_GRAIN, CopyJob, &job);
+}
+
+typedef struct {
+  const ParticleSoA_t *ps;
+  float alpha;
+  float *out_x;
+  float *out_y;
+} InterpolateJob_t;
+
+static void InterpolateJob(void *ctx, size_t begin, size_t end,
+                           unsigned int worker) {
+  const InterpolateJob_t *job = ctx;
+  const float *restrict x = job->ps->x;
+  const float *restrict y = job->ps->y;
+  const float *restrict px = job->ps->prev_x;
+  const float *restrict py = job->ps->prev_y;
+  float *restrict out_x = job->out_x;
+  float *restrict out_y = job->out_y;
+  const float alpha = job->alpha;
+
+  // Simple enough for the compiler to vectorise on its own.
+  for (size_t i = begin; i < end; i++) {
+    out_x[i] = px[i] + (x[i] - px[i]) * alpha;
+    out_y[i] = py[i] + (y[i] - py[i]) * alpha;
+  }
+}
+
+void ParticleSoA_Interpolate(const ParticleSoA_t *ps, ThreadPool_t *pool,
+                             float alpha, float *out_x, float *out_y) {
+  InterpolateJob_t job = {
+      .ps = ps, .alpha = alpha, .out_x = out_x, .out_y = out_y};
+  ThreadPool_ParallelFor(pool, ps->Count, SOA_UPDATE_GRAIN, InterpolateJob,
+                         &job);
+}
+
+const char *ParticleSoA_KernelName(void) {
+  SelectKernels();
+  return kernelName;
+}
+
+/*
+ * Closed-form evaluation. A particle k steps after its last reset sits at
+ * origin + v * (k * dt), and it is reset on the first step that would take it
+ * out of bounds, so its position only depends on the step number modulo its
+ * period.
+ */
+void ParticleSoA_SetPeriodsRect(ParticleSoA_t *ps, float dt, float min_x,
+                                float min_y, float max_x, float max_y) {
+  const ParticleRect_t bounds = {min_x, min_y, max_x, max_y};
+  ParticleRect.SetPeriods(ps, dt, &bounds);
+}
+
+void ParticleSoA_SetPeriodsCircle(ParticleSoA_t *ps, float dt,
+                                  float radius) {
+  const ParticleCircle_t bounds = {radius};
+  ParticleCircle.SetPeriods(ps, dt, &bounds);
+}
+
+typedef struct {
+  const ParticleSoA_t *ps;
+  float dt;
+  double step;
+  float alpha;
+  float *out_x;
+  float *out_y;
+} EvaluateJob_t;
+
+/*
+ * The double precision floor() is a truncate, convert back and fix up
+ * sequence on baseline x86-64 and a single rounding instruction once SSE4.1
+ * is available, so the loop is built twice and picked at run time like the
+ * update kernels.
+ *
+ * It draws what ParticleSoA_Interpolate() draws after step + 1 updates: the
+ * two states the update kernels store, with their arithmetic, blended the
+ * same way, and the origin when update step + 1 resets the particle.
+ */
+#define EVALUATE_LOOP(job, begin, end)                                \
+  do {                                                                \
+    const float *restrict ox = (job)->ps->origin_x;                   \
+    const float *restrict oy = (job)->ps->origin_y;                   \
+    const float *restrict vx = (job)->ps->vx;                         \
+    const float *restrict vy = (job)->ps->vy;                         \
+    const float *restrict period = (job)->ps->period;                 \
+    const float dt = (job)->dt;                                       \
+    const float alpha = (job)->alpha;                                 \
+    float *out_x = (job)->out_x;                                      \
+    float *out_y = (job)->out_y;                                      \
+    for (size_t i = (begin); i < (end); i++) {                        \
+      /* step is whole and below 2^53, period below 2^24, so */       \
+      /* this is an exact modulo */                                   \
+      const double p = period[i];                                     \
+      double k = (job)->step;                                         \
+      k = p > 0 ? k - floor(k / p) * p : k;                           \
+      const float k0 = (float)k;                                      \
+      const float x0 = ox[i] + vx[i] * (k0 * dt);                     \
+      const float y0 = oy[i] + vy[i] * (k0 * dt);                     \
+      const float x1 = ox[i] + vx[i] * ((k0 + 1) * dt);               \
+      const float y1 = oy[i] + vy[i] * ((k0 + 1) * dt);               \
+      const bool reset = k + 1 == p;                                  \
+      out_x[i] = reset ? ox[i] : x0 + (x1 - x0) * alpha;              \
+      out_y[i] = reset ? oy[i] : y0 + (y1 - y0) * alpha;              \
+    }                                                                 \
+  } while (0)
+
+static void Evaluate_Scalar(const EvaluateJob_t *job, size_t begin,
+                            size_t end) {
+  EVALUATE_LOOP(job, begin, end);
+}
+
+#ifdef PARTICLE_SOA_X86
+__attribute__((target("avx2"))) static void Evaluate_AVX2(
+    const EvaluateJob_t *job, size_t begin, size_t end) {
+  EVALUATE_LOOP(job, begin, end);
+}
+#endif
+
+static void EvaluateJob(void *ctx, size_t begin, size_t end,
+                        unsigned int worker) {
+  const EvaluateJob_t *job = ctx;
+#ifdef PARTICLE_SOA_X86
+  if (isa == PARTICLE_ISA_AVX2) {
+    Evaluate_AVX2(job, begin, end);
+    return;
+  }
+#endif
+  Evaluate_Scalar(job, begin, end);
+}
+
+void ParticleSoA_Evaluate(const ParticleSoA_t *ps, ThreadPool_t *pool,
+                          float dt, uint64_t step, float alpha, float *out_x,
+                          float *out_y) {
+  EvaluateJob_t job = {.ps = ps,
+                       .dt = dt,
+                       .step = (double)step,
+                       .alpha = alpha,
+                       .out_x = out_x,
+                       .out_y = out_y};
+  SelectKernels();
+  ThreadPool_ParallelFor(pool, ps->Count, SOA_UPDATE_GRAIN, EvaluateJob,
+                         &job);
+}
+
+/*
+ * The update kernels' arithmetic, for the state after step updates and the
+ * one before it, or the origin for both when update step reset the particle.
+ */
+void ParticleSoA_Seek(ParticleSoA_t *ps, float dt, uint64_t step) {
+  for (size_t i = 0; i < ps->Count; i++) {
+    const double p = ps->period[i];
+    const float age = p > 0 ? step - floor(step / p) * p : step;
+    const float prev_age = age > 0 ? age - 1 : 0;
+
+    ps->age[i] = age;
+    ps->x[i] = ps->origin_x[i] + ps->vx[i] * (age * dt);
+    ps->y[i] = ps->origin_y[i] + ps->vy[i] * (age * dt);
+    ps->prev_x[i] = ps->origin_x[i] + ps->vx[i] * (prev_age * dt);
+    ps->prev_y[i] = ps->origin_y[i] + ps->vy[i] * (prev_age * dt);
+  }
+}
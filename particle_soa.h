@@ -0,0 +1,134 @@
+#ifndef PARTICLE_SOA_H
+#define PARTICLE_SOA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_pool.h"
+
+/*
+ * Structure-of-arrays particle store for the beat sketches. Only the fields
+ * touched every frame live here; cold per-particle data such as color is
+ * kept by the sketch. Every array is 64-byte aligned and padded to a whole
+ * number of cache lines so the SIMD kernels never straddle an allocation.
+ */
+typedef struct {
+  size_t Count;
+  float *x;
+  float *y;
+  float *prev_x;  // position before the last update, for interpolation
+  float *prev_y;
+  float *vx;
+  float *vy;
+  float *origin_x;
+  float *origin_y;
+  float *period;  // steps from one reset to the next, 0 if never reset
+  float *age;     // steps since the last reset, whole
+} ParticleSoA_t;
+
+/*
+ * @note caller is responsible for disposing of the store with
+ * ParticleSoA_Destroy().
+ */
+ParticleSoA_t *ParticleSoA_Create(size_t count);
+void ParticleSoA_Destroy(ParticleSoA_t *ps);
+
+/*
+ * Creates a store with only x, y, prev_x and prev_y, enough to interpolate,
+ * for snapshots of another store's positions taken with
+ * ParticleSoA_CopyPositions(). The other arrays are NULL.
+ *
+ * @note caller is responsible for disposing of the store with
+ * ParticleSoA_Destroy().
+ */
+ParticleSoA_t *ParticleSoA_CreatePositions(size_t count);
+
+/*
+ * Copies x, y, prev_x and prev_y of src to dst, which holds as many
+ * particles.
+ */
+void ParticleSoA_CopyPositions(ParticleSoA_t *dst, const ParticleSoA_t *src,
+                               ThreadPool_t *pool);
+
+/*
+ * Moves every particle a step further, to origin + velocity * (age * dt),
+ * and sends the ones that left the [min_x, max_x] x [min_y, max_y]
+ * rectangle back to their origin. The work is spread over pool, which may be
+ * NULL to update on the calling thread. Other boundaries are defined with
+ * particle_policy.h.
+ */
+void ParticleSoA_UpdateRect(ParticleSoA_t *ps, ThreadPool_t *pool, float dt,
+                            float min_x, float min_y, float max_x,
+                            float max_y);
+
+/*
+ * Moves every particle a step further and sends the ones that are further
+ * than radius away from their origin back to the origin.
+ */
+void ParticleSoA_UpdateCircle(ParticleSoA_t *ps, ThreadPool_t *pool, float dt,
+                              float radius);
+
+/*
+ * Writes prev + (current - prev) * alpha for every particle into out_x and
+ * out_y, which must hold ps->Count floats. A particle that was just reset is
+ * drawn at its origin rather than somewhere between the boundary and origin.
+ */
+void ParticleSoA_Interpolate(const ParticleSoA_t *ps, ThreadPool_t *pool,
+                             float alpha, float *out_x, float *out_y);
+
+/*
+ * Fill in period for particles that move as ParticleSoA_UpdateRect() or
+ * ParticleSoA_UpdateCircle() would move them with steps of dt seconds. Every
+ * particle then follows a fixed cycle that ParticleSoA_Evaluate() can jump
+ * into at any point.
+ */
+void ParticleSoA_SetPeriodsRect(ParticleSoA_t *ps, float dt, float min_x,
+                                float min_y, float max_x, float max_y);
+void ParticleSoA_SetPeriodsCircle(ParticleSoA_t *ps, float dt, float radius);
+
+/*
+ * Writes where every particle is drawn alpha of the way through update
+ * number step + 1 into out_x and out_y, straight from its origin, velocity
+ * and period. No update has to run first and nothing accumulates, so any
+ * step can be evaluated in any order. This is bit for bit what
+ * ParticleSoA_Interpolate() draws after step + 1 updates from the origin,
+ * the origin for a particle that update resets included, for particles that
+ * reset within PARTICLE_POLICY_MAX_PERIOD steps; ages past that are not
+ * whole floats. out_x and out_y may be ps->x and ps->y.
+ *
+ * @note ParticleSoA_SetPeriodsRect(), ParticleSoA_SetPeriodsCircle() or the
+ * SetPeriods of a ParticleBoundary_t must have been called since the
+ * velocities last changed.
+ */
+void ParticleSoA_Evaluate(const ParticleSoA_t *ps, ThreadPool_t *pool,
+                          float dt, uint64_t step, float alpha, float *out_x,
+                          float *out_y);
+
+/*
+ * Moves every particle to update number step, with the age, positions and
+ * previous positions that many updates from the origin would have left, so
+ * updates and interpolation carry on exactly as if they had run. Prepared as
+ * for ParticleSoA_Evaluate().
+ */
+void ParticleSoA_Seek(ParticleSoA_t *ps, float dt, uint64_t step);
+
+/*
+ * Allocates an array in the same padded, aligned layout as the store's own.
+ * Release with free().
+ */
+float *ParticleSoA_AllocArray(size_t count);
+
+typedef enum {
+  PARTICLE_ISA_SCALAR,
+  PARTICLE_ISA_SSE41,
+  PARTICLE_ISA_AVX2,
+} ParticleIsa_t;
+
+/*
+ * Instruction set of the update kernels picked for this CPU, the widest it
+ * supports, and its name ("avx2", "sse4.1" or "scalar").
+ */
+ParticleIsa_t ParticleSoA_Isa(void);
+const char *ParticleSoA_KernelName(void);
+
+#endif  // PARTICLE_SOA_H
@@ -0,0 +1,101 @@
+#include "pipeline.h"
+#include <allegro5/allegro5.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SLOT_MASK (3u)
+#define SLOT_FRESH (4u)  // the shared slot was published and not yet taken
+
+struct Pipeline {
+  void *Snapshots[3];
+  // Index of the snapshot in between the two threads, and SLOT_FRESH when
+  // the producer put it there after the consumer last took one
+  _Atomic unsigned int Shared;
+  unsigned int Back;   // producer's snapshot, only touched by the producer
+  unsigned int Front;  // consumer's snapshot, only touched by the consumer
+
+  Pipeline_ProduceFn_t Produce;
+  void *Ctx;
+  _Atomic bool Stop;
+  ALLEGRO_THREAD *Thread;
+};
+
+/*
+ * Swaps the producer's finished snapshot for the shared one. Release makes
+ * what was written visible to the consumer that takes it; acquire makes
+ * sure the consumer is done with the snapshot handed back before it is
+ * written again.
+ */
+static void Publish(Pipeline_t *p) {
+  p->Back = atomic_exchange_explicit(&p->Shared, p->Back | SLOT_FRESH,
+                                     memory_order_acq_rel) &
+            SLOT_MASK;
+}
+
+void *Pipeline_Latest(Pipeline_t *p) {
+  if (atomic_load_explicit(&p->Shared, memory_order_relaxed) & SLOT_FRESH) {
+    p->Front = atomic_exchange_explicit(&p->Shared, p->Front,
+                                        memory_order_acq_rel) &
+               SLOT_MASK;
+  }
+  return p->Snapshots[p->Front];
+}
+
+static void *ProducerMain(ALLEGRO_THREAD *thread, void *arg) {
+  Pipeline_t *p = arg;
+
+  (void)thread;
+  while (!atomic_load_explicit(&p->Stop, memory_order_relaxed)) {
+    double next;
+    if (p->Produce(p->Ctx, p->Snapshots[p->Back], &next)) {
+      Publish(p);
+    }
+    const double wait = next - al_get_time();
+    if (wait > 0) {
+      al_rest(wait);
+    }
+  }
+  return NULL;
+}
+
+Pipeline_t *Pipeline_Create(void *const snapshots[3],
+                            Pipeline_ProduceFn_t produce, void *ctx) {
+  Pipeline_t *p = calloc(1, sizeof(*p));
+  if (p == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate pipeline!\n");
+    return NULL;
+  }
+  for (int i = 0; i < 3; i++) {
+    p->Snapshots[i] = snapshots[i];
+  }
+  p->Front = 0;
+  atomic_init(&p->Shared, 1);
+  p->Back = 2;
+  p->Produce = produce;
+  p->Ctx = ctx;
+  atomic_init(&p->Stop, false);
+
+  double next;
+  produce(ctx, p->Snapshots[p->Back], &next);
+  Publish(p);
+
+  p->Thread = al_create_thread(ProducerMain, p);
+  if (p->Thread == NULL) {
+    fprintf(stderr, "ERROR: Failed to create pipeline thread!\n");
+    free(p);
+    return NULL;
+  }
+  al_start_thread(p->Thread);
+  return p;
+}
+
+void Pipeline_Destroy(Pipeline_t *p) {
+  if (p == NULL) {
+    return;
+  }
+  atomic_store_explicit(&p->Stop, true, memory_order_relaxed);
+  al_join_thread(p->Thread, NULL);
+  al_destroy_thread(p->Thread);
+  free(p);
+}
@@ -0,0 +1,47 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+
+/*
+ * Producer thread handing snapshots to a consumer through a lock-free
+ * triple buffer. The producer fills one of three snapshots while the
+ * consumer reads another; the third holds the newest complete one. Handing
+ * over is a single atomic exchange on either side, so neither ever waits for
+ * the other: a producer that is ahead overwrites snapshots nobody looked at,
+ * and a consumer that is ahead reads the same snapshot again.
+ *
+ * The host uses it for --pipeline, where the simulation runs on the
+ * producer thread and the main thread draws, so a frame costs the longer of
+ * the two rather than their sum.
+ */
+typedef struct Pipeline Pipeline_t;
+
+/*
+ * Runs on the producer thread. Writes the newest state into snapshot and
+ * returns true, or returns false when there is nothing new and snapshot is
+ * left as it was. *next is set to the time (al_get_time()) to be called
+ * again.
+ */
+typedef bool (*Pipeline_ProduceFn_t)(void *ctx, void *snapshot, double *next);
+
+/*
+ * Starts a producer thread calling produce(ctx, ...) with the three
+ * snapshots in turn. The first call is made on the calling thread before
+ * this returns, and its snapshot is published whatever it returns, so
+ * Pipeline_Latest() always has one. Returns NULL on failure.
+ *
+ * @note caller is responsible for stopping the thread with
+ * Pipeline_Destroy(), which leaves the snapshots to the caller.
+ */
+Pipeline_t *Pipeline_Create(void *const snapshots[3],
+                            Pipeline_ProduceFn_t produce, void *ctx);
+void Pipeline_Destroy(Pipeline_t *p);
+
+/*
+ * Newest complete snapshot. It stays the consumer's until the next call, so
+ * only call this from one thread.
+ */
+void *Pipeline_Latest(Pipeline_t *p);
+
+#endif  // PIPELINE_H
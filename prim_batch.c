@@ -0,0 +1,211 @@
+#include "prim_batch.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raster.h"
+
+#define QUAD_VERTS (4)
+#define QUAD_INDICES (6)
+#define LINE_VERTS (2)
+
+/*
+ * Index pattern for quads, shared by every quad batch. Created when the first
+ * quad batch is created and released with the last one.
+ */
+static ALLEGRO_INDEX_BUFFER *sharedQuadIndices = NULL;
+static int *sharedCpuQuadIndices = NULL;
+static unsigned int numQuadBatches = 0;
+
+static bool AcquireQuadIndices(bool gpu) {
+  if (sharedCpuQuadIndices == NULL) {
+    sharedCpuQuadIndices =
+        malloc(PRIM_BATCH_MAX_PRIMS * QUAD_INDICES * sizeof(int));
+    if (sharedCpuQuadIndices == NULL) {
+      return false;
+    }
+    for (int q = 0; q < PRIM_BATCH_MAX_PRIMS; q++) {
+      int *idx = &sharedCpuQuadIndices[q * QUAD_INDICES];
+      const int v = q * QUAD_VERTS;
+      idx[0] = v;
+      idx[1] = v + 1;
+      idx[2] = v + 2;
+      idx[3] = v;
+      idx[4] = v + 2;
+      idx[5] = v + 3;
+    }
+  }
+
+  if (gpu && sharedQuadIndices == NULL) {
+    uint16_t *idx16 =
+        malloc(PRIM_BATCH_MAX_PRIMS * QUAD_INDICES * sizeof(uint16_t));
+    if (idx16 != NULL) {
+      for (int i = 0; i < PRIM_BATCH_MAX_PRIMS * QUAD_INDICES; i++) {
+        idx16[i] = (uint16_t)sharedCpuQuadIndices[i];
+      }
+      sharedQuadIndices = al_create_index_buffer(
+          sizeof(uint16_t), idx16, PRIM_BATCH_MAX_PRIMS * QUAD_INDICES,
+          ALLEGRO_PRIM_BUFFER_STATIC);
+      free(idx16);
+    }
+  }
+
+  numQuadBatches++;
+  return true;
+}
+
+static void ReleaseQuadIndices(void) {
+  if (numQuadBatches == 0 || --numQuadBatches > 0) {
+    return;
+  }
+  if (sharedQuadIndices) {
+    al_destroy_index_buffer(sharedQuadIndices);
+    sharedQuadIndices = NULL;
+  }
+  free(sharedCpuQuadIndices);
+  sharedCpuQuadIndices = NULL;
+}
+
+PrimBatch_t *PrimBatch_Create(PrimBatchType_t type) {
+  PrimBatch_t *b = calloc(1, sizeof(*b));
+  if (b == NULL) {
+    return NULL;
+  }
+  b->Type = type;
+  b->VertsPerPrim = (type == PRIM_BATCH_QUADS) ? QUAD_VERTS : LINE_VERTS;
+
+  const int num_verts = PRIM_BATCH_MAX_PRIMS * b->VertsPerPrim;
+  ALLEGRO_BITMAP *target = al_get_target_bitmap();
+  const bool gpu =
+      target && !(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP);
+
+  // The CPU array is always there so a failed lock can still be drawn.
+  b->CpuVertices = calloc(num_verts, sizeof(ALLEGRO_VERTEX));
+  if (b->CpuVertices == NULL) {
+    free(b);
+    return NULL;
+  }
+
+  if (type == PRIM_BATCH_QUADS && !AcquireQuadIndices(gpu)) {
+    free(b->CpuVertices);
+    free(b);
+    return NULL;
+  }
+
+  if (gpu && (type != PRIM_BATCH_QUADS || sharedQuadIndices != NULL)) {
+    b->Vertices = al_create_vertex_buffer(NULL, NULL, num_verts,
+                                          ALLEGRO_PRIM_BUFFER_STREAM);
+  }
+  return b;
+}
+
+void PrimBatch_Destroy(PrimBatch_t *b) {
+  if (b == NULL) {
+    return;
+  }
+  if (b->Type == PRIM_BATCH_QUADS) {
+    ReleaseQuadIndices();
+  }
+  if (b->Vertices) {
+    al_destroy_vertex_buffer(b->Vertices);
+  }
+  free(b->CpuVertices);
+  free(b);
+}
+
+static void Map(PrimBatch_t *b) {
+  b->NumPrims = 0;
+  b->Mapped = NULL;
+  // The rasterizer reads the vertices on the CPU, see Submit().
+  if (b->Vertices && Raster_GetCurrent() == NULL) {
+    b->Mapped = al_lock_vertex_buffer(b->Vertices, 0,
+                                      PRIM_BATCH_MAX_PRIMS * b->VertsPerPrim,
+                                      ALLEGRO_LOCK_WRITEONLY);
+  }
+  if (b->Mapped == NULL) {
+    b->Mapped = b->CpuVertices;
+  }
+}
+
+static void Submit(PrimBatch_t *b) {
+  const bool gpu = (b->Mapped != b->CpuVertices);
+  const int num_verts = b->NumPrims * b->VertsPerPrim;
+  const int num_indices = b->NumPrims * QUAD_INDICES;
+
+  if (gpu) {
+    al_unlock_vertex_buffer(b->Vertices);
+  }
+  b->Mapped = NULL;
+  if (num_verts == 0) {
+    return;
+  }
+
+  Raster_t *raster = Raster_GetCurrent();
+  if (raster) {
+    if (b->Type == PRIM_BATCH_QUADS) {
+      Raster_AddQuads(raster, b->CpuVertices, b->NumPrims);
+    } else {
+      Raster_AddLineList(raster, b->CpuVertices, NULL, num_verts);
+    }
+    return;
+  }
+
+  if (b->Type == PRIM_BATCH_QUADS) {
+    if (gpu) {
+      al_draw_indexed_buffer(b->Vertices, NULL, sharedQuadIndices, 0,
+                             num_indices, ALLEGRO_PRIM_TRIANGLE_LIST);
+    } else {
+      al_draw_indexed_prim(b->CpuVertices, NULL, NULL, sharedCpuQuadIndices,
+                           num_indices, ALLEGRO_PRIM_TRIANGLE_LIST);
+    }
+  } else {
+    if (gpu) {
+      al_draw_vertex_buffer(b->Vertices, NULL, 0, num_verts,
+                            ALLEGRO_PRIM_LINE_LIST);
+    } else {
+      al_draw_prim(b->CpuVertices, NULL, NULL, 0, num_verts,
+                   ALLEGRO_PRIM_LINE_LIST);
+    }
+  }
+}
+
+void PrimBatch_Begin(PrimBatch_t *b) { Map(b); }
+
+ALLEGRO_VERTEX *PrimBatch_Add(PrimBatch_t *b) {
+  if (b->NumPrims == PRIM_BATCH_MAX_PRIMS) {
+    Submit(b);
+    Map(b);
+  }
+  ALLEGRO_VERTEX *v = &b->Mapped[b->NumPrims * b->VertsPerPrim];
+  b->NumPrims++;
+  return v;
+}
+
+void PrimBatch_End(PrimBatch_t *b) { Submit(b); }
+
+void PrimBatch_AddQuad(PrimBatch_t *b, float x0, float y0, float x1, float y1,
+                       ALLEGRO_COLOR color) {
+  ALLEGRO_VERTEX *v = PrimBatch_Add(b);
+  v[0] = (ALLEGRO_VERTEX){.x = x0, .y = y0, .color = color};
+  v[1] = (ALLEGRO_VERTEX){.x = x1, .y = y0, .color = color};
+  v[2] = (ALLEGRO_VERTEX){.x = x1, .y = y1, .color = color};
+  v[3] = (ALLEGRO_VERTEX){.x = x0, .y = y1, .color = color};
+}
+
+void PrimBatch_AddLine(PrimBatch_t *b, float x0, float y0, float x1, float y1,
+                       ALLEGRO_COLOR color) {
+  ALLEGRO_VERTEX *v = PrimBatch_Add(b);
+  v[0] = (ALLEGRO_VERTEX){.x = x0, .y = y0, .color = color};
+  v[1] = (ALLEGRO_VERTEX){.x = x1, .y = y1, .color = color};
+}
+
+void PrimBatch_DrawSquares(PrimBatch_t *b, const float *x, const float *y,
+                           const uint8_t *colors,
+                           const ALLEGRO_COLOR *palette, size_t count,
+                           float size) {
+  PrimBatch_Begin(b);
+  for (size_t i = 0; i < count; i++) {
+    PrimBatch_AddQuad(b, x[i], y[i], x[i] + size, y[i] + size,
+                      palette[colors[i]]);
+  }
+  PrimBatch_End(b);
+}
@@ -0,0 +1,81 @@
+#ifndef PRIM_BATCH_H
+#define PRIM_BATCH_H
+
+#include <allegro5/allegro5.h>
+#include <allegro5/allegro_primitives.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Batched primitive submission. Instead of one al_draw_* call per particle,
+ * vertices are written straight into a persistent vertex buffer and the whole
+ * batch is submitted with a single draw call. Quads share one static index
+ * buffer. When no vertex buffer can be created (e.g. drawing into a memory
+ * bitmap in headless mode) the batch falls back to CPU-side arrays and
+ * al_draw_indexed_prim(), so callers never need to care which path is used.
+ * Likewise, with a rasterizer current (see raster.h) the CPU arrays are
+ * recorded into it instead of being drawn by Allegro.
+ *
+ * A batch is flushed every PRIM_BATCH_MAX_PRIMS primitives, which keeps quad
+ * indices within 16 bits.
+ */
+#define PRIM_BATCH_MAX_PRIMS (16384)
+
+typedef enum {
+  PRIM_BATCH_QUADS,  // 4 vertices per primitive, drawn as 2 triangles
+  PRIM_BATCH_LINES,  // 2 vertices per primitive, drawn as hairlines
+} PrimBatchType_t;
+
+typedef struct {
+  PrimBatchType_t Type;
+  unsigned int VertsPerPrim;
+  size_t NumPrims;                   // primitives added since the last flush
+  ALLEGRO_VERTEX_BUFFER *Vertices;   // NULL when using the CPU path
+  ALLEGRO_VERTEX *Mapped;            // locked GPU memory or the CPU array
+  ALLEGRO_VERTEX *CpuVertices;      // fallback storage, always allocated
+} PrimBatch_t;
+
+/*
+ * Creates a batch for the current target bitmap. Must be called after the
+ * display (or headless canvas) exists.
+ *
+ * @note caller is responsible for disposing of the batch with
+ * PrimBatch_Destroy().
+ */
+PrimBatch_t *PrimBatch_Create(PrimBatchType_t type);
+void PrimBatch_Destroy(PrimBatch_t *b);
+
+void PrimBatch_Begin(PrimBatch_t *b);
+
+/*
+ * Returns storage for the next primitive's VertsPerPrim vertices. Only x, y
+ * and color need to be filled in. Flushes automatically when full.
+ */
+ALLEGRO_VERTEX *PrimBatch_Add(PrimBatch_t *b);
+
+/*
+ * Submits whatever is left in the batch.
+ */
+void PrimBatch_End(PrimBatch_t *b);
+
+/*
+ * Adds an axis-aligned quad or a line. Must be called between
+ * PrimBatch_Begin() and PrimBatch_End() on a batch of the matching type.
+ */
+void PrimBatch_AddQuad(PrimBatch_t *b, float x0, float y0, float x1, float y1,
+                       ALLEGRO_COLOR color);
+void PrimBatch_AddLine(PrimBatch_t *b, float x0, float y0, float x1, float y1,
+                       ALLEGRO_COLOR color);
+
+/*
+ * Draws count squares of the given size with their top left corner at
+ * (x[i], y[i]) in palette[colors[i]] as one Begin/Add/End cycle. Particles
+ * keep a byte per color rather than an ALLEGRO_COLOR's sixteen; it is only
+ * looked up here.
+ */
+void PrimBatch_DrawSquares(PrimBatch_t *b, const float *x, const float *y,
+                           const uint8_t *colors,
+                           const ALLEGRO_COLOR *palette, size_t count,
+                           float size);
+
+#endif  // PRIM_BATCH_H
@@ -0,0 +1,1143 @@
+#include "raster.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RASTER_X86 (1)
+#include <immintrin.h>
+#endif
+
+#define TILE_PX RASTER_TILE_PX
+#define TILE_SHIFT (5)  // log2(TILE_PX)
+#define TILE_PIXELS (TILE_PX * TILE_PX)
+#define LANES (8)
+#define SCRATCH_ALIGNMENT (32)
+#define SETUP_GRAIN (4096)  // primitives per thread pool chunk when recording
+#define HAIRLINE_PX (1.0f)
+#define NO_EDGE (1e30f)  // distance to an edge a polygon does not have
+
+_Static_assert(TILE_PX == 1 << TILE_SHIFT, "TILE_SHIFT must match TILE_PX");
+_Static_assert(TILE_PX % LANES == 0, "tile rows must hold whole lanes");
+
+typedef enum {
+  CMD_RECT,      // axis-aligned, area coverage
+  CMD_LINE,      // butt ends, color runs along it
+  CMD_POLYGON,   // convex, 3 or 4 edges
+  CMD_POLYLINE,  // round joins, points in Raster_t.Points
+} CmdType_t;
+
+typedef struct {
+  float X0, Y0, X1, Y1;
+} CmdRect_t;
+
+typedef struct {
+  float X0, Y0;  // start
+  float Dx, Dy;  // unit direction
+  float Len;
+  float InvLen;
+  float HalfWidth;
+  float MaxCover;   // below 1 for lines thinner than a pixel
+  float Color1[4];  // at the end, Cmd_t.Color is at the start
+} CmdLine_t;
+
+typedef struct {
+  // A[i] * x + B[i] * y + C[i] is the distance to edge i, positive inside
+  float A[4], B[4], C[4];
+} CmdPolygon_t;
+
+typedef struct {
+  uint32_t First;  // in Raster_t.Points
+  uint32_t Count;  // at least 2
+  float HalfWidth;
+  float MaxCover;
+} CmdPolyLine_t;
+
+typedef struct {
+  uint8_t Type;
+  // Pixels it may touch, already clipped. Empty when X0 == X1, e.g. after
+  // being clipped away; such commands are never binned.
+  int16_t X0, Y0, X1, Y1;
+  float Color[4];  // premultiplied r, g, b, a
+  union {
+    CmdRect_t Rect;
+    CmdLine_t Line;
+    CmdPolygon_t Polygon;
+    CmdPolyLine_t PolyLine;
+  };
+} Cmd_t;
+
+typedef struct {
+  uint32_t *Cmds;  // indices, in recording order
+  uint32_t Count;
+  uint32_t Capacity;
+} Bin_t;
+
+typedef struct {
+  int X0, Y0, X1, Y1;
+} Clip_t;
+
+/*
+ * Part of a command inside one tile, in tile pixels, and where the tile is
+ * in the target.
+ */
+typedef struct {
+  int X0, Y0, X1, Y1;
+  float Left;
+  float Top;
+} Span_t;
+
+/*
+ * A worker's tile is 5 planes of TILE_PIXELS floats: red, green, blue and
+ * alpha of the pixels, and coverage scratch for polylines.
+ */
+#define PLANE_R (0)
+#define PLANE_G (1 * TILE_PIXELS)
+#define PLANE_B (2 * TILE_PIXELS)
+#define PLANE_A (3 * TILE_PIXELS)
+#define PLANE_COVER (4 * TILE_PIXELS)
+#define TILE_FLOATS (5 * TILE_PIXELS)
+
+typedef struct {
+  void (*Load)(float *tile, const uint8_t *pixels, int pitch, int w, int h);
+  void (*Store)(const float *tile, uint8_t *pixels, int pitch, int w, int h);
+  void (*Rect)(float *tile, const Cmd_t *c, const Span_t *s);
+  void (*Line)(float *tile, const Cmd_t *c, const Span_t *s);
+  void (*Polygon)(float *tile, const Cmd_t *c, const Span_t *s);
+  void (*PolyLine)(float *tile, const Cmd_t *c, const Span_t *s,
+                   const float *points);
+  const char *Name;
+} Kernels_t;
+
+struct Raster {
+  ALLEGRO_BITMAP *Target;
+  ThreadPool_t *Pool;
+  const Kernels_t *Kernels;
+  int Width;
+  int Height;
+  int TilesX;
+  int TilesY;
+
+  Cmd_t *Cmds;
+  size_t NumCmds;
+  size_t CmdCapacity;
+  float *Points;  // x, y pairs of the polylines
+  size_t NumPoints;
+  size_t PointCapacity;
+  bool Dropped;  // ran out of memory since the last flush
+
+  Bin_t *Bins;       // TilesX * TilesY, row by row
+  uint32_t *Active;  // tiles with commands, gathered by Raster_Flush()
+  unsigned int NumWorkers;
+  float **Tiles;  // one per worker, TILE_FLOATS each
+};
+
+static _Thread_local Raster_t *current = NULL;
+
+static inline float Clamp01(float x) { return fminf(fmaxf(x, 0.0f), 1.0f); }
+
+/*
+ * Premultiplied source over, the default blender: dst = src + dst * (1 - a)
+ * with the source scaled by coverage.
+ */
+static inline void Blend(float *tile, int i, float cover, const float *color) {
+  const float k = 1.0f - color[3] * cover;
+  tile[PLANE_R + i] = tile[PLANE_R + i] * k + color[0] * cover;
+  tile[PLANE_G + i] = tile[PLANE_G + i] * k + color[1] * cover;
+  tile[PLANE_B + i] = tile[PLANE_B + i] * k + color[2] * cover;
+  tile[PLANE_A + i] = tile[PLANE_A + i] * k + color[3] * cover;
+}
+
+static void Load_Scalar(float *tile, const uint8_t *pixels, int pitch, int w,
+                        int h) {
+  for (int y = 0; y < h; y++) {
+    const uint8_t *p = pixels + (ptrdiff_t)y * pitch;
+    for (int x = 0; x < w; x++) {
+      const int i = y * TILE_PX + x;
+      tile[PLANE_R + i] = p[4 * x] * (1.0f / 255);
+      tile[PLANE_G + i] = p[4 * x + 1] * (1.0f / 255);
+      tile[PLANE_B + i] = p[4 * x + 2] * (1.0f / 255);
+      tile[PLANE_A + i] = p[4 * x + 3] * (1.0f / 255);
+    }
+  }
+}
+
+static void Store_Scalar(const float *tile, uint8_t *pixels, int pitch, int w,
+                         int h) {
+  for (int y = 0; y < h; y++) {
+    uint8_t *p = pixels + (ptrdiff_t)y * pitch;
+    for (int x = 0; x < w; x++) {
+      const int i = y * TILE_PX + x;
+      p[4 * x] = (uint8_t)(Clamp01(tile[PLANE_R + i]) * 255 + 0.5f);
+      p[4 * x + 1] = (uint8_t)(Clamp01(tile[PLANE_G + i]) * 255 + 0.5f);
+      p[4 * x + 2] = (uint8_t)(Clamp01(tile[PLANE_B + i]) * 255 + 0.5f);
+      p[4 * x + 3] = (uint8_t)(Clamp01(tile[PLANE_A + i]) * 255 + 0.5f);
+    }
+  }
+}
+
+/*
+ * Coverage is the area of the pixel inside the rectangle, the product of the
+ * overlaps in x and y.
+ */
+static void Rect_Scalar(float *tile, const Cmd_t *c, const Span_t *s) {
+  const CmdRect_t *q = &c->Rect;
+
+  for (int y = s->Y0; y < s->Y1; y++) {
+    const float py = s->Top + y;
+    const float cy = Clamp01(fminf(q->Y1, py + 1) - fmaxf(q->Y0, py));
+    for (int x = s->X0; x < s->X1; x++) {
+      const float px = s->Left + x;
+      const float cx = Clamp01(fminf(q->X1, px + 1) - fmaxf(q->X0, px));
+      Blend(tile, y * TILE_PX + x, cx * cy, c->Color);
+    }
+  }
+}
+
+/*
+ * Coverage falls off over a pixel across the line's sides and across its
+ * ends, so two lines meeting end to end in a straight line add up to one.
+ */
+static void Line_Scalar(float *tile, const Cmd_t *c, const Span_t *s) {
+  const CmdLine_t *l = &c->Line;
+
+  for (int y = s->Y0; y < s->Y1; y++) {
+    const float py = s->Top + y + 0.5f - l->Y0;
+    for (int x = s->X0; x < s->X1; x++) {
+      const float px = x + (s->Left + 0.5f - l->X0);
+      const float along = px * l->Dx + py * l->Dy;
+      const float across = fabsf(px * l->Dy - py * l->Dx);
+      const float cover =
+          fminf(Clamp01(l->HalfWidth + 0.5f - across), l->MaxCover) *
+          Clamp01(along + 0.5f) * Clamp01(l->Len + 0.5f - along);
+      const float t = Clamp01(along * l->InvLen);
+      float color[4];
+      for (int k = 0; k < 4; k++) {
+        color[k] = c->Color[k] + (l->Color1[k] - c->Color[k]) * t;
+      }
+      Blend(tile, y * TILE_PX + x, cover, color);
+    }
+  }
+}
+
+/*
+ * Coverage from the distance to the nearest edge, which is exact along the
+ * edges and rounds the corners off a little.
+ */
+static void Polygon_Scalar(float *tile, const Cmd_t *c, const Span_t *s) {
+  const CmdPolygon_t *p = &c->Polygon;
+
+  for (int y = s->Y0; y < s->Y1; y++) {
+    const float py = s->Top + y + 0.5f;
+    for (int x = s->X0; x < s->X1; x++) {
+      const float px = x + (s->Left + 0.5f);
+      float d = NO_EDGE;
+      for (int e = 0; e < 4; e++) {
+        d = fminf(d, p->A[e] * px + (p->B[e] * py + p->C[e]));
+      }
+      Blend(tile, y * TILE_PX + x, Clamp01(d + 0.5f), c->Color);
+    }
+  }
+}
+
+/*
+ * Clips the bounds of segment a-b, widened by margin, to span. Returns false
+ * when nothing is left.
+ */
+static bool SegmentSpan(const float *a, const float *b, float margin,
+                        const Span_t *s, Span_t *out) {
+  *out = *s;
+  out->X0 = (int)fmaxf(floorf(fminf(a[0], b[0]) - margin - s->Left), s->X0);
+  out->Y0 = (int)fmaxf(floorf(fminf(a[1], b[1]) - margin - s->Top), s->Y0);
+  out->X1 = (int)fminf(ceilf(fmaxf(a[0], b[0]) + margin - s->Left), s->X1);
+  out->Y1 = (int)fminf(ceilf(fmaxf(a[1], b[1]) + margin - s->Top), s->Y1);
+  return out->X0 < out->X1 && out->Y0 < out->Y1;
+}
+
+/*
+ * Every segment is a capsule. Coverage of the polyline is the highest of
+ * its segments', gathered in the coverage plane before blending once.
+ */
+static void PolyLine_Scalar(float *tile, const Cmd_t *c, const Span_t *s,
+                            const float *points) {
+  const CmdPolyLine_t *l = &c->PolyLine;
+  const float *pts = &points[2 * l->First];
+  float *cover = &tile[PLANE_COVER];
+
+  for (int y = s->Y0; y < s->Y1; y++) {
+    for (int x = s->X0; x < s->X1; x++) {
+      cover[y * TILE_PX + x] = 0;
+    }
+  }
+  for (uint32_t k = 0; k + 1 < l->Count; k++) {
+    const float *a = &pts[2 * k];
+    const float *b = &pts[2 * k + 2];
+    Span_t seg;
+    if (!SegmentSpan(a, b, l->HalfWidth + 0.5f, s, &seg)) {
+      continue;
+    }
+    const float bax = b[0] - a[0];
+    const float bay = b[1] - a[1];
+    const float len2 = bax * bax + bay * bay;
+    const float inv = len2 > 0 ? 1.0f / len2 : 0;
+    for (int y = seg.Y0; y < seg.Y1; y++) {
+      const float pay = s->Top + y + 0.5f - a[1];
+      for (int x = seg.X0; x < seg.X1; x++) {
+        const float pax = x + (s->Left + 0.5f - a[0]);
+        const float h = Clamp01((pax * bax + pay * bay) * inv);
+        const float dx = pax - bax * h;
+        const float dy = pay - bay * h;
+        const float d = sqrtf(dx * dx + dy * dy);
+        const float cv = fminf(Clamp01(l->HalfWidth + 0.5f - d), l->MaxCover);
+        const int i = y * TILE_PX + x;
+        cover[i] = fmaxf(cover[i], cv);
+      }
+    }
+  }
+  for (int y = s->Y0; y < s->Y1; y++) {
+    for (int x = s->X0; x < s->X1; x++) {
+      const int i = y * TILE_PX + x;
+      Blend(tile, i, cover[i], c->Color);
+    }
+  }
+}
+
+static const Kernels_t scalarKernels = {
+    Load_Scalar,    Store_Scalar,    Rect_Scalar, Line_Scalar,
+    Polygon_Scalar, PolyLine_Scalar, "scalar",
+};
+
+#ifdef RASTER_X86
+#define AVX2 __attribute__((target("avx2")))
+
+/*
+ * The AVX2 kernels work on the 8 pixel groups of a row that overlap the
+ * span, starting at a multiple of 8 so the loads are aligned, and mask off
+ * the pixels outside it.
+ */
+AVX2 static inline __m256 LaneX(int x) {
+  return _mm256_add_ps(_mm256_set1_ps((float)x),
+                       _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+AVX2 static inline __m256 SpanMask(__m256 lane_x, const Span_t *s) {
+  return _mm256_and_ps(
+      _mm256_cmp_ps(lane_x, _mm256_set1_ps((float)s->X0), _CMP_GE_OQ),
+      _mm256_cmp_ps(lane_x, _mm256_set1_ps((float)s->X1), _CMP_LT_OQ));
+}
+
+AVX2 static inline __m256 Clamp01_AVX2(__m256 x) {
+  return _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()),
+                       _mm256_set1_ps(1.0f));
+}
+
+AVX2 static inline void Blend_AVX2(float *tile, int i, __m256 cover,
+                                   __m256 r, __m256 g, __m256 b, __m256 a) {
+  const __m256 k =
+      _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(a, cover));
+  float *pr = &tile[PLANE_R + i];
+  float *pg = &tile[PLANE_G + i];
+  float *pb = &tile[PLANE_B + i];
+  float *pa = &tile[PLANE_A + i];
+  _mm256_store_ps(pr, _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(pr), k),
+                                    _mm256_mul_ps(r, cover)));
+  _mm256_store_ps(pg, _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(pg), k),
+                                    _mm256_mul_ps(g, cover)));
+  _mm256_store_ps(pb, _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(pb), k),
+                                    _mm256_mul_ps(b, cover)));
+  _mm256_store_ps(pa, _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(pa), k),
+                                    _mm256_mul_ps(a, cover)));
+}
+
+AVX2 static inline void BlendColor_AVX2(float *tile, int i, __m256 cover,
+                                        const float *color) {
+  Blend_AVX2(tile, i, cover, _mm256_set1_ps(color[0]),
+             _mm256_set1_ps(color[1]), _mm256_set1_ps(color[2]),
+             _mm256_set1_ps(color[3]));
+}
+
+AVX2 static void Load_AVX2(float *tile, const uint8_t *pixels, int pitch,
+                           int w, int h) {
+  const __m256i mask = _mm256_set1_epi32(0xff);
+  const __m256 scale = _mm256_set1_ps(1.0f / 255);
+  const int wv = w & ~(LANES - 1);
+
+  for (int y = 0; y < h; y++) {
+    const uint8_t *p = pixels + (ptrdiff_t)y * pitch;
+    for (int x = 0; x < wv; x += LANES) {
+      const int i = y * TILE_PX + x;
+      const __m256i px = _mm256_loadu_si256((const __m256i *)&p[4 * x]);
+      const __m256i r = _mm256_and_si256(px, mask);
+      const __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+      const __m256i b = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask);
+      const __m256i a = _mm256_srli_epi32(px, 24);
+      _mm256_store_ps(&tile[PLANE_R + i],
+                      _mm256_mul_ps(_mm256_cvtepi32_ps(r), scale));
+      _mm256_store_ps(&tile[PLANE_G + i],
+                      _mm256_mul_ps(_mm256_cvtepi32_ps(g), scale));
+      _mm256_store_ps(&tile[PLANE_B + i],
+                      _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+      _mm256_store_ps(&tile[PLANE_A + i],
+                      _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+    }
+  }
+  if (wv < w) {
+    Load_Scalar(&tile[wv], pixels + 4 * wv, pitch, w - wv, h);
+  }
+}
+
+// Rounds like Store_Scalar(): clamp, scale and truncate after adding .5
+AVX2 static inline __m256i ToByte(const float *v) {
+  const __m256 x = _mm256_mul_ps(Clamp01_AVX2(_mm256_load_ps(v)),
+                                 _mm256_set1_ps(255.0f));
+  return _mm256_cvttps_epi32(_mm256_add_ps(x, _mm256_set1_ps(0.5f)));
+}
+
+AVX2 static void Store_AVX2(const float *tile, uint8_t *pixels, int pitch,
+                            int w, int h) {
+  const int wv = w & ~(LANES - 1);
+
+  for (int y = 0; y < h; y++) {
+    uint8_t *p = pixels + (ptrdiff_t)y * pitch;
+    for (int x = 0; x < wv; x += LANES) {
+      const int i = y * TILE_PX + x;
+      __m256i px = ToByte(&tile[PLANE_R + i]);
+      px = _mm256_or_si256(px, _mm256_slli_epi32(ToByte(&tile[PLANE_G + i]),
+                                                 8));
+      px = _mm256_or_si256(px, _mm256_slli_epi32(ToByte(&tile[PLANE_B + i]),
+                                                 16));
+      px = _mm256_or_si256(px, _mm256_slli_epi32(ToByte(&tile[PLANE_A + i]),
+                                                 24));
+      _mm256_storeu_si256((__m256i *)&p[4 * x], px);
+    }
+  }
+  if (wv < w) {
+    Store_Scalar(&tile[wv], pixels + 4 * wv, pitch, w - wv, h);
+  }
+}
+
+AVX2 static void Rect_AVX2(float *tile, const Cmd_t *c, const Span_t *s) {
+  const CmdRect_t *q = &c->Rect;
+  const __m256 x0 = _mm256_set1_ps(q->X0);
+  const __m256 x1 = _mm256_set1_ps(q->X1);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const int xb = s->X0 & ~(LANES - 1);
+
+  for (int y = s->Y0; y < s->Y1; y++) {
+    const float py = s->Top + y;
+    const __m256 cy =
+        _mm256_set1_ps(Clamp01(fminf(q->Y1, py + 1) - fmaxf(q->Y0, py)));
+    for (int x = xb; x < s->X1; x += LANES) {
+      const __m256 lane = LaneX(x);
+      const __m256 px = _mm256_add_ps(lane, _mm256_set1_ps(s->Left));
+      const __m256 cx = Clamp01_AVX2(
+          _mm256_sub_ps(_mm256_min_ps(x1, _mm256_add_ps(px, one)),
+                        _mm256_max_ps(x0, px)));
+      const __m256 cover =
+          _mm256_and_ps(_mm256_mul_ps(cx, cy), SpanMask(lane, s));
+      BlendColor_AVX2(tile, y * TILE_PX + x, cover, c->Color);
+    }
+  }
+}
+
+AVX2 static void Line_AVX2(float *tile, const Cmd_t *c, const Span_t *s) {
+  const CmdLine_t *l = &c->Line;
+  const __m256 dx = _mm256_set1_ps(l->Dx);
+  const __m256 dy = _mm256_set1_ps(l->Dy);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 side = _mm256_set1_ps(l->HalfWidth + 0.5f);
+  const __m256 end = _mm256_set1_ps(l->Len + 0.5f);
+  const __m256 max_cover = _mm256_set1_ps(l->MaxCover);
+  const __m256 inv_len = _mm256_set1_ps(l->InvLen);
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 c0[4];
+  __m256 dc[4];
+  for (int k = 0; k < 4; k++) {
+    c0[k] = _mm256_set1_ps(c->Color[k]);
+    dc[k] = _mm256_set1_ps(l->Color1[k] - c->Color[k]);
+  }
+  const int xb = s->X0 & ~(LANES - 1);
+
+  for (int y = s->Y0; y < s->Y1; y++) {
+    const __m256 py = _mm256_set1_ps(s->Top + y + 0.5f - l->Y0);
+    for (int x = xb; x < s->X1; x += LANES) {
+      const __m256 lane = LaneX(x);
+      const __m256 px =
+          _mm256_add_ps(lane, _mm256_set1_ps(s->Left + 0.5f - l->X0));
+      const __m256 along =
+          _mm256_add_ps(_mm256_mul_ps(px, dx), _mm256_mul_ps(py, dy));
+      const __m256 across = _mm256_and_ps(
+          _mm256_sub_ps(_mm256_mul_ps(px, dy), _mm256_mul_ps(py, dx)),
+          abs_mask);
+      __m256 cover = _mm256_min_ps(
+          Clamp01_AVX2(_mm256_sub_ps(side, across)), max_cover);
+      cover = _mm256_mul_ps(cover, Clamp01_AVX2(_mm256_add_ps(along, half)));
+      cover = _mm256_mul_ps(cover, Clamp01_AVX2(_mm256_sub_ps(end, along)));
+      cover = _mm256_and_ps(cover, SpanMask(lane, s));
+      const __m256 t = Clamp01_AVX2(_mm256_mul_ps(along, inv_len));
+      Blend_AVX2(tile, y * TILE_PX + x, cover,
+                 _mm256_add_ps(c0[0], _mm256_mul_ps(dc[0], t)),
+                 _mm256_add_ps(c0[1], _mm256_mul_ps(dc[1], t)),
+                 _mm256_add_ps(c0[2], _mm256_mul_ps(dc[2], t)),
+                 _mm256_add_ps(c0[3], _mm256_mul_ps(dc[3], t)));
+    }
+  }
+}
+
+AVX2 static void Polygon_AVX2(float *tile, const Cmd_t *c, const Span_t *s) {
+  const CmdPolygon_t *p = &c->Polygon;
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const int xb = s->X0 & ~(LANES - 1);
+
+  for (int y = s->Y0; y < s->Y1; y++) {
+    const float py = s->Top + y + 0.5f;
+    // Each edge's distance along the row is a + b * x
+    __m256 row[4];
+    __m256 a[4];
+    for (int e = 0; e < 4; e++) {
+      row[e] = _mm256_set1_ps(p->B[e] * py + p->C[e]);
+      a[e] = _mm256_set1_ps(p->A[e]);
+    }
+    for (int x = xb; x < s->X1; x += LANES) {
+      const __m256 lane = LaneX(x);
+      const __m256 px =
+          _mm256_add_ps(lane, _mm256_set1_ps(s->Left + 0.5f));
+      __m256 d = _mm256_set1_ps(NO_EDGE);
+      for (int e = 0; e < 4; e++) {
+        d = _mm256_min_ps(d, _mm256_add_ps(_mm256_mul_ps(a[e], px), row[e]));
+      }
+      const __m256 cover = _mm256_and_ps(
+          Clamp01_AVX2(_mm256_add_ps(d, half)), SpanMask(lane, s));
+      BlendColor_AVX2(tile, y * TILE_PX + x, cover, c->Color);
+    }
+  }
+}
+
+AVX2 static void PolyLine_AVX2(float *tile, const Cmd_t *c, const Span_t *s,
+                               const float *points) {
+  const CmdPolyLine_t *l = &c->PolyLine;
+  const float *pts = &points[2 * l->First];
+  float *cover = &tile[PLANE_COVER];
+  const __m256 side = _mm256_set1_ps(l->HalfWidth + 0.5f);
+  const __m256 max_cover = _mm256_set1_ps(l->MaxCover);
+  const int xb = s->X0 & ~(LANES - 1);
+
+  for (int y = s->Y0; y < s->Y1; y++) {
+    for (int x = xb; x < s->X1; x += LANES) {
+      _mm256_store_ps(&cover[y * TILE_PX + x], _mm256_setzero_ps());
+    }
+  }
+  // Groups a segment shares with the span's are fully computed, so pixels
+  // outside the span get coverage too, which the blend below masks off.
+  for (uint32_t k = 0; k + 1 < l->Count; k++) {
+    const float *a = &pts[2 * k];
+    const float *b = &pts[2 * k + 2];
+    Span_t seg;
+    if (!SegmentSpan(a, b, l->HalfWidth + 0.5f, s, &seg)) {
+      continue;
+    }
+    const float ba_x = b[0] - a[0];
+    const float ba_y = b[1] - a[1];
+    const float len2 = ba_x * ba_x + ba_y * ba_y;
+    const __m256 bax = _mm256_set1_ps(ba_x);
+    const __m256 bay = _mm256_set1_ps(ba_y);
+    const __m256 inv = _mm256_set1_ps(len2 > 0 ? 1.0f / len2 : 0);
+    const int sxb = seg.X0 & ~(LANES - 1);
+    for (int y = seg.Y0; y < seg.Y1; y++) {
+      const __m256 pay = _mm256_set1_ps(s->Top + y + 0.5f - a[1]);
+      for (int x = sxb; x < seg.X1; x += LANES) {
+        const __m256 pax = _mm256_add_ps(
+            LaneX(x), _mm256_set1_ps(s->Left + 0.5f - a[0]));
+        const __m256 h = Clamp01_AVX2(_mm256_mul_ps(
+            _mm256_add_ps(_mm256_mul_ps(pax, bax), _mm256_mul_ps(pay, bay)),
+            inv));
+        const __m256 dx = _mm256_sub_ps(pax, _mm256_mul_ps(bax, h));
+        const __m256 dy = _mm256_sub_ps(pay, _mm256_mul_ps(bay, h));
+        const __m256 d = _mm256_sqrt_ps(
+            _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+        const __m256 cv =
+            _mm256_min_ps(Clamp01_AVX2(_mm256_sub_ps(side, d)), max_cover);
+        float *out = &cover[y * TILE_PX + x];
+        _mm256_store_ps(out, _mm256_max_ps(_mm256_load_ps(out), cv));
+      }
+    }
+  }
+  for (int y = s->Y0; y < s->Y1; y++) {
+    for (int x = xb; x < s->X1; x += LANES) {
+      const int i = y * TILE_PX + x;
+      const __m256 cv =
+          _mm256_and_ps(_mm256_load_ps(&cover[i]), SpanMask(LaneX(x), s));
+      BlendColor_AVX2(tile, i, cv, c->Color);
+    }
+  }
+}
+
+static const Kernels_t avx2Kernels = {
+    Load_AVX2,    Store_AVX2,    Rect_AVX2, Line_AVX2,
+    Polygon_AVX2, PolyLine_AVX2, "avx2",
+};
+#endif  // RASTER_X86
+
+/*
+ * Cached CPU check; the first call may come from several pool workers at
+ * once, which all store the same value.
+ */
+static bool UseAVX2(void) {
+#ifdef RASTER_X86
+  static _Atomic int hasAVX2 = -1;
+  int has = hasAVX2;
+  if (has < 0) {
+    __builtin_cpu_init();
+    has = __builtin_cpu_supports("avx2") ? 1 : 0;
+    hasAVX2 = has;
+  }
+  return has;
+#else
+  return false;
+#endif
+}
+
+static const Kernels_t *SelectKernels(void) {
+#ifdef RASTER_X86
+  if (UseAVX2()) {
+    return &avx2Kernels;
+  }
+#endif
+  return &scalarKernels;
+}
+
+const char *Raster_KernelName(void) { return SelectKernels()->Name; }
+
+Raster_t *Raster_Create(ALLEGRO_BITMAP *target, ThreadPool_t *pool) {
+  const int width = al_get_bitmap_width(target);
+  const int height = al_get_bitmap_height(target);
+  if (width <= 0 || height <= 0 || width > INT16_MAX ||
+      height > INT16_MAX) {
+    fprintf(stderr, "ERROR: Cannot rasterize into a %dx%d bitmap!\n", width,
+            height);
+    return NULL;
+  }
+
+  Raster_t *r = calloc(1, sizeof(*r));
+  if (r == NULL) {
+    return NULL;
+  }
+  r->Target = target;
+  r->Pool = pool;
+  r->Kernels = SelectKernels();
+  r->Width = width;
+  r->Height = height;
+  r->TilesX = (width + TILE_PX - 1) / TILE_PX;
+  r->TilesY = (height + TILE_PX - 1) / TILE_PX;
+  r->NumWorkers = ThreadPool_NumThreads(pool);
+
+  const size_t num_tiles = (size_t)r->TilesX * r->TilesY;
+  r->Bins = calloc(num_tiles, sizeof(*r->Bins));
+  r->Active = malloc(num_tiles * sizeof(*r->Active));
+  r->Tiles = calloc(r->NumWorkers, sizeof(*r->Tiles));
+  if (!r->Bins || !r->Active || !r->Tiles) {
+    Raster_Destroy(r);
+    return NULL;
+  }
+  for (unsigned int w = 0; w < r->NumWorkers; w++) {
+    r->Tiles[w] =
+        aligned_alloc(SCRATCH_ALIGNMENT, TILE_FLOATS * sizeof(float));
+    if (r->Tiles[w] == NULL) {
+      Raster_Destroy(r);
+      return NULL;
+    }
+    // Columns right of a narrow edge tile are blended with zero coverage,
+    // and never stored, but should still be numbers.
+    memset(r->Tiles[w], 0, TILE_FLOATS * sizeof(float));
+  }
+  return r;
+}
+
+void Raster_Destroy(Raster_t *r) {
+  if (r == NULL) {
+    return;
+  }
+  if (current == r) {
+    current = NULL;
+  }
+  for (size_t t = 0; r->Bins && t < (size_t)r->TilesX * r->TilesY; t++) {
+    free(r->Bins[t].Cmds);
+  }
+  for (unsigned int w = 0; r->Tiles && w < r->NumWorkers; w++) {
+    free(r->Tiles[w]);
+  }
+  free(r->Bins);
+  free(r->Active);
+  free(r->Tiles);
+  free(r->Cmds);
+  free(r->Points);
+  free(r);
+}
+
+void Raster_MakeCurrent(Raster_t *r) { current = r; }
+
+Raster_t *Raster_GetCurrent(void) {
+  if (current && al_get_target_bitmap() == current->Target) {
+    return current;
+  }
+  return NULL;
+}
+
+/*
+ * Recording
+ */
+static Clip_t GetClip(const Raster_t *r) {
+  int x, y, w, h;
+  al_get_clipping_rectangle(&x, &y, &w, &h);
+  const Clip_t clip = {
+      x > 0 ? x : 0,
+      y > 0 ? y : 0,
+      x + w < r->Width ? x + w : r->Width,
+      y + h < r->Height ? y + h : r->Height,
+  };
+  return clip;
+}
+
+/*
+ * Sets the pixels c may touch to those overlapping [x0, x1] x [y0, y1]
+ * widened by margin, within clip. Empty or NaN bounds leave c empty; they
+ * are caught before clamping since fmaxf/fminf would turn a NaN into the
+ * clip edge.
+ */
+static void SetBounds(Cmd_t *c, const Clip_t *clip, float x0, float y0,
+                      float x1, float y1, float margin) {
+  if (!(x0 <= x1 && y0 <= y1 && margin >= 0)) {
+    c->X0 = c->Y0 = c->X1 = c->Y1 = 0;
+    return;
+  }
+  const float px0 = fmaxf(floorf(x0 - margin), clip->X0);
+  const float py0 = fmaxf(floorf(y0 - margin), clip->Y0);
+  const float px1 = fminf(ceilf(x1 + margin), clip->X1);
+  const float py1 = fminf(ceilf(y1 + margin), clip->Y1);
+  if (!(px0 < px1 && py0 < py1)) {
+    c->X0 = c->Y0 = c->X1 = c->Y1 = 0;
+    return;
+  }
+  c->X0 = (int16_t)px0;
+  c->Y0 = (int16_t)py0;
+  c->X1 = (int16_t)px1;
+  c->Y1 = (int16_t)py1;
+}
+
+static void SetColor(float *out, ALLEGRO_COLOR color) {
+  out[0] = color.r;
+  out[1] = color.g;
+  out[2] = color.b;
+  out[3] = color.a;
+}
+
+static void SetupRect(Cmd_t *c, const Clip_t *clip, float x0, float y0,
+                      float x1, float y1, ALLEGRO_COLOR color) {
+  c->Type = CMD_RECT;
+  SetColor(c->Color, color);
+  // fminf/fmaxf drop a NaN corner, so reject those here.
+  if (isnan(x0) || isnan(y0) || isnan(x1) || isnan(y1)) {
+    c->X0 = c->Y0 = c->X1 = c->Y1 = 0;
+    return;
+  }
+  c->Rect = (CmdRect_t){fminf(x0, x1), fminf(y0, y1), fmaxf(x0, x1),
+                        fmaxf(y0, y1)};
+  SetBounds(c, clip, c->Rect.X0, c->Rect.Y0, c->Rect.X1, c->Rect.Y1, 0);
+}
+
+/*
+ * Convex polygon of n (3 or 4) vertices in either winding.
+ */
+static void SetupPolygon(Cmd_t *c, const Clip_t *clip, const float *x,
+                         const float *y, int n, ALLEGRO_COLOR color) {
+  CmdPolygon_t *p = &c->Polygon;
+  float area = 0;
+  float min_x = x[0], min_y = y[0], max_x = x[0], max_y = y[0];
+
+  for (int i = 0; i < n; i++) {
+    const int j = (i + 1) % n;
+    area += x[i] * y[j] - x[j] * y[i];
+    min_x = fminf(min_x, x[i]);
+    min_y = fminf(min_y, y[i]);
+    max_x = fmaxf(max_x, x[i]);
+    max_y = fmaxf(max_y, y[i]);
+  }
+  c->Type = CMD_POLYGON;
+  SetColor(c->Color, color);
+  if (!(area != 0)) {
+    c->X0 = c->Y0 = c->X1 = c->Y1 = 0;
+    return;
+  }
+  const float sign = area > 0 ? 1.0f : -1.0f;
+  for (int i = 0; i < 4; i++) {
+    p->A[i] = p->B[i] = 0;
+    p->C[i] = NO_EDGE;
+    if (i >= n) {
+      continue;
+    }
+    const int j = (i + 1) % n;
+    const float ex = x[j] - x[i];
+    const float ey = y[j] - y[i];
+    const float len = sqrtf(ex * ex + ey * ey);
+    if (len > 0) {
+      const float s = sign / len;
+      p->A[i] = -ey * s;
+      p->B[i] = ex * s;
+      p->C[i] = (ey * x[i] - ex * y[i]) * s;
+    }
+  }
+  SetBounds(c, clip, min_x, min_y, max_x, max_y, 0.5f);
+}
+
+static void SetupQuad(Cmd_t *c, const Clip_t *clip, const ALLEGRO_VERTEX *v) {
+  const bool rect = (v[0].y == v[1].y && v[1].x == v[2].x &&
+                     v[2].y == v[3].y && v[3].x == v[0].x) ||
+                    (v[0].x == v[1].x && v[1].y == v[2].y &&
+                     v[2].x == v[3].x && v[3].y == v[0].y);
+  if (rect) {
+    SetupRect(c, clip, v[0].x, v[0].y, v[2].x, v[2].y, v[0].color);
+    return;
+  }
+  const float x[4] = {v[0].x, v[1].x, v[2].x, v[3].x};
+  const float y[4] = {v[0].y, v[1].y, v[2].y, v[3].y};
+  SetupPolygon(c, clip, x, y, 4, v[0].color);
+}
+
+static float HalfWidth(float thickness) {
+  return 0.5f * (thickness > 0 ? thickness : HAIRLINE_PX);
+}
+
+static void SetupLine(Cmd_t *c, const Clip_t *clip, float x0, float y0,
+                      float x1, float y1, ALLEGRO_COLOR c0, ALLEGRO_COLOR c1,
+                      float thickness) {
+  CmdLine_t *l = &c->Line;
+  const float dx = x1 - x0;
+  const float dy = y1 - y0;
+  const float len = sqrtf(dx * dx + dy * dy);
+
+  c->Type = CMD_LINE;
+  // Zero length lines, e.g. the trail of a particle that just respawned,
+  // draw nothing.
+  if (!(len > 1e-6f)) {
+    c->X0 = c->Y0 = c->X1 = c->Y1 = 0;
+    return;
+  }
+  SetColor(c->Color, c0);
+  SetColor(l->Color1, c1);
+  l->X0 = x0;
+  l->Y0 = y0;
+  l->Dx = dx / len;
+  l->Dy = dy / len;
+  l->Len = len;
+  l->InvLen = 1.0f / len;
+  l->HalfWidth = HalfWidth(thickness);
+  l->MaxCover = fminf(2 * l->HalfWidth, 1.0f);
+  SetBounds(c, clip, fminf(x0, x1), fminf(y0, y1), fmaxf(x0, x1),
+            fmaxf(y0, y1), l->HalfWidth + 0.5f);
+}
+
+/*
+ * Makes room for count more commands and returns the first, or NULL after
+ * noting that they were dropped.
+ */
+static Cmd_t *AddCmds(Raster_t *r, size_t count) {
+  if (r->NumCmds + count > r->CmdCapacity) {
+    size_t cap = r->CmdCapacity ? r->CmdCapacity : 1024;
+    while (cap < r->NumCmds + count) {
+      cap *= 2;
+    }
+    // Bins hold 32-bit indices
+    Cmd_t *cmds =
+        cap <= UINT32_MAX ? realloc(r->Cmds, cap * sizeof(*cmds)) : NULL;
+    if (cmds == NULL) {
+      r->Dropped = true;
+      return NULL;
+    }
+    r->Cmds = cmds;
+    r->CmdCapacity = cap;
+  }
+  Cmd_t *c = &r->Cmds[r->NumCmds];
+  r->NumCmds += count;
+  return c;
+}
+
+static bool PushToBin(Bin_t *bin, uint32_t cmd) {
+  if (bin->Count == bin->Capacity) {
+    const uint32_t cap = bin->Capacity ? 2 * bin->Capacity : 64;
+    uint32_t *cmds = realloc(bin->Cmds, cap * sizeof(*cmds));
+    if (cmds == NULL) {
+      return false;
+    }
+    bin->Cmds = cmds;
+    bin->Capacity = cap;
+  }
+  bin->Cmds[bin->Count++] = cmd;
+  return true;
+}
+
+/*
+ * Adds commands [first, end) to the bins of the tiles they touch. Runs on
+ * the calling thread so every bin stays in recording order.
+ */
+static void Bin(Raster_t *r, size_t first, size_t end) {
+  for (size_t i = first; i < end; i++) {
+    const Cmd_t *c = &r->Cmds[i];
+    if (c->X0 == c->X1) {
+      continue;
+    }
+    const int tx0 = c->X0 >> TILE_SHIFT;
+    const int ty0 = c->Y0 >> TILE_SHIFT;
+    const int tx1 = (c->X1 - 1) >> TILE_SHIFT;
+    const int ty1 = (c->Y1 - 1) >> TILE_SHIFT;
+    for (int ty = ty0; ty <= ty1; ty++) {
+      for (int tx = tx0; tx <= tx1; tx++) {
+        if (!PushToBin(&r->Bins[ty * r->TilesX + tx], (uint32_t)i)) {
+          r->Dropped = true;
+        }
+      }
+    }
+  }
+}
+
+typedef struct {
+  Cmd_t *Cmds;
+  Clip_t Clip;
+  const ALLEGRO_VERTEX *Vertices;
+  const int *Indices;
+} SetupCtx_t;
+
+static void SetupQuads(void *ctx, size_t begin, size_t end,
+                       unsigned int worker) {
+  const SetupCtx_t *c = ctx;
+
+  (void)worker;
+  for (size_t i = begin; i < end; i++) {
+    SetupQuad(&c->Cmds[i], &c->Clip, &c->Vertices[4 * i]);
+  }
+}
+
+static void SetupLines(void *ctx, size_t begin, size_t end,
+                       unsigned int worker) {
+  const SetupCtx_t *c = ctx;
+
+  (void)worker;
+  for (size_t i = begin; i < end; i++) {
+    const ALLEGRO_VERTEX *a = &c->Vertices[2 * i];
+    const ALLEGRO_VERTEX *b = &c->Vertices[2 * i + 1];
+    if (c->Indices) {
+      a = &c->Vertices[c->Indices[2 * i]];
+      b = &c->Vertices[c->Indices[2 * i + 1]];
+    }
+    SetupLine(&c->Cmds[i], &c->Clip, a->x, a->y, b->x, b->y, a->color,
+              b->color, 0);
+  }
+}
+
+void Raster_AddQuads(Raster_t *r, const ALLEGRO_VERTEX *v, size_t count) {
+  const size_t first = r->NumCmds;
+  SetupCtx_t ctx = {AddCmds(r, count), GetClip(r), v, NULL};
+
+  if (ctx.Cmds == NULL) {
+    return;
+  }
+  ThreadPool_ParallelFor(r->Pool, count, SETUP_GRAIN, SetupQuads, &ctx);
+  Bin(r, first, r->NumCmds);
+}
+
+void Raster_AddLineList(Raster_t *r, const ALLEGRO_VERTEX *v,
+                        const int *indices, size_t count) {
+  const size_t first = r->NumCmds;
+  SetupCtx_t ctx = {AddCmds(r, count / 2), GetClip(r), v, indices};
+
+  if (ctx.Cmds == NULL) {
+    return;
+  }
+  ThreadPool_ParallelFor(r->Pool, count / 2, SETUP_GRAIN, SetupLines, &ctx);
+  Bin(r, first, r->NumCmds);
+}
+
+void Raster_AddLine(Raster_t *r, float x0, float y0, float x1, float y1,
+                    ALLEGRO_COLOR color, float thickness) {
+  const Clip_t clip = GetClip(r);
+  Cmd_t *c = AddCmds(r, 1);
+
+  if (c == NULL) {
+    return;
+  }
+  SetupLine(c, &clip, x0, y0, x1, y1, color, color, thickness);
+  Bin(r, r->NumCmds - 1, r->NumCmds);
+}
+
+void Raster_AddPolyLine(Raster_t *r, const float *xy, size_t count,
+                        ALLEGRO_COLOR color, float thickness) {
+  if (count < 2) {
+    return;
+  }
+  if (r->NumPoints + count > r->PointCapacity) {
+    size_t cap = r->PointCapacity ? r->PointCapacity : 1024;
+    while (cap < r->NumPoints + count) {
+      cap *= 2;
+    }
+    float *pts = cap <= UINT32_MAX ? realloc(r->Points, 2 * cap * sizeof(*pts))
+                                   : NULL;
+    if (pts == NULL) {
+      r->Dropped = true;
+      return;
+    }
+    r->Points = pts;
+    r->PointCapacity = cap;
+  }
+  const Clip_t clip = GetClip(r);
+  Cmd_t *c = AddCmds(r, 1);
+  if (c == NULL) {
+    return;
+  }
+
+  float *pts = &r->Points[2 * r->NumPoints];
+  float min_x = xy[0], min_y = xy[1], max_x = xy[0], max_y = xy[1];
+  memcpy(pts, xy, 2 * count * sizeof(*pts));
+  for (size_t i = 1; i < count; i++) {
+    min_x = fminf(min_x, xy[2 * i]);
+    min_y = fminf(min_y, xy[2 * i + 1]);
+    max_x = fmaxf(max_x, xy[2 * i]);
+    max_y = fmaxf(max_y, xy[2 * i + 1]);
+  }
+  c->Type = CMD_POLYLINE;
+  SetColor(c->Color, color);
+  c->PolyLine.First = (uint32_t)r->NumPoints;
+  c->PolyLine.Count = (uint32_t)count;
+  c->PolyLine.HalfWidth = HalfWidth(thickness);
+  c->PolyLine.MaxCover = fminf(2 * c->PolyLine.HalfWidth, 1.0f);
+  SetBounds(c, &clip, min_x, min_y, max_x, max_y,
+            c->PolyLine.HalfWidth + 0.5f);
+  r->NumPoints += count;
+  Bin(r, r->NumCmds - 1, r->NumCmds);
+}
+
+void Raster_AddTriangle(Raster_t *r, float x0, float y0, float x1, float y1,
+                        float x2, float y2, ALLEGRO_COLOR color) {
+  const Clip_t clip = GetClip(r);
+  const float x[3] = {x0, x1, x2};
+  const float y[3] = {y0, y1, y2};
+  Cmd_t *c = AddCmds(r, 1);
+
+  if (c == NULL) {
+    return;
+  }
+  SetupPolygon(c, &clip, x, y, 3, color);
+  Bin(r, r->NumCmds - 1, r->NumCmds);
+}
+
+/*
+ * Rasterizing
+ */
+typedef struct {
+  const Raster_t *Raster;
+  uint8_t *Pixels;
+  int Pitch;
+} FlushCtx_t;
+
+static void RasterizeTiles(void *ctx, size_t begin, size_t end,
+                           unsigned int worker) {
+  const FlushCtx_t *f = ctx;
+  const Raster_t *r = f->Raster;
+  const Kernels_t *k = r->Kernels;
+  float *tile = r->Tiles[worker];
+
+  for (size_t a = begin; a < end; a++) {
+    const uint32_t t = r->Active[a];
+    const Bin_t *bin = &r->Bins[t];
+    const int left = (int)(t % r->TilesX) * TILE_PX;
+    const int top = (int)(t / r->TilesX) * TILE_PX;
+    const int w = r->Width - left < TILE_PX ? r->Width - left : TILE_PX;
+    const int h = r->Height - top < TILE_PX ? r->Height - top : TILE_PX;
+    uint8_t *pixels = f->Pixels + (ptrdiff_t)top * f->Pitch + 4 * left;
+
+    k->Load(tile, pixels, f->Pitch, w, h);
+    for (uint32_t i = 0; i < bin->Count; i++) {
+      const Cmd_t *c = &r->Cmds[bin->Cmds[i]];
+      const Span_t s = {
+          (c->X0 > left ? c->X0 : left) - left,
+          (c->Y0 > top ? c->Y0 : top) - top,
+          (c->X1 < left + w ? c->X1 : left + w) - left,
+          (c->Y1 < top + h ? c->Y1 : top + h) - top,
+          (float)left,
+          (float)top,
+      };
+      switch (c->Type) {
+        case CMD_RECT:
+          k->Rect(tile, c, &s);
+          break;
+        case CMD_LINE:
+          k->Line(tile, c, &s);
+          break;
+        case CMD_POLYGON:
+          k->Polygon(tile, c, &s);
+          break;
+        case CMD_POLYLINE:
+          k->PolyLine(tile, c, &s, r->Points);
+          break;
+      }
+    }
+    k->Store(tile, pixels, f->Pitch, w, h);
+  }
+}
+
+bool Raster_Flush(Raster_t *r) {
+  const size_t num_tiles = (size_t)r->TilesX * r->TilesY;
+  size_t num_active = 0;
+  bool ok = true;
+
+  if (r->Dropped) {
+    fprintf(stderr, "ERROR: Out of memory, primitives were dropped!\n");
+    r->Dropped = false;
+  }
+  for (size_t t = 0; t < num_tiles; t++) {
+    if (r->Bins[t].Count > 0) {
+      r->Active[num_active++] = (uint32_t)t;
+    }
+  }
+
+  if (num_active > 0) {
+    ALLEGRO_LOCKED_REGION *region =
+        al_lock_bitmap(r->Target, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+                       ALLEGRO_LOCK_READWRITE);
+    if (region == NULL) {
+      ok = false;
+    } else {
+      FlushCtx_t ctx = {r, region->data, region->pitch};
+      ThreadPool_ParallelFor(r->Pool, num_active, 1, RasterizeTiles, &ctx);
+      al_unlock_bitmap(r->Target);
+    }
+  }
+
+  for (size_t a = 0; a < num_active; a++) {
+    r->Bins[r->Active[a]].Count = 0;
+  }
+  r->NumCmds = 0;
+  r->NumPoints = 0;
+  return ok;
+}
+
+void Raster_DrawLine(float x0, float y0, float x1, float y1,
+                     ALLEGRO_COLOR color, float thickness) {
+  Raster_t *r = Raster_GetCurrent();
+  if (r) {
+    Raster_AddLine(r, x0, y0, x1, y1, color, thickness);
+  } else {
+    al_draw_line(x0, y0, x1, y1, color, thickness);
+  }
+}
+
+void Raster_DrawTriangle(float x0, float y0, float x1, float y1, float x2,
+                         float y2, ALLEGRO_COLOR color, float thickness) {
+  Raster_t *r = Raster_GetCurrent();
+  if (r) {
+    const float xy[8] = {x0, y0, x1, y1, x2, y2, x0, y0};
+    Raster_AddPolyLine(r, xy, 4, color, thickness);
+  } else {
+    al_draw_triangle(x0, y0, x1, y1, x2, y2, color, thickness);
+  }
+}
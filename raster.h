@@ -0,0 +1,118 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <allegro5/allegro5.h>
+#include <allegro5/allegro_primitives.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "thread_pool.h"
+
+/*
+ * Tile-binned software rasterizer for the primitives the sketches draw:
+ * filled rectangles, convex quads and triangles, and antialiased lines and
+ * polylines of any thickness. It stands in for Allegro's primitives addon
+ * where that has no GPU to run on and its software path becomes the whole
+ * cost of a frame.
+ *
+ * Primitives are recorded rather than drawn. Each one is set up once, with
+ * its edges and colors in the form the inner loops want, and binned into
+ * every RASTER_TILE_PX square tile of the target it may touch. Raster_Flush()
+ * then rasterizes the tiles in parallel, each by one worker that loads the
+ * tile's pixels as floats, blends its primitives into them in the order they
+ * were recorded, and writes the tile back. Coverage comes from the distance
+ * to the primitive's edges, 8 pixels at a time with AVX2 where the CPU has
+ * it.
+ *
+ * Colors blend like Allegro's default blender, premultiplied source over.
+ * Coordinates are target pixels, with pixel centers at .5 like Allegro's;
+ * the current transform is not applied, but the clipping rectangle at the
+ * time a primitive is recorded is.
+ *
+ * PrimBatch_t, Trails_t and LineMesh_t hand their primitives to the current
+ * rasterizer, see Raster_MakeCurrent(), instead of Allegro, so sketches draw
+ * through it unchanged. Anything drawn into the target another way, e.g.
+ * al_clear_to_color(), has to be drawn before the primitives recorded since
+ * the last flush, or after the next one.
+ */
+#define RASTER_TILE_PX (32)
+
+typedef struct Raster Raster_t;
+
+/*
+ * Creates a rasterizer for target, which it locks when flushing, so a
+ * memory bitmap is best. Primitives are set up and tiles rasterized on pool,
+ * or on the calling thread only when pool is NULL. Returns NULL on failure.
+ *
+ * @note caller is responsible for disposing of the rasterizer with
+ * Raster_Destroy().
+ */
+Raster_t *Raster_Create(ALLEGRO_BITMAP *target, ThreadPool_t *pool);
+void Raster_Destroy(Raster_t *r);
+
+/*
+ * Makes r the calling thread's rasterizer, or leaves the thread without one
+ * when r is NULL. Like Allegro's target bitmap it is per thread.
+ */
+void Raster_MakeCurrent(Raster_t *r);
+
+/*
+ * The calling thread's rasterizer, if it has one and its target is the
+ * current target bitmap, otherwise NULL and primitives go to Allegro.
+ */
+Raster_t *Raster_GetCurrent(void);
+
+/*
+ * Records count quads of 4 vertices each, like PrimBatch_t's. Quads must be
+ * convex and take the color of their first vertex. Axis-aligned rectangles
+ * get exact area coverage, other quads edge distance antialiasing.
+ */
+void Raster_AddQuads(Raster_t *r, const ALLEGRO_VERTEX *v, size_t count);
+
+/*
+ * Records a line list of count vertices, like al_draw_indexed_prim() with
+ * ALLEGRO_PRIM_LINE_LIST, or al_draw_prim() when indices is NULL. Lines are
+ * 1 pixel wide with butt ends, so the segments of a trail join seamlessly,
+ * and their color runs from one vertex's to the other's.
+ */
+void Raster_AddLineList(Raster_t *r, const ALLEGRO_VERTEX *v,
+                        const int *indices, size_t count);
+
+/*
+ * Records a line of the given thickness with butt ends, or a 1 pixel wide
+ * one when the thickness is not positive.
+ */
+void Raster_AddLine(Raster_t *r, float x0, float y0, float x1, float y1,
+                    ALLEGRO_COLOR color, float thickness);
+
+/*
+ * Records a polyline through the count points in xy (x0, y0, x1, y1, ...)
+ * with round joins and ends. It is covered as one shape, so translucent
+ * polylines do not darken where their segments overlap. A thickness that is
+ * not positive draws a 1 pixel wide polyline. xy is copied.
+ */
+void Raster_AddPolyLine(Raster_t *r, const float *xy, size_t count,
+                        ALLEGRO_COLOR color, float thickness);
+
+void Raster_AddTriangle(Raster_t *r, float x0, float y0, float x1, float y1,
+                        float x2, float y2, ALLEGRO_COLOR color);
+
+/*
+ * Rasterizes everything recorded since the last flush into the target and
+ * starts over. Returns false if the target could not be locked, in which
+ * case the primitives are dropped.
+ */
+bool Raster_Flush(Raster_t *r);
+
+/*
+ * al_draw_line() and al_draw_triangle(), through the current rasterizer
+ * when there is one.
+ */
+void Raster_DrawLine(float x0, float y0, float x1, float y1,
+                     ALLEGRO_COLOR color, float thickness);
+void Raster_DrawTriangle(float x0, float y0, float x1, float y1, float x2,
+                         float y2, ALLEGRO_COLOR color, float thickness);
+
+// Name of the rasterizer's kernels, "avx2" or "scalar"
+const char *Raster_KernelName(void);
+
+#endif  // RASTER_H
@@ -0,0 +1,161 @@
+#include "rng.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RNG_X86 (1)
+#include <immintrin.h>
+#endif
+
+#define PHILOX_M0 (0xD2511F53u)
+#define PHILOX_M1 (0xCD9E8D57u)
+#define PHILOX_W0 (0x9E3779B9u)
+#define PHILOX_W1 (0xBB67AE85u)
+#define PHILOX_ROUNDS (10)
+
+/*
+ * Elements are laid out so that one AVX2 pass produces 32 consecutive ones:
+ * 8 Philox blocks side by side, word w of block b landing at w * 8 + b.
+ * The scalar path uses the same mapping.
+ */
+#define LANES (8)
+#define WORDS (4)
+#define GROUP (LANES * WORDS)
+
+// 24 random bits scaled into [0, 1), exact in single precision
+#define U32_TO_UNIT(u) ((float)((u) >> 8) * (1.0f / 16777216.0f))
+
+void Rng_Init(Rng_t *rng, uint64_t seed) {
+  rng->Key[0] = (uint32_t)seed;
+  rng->Key[1] = (uint32_t)(seed >> 32);
+}
+
+void Rng_Philox4x32(const Rng_t *rng, const uint32_t ctr[4], uint32_t out[4]) {
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = rng->Key[0], k1 = rng->Key[1];
+
+  for (int r = 0; r < PHILOX_ROUNDS; r++) {
+    const uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+    const uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+    const uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+    const uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t)p1;
+    c3 = (uint32_t)p0;
+    c0 = n0;
+    c2 = n2;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+uint32_t Rng_U32(const Rng_t *rng, uint32_t stream, uint32_t generation,
+                 uint64_t index) {
+  const uint64_t block = index / GROUP * LANES + index % LANES;
+  const uint32_t ctr[4] = {stream, generation, (uint32_t)block,
+                           (uint32_t)(block >> 32)};
+  uint32_t out[4];
+
+  Rng_Philox4x32(rng, ctr, out);
+  return out[(index % GROUP) / LANES];
+}
+
+float Rng_Uniform(const Rng_t *rng, uint32_t stream, uint32_t generation,
+                  uint64_t index) {
+  return U32_TO_UNIT(Rng_U32(rng, stream, generation, index));
+}
+
+#ifdef RNG_X86
+__attribute__((target("avx2"))) static inline void MulHiLo(__m256i m,
+                                                           __m256i x,
+                                                           __m256i *hi,
+                                                           __m256i *lo) {
+  // _mm256_mul_epu32 only multiplies the even lanes, so do the odd ones
+  // separately and stitch the halves back together.
+  const __m256i even = _mm256_mul_epu32(m, x);
+  const __m256i odd = _mm256_mul_epu32(m, _mm256_srli_epi64(x, 32));
+  *lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+  *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+/*
+ * Fills out[0..GROUP) for the group starting at block first_block.
+ */
+__attribute__((target("avx2"))) static void FillGroup_AVX2(
+    const Rng_t *rng, uint32_t stream, uint32_t generation,
+    uint64_t first_block, float *out) {
+  const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0);
+  const __m256i m1 = _mm256_set1_epi32((int)PHILOX_M1);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i c0 = _mm256_set1_epi32((int)stream);
+  __m256i c1 = _mm256_set1_epi32((int)generation);
+  __m256i c2 = _mm256_add_epi32(_mm256_set1_epi32((int)first_block), lanes);
+  __m256i c3 = _mm256_set1_epi32((int)(first_block >> 32));
+  uint32_t k0 = rng->Key[0], k1 = rng->Key[1];
+
+  // first_block is a multiple of LANES, so adding the lane never carries
+  // into the high word.
+  for (int r = 0; r < PHILOX_ROUNDS; r++) {
+    __m256i hi0, lo0, hi1, lo1;
+    MulHiLo(m0, c0, &hi0, &lo0);
+    MulHiLo(m1, c2, &hi1, &lo1);
+    c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1),
+                          _mm256_set1_epi32((int)k0));
+    c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3),
+                          _mm256_set1_epi32((int)k1));
+    c1 = lo1;
+    c3 = lo0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+
+  const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+  const __m256i words[WORDS] = {c0, c1, c2, c3};
+  for (int w = 0; w < WORDS; w++) {
+    __m256 f = _mm256_cvtepi32_ps(_mm256_srli_epi32(words[w], 8));
+    _mm256_storeu_ps(&out[w * LANES], _mm256_mul_ps(f, scale));
+  }
+}
+#endif  // RNG_X86
+
+static void FillScalar(const Rng_t *rng, uint32_t stream, uint32_t generation,
+                       uint64_t first, float *out, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = Rng_Uniform(rng, stream, generation, first + i);
+  }
+}
+
+void Rng_FillUniform(const Rng_t *rng, uint32_t stream, uint32_t generation,
+                     uint64_t first, float *out, size_t count) {
+#ifdef RNG_X86
+  // Fills may run on pool workers, so the first check can race; every racer
+  // stores the same value.
+  static _Atomic int hasAVX2 = -1;
+  int has = hasAVX2;
+  if (has < 0) {
+    __builtin_cpu_init();
+    has = __builtin_cpu_supports("avx2") ? 1 : 0;
+    hasAVX2 = has;
+  }
+
+  if (has) {
+    // Scalar up to the next group boundary, whole groups in SIMD, then the
+    // scalar tail.
+    size_t head = (GROUP - first % GROUP) % GROUP;
+    if (head > count) {
+      head = count;
+    }
+    FillScalar(rng, stream, generation, first, out, head);
+
+    size_t i = head;
+    for (; i + GROUP <= count; i += GROUP) {
+      const uint64_t block = (first + i) / GROUP * LANES;
+      FillGroup_AVX2(rng, stream, generation, block, &out[i]);
+    }
+    FillScalar(rng, stream, generation, first + i, &out[i], count - i);
+    return;
+  }
+#endif
+  FillScalar(rng, stream, generation, first, out, count);
+}
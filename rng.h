@@ -0,0 +1,45 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Counter-based random numbers (Philox4x32-10). A value is a pure function of
+ * (seed, stream, generation, index), so there is no hidden state: any thread
+ * can regenerate any particle's randomness on its own, in any order, and a
+ * run is bit-reproducible from its seed.
+ *
+ * By convention stream says what the number is for (one RNG_STREAM_* value
+ * per use), generation counts respawns or regenerations of an object, and
+ * index is the particle or point id.
+ */
+typedef struct {
+  uint32_t Key[2];
+} Rng_t;
+
+void Rng_Init(Rng_t *rng, uint64_t seed);
+
+/*
+ * Raw Philox4x32-10 block function: four random words for a 128-bit counter.
+ */
+void Rng_Philox4x32(const Rng_t *rng, const uint32_t ctr[4], uint32_t out[4]);
+
+uint32_t Rng_U32(const Rng_t *rng, uint32_t stream, uint32_t generation,
+                 uint64_t index);
+
+/*
+ * Uniform float in [0, 1).
+ */
+float Rng_Uniform(const Rng_t *rng, uint32_t stream, uint32_t generation,
+                  uint64_t index);
+
+/*
+ * Writes Rng_Uniform(rng, stream, generation, first + i) to out[i] for i in
+ * [0, count). Vectorised with AVX2 where available; the result is the same
+ * either way.
+ */
+void Rng_FillUniform(const Rng_t *rng, uint32_t stream, uint32_t generation,
+                     uint64_t first, float *out, size_t count);
+
+#endif  // RNG_H
@@ -0,0 +1,49 @@
+#include "scheduler.h"
+#include <math.h>
+
+#define DEFAULT_MAX_FRAME_TIME (0.25)
+
+// Absorbs rounding when frame and step durations are the same nominal value,
+// so e.g. a 60 Hz frame always yields exactly one 60 Hz step.
+#define STEP_EPSILON (1e-9)
+
+void Scheduler_Init(Scheduler_t *s, double sim_rate,
+                    unsigned int max_steps_per_frame, double start_time) {
+  s->Step = 1.0 / sim_rate;
+  s->MaxStepsPerFrame = max_steps_per_frame ? max_steps_per_frame : 1;
+  s->MaxFrameTime = DEFAULT_MAX_FRAME_TIME;
+  s->Accumulator = 0.0;
+  s->PrevTime = start_time;
+  s->TotalSteps = 0;
+  s->DroppedSteps = 0;
+}
+
+unsigned int Scheduler_Advance(Scheduler_t *s, double now) {
+  double elapsed = now - s->PrevTime;
+  s->PrevTime = now;
+
+  if (elapsed < 0.0) {
+    elapsed = 0.0;
+  } else if (elapsed > s->MaxFrameTime) {
+    elapsed = s->MaxFrameTime;
+  }
+  s->Accumulator += elapsed;
+
+  double steps = floor(s->Accumulator / s->Step + STEP_EPSILON);
+  s->Accumulator -= steps * s->Step;
+  if (s->Accumulator < 0.0) {
+    s->Accumulator = 0.0;
+  }
+
+  if (steps > s->MaxStepsPerFrame) {
+    s->DroppedSteps += (uint64_t)steps - s->MaxStepsPerFrame;
+    steps = s->MaxStepsPerFrame;
+  }
+  s->TotalSteps += (uint64_t)steps;
+  return (unsigned int)steps;
+}
+
+float Scheduler_Alpha(const Scheduler_t *s) {
+  float alpha = (float)(s->Accumulator / s->Step);
+  return alpha < 1.0f ? alpha : 1.0f;
+}
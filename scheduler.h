@@ -0,0 +1,46 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+/*
+ * Fixed-timestep simulation scheduler. Real (or, in headless mode, simulated)
+ * time is fed in once per frame and converted into a whole number of
+ * simulation steps of exactly Step seconds, so the simulation goes through
+ * the same sequence of states on every machine no matter how fast frames
+ * arrive. Whatever is left over is reported as an interpolation factor for
+ * drawing between the last two states.
+ */
+typedef struct {
+  double Step;                    // simulated seconds per update
+  unsigned int MaxStepsPerFrame;  // cap on updates run for a single frame
+  double MaxFrameTime;            // longer frames are clamped to this
+  double Accumulator;             // time not yet simulated, always < Step
+  double PrevTime;
+  uint64_t TotalSteps;    // steps run since Scheduler_Init()
+  uint64_t DroppedSteps;  // steps skipped by the per-frame cap
+} Scheduler_t;
+
+/*
+ * sim_rate is in steps per second. start_time is the time the first call to
+ * Scheduler_Advance() is measured from.
+ */
+void Scheduler_Init(Scheduler_t *s, double sim_rate,
+                    unsigned int max_steps_per_frame, double start_time);
+
+/*
+ * Advances the clock to now and returns how many steps of s->Step to run.
+ *
+ * A long stall (debugger, window drag, swapped out) is clamped to
+ * MaxFrameTime and at most MaxStepsPerFrame steps are returned. Time beyond
+ * that is dropped rather than carried over, so a slow machine runs the
+ * simulation slower instead of falling further behind every frame.
+ */
+unsigned int Scheduler_Advance(Scheduler_t *s, double now);
+
+/*
+ * Fraction of a step between the last simulated state and now, in [0, 1).
+ */
+float Scheduler_Alpha(const Scheduler_t *s);
+
+#endif  // SCHEDULER_H
@@ -0,0 +1,18 @@
+#include <stdio.h>
+#include "host.h"
+
+/*
+ * Runs a sketch built as a shared object and reloads it whenever it is
+ * rebuilt. See host.h.
+ */
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s SKETCH.so [options]\n", argv[0]);
+    return 1;
+  }
+  // Drop the sketch from the arguments, so the options see the program name
+  // followed by their own.
+  const char *path = argv[1];
+  argv[1] = argv[0];
+  return Host_MainPlugin(path, argc - 1, argv + 1);
+}
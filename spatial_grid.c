@@ -0,0 +1,188 @@
+#include "spatial_grid.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CELLS (1 << 22)  // cells of a grid at most, 16 MiB of starts
+
+SpatialGrid_t *SpatialGrid_Create(GridRect_t world, float cell_size) {
+  if (!(cell_size > 0) || !(world.X1 >= world.X0) ||
+      !(world.Y1 >= world.Y0)) {
+    return NULL;
+  }
+  const double cols = floor((world.X1 - world.X0) / cell_size) + 1;
+  const double rows = floor((world.Y1 - world.Y0) / cell_size) + 1;
+  if (cols * rows > MAX_CELLS) {
+    return NULL;
+  }
+
+  SpatialGrid_t *g = calloc(1, sizeof(*g));
+  if (g == NULL) {
+    return NULL;
+  }
+  g->World = world;
+  g->CellSize = cell_size;
+  g->Cols = (int)cols;
+  g->Rows = (int)rows;
+  g->CellStart = calloc((size_t)g->Cols * g->Rows + 1, sizeof(uint32_t));
+  if (g->CellStart == NULL) {
+    free(g);
+    return NULL;
+  }
+  return g;
+}
+
+void SpatialGrid_Destroy(SpatialGrid_t *g) {
+  if (g == NULL) {
+    return;
+  }
+  free(g->CellStart);
+  free(g->Items);
+  free(g->Bounds);
+  free(g->Stamps);
+  free(g->Results);
+  free(g);
+}
+
+/*
+ * Cell along an axis of n cells for v in cell units. Anything outside the
+ * world, and NaN, lands on its border.
+ */
+static int CellOf(float v, int n) {
+  if (!(v > 0)) {
+    return 0;
+  }
+  return v >= n ? n - 1 : (int)v;
+}
+
+// Cells [*c0, *c1] x [*r0, *r1] that rect overlaps
+static void CellRange(const SpatialGrid_t *g, GridRect_t rect, int *c0,
+                      int *r0, int *c1, int *r1) {
+  const float inv = 1.0f / g->CellSize;
+
+  *c0 = CellOf((rect.X0 - g->World.X0) * inv, g->Cols);
+  *r0 = CellOf((rect.Y0 - g->World.Y0) * inv, g->Rows);
+  *c1 = CellOf((rect.X1 - g->World.X0) * inv, g->Cols);
+  *r1 = CellOf((rect.Y1 - g->World.Y0) * inv, g->Rows);
+}
+
+static bool Reserve(SpatialGrid_t *g, size_t count, size_t refs) {
+  if (count > g->Capacity) {
+    // Contents are rebuilt anyway, so there is nothing to copy over.
+    free(g->Bounds);
+    free(g->Stamps);
+    free(g->Results);
+    g->Bounds = malloc(count * sizeof(*g->Bounds));
+    g->Stamps = calloc(count, sizeof(*g->Stamps));
+    g->Results = malloc(count * sizeof(*g->Results));
+    g->Query = 0;
+    if (g->Bounds == NULL || g->Stamps == NULL || g->Results == NULL) {
+      g->Capacity = 0;
+      return false;
+    }
+    g->Capacity = count;
+  }
+  if (refs > g->ItemCapacity) {
+    free(g->Items);
+    g->Items = malloc(refs * sizeof(*g->Items));
+    if (g->Items == NULL) {
+      g->ItemCapacity = 0;
+      return false;
+    }
+    g->ItemCapacity = refs;
+  }
+  return true;
+}
+
+bool SpatialGrid_Build(SpatialGrid_t *g, const GridRect_t *bounds,
+                       size_t count) {
+  const size_t num_cells = (size_t)g->Cols * g->Rows;
+  uint32_t *start = g->CellStart;
+
+  g->NumItems = 0;
+  memset(start, 0, (num_cells + 1) * sizeof(*start));
+  if (count > UINT32_MAX) {
+    return false;
+  }
+
+  // First pass: items per cell, shifted by one so that the prefix sum below
+  // leaves every cell's start in its own entry.
+  size_t refs = 0;
+  for (size_t i = 0; i < count; i++) {
+    int c0, r0, c1, r1;
+    CellRange(g, bounds[i], &c0, &r0, &c1, &r1);
+    for (int r = r0; r <= r1; r++) {
+      for (int c = c0; c <= c1; c++) {
+        start[(size_t)r * g->Cols + c + 1]++;
+        refs++;
+      }
+    }
+  }
+  if (refs > UINT32_MAX || !Reserve(g, count, refs)) {
+    memset(start, 0, (num_cells + 1) * sizeof(*start));
+    return false;
+  }
+  for (size_t c = 0; c < num_cells; c++) {
+    start[c + 1] += start[c];
+  }
+
+  // Second pass: fill the lists, advancing each cell's start past what it
+  // got, then move the starts back.
+  for (size_t i = 0; i < count; i++) {
+    int c0, r0, c1, r1;
+    CellRange(g, bounds[i], &c0, &r0, &c1, &r1);
+    for (int r = r0; r <= r1; r++) {
+      for (int c = c0; c <= c1; c++) {
+        g->Items[start[(size_t)r * g->Cols + c]++] = (uint32_t)i;
+      }
+    }
+  }
+  memmove(&start[1], &start[0], num_cells * sizeof(*start));
+  start[0] = 0;
+
+  memcpy(g->Bounds, bounds, count * sizeof(*bounds));
+  g->NumItems = count;
+  return true;
+}
+
+static int CompareU32(const void *a, const void *b) {
+  const uint32_t x = *(const uint32_t *)a;
+  const uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+size_t SpatialGrid_Query(SpatialGrid_t *g, GridRect_t rect,
+                         const uint32_t **items) {
+  size_t n = 0;
+
+  *items = g->Results;
+  if (g->NumItems == 0) {
+    return 0;
+  }
+  // A stamp per item marks it as found by this query, so items listed in
+  // several cells are only tested once. Zero is never a query.
+  if (++g->Query == 0) {
+    memset(g->Stamps, 0, g->Capacity * sizeof(*g->Stamps));
+    g->Query = 1;
+  }
+
+  int c0, r0, c1, r1;
+  CellRange(g, rect, &c0, &r0, &c1, &r1);
+  for (int r = r0; r <= r1; r++) {
+    const uint32_t *start = &g->CellStart[(size_t)r * g->Cols];
+    for (uint32_t j = start[c0]; j < start[c1 + 1]; j++) {
+      const uint32_t i = g->Items[j];
+      const GridRect_t *b = &g->Bounds[i];
+      if (g->Stamps[i] == g->Query) {
+        continue;
+      }
+      g->Stamps[i] = g->Query;
+      if (b->X0 <= rect.X1 && rect.X0 <= b->X1 && b->Y0 <= rect.Y1 &&
+          rect.Y0 <= b->Y1) {
+        g->Results[n++] = i;
+      }
+    }
+  }
+  qsort(g->Results, n, sizeof(*g->Results), CompareU32);
+  return n;
+}
@@ -0,0 +1,73 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Uniform grid over the bounds of many items, e.g. the polylines of a scene
+ * or particles, for finding the few of them in a small part of a large
+ * world without looking at the rest.
+ *
+ * The world is cut into square cells, and every item is listed in each cell
+ * its bounds overlap. The lists are laid out cell after cell in one array,
+ * like HandDrawnBatch_t's points, so building is two passes of counting and
+ * a query reads the lists of the cells it overlaps front to back. Items
+ * outside the world go to the cells on its border.
+ *
+ * A cell a few times the size of a typical item keeps both the number of
+ * cells an item lands in and the number of items a query has to reject
+ * small. A grid is not thread safe; queries write to it.
+ */
+typedef struct {
+  float X0;  // inclusive
+  float Y0;
+  float X1;  // inclusive
+  float Y1;
+} GridRect_t;
+
+typedef struct {
+  GridRect_t World;
+  float CellSize;
+  int Cols;
+  int Rows;
+  uint32_t *CellStart;  // Cols * Rows + 1 entries into Items
+  uint32_t *Items;      // item indices, cell by cell
+  size_t ItemCapacity;
+  GridRect_t *Bounds;  // of every item, for exact tests
+  size_t NumItems;
+  size_t Capacity;
+  uint32_t *Stamps;  // query that last returned each item
+  uint32_t Query;
+  uint32_t *Results;
+} SpatialGrid_t;
+
+/*
+ * Creates an empty grid over world with square cells of cell_size. Returns
+ * NULL on failure.
+ *
+ * @note caller is responsible for disposing of the grid with
+ * SpatialGrid_Destroy().
+ */
+SpatialGrid_t *SpatialGrid_Create(GridRect_t world, float cell_size);
+void SpatialGrid_Destroy(SpatialGrid_t *g);
+
+/*
+ * Replaces the contents of the grid with items [0, count), item i covering
+ * bounds[i]. Points are items with empty bounds. Returns false when out of
+ * memory, leaving the grid empty.
+ */
+bool SpatialGrid_Build(SpatialGrid_t *g, const GridRect_t *bounds,
+                       size_t count);
+
+/*
+ * Finds every item whose bounds overlap rect, each once and in ascending
+ * order, so drawing them keeps the order they were built in. Returns how
+ * many there are and points *items at them; the array belongs to the grid
+ * and is valid until the next query or build.
+ */
+size_t SpatialGrid_Query(SpatialGrid_t *g, GridRect_t rect,
+                         const uint32_t **items);
+
+#endif  // SPATIAL_GRID_H
@@ -0,0 +1,698 @@
+/*
+ * Renders a sketch once for every combination of parameter values in a sweep
+ * file and lays the last frame of each run out on contact sheets.
+ *
+ *   ./sweep --frames 300 --out sweep beat.sweep ./beat_circle --density log
+ *
+ * A sweep file looks like a --config file (see params.h) that lists several
+ * values per parameter, separated by commas or blanks, or as a range
+ * first:last:step:
+ *
+ *   particles = 2000, 20000, 200000
+ *   speed_step = 5:20:5
+ *   seed = 1 2 3
+ *
+ * seed is passed as --seed, everything else as --set. The example renders
+ * 3 * 4 * 3 = 36 runs. Each run is a headless process of its own with one
+ * worker thread, and --jobs of them (one per CPU by default) run at a time.
+ * Options after the sketch are passed to every run.
+ *
+ * DIR/run_NNNNN holds the last frame and the log of each run,
+ * DIR/sheet_NNN.png the contact sheets, labelled with the run number and the
+ * values of every parameter that varies, and DIR/index.csv every run with
+ * its parameters, where it is on which sheet, and whether it worked.
+ */
+#include <allegro5/allegro5.h>
+#include <allegro5/allegro_font.h>
+#include <allegro5/allegro_image.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "params.h"
+
+#define MAX_AXES (16)
+#define MAX_AXIS_VALUES (256)
+#define MAX_VALUE_LEN (32)
+#define MAX_RUNS (100000)
+#define MAX_ARGS (256)
+#define MAX_JOBS (256)
+#define MAX_PATH_LEN (1024)
+#define MAX_LINE_LEN (4096)
+
+#define DEFAULT_OUT_DIR "sweep"
+#define DEFAULT_NUM_FRAMES (120)
+#define DEFAULT_COLUMNS (6)
+#define DEFAULT_ROWS (6)
+#define DEFAULT_CELL_WIDTH_PX (200)
+#define LABEL_LINE_PX (10)  // the builtin font is 8 px high
+
+// One swept parameter and its values, as written in the sweep file
+typedef struct {
+  char Name[PARAMS_NAME_LEN];
+  unsigned int NumValues;
+  char Values[MAX_AXIS_VALUES][MAX_VALUE_LEN];
+} Axis_t;
+
+typedef struct {
+  const char *OutDir;
+  unsigned int NumFrames;
+  unsigned int NumJobs;
+  unsigned int Columns;
+  unsigned int Rows;
+  unsigned int CellWidth;
+  const char *SweepPath;
+  const char *Sketch;
+  char **SketchArgs;  // passed to every run
+  int NumSketchArgs;
+
+  Axis_t Axes[MAX_AXES];
+  unsigned int NumAxes;
+  int SeedAxis;  // index into Axes, or -1 for a fixed seed
+  unsigned long NumRuns;
+} Sweep_t;
+
+static void PrintUsage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options] SWEEP_FILE SKETCH [sketch options]\n"
+          "  --out DIR     directory for runs, sheets and index (default "
+          DEFAULT_OUT_DIR ")\n"
+          "  --frames N    frames to render per run, the last one is kept\n"
+          "                (default %d)\n"
+          "  --jobs N      runs at a time (default one per CPU)\n"
+          "  --columns N   runs across a contact sheet (default %d)\n"
+          "  --rows N      runs down a contact sheet (default %d)\n"
+          "  --cell PX     width of a run on a contact sheet (default %d)\n",
+          prog, DEFAULT_NUM_FRAMES, DEFAULT_COLUMNS, DEFAULT_ROWS,
+          DEFAULT_CELL_WIDTH_PX);
+}
+
+static bool ParseUInt(const char *str, unsigned int *value) {
+  char *end;
+  errno = 0;
+  unsigned long v = strtoul(str, &end, 10);
+  if (errno != 0 || end == str || *end != '\0' || str[0] == '-' || v == 0 ||
+      v > 0xffffffffUL) {
+    fprintf(stderr, "ERROR: '%s' is not a valid positive integer!\n", str);
+    return false;
+  }
+  *value = (unsigned int)v;
+  return true;
+}
+
+static bool ParseNumber(const char *str, double *value) {
+  char *end;
+  errno = 0;
+  const double v = strtod(str, &end);
+  if (errno != 0 || end == str || *end != '\0' || !isfinite(v)) {
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+static bool ParseArgs(Sweep_t *sw, int argc, char **argv) {
+  int i = 1;
+
+  sw->OutDir = DEFAULT_OUT_DIR;
+  sw->NumFrames = DEFAULT_NUM_FRAMES;
+  const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  sw->NumJobs = (cpus > 0 && cpus <= MAX_JOBS) ? (unsigned int)cpus : 1;
+  sw->Columns = DEFAULT_COLUMNS;
+  sw->Rows = DEFAULT_ROWS;
+  sw->CellWidth = DEFAULT_CELL_WIDTH_PX;
+
+  for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+    const char *arg = argv[i];
+    const bool has_value = (i + 1 < argc);
+    bool ok = has_value;
+
+    if (strcmp(arg, "--out") == 0 && has_value) {
+      sw->OutDir = argv[++i];
+    } else if (strcmp(arg, "--frames") == 0 && has_value) {
+      ok = ParseUInt(argv[++i], &sw->NumFrames);
+    } else if (strcmp(arg, "--jobs") == 0 && has_value) {
+      ok = ParseUInt(argv[++i], &sw->NumJobs);
+    } else if (strcmp(arg, "--columns") == 0 && has_value) {
+      ok = ParseUInt(argv[++i], &sw->Columns);
+    } else if (strcmp(arg, "--rows") == 0 && has_value) {
+      ok = ParseUInt(argv[++i], &sw->Rows);
+    } else if (strcmp(arg, "--cell") == 0 && has_value) {
+      ok = ParseUInt(argv[++i], &sw->CellWidth);
+    } else {
+      fprintf(stderr, "ERROR: Unknown or incomplete option '%s'!\n", arg);
+      return false;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  if (sw->NumJobs > MAX_JOBS) {
+    fprintf(stderr, "ERROR: More than %d jobs!\n", MAX_JOBS);
+    return false;
+  }
+  if (argc - i < 2) {
+    fprintf(stderr, "ERROR: Missing sweep file or sketch!\n");
+    return false;
+  }
+  sw->SweepPath = argv[i];
+  sw->Sketch = argv[i + 1];
+  sw->SketchArgs = argv + i + 2;
+  sw->NumSketchArgs = argc - i - 2;
+  if (sw->NumSketchArgs > MAX_ARGS / 2) {
+    fprintf(stderr, "ERROR: Too many sketch options!\n");
+    return false;
+  }
+  return true;
+}
+
+static bool AddValue(Axis_t *axis, const char *value) {
+  if (axis->NumValues == MAX_AXIS_VALUES) {
+    fprintf(stderr, "ERROR: %s has more than %d values!\n", axis->Name,
+            MAX_AXIS_VALUES);
+    return false;
+  }
+  snprintf(axis->Values[axis->NumValues++], MAX_VALUE_LEN, "%s", value);
+  return true;
+}
+
+/*
+ * Adds a value or a first:last:step range to axis.
+ */
+static bool AddToken(Axis_t *axis, char *token) {
+  char *sep = strchr(token, ':');
+  double v;
+
+  if (sep == NULL) {
+    if (strlen(token) >= MAX_VALUE_LEN || !ParseNumber(token, &v)) {
+      fprintf(stderr, "ERROR: '%s' is not a valid value for %s!\n", token,
+              axis->Name);
+      return false;
+    }
+    return AddValue(axis, token);
+  }
+
+  double first;
+  double last;
+  double step;
+  char *sep2 = strchr(sep + 1, ':');
+  if (sep2 != NULL) {
+    *sep = *sep2 = '\0';
+  }
+  if (sep2 == NULL || !ParseNumber(token, &first) ||
+      !ParseNumber(sep + 1, &last) || !ParseNumber(sep2 + 1, &step) ||
+      !(step > 0.0) || last < first ||
+      (last - first) / step >= MAX_AXIS_VALUES) {
+    fprintf(stderr, "ERROR: Bad first:last:step range for %s!\n",
+            axis->Name);
+    return false;
+  }
+  // Counting steps rather than adding them up keeps last in the range.
+  const unsigned long n = (unsigned long)((last - first) / step + 1e-9) + 1;
+  for (unsigned long k = 0; k < n; k++) {
+    char value[MAX_VALUE_LEN];
+    snprintf(value, sizeof(value), "%.10g", first + k * step);
+    if (!AddValue(axis, value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool LoadSweep(Sweep_t *sw) {
+  char line[MAX_LINE_LEN];
+  char *name;
+  char *values;
+  unsigned int line_num = 0;
+  bool ok = true;
+
+  sw->NumAxes = 0;
+  sw->SeedAxis = -1;
+  FILE *f = fopen(sw->SweepPath, "r");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: Failed to open sweep '%s'!\n", sw->SweepPath);
+    return false;
+  }
+  while (ok && fgets(line, sizeof(line), f)) {
+    line_num++;
+    const int kind = Params_SplitLine(line, &name, &values);
+    if (kind == 0) {
+      continue;
+    }
+    if (kind < 0) {
+      fprintf(stderr, "ERROR: %s:%u is not a name = values line!\n",
+              sw->SweepPath, line_num);
+      ok = false;
+      break;
+    }
+    for (unsigned int a = 0; a < sw->NumAxes; a++) {
+      if (strcmp(sw->Axes[a].Name, name) == 0) {
+        fprintf(stderr, "ERROR: %s:%u sets %s again!\n", sw->SweepPath,
+                line_num, name);
+        ok = false;
+      }
+    }
+    if (ok && sw->NumAxes == MAX_AXES) {
+      fprintf(stderr, "ERROR: More than %d swept parameters!\n", MAX_AXES);
+      ok = false;
+    }
+    if (!ok) {
+      break;
+    }
+    Axis_t *axis = &sw->Axes[sw->NumAxes];
+    strcpy(axis->Name, name);
+    axis->NumValues = 0;
+    for (char *token = strtok(values, ", \t"); ok && token;
+         token = strtok(NULL, ", \t")) {
+      ok = AddToken(axis, token);
+    }
+    if (ok && axis->NumValues == 0) {
+      fprintf(stderr, "ERROR: %s:%u has no values!\n", sw->SweepPath,
+              line_num);
+      ok = false;
+    }
+    if (strcmp(name, "seed") == 0) {
+      sw->SeedAxis = sw->NumAxes;
+    }
+    sw->NumAxes++;
+  }
+  fclose(f);
+  if (!ok) {
+    return false;
+  }
+
+  sw->NumRuns = 1;
+  for (unsigned int a = 0; a < sw->NumAxes; a++) {
+    sw->NumRuns *= sw->Axes[a].NumValues;
+    if (sw->NumRuns > MAX_RUNS) {
+      fprintf(stderr, "ERROR: Sweep has more than %d runs!\n", MAX_RUNS);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Value of axis a in run. The last axis changes fastest, so neighbouring
+ * runs on a sheet differ in the last parameter of the sweep file.
+ */
+static const char *RunValue(const Sweep_t *sw, unsigned long run,
+                            unsigned int a) {
+  for (unsigned int b = sw->NumAxes - 1; b > a; b--) {
+    run /= sw->Axes[b].NumValues;
+  }
+  return sw->Axes[a].Values[run % sw->Axes[a].NumValues];
+}
+
+static const char *RunSeed(const Sweep_t *sw, unsigned long run) {
+  return (sw->SeedAxis < 0) ? "1" : RunValue(sw, run, sw->SeedAxis);
+}
+
+static bool RunPath(char *path, const Sweep_t *sw, unsigned long run,
+                    const char *file) {
+  const int len = snprintf(path, MAX_PATH_LEN, "%s/run_%05lu%s%s", sw->OutDir,
+                           run, file ? "/" : "", file ? file : "");
+  if (len < 0 || len >= MAX_PATH_LEN) {
+    fprintf(stderr, "ERROR: Output path is too long!\n");
+    return false;
+  }
+  return true;
+}
+
+static bool MakeDir(const char *path) {
+  if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "ERROR: Failed to create directory '%s'!\n", path);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Starts run as a headless process writing into its own directory. Returns
+ * its pid, or -1 after printing an error.
+ */
+static pid_t StartRun(const Sweep_t *sw, unsigned long run) {
+  char dir[MAX_PATH_LEN];
+  char log[MAX_PATH_LEN];
+  char frames[16];
+  char sets[MAX_AXES][PARAMS_NAME_LEN + MAX_VALUE_LEN + 1];
+  char *args[MAX_ARGS];
+  int n = 0;
+
+  if (!RunPath(dir, sw, run, NULL) || !RunPath(log, sw, run, "log.txt") ||
+      !MakeDir(dir)) {
+    return -1;
+  }
+  snprintf(frames, sizeof(frames), "%u", sw->NumFrames);
+  args[n++] = (char *)sw->Sketch;
+  args[n++] = "--headless";
+  args[n++] = "--last-frame";
+  args[n++] = "--frames";
+  args[n++] = frames;
+  args[n++] = "--threads";
+  args[n++] = "1";
+  args[n++] = "--out";
+  args[n++] = dir;
+  args[n++] = "--seed";
+  args[n++] = (char *)RunSeed(sw, run);
+  for (unsigned int a = 0; a < sw->NumAxes; a++) {
+    if ((int)a != sw->SeedAxis) {
+      snprintf(sets[a], sizeof(sets[a]), "%s=%s", sw->Axes[a].Name,
+               RunValue(sw, run, a));
+      args[n++] = "--set";
+      args[n++] = sets[a];
+    }
+  }
+  for (int i = 0; i < sw->NumSketchArgs; i++) {
+    args[n++] = sw->SketchArgs[i];
+  }
+  args[n] = NULL;
+
+  fflush(stdout);
+  fflush(stderr);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    fprintf(stderr, "ERROR: Failed to start run %lu!\n", run);
+    return -1;
+  }
+  if (pid == 0) {
+    const int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      close(fd);
+    }
+    execv(sw->Sketch, args);
+    fprintf(stderr, "ERROR: Failed to run '%s'!\n", sw->Sketch);
+    _exit(127);
+  }
+  return pid;
+}
+
+/*
+ * Runs every combination, at most NumJobs at a time. ok[run] tells whether
+ * run exited successfully. Returns the number of failed runs.
+ */
+static unsigned long RunAll(const Sweep_t *sw, bool *ok) {
+  pid_t pids[MAX_JOBS];
+  unsigned long runs[MAX_JOBS];
+  unsigned long next = 0;
+  unsigned long done = 0;
+  unsigned long failed = 0;
+  unsigned int running = 0;
+
+  while (done < sw->NumRuns) {
+    while (running < sw->NumJobs && next < sw->NumRuns) {
+      const pid_t pid = StartRun(sw, next);
+      if (pid < 0) {
+        ok[next] = false;
+        failed++;
+        done++;
+      } else {
+        pids[running] = pid;
+        runs[running] = next;
+        running++;
+      }
+      next++;
+    }
+    if (running == 0) {
+      continue;
+    }
+
+    int status;
+    const pid_t pid = wait(&status);
+    if (pid < 0) {
+      fprintf(stderr, "ERROR: Lost track of the running runs!\n");
+      return failed + (sw->NumRuns - done);
+    }
+    for (unsigned int j = 0; j < running; j++) {
+      if (pids[j] != pid) {
+        continue;
+      }
+      const unsigned long run = runs[j];
+      ok[run] = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+      if (!ok[run]) {
+        fprintf(stderr, "ERROR: Run %lu failed, see %s/run_%05lu/log.txt!\n",
+                run, sw->OutDir, run);
+        failed++;
+      }
+      running--;
+      pids[j] = pids[running];
+      runs[j] = runs[running];
+      done++;
+      printf("\rRendered %lu of %lu runs", done, sw->NumRuns);
+      fflush(stdout);
+      break;
+    }
+  }
+  printf("\n");
+  return failed;
+}
+
+/*
+ * Box filters img into the w x h pixels at (x, y) of the locked sheet.
+ */
+static void DrawCell(ALLEGRO_LOCKED_REGION *sheet, ALLEGRO_BITMAP *img, int x,
+                     int y, int w, int h) {
+  const int iw = al_get_bitmap_width(img);
+  const int ih = al_get_bitmap_height(img);
+  ALLEGRO_LOCKED_REGION *src = al_lock_bitmap(
+      img, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+  if (src == NULL) {
+    return;
+  }
+
+  for (int dy = 0; dy < h; dy++) {
+    const int y0 = dy * ih / h;
+    const int y1 = (dy + 1) * ih / h > y0 ? (dy + 1) * ih / h : y0 + 1;
+    uint8_t *out = (uint8_t *)sheet->data + (y + dy) * sheet->pitch + x * 4;
+    for (int dx = 0; dx < w; dx++, out += 4) {
+      const int x0 = dx * iw / w;
+      const int x1 = (dx + 1) * iw / w > x0 ? (dx + 1) * iw / w : x0 + 1;
+      unsigned int sum[3] = {0, 0, 0};
+      for (int sy = y0; sy < y1; sy++) {
+        const uint8_t *in = (const uint8_t *)src->data + sy * src->pitch;
+        for (int sx = x0; sx < x1; sx++) {
+          sum[0] += in[sx * 4];
+          sum[1] += in[sx * 4 + 1];
+          sum[2] += in[sx * 4 + 2];
+        }
+      }
+      const unsigned int count = (x1 - x0) * (y1 - y0);
+      out[0] = sum[0] / count;
+      out[1] = sum[1] / count;
+      out[2] = sum[2] / count;
+      out[3] = 0xff;
+    }
+  }
+  al_unlock_bitmap(img);
+}
+
+static ALLEGRO_BITMAP *LoadRunFrame(const Sweep_t *sw, unsigned long run) {
+  char file[32];
+  char path[MAX_PATH_LEN];
+
+  snprintf(file, sizeof(file), "frame_%05u.png", sw->NumFrames - 1);
+  if (!RunPath(path, sw, run, file)) {
+    return NULL;
+  }
+  ALLEGRO_BITMAP *img = al_load_bitmap(path);
+  if (img == NULL) {
+    fprintf(stderr, "ERROR: Failed to load '%s'!\n", path);
+  }
+  return img;
+}
+
+/*
+ * Draws the run number and every parameter that varies below a cell.
+ */
+static void DrawLabel(const Sweep_t *sw, ALLEGRO_FONT *font, unsigned long run,
+                      bool ok, int x, int y, int w, int h) {
+  const ALLEGRO_COLOR text = al_map_rgb(0xff, 0xf2, 0x75);
+  const ALLEGRO_COLOR fail = al_map_rgb(0xff, 0x3c, 0x38);
+
+  al_set_clipping_rectangle(x, y, w, h);
+  al_draw_textf(font, ok ? text : fail, x + 2, y + 1, ALLEGRO_ALIGN_LEFT,
+                ok ? "#%lu" : "#%lu failed", run);
+  for (unsigned int a = 0; a < sw->NumAxes; a++) {
+    if (sw->Axes[a].NumValues > 1) {
+      y += LABEL_LINE_PX;
+      al_draw_textf(font, text, x + 2, y + 1, ALLEGRO_ALIGN_LEFT, "%s=%s",
+                    sw->Axes[a].Name, RunValue(sw, run, a));
+    }
+  }
+  al_reset_clipping_rectangle();
+}
+
+/*
+ * Lays out Columns x Rows runs per sheet and writes each sheet. Every cell
+ * is as high as the first frame that loads is, scaled to CellWidth.
+ */
+static bool WriteSheets(const Sweep_t *sw, const bool *ok,
+                        unsigned int *num_sheets) {
+  const unsigned long per_sheet = (unsigned long)sw->Columns * sw->Rows;
+  unsigned int label_lines = 1;
+  int cell_h = 0;
+
+  for (unsigned int a = 0; a < sw->NumAxes; a++) {
+    label_lines += (sw->Axes[a].NumValues > 1);
+  }
+  for (unsigned long run = 0; run < sw->NumRuns && cell_h == 0; run++) {
+    ALLEGRO_BITMAP *img = ok[run] ? LoadRunFrame(sw, run) : NULL;
+    if (img) {
+      cell_h = (int)((double)sw->CellWidth * al_get_bitmap_height(img) /
+                     al_get_bitmap_width(img));
+      cell_h = cell_h ? cell_h : 1;
+      al_destroy_bitmap(img);
+    }
+  }
+  *num_sheets = 0;
+  if (cell_h == 0) {
+    fprintf(stderr, "ERROR: No run rendered a frame!\n");
+    return false;
+  }
+  ALLEGRO_FONT *font = al_create_builtin_font();
+  if (font == NULL) {
+    fprintf(stderr, "ERROR: Failed to create the label font!\n");
+    return false;
+  }
+
+  const int cell_w = sw->CellWidth;
+  const int slot_h = cell_h + label_lines * LABEL_LINE_PX + 2;
+  bool result = true;
+  for (unsigned long first = 0; first < sw->NumRuns && result;
+       first += per_sheet) {
+    const unsigned long count = (sw->NumRuns - first < per_sheet)
+                                    ? sw->NumRuns - first
+                                    : per_sheet;
+    const unsigned int rows = (count + sw->Columns - 1) / sw->Columns;
+    const unsigned int columns = (count < sw->Columns) ? count : sw->Columns;
+    ALLEGRO_BITMAP *sheet = al_create_bitmap(columns * cell_w, rows * slot_h);
+    if (sheet == NULL) {
+      fprintf(stderr, "ERROR: Failed to create a contact sheet!\n");
+      result = false;
+      break;
+    }
+    al_set_target_bitmap(sheet);
+    al_clear_to_color(al_map_rgb(0x18, 0x1a, 0x20));
+
+    ALLEGRO_LOCKED_REGION *region = al_lock_bitmap(
+        sheet, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READWRITE);
+    for (unsigned long i = 0; region && i < count; i++) {
+      ALLEGRO_BITMAP *img = ok[first + i] ? LoadRunFrame(sw, first + i) : NULL;
+      if (img) {
+        DrawCell(region, img, (i % sw->Columns) * cell_w,
+                 (i / sw->Columns) * slot_h, cell_w, cell_h);
+        al_destroy_bitmap(img);
+      }
+    }
+    if (region) {
+      al_unlock_bitmap(sheet);
+    }
+    for (unsigned long i = 0; i < count; i++) {
+      DrawLabel(sw, font, first + i, ok[first + i], (i % sw->Columns) * cell_w,
+                (i / sw->Columns) * slot_h + cell_h, cell_w, slot_h - cell_h);
+    }
+
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/sheet_%03u.png", sw->OutDir,
+             *num_sheets);
+    if (!al_save_bitmap(path, sheet)) {
+      fprintf(stderr, "ERROR: Failed to save contact sheet '%s'!\n", path);
+      result = false;
+    }
+    al_destroy_bitmap(sheet);
+    (*num_sheets)++;
+  }
+  al_destroy_font(font);
+  return result;
+}
+
+static bool WriteIndex(const Sweep_t *sw, const bool *ok) {
+  const unsigned long per_sheet = (unsigned long)sw->Columns * sw->Rows;
+  char path[MAX_PATH_LEN];
+
+  snprintf(path, sizeof(path), "%s/index.csv", sw->OutDir);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: Failed to create '%s'!\n", path);
+    return false;
+  }
+  fprintf(f, "run,sheet,column,row,status,frame");
+  if (sw->SeedAxis < 0) {
+    fprintf(f, ",seed");
+  }
+  for (unsigned int a = 0; a < sw->NumAxes; a++) {
+    fprintf(f, ",%s", sw->Axes[a].Name);
+  }
+  fprintf(f, "\n");
+
+  for (unsigned long run = 0; run < sw->NumRuns; run++) {
+    const unsigned long i = run % per_sheet;
+    fprintf(f, "%lu,%lu,%lu,%lu,%s,run_%05lu/frame_%05u.png", run,
+            run / per_sheet, i % sw->Columns, i / sw->Columns,
+            ok[run] ? "ok" : "failed", run, sw->NumFrames - 1);
+    if (sw->SeedAxis < 0) {
+      fprintf(f, ",%s", RunSeed(sw, run));
+    }
+    for (unsigned int a = 0; a < sw->NumAxes; a++) {
+      fprintf(f, ",%s", RunValue(sw, run, a));
+    }
+    fprintf(f, "\n");
+  }
+  const bool written = !ferror(f);
+  if (fclose(f) != 0 || !written) {
+    fprintf(stderr, "ERROR: Failed to write '%s'!\n", path);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  static Sweep_t sw;
+
+  if (!ParseArgs(&sw, argc, argv)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  if (!LoadSweep(&sw) || !MakeDir(sw.OutDir)) {
+    return 1;
+  }
+  if (!al_init()) {
+    fprintf(stderr, "ERROR: Failed to initialize allegro!\n");
+    return 1;
+  }
+  if (!al_init_image_addon() || !al_init_font_addon()) {
+    fprintf(stderr, "ERROR: Failed to load image and font addons!\n");
+    return 1;
+  }
+  al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+  bool *ok = calloc(sw.NumRuns, sizeof(*ok));
+  if (ok == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate %lu runs!\n", sw.NumRuns);
+    return 1;
+  }
+  printf("Sweeping %lu runs of %s, %u at a time\n", sw.NumRuns, sw.Sketch,
+         sw.NumJobs);
+  const double start = al_get_time();
+  const unsigned long failed = RunAll(&sw, ok);
+  const double elapsed = al_get_time() - start;
+  printf("Rendered %lu runs in %.1f s, %lu failed\n", sw.NumRuns - failed,
+         elapsed, failed);
+
+  unsigned int num_sheets = 0;
+  const bool sheets = WriteSheets(&sw, ok, &num_sheets);
+  const bool index = WriteIndex(&sw, ok);
+  if (index) {
+    printf("Wrote %u contact sheets and index.csv to %s\n", num_sheets,
+           sw.OutDir);
+  }
+  free(ok);
+  return (sheets && index && failed == 0) ? 0 : 1;
+}
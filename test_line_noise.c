@@ -3,8 +3,15 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "arena.h"
+#include "handdrawn.h"
+#include "host.h"
+#include "line_mesh.h"
 #include "noise1234.h"
 #include "procgenlib.h"
+#include "rng.h"
+#include "spatial_grid.h"
+#include "view.h"
 
 #define WIN_WIDTH_PX (800)
 #define WIN_HEIGHT_PX (800)
@@ -13,222 +20,332 @@
 
 #define FPS (60.0f)
 
-static void Initialize();
-static void Terminate();
-static void Draw();
-static void Update(double dt, ALLEGRO_EVENT *ev);
-static bool IsRunning();
-
-static ALLEGRO_DISPLAY *display = NULL;
-static ALLEGRO_EVENT_QUEUE *eq = NULL;
-static ALLEGRO_TIMER *timer = NULL;
-static bool redraw = true;
-static bool doexit = false;
+// Polylines generated from the visible lines, released at every rebuild
+#define FRAME_ARENA_BLOCK_SIZE (256 * 1024)
+
+#define MAX_POINTS (1024)  // points of a hand-drawn line at most, see params.h
+
+// Defaults of the parameters, see params.h. With no lines the world is the
+// three test lines in the window; --set lines=50000 scatters a large one,
+// WORLD_PX across unless world says otherwise.
+#define NUM_LINES (0)     // lines scattered over the world
+#define WORLD_PX (16000)  // width and height of a world with lines
+#define ZOOM (1.0)        // window px per world px at the start
+#define BOIL_SECONDS (0)  // between new wobbles of the test lines, 0 never
+
+// Scattered lines, in world px
+#define LINE_MIN_LEN_PX (20.0f)
+#define LINE_MAX_LEN_PX (200.0f)
+#define LINE_MIN_THICKNESS_PX (1.0f)
+#define LINE_MAX_THICKNESS_PX (3.0f)
+
+#define GRID_CELL_PX (256.0f)  // world px, a few lines across
+#define GRID_MAX_CELLS (1024)  // along a side, larger worlds get larger cells
+
+#define LOD_SEGMENT_PX (24.0f)   // window px per segment of a hand-drawn line
+#define LOD_MIN_LEN_PX (0.5f)    // shorter lines are not drawn at all
+#define WOBBLE_PX (4.0f)         // how far hand-drawn points stray, window px
+
+#define RNG_STREAM_WORLD (16)  // clear of handdrawn.c's streams
+
+#define NUM_TEST_LINES (3)
+
+typedef struct {
+  // Every line of the world: the three test lines, then the scattered ones
+  Line2D_t *Lines;
+  size_t NumLines;
+  unsigned int MaxPoints;
+  SpatialGrid_t *Grid;  // over the bounds of Lines
+
+  // The test lines boil: every BoilSeconds they are drawn with a new wobble
+  double BoilSeconds;
+  double BoilTime;  // since the last new wobble
+  uint32_t Boils;
+
+  // The visible lines, hand drawn at a level of detail that fits the view,
+  // tessellated once and drawn from here until the view changes.
+  Arena_t *FrameArena;
+  LineMesh_t *LineMesh;
+  bool Built;
+  View_t BuiltView;
+} State_t;
+
+static void TerminateCustom(Host_t *host, void *state) {
+  State_t *s = state;
+
+  LineMesh_Destroy(s->LineMesh);
+  Arena_Destroy(s->FrameArena);
+  SpatialGrid_Destroy(s->Grid);
+  free(s->Lines);
+  free(s);
+}
 
-Line2D_t horizLine;
-Line2D_t vertLine;
-Line2D_t diagLine;
+static void SetLine(Line2D_t *line, float x0, float y0, float x1, float y1,
+                    Color_t color, float thickness) {
+  line->Color = color;
+  line->Thickness = thickness;
+  line->StartPoint = (Point2D_t){.x = x0, .y = y0};
+  line->EndPoint = (Point2D_t){.x = x1, .y = y1};
+}
 
-PolyLine2D_t *horizPolyLine;
-PolyLine2D_t *vertPolyLine;
-PolyLine2D_t *diagPolyLine;
+/*
+ * The three test lines where they always were, in the corner of a world_px
+ * square, and num_lines more scattered over it.
+ */
+static void GenerateWorld(State_t *s, const Rng_t *rng, size_t num_lines,
+                          float world_px) {
+  static const uint32_t palette[] = {0xffff50, 0xff703b, 0x50c8ff, 0xe0e0e0,
+                                     0x9cff6e};
+  const Color_t yellow = Color_FromHex(0xffff50, 0);
+  Line2D_t *l = s->Lines;
+
+  SetLine(&l[0], 100, 50, WIN_WIDTH_PX - 100, 50, yellow, 3.0);
+  SetLine(&l[1], 100, 100, WIN_WIDTH_PX - 100, WIN_HEIGHT_PX - 100, yellow,
+          3.0);
+  SetLine(&l[2], WIN_WIDTH_PX - 50, 50, WIN_WIDTH_PX - 50, WIN_HEIGHT_PX - 50,
+          yellow, 3.0);
+
+  for (size_t i = 0; i < num_lines; i++) {
+    const size_t id = NUM_TEST_LINES + i;
+    const float x = world_px * Rng_Uniform(rng, RNG_STREAM_WORLD, id, 0);
+    const float y = world_px * Rng_Uniform(rng, RNG_STREAM_WORLD, id, 1);
+    const float angle = 2 * M_PI * Rng_Uniform(rng, RNG_STREAM_WORLD, id, 2);
+    const float len =
+        LINE_MIN_LEN_PX + (LINE_MAX_LEN_PX - LINE_MIN_LEN_PX) *
+                              Rng_Uniform(rng, RNG_STREAM_WORLD, id, 3);
+    const float thickness =
+        LINE_MIN_THICKNESS_PX +
+        (LINE_MAX_THICKNESS_PX - LINE_MIN_THICKNESS_PX) *
+            Rng_Uniform(rng, RNG_STREAM_WORLD, id, 4);
+    const uint32_t hex = palette[Rng_U32(rng, RNG_STREAM_WORLD, id, 5) %
+                                 (sizeof(palette) / sizeof(palette[0]))];
+
+    SetLine(&l[id], x, y, x + len * cosf(angle), y + len * sinf(angle),
+            Color_FromHex(hex, 0), thickness);
+  }
+  s->NumLines = NUM_TEST_LINES + num_lines;
+}
 
 /*
- * TODO: Add variability in length
- * TODO: Make number of segments dependent on line length
- * TODO: Make noise magnitude depend on segment length
- *
- * @note caller is responsible for disposing of the polyline structure with
- * PolyLine2D_Destroy().
+ * Indexes the lines by their bounds, grown by half their thickness. Returns
+ * false after printing an error on failure.
  */
-PolyLine2D_t *GetHandDawnLine(Line2D_t *line) {
-  PolyLine2D_t *pl = PolyLine2D_Create(32);
-  if (pl == NULL) {
-    return NULL;
+static bool BuildGrid(State_t *s, float world_px) {
+  const float cell = fmaxf(GRID_CELL_PX, world_px / GRID_MAX_CELLS);
+  const GridRect_t world = {0, 0, world_px, world_px};
+  GridRect_t *bounds = malloc(s->NumLines * sizeof(*bounds));
+  s->Grid = SpatialGrid_Create(world, cell);
+  if (bounds == NULL || s->Grid == NULL) {
+    free(bounds);
+    fprintf(stderr, "ERROR: Failed to create spatial grid!\n");
+    return false;
+  }
+  for (size_t i = 0; i < s->NumLines; i++) {
+    const Line2D_t *l = &s->Lines[i];
+    const float hw = 0.5f * l->Thickness;
+    bounds[i] = (GridRect_t){fminf(l->StartPoint.x, l->EndPoint.x) - hw,
+                             fminf(l->StartPoint.y, l->EndPoint.y) - hw,
+                             fmaxf(l->StartPoint.x, l->EndPoint.x) + hw,
+                             fmaxf(l->StartPoint.y, l->EndPoint.y) + hw};
   }
-  const float seg_len_x =
-      (line->EndPoint.x - line->StartPoint.x) / (pl->NumPoints - 1);
-  const float seg_len_y =
-      (line->EndPoint.y - line->StartPoint.y) / (pl->NumPoints - 1);
-  const Vector2D_t orthoVector = Vector2D_Orthogonal(Vector2D_FromLine(line));
-
-  pl->Color = line->Color;
-  pl->Thickness = line->Thickness;
-
-  // Start and end points of the polyline are the same as the input line
-  pl->Points[0] = line->StartPoint;
-  pl->Points[pl->NumPoints - 1] = line->EndPoint;
-
-  // Divide the line into line segments
-  for (int i = 1; i < pl->NumPoints - 1; i++) {
-    pl->Points[i].x = pl->Points[i - 1].x + seg_len_x;
-    pl->Points[i].y = pl->Points[i - 1].y + seg_len_y;
+  const bool ok = SpatialGrid_Build(s->Grid, bounds, s->NumLines);
+  free(bounds);
+  if (!ok) {
+    fprintf(stderr, "ERROR: Failed to index the lines!\n");
   }
+  return ok;
+}
 
-  // This is so we don't have to sprinkle constant checks later on. It just
-  // protects against a programmer that decides to use less than 3 points for
-  // some reason.
-  if (pl->NumPoints < 3) {
-    return pl;
+static void *InitCustom(Host_t *host) {
+  State_t *s = calloc(1, sizeof(*s));
+  if (s == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate the sketch!\n");
+    return NULL;
+  }
+  Params_t *params = &host->Options.Params;
+  s->MaxPoints =
+      Params_GetUInt(params, "points", HAND_DRAWN_POINTS, 2, MAX_POINTS);
+  const unsigned int num_lines =
+      Params_GetUInt(params, "lines", NUM_LINES, 0, 100000000);
+  const float world_px =
+      Params_Get(params, "world", num_lines ? WORLD_PX : WIN_WIDTH_PX,
+                 WIN_WIDTH_PX, 1e7);
+  const double zoom = Params_Get(params, "zoom", ZOOM, 1e-3, 1e3);
+  const double center_x =
+      Params_Get(params, "center_x", CENTER_X_PX, 0, world_px);
+  const double center_y =
+      Params_Get(params, "center_y", CENTER_Y_PX, 0, world_px);
+  s->BoilSeconds = Params_Get(params, "boil", BOIL_SECONDS, 0, 1e3);
+
+  s->Lines =
+      malloc((NUM_TEST_LINES + (size_t)num_lines) * sizeof(*s->Lines));
+  if (s->Lines == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate the lines!\n");
+    TerminateCustom(host, s);
+    return NULL;
+  }
+  GenerateWorld(s, &host->Rng, num_lines, world_px);
+  if (!BuildGrid(s, world_px)) {
+    TerminateCustom(host, s);
+    return NULL;
   }
 
-  // Jitter all line segment points except for the first and the last one.
-  // This can be combined with the previousloop, but for readability it is not.
-  Line2D_t lineSeg;
-  Vector2D_t segVec;         // line segment vector
-  Vector2D_t segStartVec;    // vector to the start of the line segment
-  float orthoVecNoiseScale;  // Multiplier for the orthogonal vector noise
-  Vector2D_t noisyOrthoVec;  // orthogonal vector multiplied by the noise factor
-  Vector2D_t
-      noisySegVec;  // line segment vector with the noise added at the end
-
-  for (int i = 1; i < pl->NumPoints - 1; i++) {
-    lineSeg.StartPoint = pl->Points[i - 1];
-    lineSeg.EndPoint = pl->Points[i];
-    segVec = Vector2D_FromLine(&lineSeg);
-    segStartVec = Vector2D_FromPoint(lineSeg.StartPoint);
-    orthoVecNoiseScale = 2.0 - 4.0 * ((float)rand() / (float)RAND_MAX);
-    noisyOrthoVec = Vector2D_Scale(orthoVector, orthoVecNoiseScale);
-    noisySegVec = Vector2D_Add(noisyOrthoVec, segVec);
-
-    pl->Points[i] = Point2D_FromVector(Vector2D_Add(segStartVec, noisySegVec));
+  s->FrameArena = Arena_Create(FRAME_ARENA_BLOCK_SIZE);
+  if (s->FrameArena == NULL) {
+    fprintf(stderr, "ERROR: Failed to create frame arena!\n");
+    TerminateCustom(host, s);
+    return NULL;
+  }
+  s->LineMesh = LineMesh_Create();
+  if (s->LineMesh == NULL) {
+    fprintf(stderr, "ERROR: Failed to create line mesh!\n");
+    TerminateCustom(host, s);
+    return NULL;
   }
-  return pl;
-}
 
-void InitCustom(void) {
-  horizLine.Color = Color_FromHex(0xffff50, 0);
-  horizLine.Thickness = 3.0;
-  horizLine.StartPoint = (Point2D_t){.x = 100, .y = 50};
-  horizLine.EndPoint = (Point2D_t){.x = WIN_WIDTH_PX - 100, .y = 50};
-
-  vertLine.Color = Color_FromHex(0xffff50, 0);
-  vertLine.Thickness = 3.0;
-  vertLine.StartPoint = (Point2D_t){.x = 100, .y = 100};
-  vertLine.EndPoint =
-      (Point2D_t){.x = WIN_WIDTH_PX - 100, .y = WIN_HEIGHT_PX - 100};
-
-  diagLine.Color = Color_FromHex(0xffff50, 0);
-  diagLine.Thickness = 3.0;
-  diagLine.StartPoint = (Point2D_t){.x = WIN_WIDTH_PX - 50, .y = 50};
-  diagLine.EndPoint =
-      (Point2D_t){.x = WIN_WIDTH_PX - 50, .y = WIN_HEIGHT_PX - 50};
-
-  horizPolyLine = GetHandDawnLine(&horizLine);
-  vertPolyLine = GetHandDawnLine(&vertLine);
-  diagPolyLine = GetHandDawnLine(&diagLine);
+  // Zoomed out no further than the whole world in half the window
+  host->View.MinZoom = 0.5 * WIN_WIDTH_PX / world_px;
+  View_Set(&host->View, center_x, center_y, zoom);
+  return s;
 }
 
-void UpdateCustom(double dt) {}
-
-void DrawCustom(void) {
-  Polyline2D_Draw(horizPolyLine);
-  Polyline2D_Draw(vertPolyLine);
-  Polyline2D_Draw(diagPolyLine);
+/*
+ * Points for a line len window px long: one per LOD_SEGMENT_PX, rounded up
+ * to one more than a power of two so that a line only changes shape when
+ * the zoom crosses an octave, and at most max_points.
+ */
+static unsigned int LodPoints(float len, unsigned int max_points) {
+  unsigned int segs = 1;
+  while (segs * LOD_SEGMENT_PX < len && segs < max_points - 1) {
+    segs *= 2;
+  }
+  return segs + 1 < max_points ? segs + 1 : max_points;
 }
 
-void TerminateCustom(void) {
-  PolyLine2D_Destroy(horizPolyLine);
-  PolyLine2D_Destroy(vertPolyLine);
-  PolyLine2D_Destroy(diagPolyLine);
+/*
+ * Random stream of line i. Lines keep theirs, so they wobble the same way
+ * every time they are drawn at the same level of detail; the test lines get
+ * a new one every time they boil.
+ */
+static unsigned int LineId(const State_t *s, uint32_t i) {
+  return i < NUM_TEST_LINES ? i + s->Boils * s->NumLines : i;
 }
 
-int main() {
-  double timeNow = 0.0, prevTime = 0.0, dt = 0.0;
-  ALLEGRO_EVENT ev;
-
-  Initialize();
-  InitCustom();
-
-  while (IsRunning()) {
-    al_wait_for_event(eq, &ev);
-    timeNow = al_get_time();
-    dt = timeNow - prevTime;
-
-    Update(dt, &ev);
-    Draw();
-
-    prevTime = timeNow;
+/*
+ * Hand draws the lines in view, in window px, and tessellates the ones that
+ * changed since the last build. Frame cost follows what is visible: the grid
+ * only hands out lines near the view, and lines far away are drawn with few
+ * points or not at all.
+ */
+static void BuildVisible(State_t *s, Host_t *host) {
+  const View_t *v = &host->View;
+  const uint32_t *visible;
+  const size_t count =
+      SpatialGrid_Query(s->Grid, View_Visible(v, WOBBLE_PX), &visible);
+
+  Arena_Reset(s->FrameArena);
+  LineMesh_Begin(s->LineMesh);
+  for (size_t i = 0; i < count; i++) {
+    Line2D_t line = s->Lines[visible[i]];
+    View_ToScreen(v, line.StartPoint.x, line.StartPoint.y, &line.StartPoint.x,
+                  &line.StartPoint.y);
+    View_ToScreen(v, line.EndPoint.x, line.EndPoint.y, &line.EndPoint.x,
+                  &line.EndPoint.y);
+    const float len = hypotf(line.EndPoint.x - line.StartPoint.x,
+                             line.EndPoint.y - line.StartPoint.y);
+    if (len < LOD_MIN_LEN_PX) {
+      continue;
+    }
+    // Thinner than a pixel is drawn as a hairline.
+    line.Thickness *= v->Zoom;
+    if (line.Thickness < 1) {
+      line.Thickness = 0;
+    }
+
+    PolyLine2D_t *pl =
+        GetHandDawnLine(&line, LodPoints(len, s->MaxPoints), &host->Rng,
+                        LineId(s, visible[i]), s->FrameArena);
+    if (pl == NULL || !LineMesh_AddPolyLine(s->LineMesh, pl)) {
+      fprintf(stderr, "ERROR: Out of memory, lines were dropped!\n");
+      break;
+    }
   }
-
-  Terminate();
-  TerminateCustom();
-  return 0;
+  LineMesh_End(s->LineMesh);
+  s->BuiltView = *v;
+  s->Built = true;
 }
 
-static void Initialize() {
-  time_t t;
-  srand(time(&t));
+static bool SameView(const View_t *a, const View_t *b) {
+  return a->CenterX == b->CenterX && a->CenterY == b->CenterY &&
+         a->Zoom == b->Zoom;
+}
 
-  if (!al_init()) {
-    fprintf(stderr, "ERROR: Failed to initialize allegro!\n");
-    goto init_fail;
-  }
+/*
+ * Marks where line i is on screen as damaged, wobble and thickness included.
+ * A new wobble stays within the same bounds, so this covers both the old and
+ * the new one.
+ */
+static void DamageLine(const State_t *s, Host_t *host, size_t i) {
+  const View_t *v = &host->View;
+  const Line2D_t *l = &s->Lines[i];
+  const float pad = WOBBLE_PX + 0.5f * l->Thickness * v->Zoom;
+  float x0, y0, x1, y1;
+
+  View_ToScreen(v, l->StartPoint.x, l->StartPoint.y, &x0, &y0);
+  View_ToScreen(v, l->EndPoint.x, l->EndPoint.y, &x1, &y1);
+  Damage_AddRect(&host->Damage, fminf(x0, x1) - pad, fminf(y0, y1) - pad,
+                 fmaxf(x0, x1) + pad, fmaxf(y0, y1) + pad);
+}
 
-  if (!al_init_primitives_addon()) {
-    fprintf(stderr, "ERROR: Failed to load primitives addon!\n");
-    goto prim_addon_fail;
-  }
+/*
+ * Only the test lines move, when they boil, so only they are marked with
+ * Damage_AddRect() and redrawn. Panning and zooming damage everything, see
+ * host.c.
+ */
+static void UpdateCustom(Host_t *host, void *state, double dt) {
+  State_t *s = state;
 
-  timer = al_create_timer(1.0 / FPS);
-  if (!timer) {
-    fprintf(stderr, "ERROR: Failed to create timer!\n");
-    goto timer_fail;
+  if (s->BoilSeconds <= 0) {
+    return;
   }
-
-  display = al_create_display(WIN_WIDTH_PX, WIN_HEIGHT_PX);
-  if (!display) {
-    fprintf(stderr, "ERROR: Failed to create display!\n");
-    goto disp_fail;
+  s->BoilTime += dt;
+  if (s->BoilTime < s->BoilSeconds) {
+    return;
   }
-
-  eq = al_create_event_queue();
-  if (!eq) {
-    fprintf(stderr, "ERROR: Failed to create event queue!\n");
-    goto eq_fail;
+  s->BoilTime = fmod(s->BoilTime, s->BoilSeconds);
+  s->Boils++;
+  s->Built = false;
+  for (size_t i = 0; i < NUM_TEST_LINES; i++) {
+    DamageLine(s, host, i);
   }
-
-  al_register_event_source(eq, al_get_display_event_source(display));
-  al_register_event_source(eq, al_get_timer_event_source(timer));
-
-  al_set_window_title(display, "Test");
-  al_start_timer(timer);
-
-  return;
-
-eq_fail:
-disp_fail:
-  al_destroy_timer(timer);
-timer_fail:
-prim_addon_fail:
-init_fail:
-  exit(1);
 }
 
-static void Terminate() {
-  al_destroy_event_queue(eq);
-  al_destroy_display(display);
-  al_destroy_timer(timer);
-}
-
-static void Draw() {
-  if (redraw && al_is_event_queue_empty(eq)) {
-    redraw = false;
-    al_clear_to_color(al_map_rgb(0x30, 0x34, 0x3f));
-    DrawCustom();
-    al_flip_display();
-  }
-}
+/*
+ * Draws the whole scene. The host clips it to the damaged parts of the
+ * canvas.
+ */
+static void DrawCustom(Host_t *host, void *state) {
+  State_t *s = state;
 
-static void Update(double dt, ALLEGRO_EVENT *ev) {
-  static double updateTimer = 0.0;
-  if (ev->type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
-    doexit = true;
-    return;
-  } else if (ev->type == ALLEGRO_EVENT_TIMER) {
-    redraw = true;
+  if (!s->Built || !SameView(&s->BuiltView, &host->View)) {
+    BuildVisible(s, host);
   }
-  UpdateCustom(dt);
+  al_clear_to_color(al_map_rgb(0x30, 0x34, 0x3f));
+  LineMesh_Draw(s->LineMesh);
 }
 
-static bool IsRunning() { return !doexit; }
\ No newline at end of file
+static const Sketch_t sketch = {
+    .ApiVersion = SKETCH_API_VERSION,
+    .Title = "Test",
+    .Width = WIN_WIDTH_PX,
+    .Height = WIN_HEIGHT_PX,
+    .Fps = FPS,
+    .Flags = SKETCH_DAMAGE,
+    .StateSize = sizeof(State_t),
+    .Init = InitCustom,
+    .Terminate = TerminateCustom,
+    .Update = UpdateCustom,
+    .Render = DrawCustom,
+};
+
+SKETCH_DEFINE(sketch)
@@ -0,0 +1,283 @@
+#include "thread_pool.h"
+#include <allegro5/allegro5.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#define CACHE_LINE_BYTES (64)
+#define CHUNK_ALIGN_ELEMS (16)  // 16 floats per cache line
+
+/*
+ * Range of chunk indices a worker still has to run. begin lives in the low
+ * 32 bits and end in the high 32 bits so the owner (taking from the front)
+ * and thieves (taking from the back) can both update it with a single CAS.
+ */
+typedef struct {
+  _Alignas(CACHE_LINE_BYTES) _Atomic uint64_t Range;
+} WorkQueue_t;
+
+typedef struct {
+  ThreadPool_t *Pool;
+  unsigned int Index;
+} WorkerArg_t;
+
+struct ThreadPool {
+  unsigned int NumThreads;
+  ALLEGRO_THREAD **Threads;  // NumThreads - 1 workers, the caller is worker 0
+  WorkerArg_t *Args;
+  WorkQueue_t *Queues;
+
+  ALLEGRO_MUTEX *Mutex;
+  ALLEGRO_COND *WorkCond;
+  ALLEGRO_COND *DoneCond;
+  uint64_t Generation;  // bumped for every job
+  unsigned int Busy;    // workers that have not finished the current job
+  bool Stop;
+
+  // Current job
+  ThreadPool_Fn_t Fn;
+  void *Ctx;
+  size_t Count;
+  size_t ChunkSize;
+};
+
+static inline uint64_t PackRange(uint32_t begin, uint32_t end) {
+  return ((uint64_t)end << 32) | begin;
+}
+
+static bool PopChunk(WorkQueue_t *q, uint32_t *chunk) {
+  uint64_t r = atomic_load_explicit(&q->Range, memory_order_acquire);
+  for (;;) {
+    const uint32_t begin = (uint32_t)r;
+    const uint32_t end = (uint32_t)(r >> 32);
+    if (begin >= end) {
+      return false;
+    }
+    if (atomic_compare_exchange_weak_explicit(
+            &q->Range, &r, PackRange(begin + 1, end), memory_order_acq_rel,
+            memory_order_acquire)) {
+      *chunk = begin;
+      return true;
+    }
+  }
+}
+
+/*
+ * Takes the back half of victim's remaining chunks.
+ */
+static bool StealChunks(WorkQueue_t *victim, uint32_t *first,
+                        uint32_t *last) {
+  uint64_t r = atomic_load_explicit(&victim->Range, memory_order_acquire);
+  for (;;) {
+    const uint32_t begin = (uint32_t)r;
+    const uint32_t end = (uint32_t)(r >> 32);
+    if (begin >= end) {
+      return false;
+    }
+    const uint32_t take = (end - begin + 1) / 2;
+    if (atomic_compare_exchange_weak_explicit(
+            &victim->Range, &r, PackRange(begin, end - take),
+            memory_order_acq_rel, memory_order_acquire)) {
+      *first = end - take;
+      *last = end;
+      return true;
+    }
+  }
+}
+
+static void RunChunk(ThreadPool_t *pool, uint32_t chunk, unsigned int self) {
+  const size_t begin = (size_t)chunk * pool->ChunkSize;
+  size_t end = begin + pool->ChunkSize;
+  if (end > pool->Count) {
+    end = pool->Count;
+  }
+  pool->Fn(pool->Ctx, begin, end, self);
+}
+
+static void RunJob(ThreadPool_t *pool, unsigned int self) {
+  WorkQueue_t *own = &pool->Queues[self];
+  uint32_t chunk;
+
+  TRACE_BEGIN(TRACE_PHASE_POOL);
+  for (;;) {
+    while (PopChunk(own, &chunk)) {
+      RunChunk(pool, chunk, self);
+    }
+
+    // Out of work: look for a victim, starting with our neighbour so
+    // thieves spread out instead of all hitting worker 0.
+    bool stole = false;
+    for (unsigned int i = 1; i < pool->NumThreads && !stole; i++) {
+      WorkQueue_t *victim = &pool->Queues[(self + i) % pool->NumThreads];
+      uint32_t first, last;
+      if (StealChunks(victim, &first, &last)) {
+        // Our queue is empty, so nobody else writes it; publish the rest of
+        // the loot so it can be stolen from us in turn.
+        atomic_store_explicit(&own->Range, PackRange(first + 1, last),
+                              memory_order_release);
+        RunChunk(pool, first, self);
+        stole = true;
+      }
+    }
+    if (!stole) {
+      TRACE_END(TRACE_PHASE_POOL);
+      return;
+    }
+  }
+}
+
+static void *WorkerMain(ALLEGRO_THREAD *thread, void *arg) {
+  WorkerArg_t *w = arg;
+  ThreadPool_t *pool = w->Pool;
+  uint64_t seen = 0;
+
+  (void)thread;
+  al_lock_mutex(pool->Mutex);
+  for (;;) {
+    while (!pool->Stop && pool->Generation == seen) {
+      al_wait_cond(pool->WorkCond, pool->Mutex);
+    }
+    if (pool->Stop) {
+      break;
+    }
+    seen = pool->Generation;
+    al_unlock_mutex(pool->Mutex);
+
+    RunJob(pool, w->Index);
+
+    al_lock_mutex(pool->Mutex);
+    if (--pool->Busy == 0) {
+      al_signal_cond(pool->DoneCond);
+    }
+  }
+  al_unlock_mutex(pool->Mutex);
+  return NULL;
+}
+
+ThreadPool_t *ThreadPool_Create(unsigned int num_threads) {
+  if (num_threads == 0) {
+    int cpus = al_get_cpu_count();
+    num_threads = (cpus > 0) ? (unsigned int)cpus : 1;
+  }
+
+  ThreadPool_t *pool = calloc(1, sizeof(*pool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->NumThreads = num_threads;
+  pool->Threads = calloc(num_threads, sizeof(*pool->Threads));
+  pool->Args = calloc(num_threads, sizeof(*pool->Args));
+  pool->Queues =
+      aligned_alloc(CACHE_LINE_BYTES, num_threads * sizeof(*pool->Queues));
+  pool->Mutex = al_create_mutex();
+  pool->WorkCond = al_create_cond();
+  pool->DoneCond = al_create_cond();
+  if (!pool->Threads || !pool->Args || !pool->Queues || !pool->Mutex ||
+      !pool->WorkCond || !pool->DoneCond) {
+    ThreadPool_Destroy(pool);
+    return NULL;
+  }
+
+  for (unsigned int i = 0; i < num_threads; i++) {
+    atomic_init(&pool->Queues[i].Range, 0);
+    pool->Args[i].Pool = pool;
+    pool->Args[i].Index = i;
+  }
+
+  for (unsigned int i = 1; i < num_threads; i++) {
+    pool->Threads[i] = al_create_thread(WorkerMain, &pool->Args[i]);
+    if (pool->Threads[i] == NULL) {
+      ThreadPool_Destroy(pool);
+      return NULL;
+    }
+    al_start_thread(pool->Threads[i]);
+  }
+  return pool;
+}
+
+void ThreadPool_Destroy(ThreadPool_t *pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  if (pool->Mutex && pool->WorkCond) {
+    al_lock_mutex(pool->Mutex);
+    pool->Stop = true;
+    al_broadcast_cond(pool->WorkCond);
+    al_unlock_mutex(pool->Mutex);
+  }
+  for (unsigned int i = 1; pool->Threads && i < pool->NumThreads; i++) {
+    if (pool->Threads[i]) {
+      al_join_thread(pool->Threads[i], NULL);
+      al_destroy_thread(pool->Threads[i]);
+    }
+  }
+
+  if (pool->DoneCond) {
+    al_destroy_cond(pool->DoneCond);
+  }
+  if (pool->WorkCond) {
+    al_destroy_cond(pool->WorkCond);
+  }
+  if (pool->Mutex) {
+    al_destroy_mutex(pool->Mutex);
+  }
+  free(pool->Queues);
+  free(pool->Args);
+  free(pool->Threads);
+  free(pool);
+}
+
+unsigned int ThreadPool_NumThreads(const ThreadPool_t *pool) {
+  return pool ? pool->NumThreads : 1;
+}
+
+void ThreadPool_ParallelFor(ThreadPool_t *pool, size_t count, size_t grain,
+                            ThreadPool_Fn_t fn, void *ctx) {
+  if (count == 0) {
+    return;
+  }
+
+  size_t chunk_size = (grain + CHUNK_ALIGN_ELEMS - 1) / CHUNK_ALIGN_ELEMS *
+                      CHUNK_ALIGN_ELEMS;
+  if (chunk_size == 0) {
+    chunk_size = CHUNK_ALIGN_ELEMS;
+  }
+  const size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+
+  if (pool == NULL || pool->NumThreads == 1 || num_chunks == 1 ||
+      num_chunks > UINT32_MAX) {
+    TRACE_BEGIN(TRACE_PHASE_POOL);
+    fn(ctx, 0, count, 0);
+    TRACE_END(TRACE_PHASE_POOL);
+    return;
+  }
+
+  al_lock_mutex(pool->Mutex);
+  pool->Fn = fn;
+  pool->Ctx = ctx;
+  pool->Count = count;
+  pool->ChunkSize = chunk_size;
+  for (unsigned int i = 0; i < pool->NumThreads; i++) {
+    const uint32_t first = (uint32_t)(num_chunks * i / pool->NumThreads);
+    const uint32_t last = (uint32_t)(num_chunks * (i + 1) / pool->NumThreads);
+    atomic_store_explicit(&pool->Queues[i].Range, PackRange(first, last),
+                          memory_order_relaxed);
+  }
+  pool->Busy = pool->NumThreads - 1;
+  pool->Generation++;
+  al_broadcast_cond(pool->WorkCond);
+  al_unlock_mutex(pool->Mutex);
+
+  RunJob(pool, 0);
+
+  // Wait for every worker to leave the job, not just for the chunks to be
+  // done, so no straggler can pick up chunks of the next job.
+  al_lock_mutex(pool->Mutex);
+  while (pool->Busy > 0) {
+    al_wait_cond(pool->DoneCond, pool->Mutex);
+  }
+  al_unlock_mutex(pool->Mutex);
+}
@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+/*
+ * Persistent worker pool for data-parallel loops. Workers are created once
+ * and sleep between jobs, so handing a loop to the pool costs a wakeup, not
+ * a thread creation.
+ *
+ * A job is split into chunks whose size is a multiple of 16 elements, so for
+ * float arrays every chunk starts on a 64-byte cache line and two workers
+ * never write to the same line. Each worker starts with an equal, contiguous
+ * share of the chunks. A worker that runs out steals half of the remaining
+ * chunks of another worker, which evens out loops where some elements cost
+ * much more than others.
+ */
+typedef struct ThreadPool ThreadPool_t;
+
+/*
+ * Body of a parallel loop. Processes elements [begin, end). worker is in
+ * [0, ThreadPool_NumThreads()) and is stable for the duration of a call, so it
+ * can index per-worker scratch data.
+ */
+typedef void (*ThreadPool_Fn_t)(void *ctx, size_t begin, size_t end,
+                                unsigned int worker);
+
+/*
+ * Creates a pool with num_threads workers in total, counting the calling
+ * thread. 0 uses one worker per CPU.
+ *
+ * @note caller is responsible for disposing of the pool with
+ * ThreadPool_Destroy().
+ */
+ThreadPool_t *ThreadPool_Create(unsigned int num_threads);
+void ThreadPool_Destroy(ThreadPool_t *pool);
+
+unsigned int ThreadPool_NumThreads(const ThreadPool_t *pool);
+
+/*
+ * Runs fn over [0, count) in chunks of about grain elements and returns once
+ * every element has been processed. The calling thread works too. A NULL
+ * pool runs the whole range on the calling thread.
+ */
+void ThreadPool_ParallelFor(ThreadPool_t *pool, size_t count, size_t grain,
+                            ThreadPool_Fn_t fn, void *ctx);
+
+#endif  // THREAD_POOL_H
@@ -0,0 +1,309 @@
+#include "trace.h"
+
+#ifdef ENABLE_TRACE
+
+#include <allegro5/allegro5.h>
+#include <allegro5/allegro_font.h>
+#include <allegro5/allegro_primitives.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OVERLAY_X_PX (8)
+#define OVERLAY_Y_PX (8)
+#define OVERLAY_BAR_WIDTH_PX (4)
+#define OVERLAY_HEIGHT_PX (60)
+
+typedef struct {
+  uint64_t Begin;
+  uint64_t End;
+  uint32_t Phase;
+  uint32_t Frame;
+} TraceEvent_t;
+
+/*
+ * Only the owning thread writes a ring. Head counts every event ever
+ * recorded, so a reader knows how many of them were overwritten.
+ */
+typedef struct {
+  _Atomic uint64_t Head;
+  TraceEvent_t Events[TRACE_RING_EVENTS];
+} TraceRing_t;
+
+static const char *phaseNames[TRACE_NUM_PHASES] = {
+    "wait", "input", "update", "render", "capture", "overlay", "flip", "pool",
+    "snapshot",
+};
+static const char *countNames[TRACE_NUM_COUNTS] = {
+    "coalesced",
+    "dropped",
+    "unchanged",
+};
+
+bool traceEnabled = false;
+_Atomic uint64_t traceCounts[TRACE_NUM_COUNTS];
+
+static TraceRing_t *rings[TRACE_MAX_THREADS];
+static _Atomic unsigned int numRings;
+static _Thread_local TraceRing_t *threadRing;
+static _Thread_local bool threadFull;  // no ring left for this thread
+static _Atomic uint32_t frame;
+
+// Converts ticks to seconds when exporting
+static uint64_t startTicks;
+static double startTime;
+
+// Frame times, main thread only
+static double lastFrameTime;
+static uint32_t histogram[TRACE_HISTOGRAM_BUCKETS];
+static uint32_t histogramFrames;
+static ALLEGRO_FONT *font;
+
+static TraceRing_t *RegisterThread(void) {
+  const unsigned int index =
+      atomic_fetch_add_explicit(&numRings, 1, memory_order_relaxed);
+  if (index >= TRACE_MAX_THREADS) {
+    threadFull = true;
+    return NULL;
+  }
+  TraceRing_t *ring = calloc(1, sizeof(*ring));
+  if (ring == NULL) {
+    threadFull = true;
+    return NULL;
+  }
+  rings[index] = ring;
+  return ring;
+}
+
+void Trace_Init(void) {
+  startTicks = Trace_Now();
+  startTime = al_get_time();
+  lastFrameTime = startTime;
+  traceEnabled = true;
+  threadRing = RegisterThread();  // the main thread is always thread 0
+}
+
+void Trace_Record(TracePhase_t phase, uint64_t begin) {
+  const uint64_t end = Trace_Now();
+  TraceRing_t *ring = threadRing;
+
+  if (ring == NULL) {
+    if (threadFull) {
+      return;
+    }
+    ring = threadRing = RegisterThread();
+    if (ring == NULL) {
+      return;
+    }
+  }
+  const uint64_t head =
+      atomic_load_explicit(&ring->Head, memory_order_relaxed);
+  ring->Events[head & (TRACE_RING_EVENTS - 1)] = (TraceEvent_t){
+      begin, end, phase,
+      atomic_load_explicit(&frame, memory_order_relaxed)};
+  atomic_store_explicit(&ring->Head, head + 1, memory_order_release);
+}
+
+void Trace_FrameEnd(void) {
+  if (!traceEnabled) {
+    return;
+  }
+  const double now = al_get_time();
+  unsigned int bucket = (unsigned int)((now - lastFrameTime) * 1000.0);
+  if (bucket >= TRACE_HISTOGRAM_BUCKETS) {
+    bucket = TRACE_HISTOGRAM_BUCKETS - 1;
+  }
+  histogram[bucket]++;
+  histogramFrames++;
+  lastFrameTime = now;
+  atomic_fetch_add_explicit(&frame, 1, memory_order_relaxed);
+}
+
+/*
+ * Upper end in ms of the bucket holding the given fraction of frames.
+ */
+static unsigned int Percentile(double fraction) {
+  const uint32_t target = (uint32_t)(fraction * histogramFrames);
+  uint32_t seen = 0;
+  for (unsigned int i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++) {
+    seen += histogram[i];
+    if (seen > target) {
+      return i + 1;
+    }
+  }
+  return TRACE_HISTOGRAM_BUCKETS;
+}
+
+/*
+ * Writes the two triangles of a rectangle to v and returns the end.
+ */
+static ALLEGRO_VERTEX *AddRect(ALLEGRO_VERTEX *v, float l, float t, float r,
+                               float b, ALLEGRO_COLOR c) {
+  v[0] = (ALLEGRO_VERTEX){.x = l, .y = t, .color = c};
+  v[1] = (ALLEGRO_VERTEX){.x = r, .y = t, .color = c};
+  v[2] = (ALLEGRO_VERTEX){.x = r, .y = b, .color = c};
+  v[3] = v[0];
+  v[4] = v[2];
+  v[5] = (ALLEGRO_VERTEX){.x = l, .y = b, .color = c};
+  return v + 6;
+}
+
+void Trace_DrawOverlay(void) {
+  ALLEGRO_VERTEX v[6 * (TRACE_HISTOGRAM_BUCKETS + 2)];
+  const ALLEGRO_COLOR back = al_map_rgba(0, 0, 0, 0xa0);
+  const ALLEGRO_COLOR bar = al_map_rgb(0x5e, 0xb0, 0xc5);
+  const ALLEGRO_COLOR mark = al_map_rgb(0xff, 0x3c, 0x38);
+  const ALLEGRO_COLOR text = al_map_rgb(0xff, 0xf2, 0x75);
+  const float x0 = OVERLAY_X_PX;
+  const float y1 = OVERLAY_Y_PX + OVERLAY_HEIGHT_PX;
+
+  if (!traceEnabled) {
+    return;
+  }
+  uint32_t max = 1;
+  for (unsigned int i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++) {
+    max = (histogram[i] > max) ? histogram[i] : max;
+  }
+
+  // Every rectangle goes into one triangle list: the background, a bar per
+  // millisecond, and a mark at 1/60 s.
+  ALLEGRO_VERTEX *out = AddRect(
+      v, x0 - 4, OVERLAY_Y_PX - 4,
+      x0 + TRACE_HISTOGRAM_BUCKETS * OVERLAY_BAR_WIDTH_PX + 4, y1 + 28, back);
+  for (unsigned int i = 0; i < TRACE_HISTOGRAM_BUCKETS; i++) {
+    const float l = x0 + i * OVERLAY_BAR_WIDTH_PX;
+    const float h = (float)OVERLAY_HEIGHT_PX * histogram[i] / max;
+    out = AddRect(out, l, y1 - h, l + OVERLAY_BAR_WIDTH_PX - 1, y1, bar);
+  }
+  const float x60 = x0 + 1000.0f / 60 * OVERLAY_BAR_WIDTH_PX;
+  out = AddRect(out, x60, OVERLAY_Y_PX, x60 + 1, y1, mark);
+  al_draw_prim(v, NULL, NULL, 0, out - v, ALLEGRO_PRIM_TRIANGLE_LIST);
+
+  if (font == NULL && al_init_font_addon()) {
+    font = al_create_builtin_font();
+  }
+  if (font) {
+    al_draw_textf(font, text, x0, y1 + 4, ALLEGRO_ALIGN_LEFT,
+                  "p50 <%u ms  p99 <%u ms", Percentile(0.5),
+                  Percentile(0.99));
+    al_draw_textf(
+        font, text, x0, y1 + 16, ALLEGRO_ALIGN_LEFT,
+        "coalesced %llu  dropped %llu",
+        (unsigned long long)atomic_load(&traceCounts[TRACE_COUNT_COALESCED]),
+        (unsigned long long)atomic_load(&traceCounts[TRACE_COUNT_DROPPED]));
+  }
+}
+
+static bool EndsWith(const char *s, const char *suffix) {
+  const size_t n = strlen(s);
+  const size_t m = strlen(suffix);
+  return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+bool Trace_Write(const char *path) {
+  const bool csv = EndsWith(path, ".csv");
+  // Ticks per microsecond, measured over the whole run
+  double rate = 1000.0;
+#if defined(__x86_64__) || defined(__i386__)
+  const double elapsed = al_get_time() - startTime;
+  if (elapsed > 0) {
+    rate = (Trace_Now() - startTicks) / (elapsed * 1e6);
+  }
+#endif
+
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: Failed to create '%s'!\n", path);
+    return false;
+  }
+
+  if (csv) {
+    fprintf(f, "thread,phase,frame,begin_us,duration_us\n");
+  } else {
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  }
+  bool first = true;
+  uint64_t lost = 0;
+  unsigned int count = atomic_load(&numRings);
+  count = (count > TRACE_MAX_THREADS) ? TRACE_MAX_THREADS : count;
+  for (unsigned int t = 0; t < count; t++) {
+    const TraceRing_t *ring = rings[t];
+    if (ring == NULL) {
+      continue;
+    }
+    const uint64_t head =
+        atomic_load_explicit(&ring->Head, memory_order_acquire);
+    const uint64_t kept =
+        (head > TRACE_RING_EVENTS) ? TRACE_RING_EVENTS : head;
+    lost += head - kept;
+
+    if (!csv) {
+      char name[32] = "main";
+      if (t > 0) {
+        snprintf(name, sizeof(name), "thread %u", t);
+      }
+      fprintf(f,
+              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+              first ? "" : ",\n", t, name);
+      first = false;
+    }
+    for (uint64_t i = head - kept; i < head; i++) {
+      const TraceEvent_t *e = &ring->Events[i & (TRACE_RING_EVENTS - 1)];
+      const double ts = (double)(int64_t)(e->Begin - startTicks) / rate;
+      const double dur = (double)(e->End - e->Begin) / rate;
+      if (csv) {
+        fprintf(f, "%u,%s,%u,%.3f,%.3f\n", t, phaseNames[e->Phase], e->Frame,
+                ts, dur);
+      } else {
+        fprintf(f,
+                ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+                phaseNames[e->Phase], t, ts, dur, e->Frame);
+      }
+    }
+  }
+  if (!csv) {
+    fprintf(f, "\n],\"otherData\":{");
+    for (int c = 0; c < TRACE_NUM_COUNTS; c++) {
+      fprintf(f, "%s\"%s\":%llu", c ? "," : "", countNames[c],
+              (unsigned long long)atomic_load(&traceCounts[c]));
+    }
+    fprintf(f, "}}\n");
+  }
+  const bool ok = !ferror(f);
+  if (fclose(f) != 0 || !ok) {
+    fprintf(stderr, "ERROR: Failed to write '%s'!\n", path);
+    return false;
+  }
+
+  printf("Frames: %u shown", atomic_load(&frame));
+  for (int c = 0; c < TRACE_NUM_COUNTS; c++) {
+    printf(", %llu %s", (unsigned long long)atomic_load(&traceCounts[c]),
+           countNames[c]);
+  }
+  printf("\n");
+  if (lost) {
+    printf("Trace kept the newest %d events of each thread, %llu older ones "
+           "were overwritten\n",
+           TRACE_RING_EVENTS, (unsigned long long)lost);
+  }
+  return true;
+}
+
+void Trace_Shutdown(void) {
+  unsigned int count = atomic_load(&numRings);
+  count = (count > TRACE_MAX_THREADS) ? TRACE_MAX_THREADS : count;
+
+  traceEnabled = false;
+  for (unsigned int t = 0; t < count; t++) {
+    free(rings[t]);
+    rings[t] = NULL;
+  }
+  if (font) {
+    al_destroy_font(font);
+    font = NULL;
+  }
+}
+
+#endif  // ENABLE_TRACE
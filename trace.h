@@ -0,0 +1,142 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Timing of where a frame's time goes. Code marks the phases of a frame
+ * with
+ *
+ *   TRACE_BEGIN(TRACE_PHASE_UPDATE);
+ *   ...
+ *   TRACE_END(TRACE_PHASE_UPDATE);
+ *
+ * in the same scope, notable events with TRACE_COUNT(), and every frame
+ * shown with TRACE_FRAME_END(). Each thread
+ * records its phases into a ring of its own, so recording takes no locks
+ * and no atomic read-modify-write: a timestamp on each side and one store
+ * of the finished event. Only the newest TRACE_RING_EVENTS events of each
+ * thread are kept. Timestamps come from the TSC on x86-64, which is
+ * converted to time when exporting, and from CLOCK_MONOTONIC elsewhere.
+ *
+ * Tracing is only built in with -DENABLE_TRACE (make TRACE=1). Without it
+ * the macros expand to nothing and none of the Trace_*() functions exist.
+ * When built in, nothing is recorded until Trace_Init() enables it, and
+ * the macros cost a predictable branch.
+ */
+#ifdef ENABLE_TRACE
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define TRACE_RING_EVENTS (1 << 15)  // per thread, a power of two
+#define TRACE_MAX_THREADS (64)
+#define TRACE_HISTOGRAM_BUCKETS (50)  // 1 ms each, the last also holds more
+
+typedef enum {
+  TRACE_PHASE_WAIT,      // blocked waiting for the next event
+  TRACE_PHASE_INPUT,     // handling an event
+  TRACE_PHASE_UPDATE,    // the simulation steps of a frame
+  TRACE_PHASE_RENDER,    // the sketch drawing a frame
+  TRACE_PHASE_CAPTURE,   // handing a frame to the video capture
+  TRACE_PHASE_OVERLAY,   // drawing the trace overlay
+  TRACE_PHASE_FLIP,      // al_flip_display()
+  TRACE_PHASE_POOL,      // one thread's share of a parallel loop
+  TRACE_PHASE_SNAPSHOT,  // copying the state to draw, with --pipeline
+  TRACE_NUM_PHASES
+} TracePhase_t;
+
+typedef enum {
+  // Timer ticks that found the previous frame still waiting to be drawn,
+  // so two frames were drawn as one
+  TRACE_COUNT_COALESCED,
+  // Frames that dropped simulation time to catch up, see Scheduler_t
+  TRACE_COUNT_DROPPED,
+  // Frames that were not redrawn because nothing changed, see damage.h
+  TRACE_COUNT_UNCHANGED,
+  TRACE_NUM_COUNTS
+} TraceCount_t;
+
+extern bool traceEnabled;
+extern _Atomic uint64_t traceCounts[TRACE_NUM_COUNTS];
+
+static inline uint64_t Trace_Now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+#define TRACE_BEGIN(phase)                                            \
+  const uint64_t trace_begin_##phase = traceEnabled ? Trace_Now() : 0
+#define TRACE_END(phase)                          \
+  do {                                            \
+    if (traceEnabled) {                           \
+      Trace_Record((phase), trace_begin_##phase); \
+    }                                             \
+  } while (0)
+#define TRACE_COUNT(count)                                \
+  do {                                                    \
+    if (traceEnabled) {                                   \
+      atomic_fetch_add_explicit(&traceCounts[(count)], 1, \
+                                memory_order_relaxed);    \
+    }                                                     \
+  } while (0)
+
+#define TRACE_FRAME_END() Trace_FrameEnd()
+
+/*
+ * Starts recording. The calling thread is named "main" in the exported
+ * trace, the ones that record after it "thread 1", "thread 2", ...
+ */
+void Trace_Init(void);
+
+/*
+ * Records phase as running from begin until now on the calling thread.
+ * Prefer TRACE_BEGIN() and TRACE_END().
+ */
+void Trace_Record(TracePhase_t phase, uint64_t begin);
+
+/*
+ * Marks a frame as shown. The time since the previous one goes into the
+ * frame time histogram. Main thread only.
+ */
+void Trace_FrameEnd(void);
+
+/*
+ * Draws the frame time histogram and the counts into the top left corner of
+ * the current target bitmap. Main thread only.
+ */
+void Trace_DrawOverlay(void);
+
+/*
+ * Writes every recorded event to path, as CSV if it ends in .csv and as
+ * Chrome trace JSON (chrome://tracing, ui.perfetto.dev) otherwise, and
+ * prints the counts. Call once every other thread has stopped recording.
+ * Returns false if the file could not be written.
+ */
+bool Trace_Write(const char *path);
+
+/*
+ * Stops recording and frees the rings and the overlay's font. Call once
+ * every other thread has stopped recording.
+ */
+void Trace_Shutdown(void);
+
+#else
+
+#define TRACE_BEGIN(phase)
+#define TRACE_END(phase)
+#define TRACE_COUNT(count)
+#define TRACE_FRAME_END()
+
+#endif  // ENABLE_TRACE
+
+#endif  // TRACE_H
@@ -0,0 +1,205 @@
+#include "trails.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raster.h"
+
+#define PUSH_GRAIN (4096)  // trails per thread pool chunk when recording
+#define DRAW_GRAIN (256)   // trails per thread pool chunk when drawing
+
+Trails_t *Trails_Create(size_t num_trails, unsigned int length) {
+  Trails_t *t = calloc(1, sizeof(*t));
+  if (t == NULL) {
+    return NULL;
+  }
+  t->NumTrails = num_trails;
+  t->Length = length;
+
+  // A trail is drawn as the particle plus every sample, Length segments.
+  const size_t verts_per_trail = (size_t)length + 1;
+  const size_t num_samples = num_trails * length;
+  if (length == 0 || num_trails == 0 ||
+      num_trails > (size_t)INT_MAX / (2 * verts_per_trail)) {
+    free(t);
+    return NULL;
+  }
+  const int num_verts = num_trails * verts_per_trail;
+  t->NumIndices = num_trails * 2 * length;
+
+  t->X = malloc(2 * num_samples * sizeof(float));
+  t->Fade = malloc(verts_per_trail * sizeof(float));
+  t->CpuVertices = calloc(num_verts, sizeof(ALLEGRO_VERTEX));
+  t->CpuIndices = malloc(t->NumIndices * sizeof(int));
+  if (!t->X || !t->Fade || !t->CpuVertices || !t->CpuIndices) {
+    Trails_Destroy(t);
+    return NULL;
+  }
+  t->Y = t->X + num_samples;
+
+  for (size_t k = 0; k < verts_per_trail; k++) {
+    t->Fade[k] = 1.0f - (float)k / length;
+  }
+  for (size_t i = 0; i < num_trails; i++) {
+    int *idx = &t->CpuIndices[i * 2 * length];
+    const int v = i * verts_per_trail;
+    for (unsigned int k = 0; k < length; k++) {
+      idx[2 * k] = v + k;
+      idx[2 * k + 1] = v + k + 1;
+    }
+  }
+
+  ALLEGRO_BITMAP *target = al_get_target_bitmap();
+  if (target && !(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP)) {
+    t->Indices = al_create_index_buffer(sizeof(int), t->CpuIndices,
+                                        t->NumIndices,
+                                        ALLEGRO_PRIM_BUFFER_STATIC);
+    if (t->Indices) {
+      t->Vertices = al_create_vertex_buffer(NULL, NULL, num_verts,
+                                            ALLEGRO_PRIM_BUFFER_STREAM);
+    }
+  }
+  return t;
+}
+
+void Trails_Destroy(Trails_t *t) {
+  if (t == NULL) {
+    return;
+  }
+  if (t->Vertices) {
+    al_destroy_vertex_buffer(t->Vertices);
+  }
+  if (t->Indices) {
+    al_destroy_index_buffer(t->Indices);
+  }
+  free(t->X);
+  free(t->Fade);
+  free(t->CpuVertices);
+  free(t->CpuIndices);
+  free(t);
+}
+
+void Trails_Reset(Trails_t *t, size_t i, float x, float y) {
+  float *tx = &t->X[i * t->Length];
+  float *ty = &t->Y[i * t->Length];
+  for (unsigned int k = 0; k < t->Length; k++) {
+    tx[k] = x;
+    ty[k] = y;
+  }
+}
+
+typedef struct {
+  Trails_t *Trails;
+  const float *X;
+  const float *Y;
+} PushCtx_t;
+
+static void PushRange(void *ctx, size_t begin, size_t end,
+                      unsigned int worker) {
+  const PushCtx_t *c = ctx;
+  const Trails_t *t = c->Trails;
+  float *tx = &t->X[begin * t->Length + t->Head];
+  float *ty = &t->Y[begin * t->Length + t->Head];
+
+  (void)worker;
+  for (size_t i = begin; i < end; i++) {
+    *tx = c->X[i];
+    *ty = c->Y[i];
+    tx += t->Length;
+    ty += t->Length;
+  }
+}
+
+void Trails_Push(Trails_t *t, ThreadPool_t *pool, const float *x,
+                 const float *y) {
+  PushCtx_t ctx = {t, x, y};
+
+  t->Head = (t->Head + 1 == t->Length) ? 0 : t->Head + 1;
+  ThreadPool_ParallelFor(pool, t->NumTrails, PUSH_GRAIN, PushRange, &ctx);
+}
+
+typedef struct {
+  Trails_t *Dst;
+  const Trails_t *Src;
+} CopyCtx_t;
+
+static void CopyRange(void *ctx, size_t begin, size_t end,
+                      unsigned int worker) {
+  const CopyCtx_t *c = ctx;
+  const size_t first = begin * c->Src->Length;
+  const size_t bytes = (end - begin) * c->Src->Length * sizeof(float);
+
+  (void)worker;
+  memcpy(&c->Dst->X[first], &c->Src->X[first], bytes);
+  memcpy(&c->Dst->Y[first], &c->Src->Y[first], bytes);
+}
+
+void Trails_CopySamples(Trails_t *dst, const Trails_t *src,
+                        ThreadPool_t *pool) {
+  CopyCtx_t ctx = {dst, src};
+
+  dst->Head = src->Head;
+  ThreadPool_ParallelFor(pool, src->NumTrails, PUSH_GRAIN, CopyRange, &ctx);
+}
+
+typedef struct {
+  const Trails_t *Trails;
+  ALLEGRO_VERTEX *Out;
+  const float *HeadX;
+  const float *HeadY;
+  const uint8_t *Colors;
+  const ALLEGRO_COLOR *Palette;
+} DrawCtx_t;
+
+static void EmitRange(void *ctx, size_t begin, size_t end,
+                      unsigned int worker) {
+  const DrawCtx_t *c = ctx;
+  const Trails_t *t = c->Trails;
+  const unsigned int len = t->Length;
+
+  (void)worker;
+  for (size_t i = begin; i < end; i++) {
+    const float *tx = &t->X[i * len];
+    const float *ty = &t->Y[i * len];
+    const ALLEGRO_COLOR col = c->Palette[c->Colors[i]];
+    ALLEGRO_VERTEX *v = &c->Out[i * (len + 1)];
+
+    // Colors are premultiplied, so fading scales all four channels.
+    v[0] = (ALLEGRO_VERTEX){.x = c->HeadX[i], .y = c->HeadY[i], .color = col};
+    unsigned int slot = t->Head;
+    for (unsigned int k = 1; k <= len; k++) {
+      const float f = t->Fade[k];
+      v[k] = (ALLEGRO_VERTEX){
+          .x = tx[slot],
+          .y = ty[slot],
+          .color = {col.r * f, col.g * f, col.b * f, col.a * f}};
+      slot = (slot == 0) ? len - 1 : slot - 1;
+    }
+  }
+}
+
+void Trails_Draw(Trails_t *t, ThreadPool_t *pool, const float *head_x,
+                 const float *head_y, const uint8_t *colors,
+                 const ALLEGRO_COLOR *palette) {
+  const int num_verts = t->NumTrails * (t->Length + 1);
+  ALLEGRO_VERTEX *mapped = NULL;
+  Raster_t *raster = Raster_GetCurrent();
+
+  if (t->Vertices && raster == NULL) {
+    mapped = al_lock_vertex_buffer(t->Vertices, 0, num_verts,
+                                   ALLEGRO_LOCK_WRITEONLY);
+  }
+  DrawCtx_t ctx = {t, mapped ? mapped : t->CpuVertices, head_x, head_y,
+                   colors, palette};
+  ThreadPool_ParallelFor(pool, t->NumTrails, DRAW_GRAIN, EmitRange, &ctx);
+
+  if (raster) {
+    Raster_AddLineList(raster, t->CpuVertices, t->CpuIndices, t->NumIndices);
+  } else if (mapped) {
+    al_unlock_vertex_buffer(t->Vertices);
+    al_draw_indexed_buffer(t->Vertices, NULL, t->Indices, 0, t->NumIndices,
+                           ALLEGRO_PRIM_LINE_LIST);
+  } else {
+    al_draw_indexed_prim(t->CpuVertices, NULL, NULL, t->CpuIndices,
+                         t->NumIndices, ALLEGRO_PRIM_LINE_LIST);
+  }
+}
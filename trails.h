@@ -0,0 +1,83 @@
+#ifndef TRAILS_H
+#define TRAILS_H
+
+#include <allegro5/allegro5.h>
+#include <allegro5/allegro_primitives.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_pool.h"
+
+/*
+ * Position history for many particles, drawn as fading trails.
+ *
+ * Every trail keeps its last Length positions in a ring. All rings live in
+ * one allocation, trail i at [i * Length, (i + 1) * Length), and they all
+ * share one head, so recording a step moves every ring forward with a single
+ * increment and one store per trail.
+ *
+ * Drawing emits every trail, from the particle's current position back to
+ * its oldest sample, into one vertex array and submits the lot as a single
+ * indexed line list. Alpha fades from opaque at the particle to transparent
+ * at the tail. The index pattern never changes, since a trail's vertices are
+ * always written newest first, so it is built once. Like PrimBatch_t, it
+ * falls back to CPU-side arrays when no vertex buffer can be created, and
+ * records them into the current rasterizer when there is one.
+ *
+ * Nothing is allocated after Trails_Create().
+ */
+typedef struct {
+  size_t NumTrails;
+  unsigned int Length;  // samples per trail
+  unsigned int Head;    // slot of the newest sample in every ring
+  float *X;             // NumTrails * Length samples each
+  float *Y;
+  float *Fade;  // alpha of each vertex along a trail, Length + 1 entries
+
+  ALLEGRO_VERTEX_BUFFER *Vertices;  // NULL when using the CPU path
+  ALLEGRO_INDEX_BUFFER *Indices;
+  ALLEGRO_VERTEX *CpuVertices;      // always kept, for a failed lock
+  int *CpuIndices;
+  int NumIndices;
+} Trails_t;
+
+/*
+ * Creates num_trails trails of length samples for the current target
+ * bitmap. Must be called after the display (or headless canvas) exists.
+ * Returns NULL on failure, including when the trails would need more than
+ * INT_MAX vertices.
+ *
+ * @note caller is responsible for disposing of the trails with
+ * Trails_Destroy().
+ */
+Trails_t *Trails_Create(size_t num_trails, unsigned int length);
+void Trails_Destroy(Trails_t *t);
+
+/*
+ * Collapses trail i onto (x, y), for particles that jump, e.g. on respawn.
+ * Trails of different particles may be reset from different threads at once.
+ */
+void Trails_Reset(Trails_t *t, size_t i, float x, float y);
+
+/*
+ * Records (x[i], y[i]) as the newest sample of trail i, dropping the oldest.
+ */
+void Trails_Push(Trails_t *t, ThreadPool_t *pool, const float *x,
+                 const float *y);
+
+/*
+ * Copies every sample of src to dst, which has as many trails of the same
+ * length, e.g. to draw them while src is recorded into.
+ */
+void Trails_CopySamples(Trails_t *dst, const Trails_t *src,
+                        ThreadPool_t *pool);
+
+/*
+ * Draws every trail starting at (head_x[i], head_y[i]), normally the
+ * particle's interpolated position, in palette[colors[i]].
+ */
+void Trails_Draw(Trails_t *t, ThreadPool_t *pool, const float *head_x,
+                 const float *head_y, const uint8_t *colors,
+                 const ALLEGRO_COLOR *palette);
+
+#endif  // TRAILS_H
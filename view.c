@@ -0,0 +1,130 @@
+#include "view.h"
+#include <math.h>
+
+#define VIEW_MIN_ZOOM (1.0 / 256)
+#define VIEW_MAX_ZOOM (256.0)
+#define VIEW_WHEEL_STEP (1.25)  // zoom factor per notch of the mouse wheel
+#define VIEW_KEY_STEP (1.5)     // zoom factor per + or -
+#define VIEW_PAN_PX (64)        // window px per arrow key press
+
+void View_Init(View_t *v, int width, int height) {
+  v->Width = width;
+  v->Height = height;
+  v->MinZoom = VIEW_MIN_ZOOM;
+  v->MaxZoom = VIEW_MAX_ZOOM;
+  v->Dragging = false;
+  View_Set(v, width / 2.0, height / 2.0, 1.0);
+}
+
+static double ClampZoom(const View_t *v, double zoom) {
+  return fmin(fmax(zoom, v->MinZoom), v->MaxZoom);
+}
+
+void View_Set(View_t *v, double x, double y, double zoom) {
+  v->CenterX = v->HomeX = x;
+  v->CenterY = v->HomeY = y;
+  v->Zoom = v->HomeZoom = ClampZoom(v, zoom);
+}
+
+void View_Reset(View_t *v) {
+  v->CenterX = v->HomeX;
+  v->CenterY = v->HomeY;
+  v->Zoom = v->HomeZoom;
+}
+
+void View_ZoomAt(View_t *v, double factor, float sx, float sy) {
+  const double zoom = ClampZoom(v, v->Zoom * factor);
+  const double ox = sx - v->Width / 2.0;
+  const double oy = sy - v->Height / 2.0;
+
+  // The point under (sx, sy) is center + offset / zoom before and after.
+  v->CenterX += ox / v->Zoom - ox / zoom;
+  v->CenterY += oy / v->Zoom - oy / zoom;
+  v->Zoom = zoom;
+}
+
+void View_Pan(View_t *v, float dx, float dy) {
+  v->CenterX -= dx / v->Zoom;
+  v->CenterY -= dy / v->Zoom;
+}
+
+void View_ToScreen(const View_t *v, float x, float y, float *sx, float *sy) {
+  *sx = (x - v->CenterX) * v->Zoom + v->Width / 2.0;
+  *sy = (y - v->CenterY) * v->Zoom + v->Height / 2.0;
+}
+
+void View_ToWorld(const View_t *v, float sx, float sy, float *x, float *y) {
+  *x = (sx - v->Width / 2.0) / v->Zoom + v->CenterX;
+  *y = (sy - v->Height / 2.0) / v->Zoom + v->CenterY;
+}
+
+GridRect_t View_Visible(const View_t *v, float margin) {
+  const double hw = (v->Width / 2.0 + margin) / v->Zoom;
+  const double hh = (v->Height / 2.0 + margin) / v->Zoom;
+
+  return (GridRect_t){v->CenterX - hw, v->CenterY - hh, v->CenterX + hw,
+                      v->CenterY + hh};
+}
+
+bool View_HandleEvent(View_t *v, const ALLEGRO_EVENT *ev) {
+  switch (ev->type) {
+    case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+      if (ev->mouse.button == 1) {
+        v->Dragging = true;
+      }
+      return false;
+    case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+      if (ev->mouse.button == 1) {
+        v->Dragging = false;
+      }
+      return false;
+    case ALLEGRO_EVENT_MOUSE_LEAVE_DISPLAY:
+      v->Dragging = false;
+      return false;
+    case ALLEGRO_EVENT_MOUSE_AXES: {
+      bool changed = false;
+      if (ev->mouse.dz != 0) {
+        View_ZoomAt(v, pow(VIEW_WHEEL_STEP, ev->mouse.dz), ev->mouse.x,
+                    ev->mouse.y);
+        changed = true;
+      }
+      if (v->Dragging && (ev->mouse.dx != 0 || ev->mouse.dy != 0)) {
+        View_Pan(v, ev->mouse.dx, ev->mouse.dy);
+        changed = true;
+      }
+      return changed;
+    }
+    case ALLEGRO_EVENT_KEY_CHAR:
+      switch (ev->keyboard.keycode) {
+        case ALLEGRO_KEY_LEFT:
+          View_Pan(v, VIEW_PAN_PX, 0);
+          return true;
+        case ALLEGRO_KEY_RIGHT:
+          View_Pan(v, -VIEW_PAN_PX, 0);
+          return true;
+        case ALLEGRO_KEY_UP:
+          View_Pan(v, 0, VIEW_PAN_PX);
+          return true;
+        case ALLEGRO_KEY_DOWN:
+          View_Pan(v, 0, -VIEW_PAN_PX);
+          return true;
+        case ALLEGRO_KEY_EQUALS:
+        case ALLEGRO_KEY_PAD_PLUS:
+          View_ZoomAt(v, VIEW_KEY_STEP, v->Width / 2.0f, v->Height / 2.0f);
+          return true;
+        case ALLEGRO_KEY_MINUS:
+        case ALLEGRO_KEY_PAD_MINUS:
+          View_ZoomAt(v, 1 / VIEW_KEY_STEP, v->Width / 2.0f,
+                      v->Height / 2.0f);
+          return true;
+        case ALLEGRO_KEY_0:
+        case ALLEGRO_KEY_PAD_0:
+          View_Reset(v);
+          return true;
+        default:
+          return false;
+      }
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <allegro5/allegro5.h>
+#include <stdbool.h>
+#include "spatial_grid.h"
+
+/*
+ * Pan and zoom of a window onto a world that may be much larger than it.
+ * The view shows the world around a center point at a zoom of window pixels
+ * per world unit, so at a zoom of 1 centered on the middle of the window,
+ * world and window coordinates are the same.
+ *
+ * In a window, dragging with the left mouse button pans, the wheel zooms
+ * around the mouse, the arrow keys pan, + and - zoom, and 0 goes back to
+ * where the view started.
+ *
+ * Sketches that draw their world through a view map it to the window
+ * themselves with View_ToScreen(), rather than with an Allegro transform, so
+ * they can pick detail by on-screen size and draw through the rasterizer,
+ * which ignores transforms.
+ */
+typedef struct {
+  int Width;  // of the window, px
+  int Height;
+  double CenterX;  // world point in the middle of the window
+  double CenterY;
+  double Zoom;  // window px per world unit
+  double MinZoom;
+  double MaxZoom;
+  double HomeX;  // where the view started, see View_Reset()
+  double HomeY;
+  double HomeZoom;
+  bool Dragging;
+} View_t;
+
+/*
+ * Shows a width x height window of the world at a zoom of 1, with world and
+ * window coordinates the same.
+ */
+void View_Init(View_t *v, int width, int height);
+
+/*
+ * Centers the view on (x, y) at the given zoom, clamped to MinZoom and
+ * MaxZoom, and makes that where View_Reset() goes back to.
+ */
+void View_Set(View_t *v, double x, double y, double zoom);
+void View_Reset(View_t *v);
+
+/*
+ * Zooms by factor, keeping the world point under window pixel (sx, sy)
+ * where it is.
+ */
+void View_ZoomAt(View_t *v, double factor, float sx, float sy);
+void View_Pan(View_t *v, float dx, float dy);  // by window px
+
+void View_ToScreen(const View_t *v, float x, float y, float *sx, float *sy);
+void View_ToWorld(const View_t *v, float sx, float sy, float *x, float *y);
+
+/*
+ * Part of the world in the window, grown by margin window px on every side
+ * for whatever reaches into it from outside, such as thick lines.
+ */
+GridRect_t View_Visible(const View_t *v, float margin);
+
+/*
+ * Pans and zooms on mouse and keyboard events. Returns whether the view
+ * changed.
+ */
+bool View_HandleEvent(View_t *v, const ALLEGRO_EVENT *ev);
+
+#endif  // VIEW_H